@@ -0,0 +1,220 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "error_debug.h"
+#include "atomic.h"
+#include "ack.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_CORE
+
+
+
+static void _source_free(nx_ack_source_t *source)
+{
+    ASSERT(source != NULL);
+
+    free(source->slots);
+    free(source);
+}
+
+
+
+nx_ack_source_t *nx_ack_source_new(apr_uint32_t size, int64_t offset, int64_t extra)
+{
+    nx_ack_source_t *source;
+    apr_uint32_t slots = 2;
+
+    // sequence numbers wrap around, the slot count must divide 2^32
+    while ( slots < size )
+    {
+	slots <<= 1;
+    }
+
+    source = malloc(sizeof(nx_ack_source_t));
+    ASSERT(source != NULL);
+    memset(source, 0, sizeof(nx_ack_source_t));
+    source->slots = malloc(sizeof(nx_ack_slot_t) * slots);
+    ASSERT(source->slots != NULL);
+    memset(source->slots, 0, sizeof(nx_ack_slot_t) * slots);
+
+    source->size = slots;
+    source->committed = offset;
+    source->committed_extra = extra;
+    source->refcnt = 1; // the owner
+
+    return ( source );
+}
+
+
+
+/**
+ * Called by the owner when the source is closed. Events which are still
+ * in flight keep the source alive until they are released.
+ */
+void nx_ack_source_free(nx_ack_source_t *source)
+{
+    ASSERT(source != NULL);
+
+    if ( nx_atomic_dec32(&(source->refcnt)) == 0 )
+    {
+	_source_free(source);
+    }
+}
+
+
+
+/**
+ * Attach a token to logdata, offset is the source position after this event.
+ */
+void nx_ack_source_track(nx_ack_source_t *source,
+			 nx_logdata_t *logdata,
+			 int64_t offset,
+			 int64_t extra)
+{
+    nx_ack_slot_t *slot;
+
+    ASSERT(source != NULL);
+    ASSERT(logdata != NULL);
+
+    if ( logdata->ack_source != NULL )
+    {
+	nx_ack_release(logdata);
+    }
+
+    slot = &(source->slots[source->head & (source->size - 1)]);
+    nx_atomic_add32(&(slot->pending), 1);
+    nx_atomic_add32(&(source->refcnt), 1);
+    (slot->count)++;
+    slot->offset = offset;
+    slot->extra = extra;
+
+    logdata->ack_source = source;
+    logdata->ack_seq = source->head;
+}
+
+
+
+/**
+ * Close the current batch, subsequent events go into a new slot.
+ * When the window is full the open slot keeps growing instead.
+ */
+void nx_ack_source_seal(nx_ack_source_t *source)
+{
+    nx_ack_slot_t *slot;
+
+    ASSERT(source != NULL);
+
+    slot = &(source->slots[source->head & (source->size - 1)]);
+    if ( slot->count == 0 )
+    {
+	return;
+    }
+    if ( source->head + 1 - source->tail >= source->size )
+    {
+	return;
+    }
+    (source->head)++;
+    slot = &(source->slots[source->head & (source->size - 1)]);
+    ASSERT(nx_atomic_read32(&(slot->pending)) == 0);
+    slot->count = 0;
+}
+
+
+
+/**
+ * Advance over the acknowledged slots and return the position up to which
+ * all events have been acknowledged. Returns TRUE if it changed since the last call.
+ */
+boolean nx_ack_source_committed(nx_ack_source_t *source,
+				int64_t *offset,
+				int64_t *extra)
+{
+    nx_ack_slot_t *slot;
+    int64_t prev;
+
+    ASSERT(source != NULL);
+
+    prev = source->committed;
+    while ( source->tail != source->head )
+    {
+	slot = &(source->slots[source->tail & (source->size - 1)]);
+	if ( nx_atomic_read32(&(slot->pending)) != 0 )
+	{
+	    break;
+	}
+	source->committed = slot->offset;
+	source->committed_extra = slot->extra;
+	slot->count = 0;
+	(source->tail)++;
+    }
+
+    if ( source->tail == source->head )
+    { // only the open slot is left
+	slot = &(source->slots[source->head & (source->size - 1)]);
+	if ( (slot->count > 0) && (nx_atomic_read32(&(slot->pending)) == 0) )
+	{
+	    source->committed = slot->offset;
+	    source->committed_extra = slot->extra;
+	}
+    }
+
+    if ( offset != NULL )
+    {
+	*offset = source->committed;
+    }
+    if ( extra != NULL )
+    {
+	*extra = source->committed_extra;
+    }
+
+    return ( prev != source->committed );
+}
+
+
+
+/**
+ * Called when logdata is cloned, the clone must also be acknowledged.
+ */
+void nx_ack_ref(nx_logdata_t *logdata)
+{
+    nx_ack_source_t *source;
+
+    ASSERT(logdata != NULL);
+
+    source = logdata->ack_source;
+    if ( source == NULL )
+    {
+	return;
+    }
+    nx_atomic_add32(&(source->slots[logdata->ack_seq & (source->size - 1)].pending), 1);
+    nx_atomic_add32(&(source->refcnt), 1);
+}
+
+
+
+/**
+ * Acknowledge the event, this is called when the logdata is freed.
+ */
+void nx_ack_release(nx_logdata_t *logdata)
+{
+    nx_ack_source_t *source;
+
+    ASSERT(logdata != NULL);
+
+    source = logdata->ack_source;
+    if ( source == NULL )
+    {
+	return;
+    }
+    logdata->ack_source = NULL;
+
+    nx_atomic_sub32(&(source->slots[logdata->ack_seq & (source->size - 1)].pending), 1);
+    if ( nx_atomic_dec32(&(source->refcnt)) == 0 )
+    {
+	_source_free(source);
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_ACK_H
+#define __NX_ACK_H
+
+#include "types.h"
+#include "logdata.h"
+
+/*
+ * Delivery acknowledgement tracking for input sources (e.g. a file read by im_file).
+ *
+ * Events read from a source are grouped into batches (slots). Each logdata carries
+ * a (source, slot) token, the slot's pending counter is decremented atomically when
+ * the logdata is freed, i.e. after an output popped it or it was dropped.
+ * The owner of the source (the input module) advances the committed position over
+ * the slots which have no pending events left. There is no locking involved on the
+ * per-event path, only atomic counters.
+ *
+ * Threading: nx_ack_source_track(), nx_ack_source_seal() and nx_ack_source_committed()
+ * must only be called by the owner (the module's job is never run concurrently),
+ * nx_ack_release() and nx_ack_ref() can be called from any thread.
+ */
+
+#define NX_ACK_DEFAULT_WINDOW 64	/* number of slots per source */
+
+typedef struct nx_ack_slot_t
+{
+    volatile apr_uint32_t pending;	///< number of unacknowledged events in this slot
+    apr_uint32_t	count;		///< number of events added to this slot
+    int64_t		offset;		///< source position after the last event in this slot
+    int64_t		extra;		///< opaque value belonging to offset (e.g. line number)
+} nx_ack_slot_t;
+
+struct nx_ack_source_t
+{
+    volatile apr_uint32_t refcnt;	///< owner + unacknowledged events
+    apr_uint32_t	size;		///< number of slots, power of two
+    apr_uint32_t	head;		///< sequence number of the open slot
+    apr_uint32_t	tail;		///< sequence number of the oldest slot not yet committed
+    int64_t		committed;	///< position up to which all events were acknowledged
+    int64_t		committed_extra;
+    nx_ack_slot_t	*slots;
+};
+
+nx_ack_source_t *nx_ack_source_new(apr_uint32_t size, int64_t offset, int64_t extra);
+void nx_ack_source_free(nx_ack_source_t *source);
+void nx_ack_source_track(nx_ack_source_t *source,
+			 nx_logdata_t *logdata,
+			 int64_t offset,
+			 int64_t extra);
+void nx_ack_source_seal(nx_ack_source_t *source);
+boolean nx_ack_source_committed(nx_ack_source_t *source,
+				int64_t *offset,
+				int64_t *extra);
+void nx_ack_ref(nx_logdata_t *logdata);
+void nx_ack_release(nx_logdata_t *logdata);
+
+#endif	/* __NX_ACK_H */
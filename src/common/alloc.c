@@ -5,13 +5,20 @@
  * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
  */
 
+#include <apr_allocator.h>
+
 #include "types.h"
 #include "exception.h"
+#include "context.h"
+#include "atomic.h"
 #include "alloc.h"
 
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
+static apr_uint32_t _scratch_arenas = 0;	///< number of threads with a scratch arena
+static uint64_t _scratch_blocks = 0;		///< blocks allocated after the first one
+
 static int abort_func(int code) NORETURN; 
 static int abort_func(int code)
 {
@@ -61,3 +68,256 @@ apr_pool_t *nx_pool_create_core()
 
     return ( pool );
 }
+
+
+
+static nx_scratch_t *nx_scratch_get()
+{
+    nx_context_t *context;
+    nx_scratch_t *scratch;
+
+    context = nx_get_thread_context();
+    if ( context->scratch == NULL )
+    {
+	scratch = malloc(sizeof(nx_scratch_t));
+	ASSERT(scratch != NULL);
+	memset(scratch, 0, sizeof(nx_scratch_t));
+	// only used by the owner thread, so the allocator has no mutex
+	CHECKERR(apr_allocator_create(&(scratch->allocator)));
+	apr_allocator_max_free_set(scratch->allocator, NX_MAX_ALLOCATOR_SIZE);
+	scratch->first = apr_allocator_alloc(scratch->allocator, NX_SCRATCH_BLOCK_SIZE);
+	ASSERT(scratch->first != NULL);
+	scratch->first->next = NULL;
+	scratch->start = scratch->first->first_avail;
+	scratch->active = scratch->first;
+	context->scratch = scratch;
+	nx_atomic_add32(&_scratch_arenas, 1);
+    }
+
+    return ( (nx_scratch_t *) context->scratch );
+}
+
+
+
+/**
+ * Allocate temporary memory from the scratch arena of the calling thread.
+ * It must not be freed, it is valid until nx_scratch_release() is called
+ * with an earlier mark or until the worker thread finishes the event.
+ */
+void *nx_scratch_alloc(apr_size_t size)
+{
+    nx_scratch_t *scratch;
+    apr_memnode_t *node;
+    char *retval;
+
+    scratch = nx_scratch_get();
+    size = APR_ALIGN_DEFAULT(size);
+
+    node = scratch->active;
+    if ( (apr_size_t) (node->endp - node->first_avail) < size )
+    {
+	node = apr_allocator_alloc(scratch->allocator,
+				   (size > NX_SCRATCH_BLOCK_SIZE) ? size : NX_SCRATCH_BLOCK_SIZE);
+	if ( node == NULL )
+	{
+	    throw_msg("scratch arena allocation error");
+	}
+	node->next = NULL;
+	scratch->active->next = node;
+	scratch->active = node;
+	nx_atomic_add64(&_scratch_blocks, 1);
+    }
+    retval = node->first_avail;
+    node->first_avail += size;
+
+    return ( retval );
+}
+
+
+
+char *nx_scratch_strdup(const char *str, int len)
+{
+    char *retval;
+
+    ASSERT(str != NULL);
+
+    if ( len < 0 )
+    {
+	len = (int) strlen(str);
+    }
+    retval = nx_scratch_alloc((apr_size_t) len + 1);
+    memcpy(retval, str, (size_t) len);
+    retval[len] = '\0';
+
+    return ( retval );
+}
+
+
+
+/**
+ * Return an empty string owned by the scratch arena of the calling thread.
+ * It can be appended to as usual but must not be freed, it is handed out
+ * again after nx_scratch_release() or the end of the event.
+ */
+nx_string_t *nx_scratch_string()
+{
+    nx_scratch_t *scratch;
+    nx_string_t *retval;
+
+    scratch = nx_scratch_get();
+
+    if ( scratch->num_used == scratch->num_string )
+    {
+	scratch->num_string = (scratch->num_string == 0) ? 8 : scratch->num_string * 2;
+	scratch->strings = realloc(scratch->strings,
+				   (size_t) scratch->num_string * sizeof(nx_string_t *));
+	ASSERT(scratch->strings != NULL);
+	memset(scratch->strings + scratch->num_used, 0,
+	       (size_t) (scratch->num_string - scratch->num_used) * sizeof(nx_string_t *));
+    }
+    if ( scratch->strings[scratch->num_used] == NULL )
+    {
+	scratch->strings[scratch->num_used] = nx_string_new();
+    }
+    retval = scratch->strings[scratch->num_used];
+    (scratch->num_used)++;
+
+    retval->len = 0;
+    retval->buf[0] = '\0';
+
+    return ( retval );
+}
+
+
+
+/**
+ * Remember the current position of the scratch arena, see nx_scratch_release()
+ */
+void nx_scratch_mark(nx_scratch_mark_t *mark)
+{
+    nx_scratch_t *scratch;
+
+    ASSERT(mark != NULL);
+
+    scratch = nx_scratch_get();
+    mark->node = scratch->active;
+    mark->avail = scratch->active->first_avail;
+    mark->num_used = scratch->num_used;
+}
+
+
+
+static void nx_scratch_rewind(nx_scratch_t *scratch, const nx_scratch_mark_t *mark)
+{
+    int i;
+
+    if ( mark->node->next != NULL )
+    {
+	apr_allocator_free(scratch->allocator, mark->node->next);
+	mark->node->next = NULL;
+    }
+    mark->node->first_avail = mark->avail;
+    scratch->active = mark->node;
+
+    for ( i = mark->num_used; i < scratch->num_used; i++ )
+    { // don't keep the memory of an occasional huge event
+	if ( scratch->strings[i]->bufsize > NX_SCRATCH_STRING_MAX_SIZE )
+	{
+	    nx_string_free(scratch->strings[i]);
+	    scratch->strings[i] = NULL;
+	}
+    }
+    scratch->num_used = mark->num_used;
+}
+
+
+
+/**
+ * Release everything allocated from the scratch arena since the mark was
+ * taken. Marks must be released in the reverse order they were taken.
+ */
+void nx_scratch_release(const nx_scratch_mark_t *mark)
+{
+    ASSERT(mark != NULL);
+
+    nx_scratch_rewind(nx_scratch_get(), mark);
+}
+
+
+
+/**
+ * Release everything allocated from the scratch arena of the calling
+ * thread. Called by the worker threads after each event.
+ */
+void nx_scratch_reset()
+{
+    nx_context_t *context;
+    nx_scratch_t *scratch;
+    nx_scratch_mark_t mark;
+
+    if ( (context = nx_find_thread_context()) == NULL )
+    {
+	return;
+    }
+    if ( (scratch = (nx_scratch_t *) context->scratch) == NULL )
+    {
+	return;
+    }
+
+    mark.node = scratch->first;
+    mark.avail = scratch->start;
+    mark.num_used = 0;
+    nx_scratch_rewind(scratch, &mark);
+}
+
+
+
+/**
+ * Free the scratch arena of the calling thread.
+ */
+void nx_scratch_thread_cleanup()
+{
+    nx_context_t *context;
+    nx_scratch_t *scratch;
+    int i;
+
+    if ( (context = nx_find_thread_context()) == NULL )
+    {
+	return;
+    }
+    if ( (scratch = (nx_scratch_t *) context->scratch) == NULL )
+    {
+	return;
+    }
+
+    for ( i = 0; i < scratch->num_string; i++ )
+    {
+	if ( scratch->strings[i] != NULL )
+	{
+	    nx_string_free(scratch->strings[i]);
+	}
+    }
+    if ( scratch->strings != NULL )
+    {
+	free(scratch->strings);
+    }
+    // allocated blocks are not freed by apr_allocator_destroy()
+    apr_allocator_free(scratch->allocator, scratch->first);
+    apr_allocator_destroy(scratch->allocator);
+    nx_atomic_sub32(&_scratch_arenas, 1);
+    free(scratch);
+    context->scratch = NULL;
+}
+
+
+
+/**
+ * Return usage counters of the scratch arenas
+ */
+void nx_scratch_get_stats(nx_scratch_stats_t *stats)
+{
+    ASSERT(stats != NULL);
+
+    stats->arenas = nx_atomic_read32(&_scratch_arenas);
+    stats->blocks = nx_atomic_read64(&_scratch_blocks);
+}
@@ -8,12 +8,53 @@
 #ifndef __NX_ALLOC_H
 #define __NX_ALLOC_H
 
+#include <apr_allocator.h>
+
 #include "types.h"
+#include "str.h"
 
 #define NX_MAX_ALLOCATOR_SIZE (1024 * 512) /* 512Kb */
+#define NX_SCRATCH_BLOCK_SIZE (1024 * 8) /* 8Kb */
+#define NX_SCRATCH_STRING_MAX_SIZE (1024 * 64) /* larger scratch strings are not kept */
+
+/**
+ * Per-thread bump pointer arena for temporaries of parsers, formatters
+ * and expression evaluation, see nx_scratch_alloc()
+ */
+typedef struct nx_scratch_t
+{
+    apr_allocator_t	*allocator;
+    apr_memnode_t	*first;		///< first block, kept on reset
+    char		*start;		///< start of the first block
+    apr_memnode_t	*active;	///< last block of the chain, allocations are served from here
+    nx_string_t		**strings;	///< reusable strings returned by nx_scratch_string()
+    int			num_string;	///< size of the strings array
+    int			num_used;	///< strings handed out
+} nx_scratch_t;
+
+typedef struct nx_scratch_stats_t
+{
+    apr_uint32_t	arenas;		///< threads having a scratch arena
+    uint64_t		blocks;		///< blocks allocated after the first one of an arena
+} nx_scratch_stats_t;
+
+typedef struct nx_scratch_mark_t
+{
+    apr_memnode_t	*node;
+    char		*avail;
+    int			num_used;
+} nx_scratch_mark_t;
 
 void nx_pool_mutex_set(apr_thread_mutex_t *mutex);
 apr_pool_t *nx_pool_create_child(apr_pool_t *parent);
 apr_pool_t *nx_pool_create_core();
+void *nx_scratch_alloc(apr_size_t size);
+char *nx_scratch_strdup(const char *str, int len);
+nx_string_t *nx_scratch_string();
+void nx_scratch_mark(nx_scratch_mark_t *mark);
+void nx_scratch_release(const nx_scratch_mark_t *mark);
+void nx_scratch_reset();
+void nx_scratch_thread_cleanup();
+void nx_scratch_get_stats(nx_scratch_stats_t *stats);
 
 #endif	/* __NX_ALLOC_H */
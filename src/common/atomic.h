@@ -18,7 +18,7 @@ extern apr_thread_mutex_t *nx_atomic_mutex;
 
 #define nx_atomic_lock() apr_thread_mutex_lock(nx_atomic_mutex)
 #define nx_atomic_unlock() apr_thread_mutex_unlock(nx_atomic_mutex)
-#define nx_atomic_set32(ptr, val) nx_atomic_lock(); *ptr = val; nx_atomic_unlock();
+#define nx_atomic_set32(ptr, val) do { nx_atomic_lock(); *(ptr) = (val); nx_atomic_unlock(); } while (0)
 
 #define nx_atomic_read32(ptr)     \
     ({                            \
@@ -28,8 +28,37 @@ extern apr_thread_mutex_t *nx_atomic_mutex;
          nx_atomic_unlock();      \
          _retval;                 \
     })
-#define nx_atomic_add32(ptr, val) nx_atomic_lock(); *ptr += val; nx_atomic_unlock();
-#define nx_atomic_sub32(ptr, val) nx_atomic_lock(); *ptr -= val; nx_atomic_unlock();
+#define nx_atomic_add32(ptr, val) do { nx_atomic_lock(); *(ptr) += (val); nx_atomic_unlock(); } while (0)
+#define nx_atomic_sub32(ptr, val) do { nx_atomic_lock(); *(ptr) -= (val); nx_atomic_unlock(); } while (0)
+#define nx_atomic_dec32(ptr)      \
+    ({                            \
+         apr_uint32_t _retval;    \
+         nx_atomic_lock();        \
+         _retval = --(*ptr);      \
+         nx_atomic_unlock();      \
+         _retval;                 \
+    })
+#define nx_atomic_add64(ptr, val) do { nx_atomic_lock(); *(ptr) += (val); nx_atomic_unlock(); } while (0)
+#define nx_atomic_read64(ptr)     \
+    ({                            \
+         uint64_t _retval;        \
+         nx_atomic_lock();        \
+         _retval = *(ptr);        \
+         nx_atomic_unlock();      \
+         _retval;                 \
+    })
+#define nx_atomic_cas64(ptr, cmp, val) \
+    ({                            \
+         int _retval = 0;         \
+         nx_atomic_lock();        \
+         if ( *(ptr) == (cmp) )   \
+         {                        \
+             *(ptr) = (val);      \
+             _retval = 1;         \
+         }                        \
+         nx_atomic_unlock();      \
+         _retval;                 \
+    })
 
 #else //NX_NOATOMIC
 #include <apr_atomic.h>
@@ -39,6 +68,11 @@ extern apr_thread_mutex_t *nx_atomic_mutex;
 #define nx_atomic_read32(ptr) apr_atomic_read32(ptr)
 #define nx_atomic_add32(ptr, val) apr_atomic_add32(ptr, val)
 #define nx_atomic_sub32(ptr, val) apr_atomic_sub32(ptr, val)
+#define nx_atomic_dec32(ptr) apr_atomic_dec32(ptr) /* returns zero if the value became zero */
+// 64 bit counters, apr_atomic has no 64 bit operations before 1.7
+#define nx_atomic_add64(ptr, val) __atomic_fetch_add(ptr, val, __ATOMIC_RELAXED)
+#define nx_atomic_read64(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define nx_atomic_cas64(ptr, cmp, val) __sync_bool_compare_and_swap(ptr, cmp, val)
 #endif
 
 
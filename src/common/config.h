@@ -82,6 +82,9 @@
 /* Define to 1 if you have the <langinfo.h> header file. */
 #define HAVE_LANGINFO_H 1
 
+/* Define to 1 if the linker supports --wrap. */
+#define HAVE_LD_WRAP 1
+
 /* Define to 1 if you have the `crypto' library (-lcrypto). */
 #define HAVE_LIBCRYPTO 1
 
@@ -9,6 +9,8 @@
 #include "error_debug.h"
 #include "config_cache.h"
 #include "module.h"
+#include "alloc.h"
+#include "atomic.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
 
@@ -34,81 +36,275 @@ static void _free_item(nx_cc_item_t *item)
 
 
 
-static void _update_item(nx_cc_item_t *item)
+static apr_size_t _item_serialized_size(nx_cc_item_t *item)
 {
-    nx_ctx_t *ctx;
-    apr_off_t offs;
-    nx_exception_t e;
+    nx_value_t key;
+    nx_string_t str;
 
+    ASSERT(item != NULL);
+    ASSERT(item->key != NULL);
     ASSERT(item->value != NULL);
 
-    ctx = nx_ctx_get();
+    nx_value_init(&key);
+    key.type = NX_VALUE_TYPE_STRING;
+    nx_string_init_const(&str, item->key);
+    key.string = &str;
 
-    CHECKERR(apr_thread_mutex_lock(ctx->config_cache_mutex));
-    try
+    return ( nx_value_serialized_size(&key) + nx_value_serialized_size(item->value) );
+}
+
+
+
+static apr_size_t _item_to_membuf(nx_cc_item_t *item, char *buf, apr_size_t bufsize)
+{
+    nx_value_t key;
+    nx_string_t str;
+    apr_size_t len;
+
+    ASSERT(item != NULL);
+    ASSERT(item->key != NULL);
+    ASSERT(item->value != NULL);
+
+    nx_value_init(&key);
+    key.type = NX_VALUE_TYPE_STRING;
+    nx_string_init_const(&str, item->key);
+    key.string = &str;
+
+    len = nx_value_to_membuf(&key, buf, bufsize);
+    // remember where the value starts, this is only informational now
+    // as the whole file is rewritten on each checkpoint
+    item->offs = (apr_off_t) len;
+    len += nx_value_to_membuf(item->value, buf + len, bufsize - len);
+
+    return ( len );
+}
+
+
+
+/**
+ * Serialize the items which have been read or written into a malloced buffer.
+ * Must be called with config_cache_mutex held.
+ */
+static char *_serialize_items(nx_ctx_t *ctx, apr_size_t *bufsize)
+{
+    nx_cc_item_t *item;
+    nx_value_t *version;
+    apr_hash_index_t *idx;
+    apr_size_t size, len;
+    char *buf;
+
+    version = nx_value_new_string(NX_CONFIG_CACHE_VERSION);
+
+    size = nx_value_serialized_size(version);
+    for ( idx = apr_hash_first(NULL, ctx->config_cache);
+	  idx != NULL;
+	  idx = apr_hash_next(idx) )
     {
-	if ( ctx->ccfile == NULL )
-	{
-	    CHECKERR_MSG(apr_file_open(&(ctx->ccfile), ctx->ccfilename,
-				       APR_READ | APR_WRITE | APR_CREATE | APR_TRUNCATE,
-				       APR_OS_DEFAULT, ctx->pool),
-			 "couldn't open config cache '%s' for writing", ctx->ccfilename);
+	apr_hash_this(idx, NULL, NULL, (void **) &item);
+	if ( item->used == FALSE )
+	{ // only write items which have been read or written
+	    continue;
 	}
-	// only integers are supported for now, string modifications trigger a whole rewrite
-	if ( (item->offs > 0) && (item->value->type == NX_VALUE_TYPE_INTEGER) )
+	size += _item_serialized_size(item);
+    }
+
+    buf = malloc(size);
+    ASSERT(buf != NULL);
+
+    len = nx_value_to_membuf(version, buf, size);
+    nx_value_free(version);
 
+    for ( idx = apr_hash_first(NULL, ctx->config_cache);
+	  idx != NULL;
+	  idx = apr_hash_next(idx) )
+    {
+	apr_hash_this(idx, NULL, NULL, (void **) &item);
+	if ( item->used == FALSE )
 	{
-	    offs = item->offs;
-	    CHECKERR_MSG(apr_file_seek(ctx->ccfile, APR_SET, &offs),
-			 "failed to seek in %s file", ctx->ccfilename);
-	    CHECKERR_MSG(nx_value_to_file(item->value, ctx->ccfile), "failed to update config cache item");
-	}
-	else
-	{ // write the whole file, not very efficient
-	    nx_config_cache_write();
+	    continue;
 	}
+	len += _item_to_membuf(item, buf + len, size - len);
 	item->needflush = FALSE;
     }
+    ASSERT(len == size);
+    *bufsize = size;
+
+    return ( buf );
+}
+
+
+
+/**
+ * Write the buffer into a temporary file and rename it over the cache file
+ * so that a crash during the write cannot leave a truncated configcache.dat behind.
+ */
+static void _write_atomic(nx_ctx_t *ctx, const char *buf, apr_size_t bufsize)
+{
+    char tmpfilename[APR_PATH_MAX];
+    apr_pool_t *pool;
+    apr_file_t *file = NULL;
+    apr_size_t bytes;
+    nx_exception_t e;
+
+    ASSERT(ctx->ccfilename != NULL);
+
+    apr_snprintf(tmpfilename, sizeof(tmpfilename), "%s.tmp", ctx->ccfilename);
+    pool = nx_pool_create_core();
+
+    try
+    {
+	CHECKERR_MSG(apr_file_open(&file, tmpfilename,
+				   APR_WRITE | APR_CREATE | APR_TRUNCATE | APR_BINARY,
+				   APR_OS_DEFAULT, pool),
+		     "couldn't open config cache '%s' for writing", tmpfilename);
+	CHECKERR_MSG(apr_file_write_full(file, buf, bufsize, &bytes),
+		     "couldn't write config cache '%s'", tmpfilename);
+	if ( ctx->cc_sync == TRUE )
+	{
+#ifdef HAVE_APR_FILE_SYNC
+	    CHECKERR_MSG(apr_file_sync(file), "failed to sync config cache '%s'", tmpfilename);
+#endif
+	}
+	CHECKERR_MSG(apr_file_close(file), "couldn't close config cache '%s'", tmpfilename);
+	file = NULL;
+	CHECKERR_MSG(apr_file_rename(tmpfilename, ctx->ccfilename, pool),
+		     "couldn't rename '%s' to '%s'", tmpfilename, ctx->ccfilename);
+    }
     catch(e)
     {
-	CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
+	if ( file != NULL )
+	{
+	    apr_file_close(file);
+	}
+	apr_file_remove(tmpfilename, pool);
+	apr_pool_destroy(pool);
 	rethrow(e);
     }
+    apr_pool_destroy(pool);
+}
+
+
+
+/**
+ * Take a snapshot of the cache under config_cache_mutex and persist it.
+ * Only the serialization is done with the lock held, the file I/O is not.
+ */
+static void _checkpoint(nx_ctx_t *ctx)
+{
+    char * volatile buf = NULL;
+    apr_size_t bufsize = 0;
+    apr_uint32_t dirty;
+    nx_exception_t e;
+
+    CHECKERR(apr_thread_mutex_lock(ctx->config_cache_mutex));
+    if ( apr_hash_count(ctx->config_cache) == 0 )
+    { // no items to write
+	CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
+	log_debug("no entries found, not writing configcache.dat");
+	return;
+    }
+    dirty = nx_atomic_read32(&(ctx->cc_dirty));
+    buf = _serialize_items(ctx, &bufsize);
     CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
+
+    try
+    {
+	_write_atomic(ctx, buf, bufsize);
+    }
+    catch(e)
+    {
+	free(buf);
+	rethrow(e);
+    }
+    free(buf);
+
+    // updates which came in after the snapshot are kept for the next round
+    nx_atomic_sub32(&(ctx->cc_dirty), dirty);
+    ctx->cc_last_flush = apr_time_now();
+
+    log_debug("config cache written to %s", ctx->ccfilename);
 }
 
 
 
-static void _write_item(apr_file_t *file, nx_cc_item_t *item)
+/**
+ * Write the whole config cache.
+ */
+void nx_config_cache_write()
 {
-    nx_value_t key;
-    nx_string_t str;
+    nx_ctx_t *ctx;
     nx_exception_t e;
 
-    ASSERT(file != NULL);
-    ASSERT(item != NULL);
-    ASSERT(item->key != NULL);
-    ASSERT(item->value != NULL);
+    ctx = nx_ctx_get();
 
-    nx_value_init(&key);
-    key.type = NX_VALUE_TYPE_STRING;
-    nx_string_init_const(&str, item->key);
-    key.string = &str;
+    ASSERT(ctx != NULL);
+    if ( ctx->nocache == TRUE )
+    {
+	log_debug("NoCache is TRUE, not writing config cache");
+	return;
+    }
 
+    log_debug("nx_config_cache_write()");
     try
     {
-	CHECKERR_MSG(nx_value_to_file(&key, file), "couldn't write key to cache file");
-	if ( item->value->type == NX_VALUE_TYPE_INTEGER )
-	{ // get offset for integer values so that updates can be done efficiently	    
-	    item->offs = 0;
-	    CHECKERR_MSG(apr_file_seek(file, APR_CUR, &(item->offs)), "failed to seek in cache file");
-	}
-	CHECKERR_MSG(nx_value_to_file(item->value, file), "couldn't write value to cache file");
+	_checkpoint(ctx);
     }
     catch(e)
     {
-	nx_value_kill(&key);
-	rethrow(e);
+	log_exception_msg(e, "couldn't write config cache '%s'", ctx->ccfilename);
+    }
+}
+
+
+
+/**
+ * Persist the config cache if it has dirty entries and either
+ * CacheFlushInterval has elapsed since the last write or the number
+ * of updates reached CacheFlushCount. Called periodically from the main loop.
+ */
+void nx_config_cache_checkpoint()
+{
+    nx_ctx_t *ctx;
+    apr_uint32_t dirty;
+    boolean due = FALSE;
+    nx_exception_t e;
+
+    ctx = nx_ctx_get();
+
+    if ( (ctx == NULL) || (ctx->nocache == TRUE) || (ctx->ccfilename == NULL) )
+    {
+	return;
+    }
+
+    dirty = nx_atomic_read32(&(ctx->cc_dirty));
+    if ( dirty == 0 )
+    {
+	return;
+    }
+
+    if ( (ctx->cc_flush_count > 0) && (dirty >= ctx->cc_flush_count) )
+    {
+	due = TRUE;
+    }
+    else if ( (ctx->cc_flush_interval > 0) &&
+	      (apr_time_now() - ctx->cc_last_flush >= ctx->cc_flush_interval) )
+    {
+	due = TRUE;
+    }
+
+    if ( due != TRUE )
+    {
+	return;
+    }
+
+    try
+    {
+	_checkpoint(ctx);
+    }
+    catch(e)
+    { // will be retried at the next interval
+	log_exception_msg(e, "failed to checkpoint config cache");
+	ctx->cc_last_flush = apr_time_now();
     }
 }
 
@@ -192,84 +388,6 @@ static void _read_item(char * volatile buf,
 
 
 
-/**
- * This is not thread safe, must ensure that modules are not running,
- * otherwise lock config_cache_mutex
- */
-void nx_config_cache_write()
-{
-    nx_ctx_t *ctx;
-    nx_cc_item_t *item;
-    nx_value_t *version = NULL;
-    nx_exception_t e;
-    apr_hash_index_t *idx;
-    const char *key;
-    apr_ssize_t keylen;
-    apr_status_t rv;
-
-    ctx = nx_ctx_get();
-
-    ASSERT(ctx != NULL);
-    if ( ctx->nocache == TRUE )
-    {
-	log_debug("NoCache is TRUE, not writing config cache");
-	return;
-    }
-
-    if ( apr_hash_count(ctx->config_cache) == 0 )
-    { // no items to write
-	log_debug("no entries found, not writing configcache.dat");
-	return;
-    }
-    log_debug("nx_config_cache_write()");
-    
-    if ( ctx->ccfile == NULL )
-    {
-	rv = apr_file_open(&(ctx->ccfile), ctx->ccfilename,
-			   APR_READ | APR_WRITE | APR_CREATE | APR_TRUNCATE,
-			   APR_OS_DEFAULT, ctx->pool);
-	if ( rv != APR_SUCCESS )
-	{
-	    log_aprerror(rv, "couldn't open config cache '%s' for writing", ctx->ccfilename);
-	    return;
-	}
-    }
-    else
-    {
-	CHECKERR_MSG(apr_file_trunc(ctx->ccfile, 0), "failed to truncate '%s'",
-		     ctx->ccfilename);
-    }
-    version = nx_value_new_string(NX_CONFIG_CACHE_VERSION);
-    try
-    {
-	CHECKERR_MSG(nx_value_to_file(version, ctx->ccfile),
-		     "couldn't write version to cache file");
-
-	idx = apr_hash_first(NULL, ctx->config_cache);
-
-	while ( idx != NULL )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, (void **) &item);
-	    idx = apr_hash_next(idx);
-	    if ( item->used == FALSE )
-	    { // only write items which have been read or written
-		continue;
-	    }
-	    _write_item(ctx->ccfile, item);
-	    item->needflush = FALSE;
-	}
-    }
-    catch(e)
-    {
-	nx_value_free(version);
-	rethrow(e);
-    }
-
-    log_debug("config cache written to %s", ctx->ccfilename);
-}
-
-
-
 void nx_config_cache_read()
 {
     nx_ctx_t *ctx;
@@ -458,6 +576,8 @@ boolean nx_config_cache_get_string(const char *module, const char *key, const ch
 
 /**
  * Set an integer value in the config cache.
+ * The value is only updated in memory and the item is marked dirty,
+ * it is persisted by the next checkpoint.
  */
 void nx_config_cache_set_int(const char *module, const char *key, int64_t value)
 {
@@ -477,15 +597,17 @@ void nx_config_cache_set_int(const char *module, const char *key, int64_t value)
 
     CHECKERR(apr_thread_mutex_lock(ctx->config_cache_mutex));
     item = (nx_cc_item_t *) apr_hash_get(ctx->config_cache, ckey, APR_HASH_KEY_STRING);
-    CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
 
     if ( item != NULL )
     {
 	ASSERT(item->value->type == NX_VALUE_TYPE_INTEGER);
 
+	if ( (item->value->integer == value) && (item->used == TRUE) )
+	{ // unchanged, nothing to flush
+	    CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
+	    return;
+	}
 	item->value->integer = value;
-	item->used = TRUE;
-	item->needflush = TRUE;
     }
     else
     {
@@ -493,12 +615,12 @@ void nx_config_cache_set_int(const char *module, const char *key, int64_t value)
 	memset(item, 0, sizeof(nx_cc_item_t));
 	item->key = strdup(ckey);
 	item->value = nx_value_new_integer(value);
-	item->used = TRUE;
-	item->needflush = TRUE;
-	CHECKERR(apr_thread_mutex_lock(ctx->config_cache_mutex));
 	apr_hash_set(ctx->config_cache, item->key, APR_HASH_KEY_STRING, (void *) item);
-	CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
     }
+    item->used = TRUE;
+    item->needflush = TRUE;
+    nx_atomic_add32(&(ctx->cc_dirty), 1);
+    CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
 }
 
 
@@ -522,15 +644,12 @@ void nx_config_cache_set_string(const char *module, const char *key, const char
 
     CHECKERR(apr_thread_mutex_lock(ctx->config_cache_mutex));
     item = (nx_cc_item_t *) apr_hash_get(ctx->config_cache, ckey, APR_HASH_KEY_STRING);
-    CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
 
     if ( item != NULL )
     {
 	ASSERT(item->value->type == NX_VALUE_TYPE_STRING);
 	nx_value_free(item->value);
 	item->value = nx_value_new_string(value);
-	item->used = TRUE;
-	item->needflush = TRUE;
     }
     else
     {
@@ -538,12 +657,12 @@ void nx_config_cache_set_string(const char *module, const char *key, const char
 	memset(item, 0, sizeof(nx_cc_item_t));
 	item->key = strdup(ckey);
 	item->value = nx_value_new_string(value);
-	item->used = TRUE;
-	item->needflush = TRUE;
-	CHECKERR(apr_thread_mutex_lock(ctx->config_cache_mutex));
 	apr_hash_set(ctx->config_cache, item->key, APR_HASH_KEY_STRING, (void *) item);
-	CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
     }
+    item->used = TRUE;
+    item->needflush = TRUE;
+    nx_atomic_add32(&(ctx->cc_dirty), 1);
+    CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
 }
 
 
@@ -567,11 +686,6 @@ void nx_config_cache_free()
 	apr_hash_set(ctx->config_cache, item->key, APR_HASH_KEY_STRING, NULL);
 	_free_item(item);
     }
-    if ( ctx->ccfile != NULL )
-    {
-	apr_file_close(ctx->ccfile);
-	ctx->ccfile = NULL;
-    }
     CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
 }
 
@@ -597,6 +711,12 @@ void nx_config_cache_remove(const char *module, const char *key)
     }
 
     CHECKERR(apr_thread_mutex_lock(ctx->config_cache_mutex));
-    apr_hash_set(ctx->config_cache, ckey, APR_HASH_KEY_STRING, NULL);
+    item = (nx_cc_item_t *) apr_hash_get(ctx->config_cache, ckey, APR_HASH_KEY_STRING);
+    if ( item != NULL )
+    {
+	apr_hash_set(ctx->config_cache, ckey, APR_HASH_KEY_STRING, NULL);
+	_free_item(item);
+	nx_atomic_add32(&(ctx->cc_dirty), 1);
+    }
     CHECKERR(apr_thread_mutex_unlock(ctx->config_cache_mutex));
 }
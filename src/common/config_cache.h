@@ -13,14 +13,15 @@
 #include "value.h"
 
 #define NX_CONFIG_CACHE_VERSION "NX-CC-VERSION 001"
+#define NX_CONFIG_CACHE_DEFAULT_FLUSH_INTERVAL 5 /* seconds */
 
 typedef struct nx_cc_item_t
 {
     boolean		used;
     char		*key;
     nx_value_t		*value;
-    apr_off_t		offs;		///< file offset in config cache
-    boolean		needflush;	///< TRUE when item was updated since last write
+    apr_off_t		offs;		///< offset of the value within the serialized item
+    boolean		needflush;	///< TRUE when item was updated since last checkpoint
 } nx_cc_item_t;
 
 boolean nx_config_cache_get_string(const char *module, const char *key, const char **result);
@@ -30,6 +31,7 @@ void nx_config_cache_set_string(const char *module, const char *key, const char
 void nx_config_cache_remove(const char *module, const char *key);
 void nx_config_cache_read();
 void nx_config_cache_write();
+void nx_config_cache_checkpoint();
 void nx_config_cache_free();
 
 #endif	/* __NX_CONFIG_CACHE_H */
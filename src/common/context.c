@@ -46,6 +46,49 @@ nx_context_t *nx_get_context()
 
 
 
+/**
+ * Return the context of the calling thread
+ */
+nx_context_t *nx_get_thread_context()
+{
+    nx_context_t *context;
+    apr_status_t rv;
+
+    ASSERT(_context_key != NULL);
+    if ( (rv = apr_threadkey_private_get((void **) &context, _context_key)) != APR_SUCCESS )
+    {
+	log_aprerror(rv, "couldn't get context by threadkey");
+	nx_abort("aborting");
+    }
+    ASSERT(context != NULL);
+
+    return ( context );
+}
+
+
+
+/**
+ * Same as nx_get_thread_context() but returns NULL if the calling thread
+ * has no context, e.g. nx_init() was not called.
+ */
+nx_context_t *nx_find_thread_context()
+{
+    nx_context_t *context = NULL;
+
+    if ( _context_key == NULL )
+    {
+	return ( NULL );
+    }
+    if ( apr_threadkey_private_get((void **) &context, _context_key) != APR_SUCCESS )
+    {
+	return ( NULL );
+    }
+
+    return ( context );
+}
+
+
+
 nx_context_t *nx_init_context()
 {
     nx_context_t *context = NULL;
@@ -17,10 +17,16 @@ struct nx_context_t
     void                        *user_data;
     void                        *thread_data;
     struct exception_context    exception_context;
+    void			*jit_stack;	///< per-thread pcre JIT stack, see regexp.c
+    void			*date_cache;	///< per-thread timestamp formatting cache, see date.c
+    void			*scratch;	///< per-thread scratch arena, see alloc.c
+    int				metrics_shard;	///< counter shard of the thread + 1, see metrics.c
 };
 typedef struct nx_context_t nx_context_t;
 
 nx_context_t *nx_get_context();
+nx_context_t *nx_get_thread_context();
+nx_context_t *nx_find_thread_context();
 nx_context_t *nx_init_context();
 apr_threadkey_t *nx_get_context_key();
 
@@ -23,6 +23,7 @@
 
 #include "types.h"
 #include "error_debug.h"
+#include "context.h"
 #include "date.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
@@ -1620,49 +1621,302 @@ apr_status_t nx_date_parse_timestamp(apr_time_t  *t,
 
 
 
+typedef apr_status_t (nx_date_parser_t)(apr_time_t *t, const char *date, const char **dateend);
+
+/* Indexed by nx_date_format_t, in the order nx_date_parse() tries them.
+ * parse_win must be called before parse_timestamp since the latter would
+ * match the 'win' format.
+ */
+static nx_date_parser_t * const _date_parsers[NX_DATE_FORMAT_NUM] =
+{
+    NULL,
+    nx_date_parse_rfc3164,
+    nx_date_parse_rfc1123,
+    nx_date_parse_iso,
+    nx_date_parse_apache,
+    nx_date_parse_cisco,
+    nx_date_parse_win,
+    nx_date_parse_timestamp,
+};
+
+
+
+/**
+ * Guess the format from the first few bytes. A format is only returned if
+ * all parsers preceding it in _date_parsers are known to reject the string,
+ * so trying it first gives the same result as the full cascade.
+ */
+static nx_date_format_t _date_sniff(const char *date)
+{
+    int len;
+
+    if ( apr_isdigit(date[0]) )
+    {
+	for ( len = 1; (len < 15) && apr_isdigit(date[len]); len++ );
+
+	// rfc3164 needs a month name, rfc1123 a non-digit in the first 3 bytes
+	if ( len == 4 )
+	{
+	    if ( date[4] == '-' )
+	    {
+		return ( NX_DATE_FORMAT_ISO );
+	    }
+	    return ( NX_DATE_FORMAT_TIMESTAMP );
+	}
+	if ( len == 2 )
+	{
+	    if ( date[2] == '/' )
+	    {
+		return ( NX_DATE_FORMAT_APACHE );
+	    }
+	    return ( NX_DATE_FORMAT_UNKNOWN );
+	}
+	if ( (len == 14) && (date[14] == '.') )
+	{
+	    return ( NX_DATE_FORMAT_WIN );
+	}
+	if ( len >= 3 )
+	{
+	    return ( NX_DATE_FORMAT_TIMESTAMP );
+	}
+    }
+    else if ( apr_isupper(date[0]) && (date[1] != '\0') && (date[2] != '\0') && (date[3] == ',') )
+    { // "Sun, 06 Nov 1994", rfc3164 needs a space after the month
+	return ( NX_DATE_FORMAT_RFC1123 );
+    }
+
+    return ( NX_DATE_FORMAT_UNKNOWN );
+}
+
+
+
+/**
+ * Same as nx_date_parse() but jumps to the parser of the format recognized
+ * from the first bytes of the string instead of trying all of them.
+ * If format is not NULL, it holds the last successfully parsed format of the
+ * source. It is tried first when the format cannot be recognized (e.g. cisco
+ * timestamps which would otherwise go through the rfc3164, rfc1123, iso and
+ * apache parsers) and is updated on success.
+ */
+apr_status_t nx_date_parse_format(apr_time_t *t,
+				  const char *date,
+				  const char **dateend,
+				  nx_date_format_t *format)
+{
+    nx_date_format_t guess;
+    unsigned int tried = 0;
+    int i;
+
+    if ( date == NULL )
+    {
+	return ( APR_EBADDATE );
+    }
+
+    guess = _date_sniff(date);
+    if ( (guess == NX_DATE_FORMAT_UNKNOWN) && (format != NULL) )
+    {
+	switch ( *format )
+	{
+	    case NX_DATE_FORMAT_RFC1123:
+		// rfc3164 can't match what rfc1123 accepts
+		guess = NX_DATE_FORMAT_RFC1123;
+		break;
+	    case NX_DATE_FORMAT_CISCO:
+		// rfc1123, iso and apache can't match what cisco accepts but rfc3164 can
+		tried |= 1 << NX_DATE_FORMAT_RFC3164;
+		if ( nx_date_parse_rfc3164(t, date, dateend) == APR_SUCCESS )
+		{
+		    *format = NX_DATE_FORMAT_RFC3164;
+		    return ( APR_SUCCESS );
+		}
+		guess = NX_DATE_FORMAT_CISCO;
+		break;
+	    default:
+		break;
+	}
+    }
+
+    if ( guess != NX_DATE_FORMAT_UNKNOWN )
+    {
+	tried |= 1 << guess;
+	if ( _date_parsers[guess](t, date, dateend) == APR_SUCCESS )
+	{
+	    if ( format != NULL )
+	    {
+		*format = guess;
+	    }
+	    return ( APR_SUCCESS );
+	}
+    }
+
+    for ( i = NX_DATE_FORMAT_UNKNOWN + 1; i < NX_DATE_FORMAT_NUM; i++ )
+    {
+	if ( (tried & (1 << i)) != 0 )
+	{
+	    continue;
+	}
+	if ( _date_parsers[i](t, date, dateend) == APR_SUCCESS )
+	{
+	    if ( format != NULL )
+	    {
+		*format = (nx_date_format_t) i;
+	    }
+	    return ( APR_SUCCESS );
+	}
+    }
+
+    return ( APR_EBADDATE );
+}
+
+
+
 apr_status_t nx_date_parse(apr_time_t *t, const char *date, const char **dateend)
+{
+    return ( nx_date_parse_format(t, date, dateend, NULL) );
+}
+
+
+/*
+ * Most events formatted by a thread fall into the same second, so the broken
+ * down time and the formatted date/time of the last second are kept per
+ * thread for localtime and GMT. Only the sub-second part needs to be rendered
+ * for these. The cache is keyed by the absolute second which is safe across
+ * DST changes since these happen on second boundaries.
+ */
+typedef struct nx_date_cache_t
+{
+    apr_time_t		sec;		///< the cached second, -1 if empty
+    apr_time_exp_t	exp;		///< broken down time with tm_usec = 0, tm_year + 1900
+    char		datetime[32];	///< "2000-01-01 00:00:00"
+    int			datetimelen;
+    char		offset[8];	///< "Z" or "+01:00"
+    int			offsetlen;
+} nx_date_cache_t;
+
+#define NX_DATE_CACHE_LT 0
+#define NX_DATE_CACHE_GMT 1
+
+
+
+static apr_status_t _date_cache_fill(nx_date_cache_t *cache, apr_time_t t, boolean gmt)
 {
     apr_status_t rv;
+    apr_time_exp_t *exp;
 
-    if ( (rv = nx_date_parse_rfc3164(t, date, dateend)) == APR_SUCCESS )
+    exp = &(cache->exp);
+    if ( gmt == TRUE )
+    {
+	rv = apr_time_exp_gmt(exp, t);
+    }
+    else
+    {
+	rv = apr_time_exp_lt(exp, t);
+    }
+    if ( rv != APR_SUCCESS )
     {
+	cache->sec = -1;
 	return ( rv );
     }
+    if ( exp->tm_year < 1900 )
+    {
+	exp->tm_year += 1900;
+    }
 
-    if ( (rv = nx_date_parse_rfc1123(t, date, dateend)) == APR_SUCCESS )
+    cache->datetimelen = apr_snprintf(cache->datetime, sizeof(cache->datetime),
+				      "%d-%02d-%02d %02d:%02d:%02d", exp->tm_year, exp->tm_mon + 1,
+				      exp->tm_mday, exp->tm_hour, exp->tm_min, exp->tm_sec);
+    if ( gmt == TRUE )
     {
-	return ( rv );
+	cache->offsetlen = apr_snprintf(cache->offset, sizeof(cache->offset), "Z");
     }
+    else
+    {
+	cache->offsetlen = apr_snprintf(cache->offset, sizeof(cache->offset), "%+03d:%02d",
+					exp->tm_gmtoff / 3600,
+					(((exp->tm_gmtoff > 0) ? exp->tm_gmtoff : -exp->tm_gmtoff) /
+					 60) % 60);
+    }
+    cache->sec = t / APR_USEC_PER_SEC;
+
+    return ( APR_SUCCESS );
+}
+
+
+
+/**
+ * Return the broken down time of t from the cache of the calling thread.
+ * tmp is used when the time can't be cached (no thread context or negative
+ * time) and holds the usec part in exp.tm_usec, otherwise tm_usec is 0 and
+ * usec is set.
+ */
+static apr_status_t _date_cache_get(const nx_date_cache_t **retval,
+				    int32_t *usec,
+				    nx_date_cache_t *tmp,
+				    apr_time_t t,
+				    boolean gmt)
+{
+    nx_context_t *context;
+    nx_date_cache_t *cache;
+    apr_status_t rv;
 
-    if ( (rv = nx_date_parse_iso(t, date, dateend)) == APR_SUCCESS )
+    if ( (t < 0) || ((context = nx_find_thread_context()) == NULL) )
     {
-	return ( rv );
+	if ( (rv = _date_cache_fill(tmp, t, gmt)) != APR_SUCCESS )
+	{
+	    return ( rv );
+	}
+	*usec = tmp->exp.tm_usec;
+	tmp->exp.tm_usec = 0;
+	*retval = tmp;
+
+	return ( APR_SUCCESS );
     }
 
-    if ( (rv = nx_date_parse_apache(t, date, dateend)) == APR_SUCCESS )
+    if ( context->date_cache == NULL )
     {
-	return ( rv );
+	cache = malloc(2 * sizeof(nx_date_cache_t));
+	ASSERT(cache != NULL);
+	cache[NX_DATE_CACHE_LT].sec = -1;
+	cache[NX_DATE_CACHE_GMT].sec = -1;
+	context->date_cache = cache;
     }
+    cache = ((nx_date_cache_t *) context->date_cache) + ((gmt == TRUE) ? NX_DATE_CACHE_GMT : NX_DATE_CACHE_LT);
 
-    if ( (rv = nx_date_parse_cisco(t, date, dateend)) == APR_SUCCESS )
+    if ( cache->sec != t / APR_USEC_PER_SEC )
     {
-	return ( rv );
+	if ( (rv = _date_cache_fill(cache, t - t % APR_USEC_PER_SEC, gmt)) != APR_SUCCESS )
+	{
+	    return ( rv );
+	}
     }
+    *usec = (int32_t) (t % APR_USEC_PER_SEC);
+    *retval = cache;
+
+    return ( APR_SUCCESS );
+}
+
+
+
+/**
+ * Free the formatting cache of the calling thread.
+ */
+void nx_date_thread_cleanup()
+{
+    nx_context_t *context;
 
-    if ( (rv = nx_date_parse_win(t, date, dateend)) == APR_SUCCESS )
+    if ( (context = nx_find_thread_context()) == NULL )
     {
-	return ( rv );
+	return;
     }
-    // parse_win must be called before parse_timestamp since the latter would match the 'win' format.
-    if ( (rv = nx_date_parse_timestamp(t, date, dateend)) == APR_SUCCESS )
+    if ( context->date_cache != NULL )
     {
-	return ( rv );
+	free(context->date_cache);
+	context->date_cache = NULL;
     }
-
-    return ( APR_EBADDATE );
 }
 
 
+
 /**
  * datestr must be able to hold at least 16 chars including NUL
  */
@@ -1672,7 +1926,10 @@ apr_status_t nx_date_to_rfc3164(char *datestr,
 				apr_time_t timeval)
 {
     apr_status_t rv;
-    apr_time_exp_t ds;
+    const nx_date_cache_t *cache;
+    nx_date_cache_t tmp;
+    int32_t usec;
+    const apr_time_exp_t *exp;
     char *ptr;
     static const char *months[] =
     {
@@ -1683,46 +1940,47 @@ apr_status_t nx_date_to_rfc3164(char *datestr,
     ASSERT(datestr != NULL);
     ASSERT(dstsize >= 16);
 
-    if ( (rv = apr_time_exp_lt(&ds, timeval)) != APR_SUCCESS )
+    if ( (rv = _date_cache_get(&cache, &usec, &tmp, timeval, FALSE)) != APR_SUCCESS )
     {
 	return ( rv );
     }
+    exp = &(cache->exp);
 
-    ASSERT(ds.tm_mon < 12);
+    ASSERT(exp->tm_mon < 12);
     
     ptr = datestr;
     // month
-    *ptr++ = months[ds.tm_mon][0];
-    *ptr++ = months[ds.tm_mon][1];
-    *ptr++ = months[ds.tm_mon][2];
+    *ptr++ = months[exp->tm_mon][0];
+    *ptr++ = months[exp->tm_mon][1];
+    *ptr++ = months[exp->tm_mon][2];
     *ptr++ = ' ';
 
     // day
-    if ( ds.tm_mday >= 10 )
+    if ( exp->tm_mday >= 10 )
     {
-	*ptr++ = (char) ((ds.tm_mday / 10) + '0');
-	*ptr++ = (char) ((ds.tm_mday % 10) + '0');
+	*ptr++ = (char) ((exp->tm_mday / 10) + '0');
+	*ptr++ = (char) ((exp->tm_mday % 10) + '0');
     }
     else
     {
 	*ptr++ = ' ';
-	*ptr++ = (char) (ds.tm_mday + '0');
+	*ptr++ = (char) (exp->tm_mday + '0');
     }
     *ptr++ = ' ';
 
     // hour
-    *ptr++ = (char) ((ds.tm_hour / 10) + '0');
-    *ptr++ = (char) ((ds.tm_hour % 10) + '0');
+    *ptr++ = (char) ((exp->tm_hour / 10) + '0');
+    *ptr++ = (char) ((exp->tm_hour % 10) + '0');
     *ptr++ = ':';
 
     // min
-    *ptr++ = (char) ((ds.tm_min / 10) + '0');
-    *ptr++ = (char) ((ds.tm_min % 10) + '0');
+    *ptr++ = (char) ((exp->tm_min / 10) + '0');
+    *ptr++ = (char) ((exp->tm_min % 10) + '0');
     *ptr++ = ':';
 
     // sec
-    *ptr++ = (char) ((ds.tm_sec / 10) + '0');
-    *ptr++ = (char) ((ds.tm_sec % 10) + '0');
+    *ptr++ = (char) ((exp->tm_sec / 10) + '0');
+    *ptr++ = (char) ((exp->tm_sec % 10) + '0');
 
     *ptr = '\0';
 
@@ -1744,6 +2002,9 @@ apr_status_t nx_date_to_rfc3164_wday_year(char *datestr,
 					  boolean spaceday)
 {
     apr_status_t rv;
+    const nx_date_cache_t *cache;
+    nx_date_cache_t tmp;
+    int32_t usec;
     apr_time_exp_t ds;
     char *ptr;
     static const char *months[] =
@@ -1756,10 +2017,11 @@ apr_status_t nx_date_to_rfc3164_wday_year(char *datestr,
     ASSERT(datestr != NULL);
     ASSERT(dstsize >= 25);
 
-    if ( (rv = apr_time_exp_lt(&ds, timeval)) != APR_SUCCESS )
+    if ( (rv = _date_cache_get(&cache, &usec, &tmp, timeval, FALSE)) != APR_SUCCESS )
     {
 	return ( rv );
     }
+    ds = cache->exp;
 
     ASSERT(ds.tm_mon < 12);
     
@@ -1839,21 +2101,18 @@ apr_status_t nx_date_to_iso(char *dst,
 			    apr_time_t t)
 {
     apr_status_t rv;
-    apr_time_exp_t exp;
+    const nx_date_cache_t *cache;
+    nx_date_cache_t tmp;
+    int32_t usec;
 
     ASSERT(dst != NULL);
     ASSERT(dstsize >= 20);
 
-    if ( (rv = apr_time_exp_lt(&exp, t)) != APR_SUCCESS )
+    if ( (rv = _date_cache_get(&cache, &usec, &tmp, t, FALSE)) != APR_SUCCESS )
     {
 	return ( rv );
     }
-    if ( exp.tm_year < 1900 )
-    {
-	exp.tm_year += 1900;
-    }
-    apr_snprintf(dst, 20, "%d-%02d-%02d %02d:%02d:%02d", exp.tm_year, exp.tm_mon + 1,
-		 exp.tm_mday, exp.tm_hour, exp.tm_min, exp.tm_sec);
+    apr_cpystrn(dst, cache->datetime, 20);
 
     return ( APR_SUCCESS );
 }
@@ -1870,42 +2129,43 @@ apr_status_t nx_date_to_rfc5424(char *dst,
 				apr_time_t t)
 {
     apr_status_t rv;
-    apr_time_exp_t exp;
+    const nx_date_cache_t *cache;
+    nx_date_cache_t tmp;
+    int32_t usec;
+    char buf[64];
+    char *ptr;
+    int i;
 
     ASSERT(dst != NULL);
     ASSERT(dstsize >= 33);
 
-    if ( gmt == TRUE )
+    if ( (rv = _date_cache_get(&cache, &usec, &tmp, t, gmt)) != APR_SUCCESS )
     {
-	if ( (rv = apr_time_exp_gmt(&exp, t)) != APR_SUCCESS )
-	{
-	    return ( rv );
-	}
-	if ( exp.tm_year < 1900 )
+	return ( rv );
+    }
+
+    memcpy(buf, cache->datetime, (size_t) cache->datetimelen);
+    buf[cache->datetimelen - 9] = 'T';
+    ptr = buf + cache->datetimelen;
+    if ( (usec >= 0) && (usec < APR_USEC_PER_SEC) )
+    {
+	*ptr++ = '.';
+	for ( i = 5; i >= 0; i-- )
 	{
-	    exp.tm_year += 1900;
+	    ptr[i] = (char) ('0' + usec % 10);
+	    usec /= 10;
 	}
-    
-	apr_snprintf(dst, 30, "%d-%02d-%02dT%02d:%02d:%02d.%06dZ", exp.tm_year, exp.tm_mon + 1,
-		     exp.tm_mday, exp.tm_hour, exp.tm_min, exp.tm_sec, exp.tm_usec);
+	ptr += 6;
     }
     else
-    { // localtime
-	if ( (rv = apr_time_exp_lt(&exp, t)) != APR_SUCCESS )
-	{
-	    return ( rv );
-	}
-	if ( exp.tm_year < 1900 )
-	{
-	    exp.tm_year += 1900;
-	}
-	apr_snprintf(dst, 33, "%d-%02d-%02dT%02d:%02d:%02d.%06d%+03d:%02d",
-		     exp.tm_year, exp.tm_mon + 1,
-		     exp.tm_mday, exp.tm_hour, exp.tm_min, exp.tm_sec,
-		     exp.tm_usec, exp.tm_gmtoff / 3600,
-		     (((exp.tm_gmtoff > 0) ? exp.tm_gmtoff : -exp.tm_gmtoff) /
-		      60) % 60);
+    {
+	ptr += apr_snprintf(ptr, 16, ".%06d", usec);
     }
+    memcpy(ptr, cache->offset, (size_t) cache->offsetlen);
+    ptr[cache->offsetlen] = '\0';
+
+    // the GMT format is at most 29 characters, the localtime one 32
+    apr_cpystrn(dst, buf, (gmt == TRUE) ? 30 : 33);
     
     return ( APR_SUCCESS );
 }
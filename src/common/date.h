@@ -1,6 +1,20 @@
 #ifndef __NX_DATE_H
 #define __NX_DATE_H
 
+/// order of the parsers tried by nx_date_parse()
+typedef enum nx_date_format_t
+{
+    NX_DATE_FORMAT_UNKNOWN = 0,
+    NX_DATE_FORMAT_RFC3164,
+    NX_DATE_FORMAT_RFC1123,
+    NX_DATE_FORMAT_ISO,
+    NX_DATE_FORMAT_APACHE,
+    NX_DATE_FORMAT_CISCO,
+    NX_DATE_FORMAT_WIN,
+    NX_DATE_FORMAT_TIMESTAMP,
+    NX_DATE_FORMAT_NUM,
+} nx_date_format_t;
+
 apr_status_t nx_date_parse_rfc3164(apr_time_t  *t, 
 				   const char *date,
 				   const char **dateend);
@@ -23,6 +37,10 @@ apr_status_t nx_date_parse_timestamp(apr_time_t  *t,
 				     const char *date,
 				     const char **dateend);
 apr_status_t nx_date_parse(apr_time_t *t, const char *date, const char **dateend);
+apr_status_t nx_date_parse_format(apr_time_t *t,
+				  const char *date,
+				  const char **dateend,
+				  nx_date_format_t *format);
 apr_status_t nx_date_to_rfc3164(char *datestr,
 				apr_size_t dstsize,
 				apr_time_t timeval);
@@ -38,5 +56,6 @@ apr_status_t nx_date_to_rfc5424(char *dst,
 				boolean gmt,
 				apr_time_t t);
 apr_status_t nx_date_fix_year(apr_time_t *t);
+void nx_date_thread_cleanup();
 
 #endif /* __NX_DATE_H */
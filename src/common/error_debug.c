@@ -12,6 +12,8 @@
 #include "exception.h"
 #include "backtrace.h"
 #include "date.h"
+#include "atomic.h"
+#include "../core/core.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
@@ -48,6 +50,27 @@ void nx_logger_disable_foreground()
 static apr_thread_mutex_t *_logger_mutex = NULL;
 
 
+
+static void log_lock()
+{
+    if ( _logger_mutex != NULL )
+    {
+	ASSERT(apr_thread_mutex_lock(_logger_mutex) == APR_SUCCESS);
+    }
+}
+
+
+
+static void log_unlock()
+{
+    if ( _logger_mutex != NULL )
+    {
+	ASSERT(apr_thread_mutex_unlock(_logger_mutex) == APR_SUCCESS);
+    }
+}
+
+
+
 void nx_logger_mutex_set(apr_thread_mutex_t *mutex)
 {
     ASSERT(mutex != NULL);
@@ -157,6 +180,62 @@ void nx_assertion_failed(nx_logmodule_t	logmodule,
 
 
 
+/*
+ * Internal logs are written by a dedicated thread while the worker threads
+ * run, so that a slow LogFile or console does not stall the callers of
+ * nx_log(). The callers format the message and put it into a bounded ring
+ * without taking a lock, if the ring is full the message is dropped and
+ * counted. Outside of nxlog_create_threads()..nxlog_wait_threads() and for
+ * critical messages the write is done by the caller. All writes are done
+ * under the logger mutex, which also protects the SuppressRepeatingLogs
+ * state.
+ */
+
+#define NX_LOGGER_CRITICAL_WAIT (APR_USEC_PER_SEC / 10) /* to flush the ring before an abort */
+
+typedef struct nx_logger_entry_t
+{
+    uint64_t		seq;		///< the ring position the entry can be written or read at
+    nx_loglevel_t	loglevel;
+    apr_time_t		time;
+    apr_size_t		len;
+    apr_size_t		msgoffs;	///< start of the message after the timestamp and level
+    char		message[NX_LOGBUF_SIZE];
+} nx_logger_entry_t;
+
+typedef struct nx_logger_t
+{
+    apr_pool_t		*pool;
+    nx_logger_entry_t	*ring;
+    uint64_t		tail;		///< next position claimed by a producer
+    uint64_t		head;		///< next position read by the logger thread
+    uint64_t		drops;		///< messages lost because the ring was full
+    uint64_t		drops_reported;
+    apr_thread_t	*thread;
+    apr_thread_mutex_t	*mutex;		///< only taken to wake up the idle logger thread
+    apr_thread_cond_t	*cond;
+    apr_uint32_t	running;	///< producers use the ring when set
+    apr_uint32_t	producers;	///< callers of nx_log() currently using the ring
+    apr_uint32_t	sleeping;	///< the logger thread waits on cond
+    apr_uint32_t	stop;
+    nx_ctx_t		*ctx;
+} nx_logger_t;
+
+/// state of SuppressRepeatingLogs, protected by the logger mutex
+typedef struct nx_logger_norepeat_t
+{
+    char		buf[NX_LOGBUF_SIZE];
+    apr_time_t		time;
+    int			cnt;
+    apr_size_t		offs;
+    nx_loglevel_t	loglevel;
+} nx_logger_norepeat_t;
+
+static nx_logger_t _logger;
+static nx_logger_norepeat_t _norepeat;
+
+
+
 static void write_log(const char	*message,
 		      apr_size_t	bytes,
 		      nx_loglevel_t	loglevel,
@@ -194,6 +273,449 @@ static void write_log(const char	*message,
 
 
 
+/**
+ * Write the timestamp and level of a log line to message if
+ * enabled, returns the offset of the message text.
+ */
+static apr_size_t log_format_header(nx_ctx_t		*ctx,
+				    char		*message,
+				    nx_loglevel_t	loglevel,
+				    apr_time_t		now)
+{
+    apr_size_t offs = 0;
+    const char *loglevelstr;
+    int i;
+
+    if ( ctx->formatlog == TRUE )
+    {
+	nx_date_to_iso(message, NX_LOGBUF_SIZE, now);
+	message[19] = ' ';
+	offs = 20;
+	loglevelstr = nx_loglevel_to_string(loglevel);
+	for ( i = 0; loglevelstr[i] != '\0'; i++ )
+	{
+	    message[offs] = loglevelstr[i];
+	    offs++;
+	    ASSERT(offs < NX_LOGBUF_SIZE);
+	}
+	message[offs] = ' ';
+	offs++;
+    }
+
+    return ( offs );
+}
+
+
+
+/**
+ * Write 'last message repeated n times' for the suppressed messages.
+ */
+static void log_write_repeated(nx_ctx_t *ctx, apr_time_t now)
+{
+    char tmpmsg[NX_LOGBUF_SIZE];
+    apr_size_t msgoffs;
+
+    if ( _norepeat.cnt > 1 )
+    {
+	if ( ctx->formatlog == TRUE )
+	{
+	    nx_date_to_iso(tmpmsg, sizeof(tmpmsg), now);
+	    msgoffs = strlen(tmpmsg);
+	    msgoffs += (apr_size_t) apr_snprintf(tmpmsg + msgoffs, NX_LOGBUF_SIZE - msgoffs,
+						 " %s last message repeated %d times"NX_LINEFEED,
+						 nx_loglevel_to_string(_norepeat.loglevel),
+						 _norepeat.cnt);
+	}
+	else
+	{
+	    msgoffs = (apr_size_t) apr_snprintf(tmpmsg, NX_LOGBUF_SIZE,
+						"last message repeated %d times"NX_LINEFEED,
+						_norepeat.cnt);
+	}
+	write_log(tmpmsg, msgoffs, NX_LOGLEVEL_INFO, ctx->logfile);
+    }
+    else if ( _norepeat.cnt == 1 )
+    {
+	write_log(_norepeat.buf, strlen(_norepeat.buf), NX_LOGLEVEL_INFO, ctx->logfile);
+    }
+}
+
+
+
+/**
+ * Write a formatted log line applying SuppressRepeatingLogs. Called with
+ * the logger mutex held.
+ */
+static void log_output(nx_ctx_t		*ctx,
+		       char		*message,
+		       apr_size_t	offs,
+		       apr_size_t	msgoffs,
+		       nx_loglevel_t	loglevel,
+		       apr_time_t	now)
+{
+    if ( (ctx->norepeat == TRUE) && (loglevel >= NX_LOGLEVEL_INFO) )
+    {
+	if ( strcmp(_norepeat.buf + _norepeat.offs, message + msgoffs) == 0 )
+	{
+	    (_norepeat.cnt)++;
+	    if ( _norepeat.time == 0 )
+	    {
+		_norepeat.time = now;
+	    }
+	    if ( _norepeat.time + NX_LOGGER_NOREPEAT_INTERVAL <= now )
+	    {
+		_norepeat.time = now;
+		if ( _norepeat.cnt > 1 )
+		{
+		    msgoffs += (apr_size_t) apr_snprintf(message + msgoffs, NX_LOGBUF_SIZE - msgoffs,
+							 "last message repeated %d times"NX_LINEFEED,
+							 _norepeat.cnt);
+		    offs = msgoffs;
+		    _norepeat.cnt = -1;
+		}
+		else
+		{ //print original
+		    _norepeat.cnt = 0;
+		}
+	    }
+	    else
+	    {
+		if ( _norepeat.cnt > 0 )
+		{
+		    return; //we suppress here
+		}
+	    }
+	}
+	else
+	{ // we have a different log message
+	    _norepeat.offs = msgoffs;
+	    log_write_repeated(ctx, now);
+
+	    _norepeat.cnt = 0;
+	    _norepeat.time = now;
+	    memcpy(_norepeat.buf, message, NX_LOGBUF_SIZE);
+	    _norepeat.loglevel = loglevel;
+	}
+    }
+
+    write_log(message, offs, loglevel, ctx->logfile);
+}
+
+
+
+/**
+ * Flush the suppressed repeats when no new message came in for a while,
+ * otherwise they would only show up with the next different message.
+ */
+static void log_flush_repeated(nx_ctx_t *ctx, apr_time_t now)
+{
+    if ( (ctx->norepeat != TRUE) || (_norepeat.cnt <= 0) ||
+	 (_norepeat.time + NX_LOGGER_NOREPEAT_INTERVAL > now) )
+    {
+	return;
+    }
+
+    log_write_repeated(ctx, now);
+    _norepeat.cnt = 0;
+    _norepeat.time = now;
+}
+
+
+
+/**
+ * Claim a slot in the ring and copy the message. Returns FALSE if the ring
+ * is full. This is the bounded MPMC queue from Dmitry Vyukov with a single
+ * consumer: a slot whose seq equals the position is free, seq == pos + 1
+ * means it holds a message.
+ */
+static boolean log_enqueue(const char		*message,
+			   apr_size_t		len,
+			   apr_size_t		msgoffs,
+			   nx_loglevel_t	loglevel,
+			   apr_time_t		now)
+{
+    nx_logger_entry_t *entry;
+    uint64_t pos, seq;
+
+    pos = __atomic_load_n(&(_logger.tail), __ATOMIC_RELAXED);
+    for ( ; ; )
+    {
+	entry = &(_logger.ring[pos & (NX_LOGGER_RING_SIZE - 1)]);
+	seq = __atomic_load_n(&(entry->seq), __ATOMIC_ACQUIRE);
+	if ( seq == pos )
+	{
+	    if ( __atomic_compare_exchange_n(&(_logger.tail), &pos, pos + 1, TRUE,
+					     __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+	    {
+		break;
+	    }
+	    // pos was updated with the current tail
+	}
+	else if ( seq < pos )
+	{ // the logger thread didn't free this slot yet
+	    nx_atomic_add64(&(_logger.drops), 1);
+	    return ( FALSE );
+	}
+	else
+	{ // another producer took it
+	    pos = __atomic_load_n(&(_logger.tail), __ATOMIC_RELAXED);
+	}
+    }
+
+    memcpy(entry->message, message, len + 1);
+    entry->len = len;
+    entry->msgoffs = msgoffs;
+    entry->loglevel = loglevel;
+    entry->time = now;
+    __atomic_store_n(&(entry->seq), pos + 1, __ATOMIC_RELEASE);
+
+    if ( nx_atomic_read32(&(_logger.sleeping)) != 0 )
+    {
+	CHECKERR(apr_thread_mutex_lock(_logger.mutex));
+	CHECKERR(apr_thread_cond_signal(_logger.cond));
+	CHECKERR(apr_thread_mutex_unlock(_logger.mutex));
+    }
+
+    return ( TRUE );
+}
+
+
+
+/**
+ * Queue a message for the logger thread if it is running. Returns FALSE
+ * if the caller has to write it. The producers using the ring are counted
+ * so that nx_logger_stop() can wait for those which saw the logger running
+ * before the ring is drained for the last time.
+ */
+static boolean log_submit(const char		*message,
+			  apr_size_t		len,
+			  apr_size_t		msgoffs,
+			  nx_loglevel_t		loglevel,
+			  apr_time_t		now)
+{
+    boolean retval = FALSE;
+
+    __atomic_add_fetch(&(_logger.producers), 1, __ATOMIC_SEQ_CST);
+    if ( __atomic_load_n(&(_logger.running), __ATOMIC_SEQ_CST) != 0 )
+    {
+	log_enqueue(message, len, msgoffs, loglevel, now);
+	retval = TRUE;
+    }
+    __atomic_sub_fetch(&(_logger.producers), 1, __ATOMIC_SEQ_CST);
+
+    return ( retval );
+}
+
+
+
+/**
+ * Write the messages queued in the ring. Returns FALSE if it was empty.
+ * Called with the logger mutex held.
+ */
+static boolean log_dequeue(nx_ctx_t *ctx)
+{
+    nx_logger_entry_t *entry;
+    uint64_t pos;
+    boolean retval = FALSE;
+
+    for ( ; ; )
+    {
+	pos = _logger.head;
+	entry = &(_logger.ring[pos & (NX_LOGGER_RING_SIZE - 1)]);
+	if ( __atomic_load_n(&(entry->seq), __ATOMIC_ACQUIRE) != pos + 1 )
+	{
+	    break;
+	}
+	log_output(ctx, entry->message, entry->len, entry->msgoffs, entry->loglevel, entry->time);
+	__atomic_store_n(&(entry->seq), pos + NX_LOGGER_RING_SIZE, __ATOMIC_RELEASE);
+	__atomic_store_n(&(_logger.head), pos + 1, __ATOMIC_RELEASE);
+	retval = TRUE;
+    }
+
+    return ( retval );
+}
+
+
+
+static void log_report_drops(nx_ctx_t *ctx)
+{
+    char message[NX_LOGBUF_SIZE];
+    apr_size_t offs;
+    uint64_t drops;
+    apr_time_t now;
+
+    drops = nx_atomic_read64(&(_logger.drops));
+    if ( drops == _logger.drops_reported )
+    {
+	return;
+    }
+
+    now = apr_time_now();
+    offs = log_format_header(ctx, message, NX_LOGLEVEL_WARNING, now);
+    offs += (apr_size_t) apr_snprintf(message + offs, NX_LOGBUF_SIZE - offs,
+				      "%"APR_UINT64_T_FMT" internal log messages were dropped"
+				      " because the logger queue was full"NX_LINEFEED,
+				      drops - _logger.drops_reported);
+    write_log(message, offs, NX_LOGLEVEL_WARNING, ctx->logfile);
+    _logger.drops_reported = drops;
+}
+
+
+
+static void* APR_THREAD_FUNC nx_logger_thread(apr_thread_t *thd, void *data UNUSED)
+{
+    nx_ctx_t *ctx;
+    apr_status_t rv;
+
+    ctx = _logger.ctx;
+
+    for ( ; ; )
+    {
+	log_lock();
+	if ( log_dequeue(ctx) == TRUE )
+	{
+	    log_report_drops(ctx);
+	    log_unlock();
+	    continue;
+	}
+	log_report_drops(ctx);
+	log_flush_repeated(ctx, apr_time_now());
+	log_unlock();
+
+	if ( nx_atomic_read32(&(_logger.stop)) != 0 )
+	{
+	    break;
+	}
+
+	// producers signal only after seeing sleeping set, check the ring again after setting it
+	CHECKERR(apr_thread_mutex_lock(_logger.mutex));
+	nx_atomic_set32(&(_logger.sleeping), 1);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if ( (__atomic_load_n(&(_logger.ring[_logger.head & (NX_LOGGER_RING_SIZE - 1)].seq),
+			      __ATOMIC_ACQUIRE) != _logger.head + 1) &&
+	     (nx_atomic_read32(&(_logger.stop)) == 0) )
+	{
+	    rv = apr_thread_cond_timedwait(_logger.cond, _logger.mutex, APR_USEC_PER_SEC);
+	    if ( (rv != APR_SUCCESS) && !APR_STATUS_IS_TIMEUP(rv) )
+	    {
+		CHECKERR(rv);
+	    }
+	}
+	nx_atomic_set32(&(_logger.sleeping), 0);
+	CHECKERR(apr_thread_mutex_unlock(_logger.mutex));
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+
+    return ( NULL );
+}
+
+
+
+/**
+ * Start writing the internal logs from a dedicated thread, called
+ * when the worker threads are created.
+ */
+void nx_logger_start()
+{
+    nx_ctx_t *ctx;
+    nx_logger_entry_t *ring;
+    int i;
+
+    ctx = nx_ctx_get();
+    ASSERT(ctx != NULL);
+
+    if ( nx_atomic_read32(&(_logger.running)) != 0 )
+    {
+	return;
+    }
+
+    if ( _logger.pool == NULL )
+    { // the ring is kept for the lifetime of the process
+	_logger.pool = nx_pool_create_core();
+	ring = apr_palloc(_logger.pool, sizeof(nx_logger_entry_t) * NX_LOGGER_RING_SIZE);
+	for ( i = 0; i < NX_LOGGER_RING_SIZE; i++ )
+	{
+	    ring[i].seq = (uint64_t) i;
+	}
+	_logger.ring = ring;
+	CHECKERR(apr_thread_mutex_create(&(_logger.mutex), APR_THREAD_MUTEX_UNNESTED, _logger.pool));
+	CHECKERR(apr_thread_cond_create(&(_logger.cond), _logger.pool));
+    }
+
+    _logger.ctx = ctx;
+    nx_atomic_set32(&(_logger.stop), 0);
+    nx_thread_create(&(_logger.thread), NULL, nx_logger_thread, NULL, _logger.pool);
+    nx_atomic_set32(&(_logger.running), 1);
+}
+
+
+
+/**
+ * Stop the logger thread after it has written the queued messages, the
+ * callers of nx_log() write synchronously afterwards.
+ */
+void nx_logger_stop()
+{
+    apr_status_t rv;
+
+    if ( nx_atomic_read32(&(_logger.running)) == 0 )
+    {
+	return;
+    }
+
+    __atomic_store_n(&(_logger.running), 0, __ATOMIC_SEQ_CST);
+    // a producer which saw the logger running may still be enqueueing
+    while ( __atomic_load_n(&(_logger.producers), __ATOMIC_SEQ_CST) != 0 )
+    {
+	apr_thread_yield();
+    }
+    nx_atomic_set32(&(_logger.stop), 1);
+    CHECKERR(apr_thread_mutex_lock(_logger.mutex));
+    CHECKERR(apr_thread_cond_signal(_logger.cond));
+    CHECKERR(apr_thread_mutex_unlock(_logger.mutex));
+    apr_thread_join(&rv, _logger.thread);
+    _logger.thread = NULL;
+
+    // messages enqueued while stopping
+    log_lock();
+    log_dequeue(_logger.ctx);
+    log_report_drops(_logger.ctx);
+    log_unlock();
+    _logger.ctx = NULL;
+}
+
+
+
+/**
+ * Number of internal log messages dropped because the logger thread
+ * could not keep up.
+ */
+uint64_t nx_logger_get_drops()
+{
+    return ( nx_atomic_read64(&(_logger.drops)) );
+}
+
+
+
+/**
+ * Give the logger thread a chance to write the queued messages before
+ * a critical message which may be followed by an abort.
+ */
+static void log_wait_empty()
+{
+    apr_time_t start;
+
+    start = apr_time_now();
+    while ( (__atomic_load_n(&(_logger.tail), __ATOMIC_ACQUIRE) != __atomic_load_n(&(_logger.head), __ATOMIC_ACQUIRE)) &&
+	    (apr_time_now() - start < NX_LOGGER_CRITICAL_WAIT) )
+    {
+	apr_sleep(1000);
+    }
+}
+
+
+
 void nx_log(apr_status_t	code,
 	    nx_loglevel_t	loglevel,
 	    nx_logmodule_t	logmodule,	///< module
@@ -262,27 +784,12 @@ void nx_log(apr_status_t	code,
 	    va_list ap;
 	    apr_size_t offs = 0;
 	    apr_size_t msgoffs = 0;
-	    const char *loglevelstr;
 	    int i;
 	    apr_time_t now;
 
 	    now = apr_time_now();
 
-	    if ( ctx->formatlog == TRUE )
-	    {
-		nx_date_to_iso(message, sizeof(message), now);
-		message[19] = ' ';
-		offs = 20;
-		loglevelstr = nx_loglevel_to_string(loglevel);
-		for ( i = 0; loglevelstr[i] != '\0'; i++ )
-		{
-		    message[offs] = loglevelstr[i];
-		    offs++;
-		    ASSERT(offs < NX_LOGBUF_SIZE);
-		}
-		message[offs] = ' ';
-		offs++;
-	    }
+	    offs = log_format_header(ctx, message, loglevel, now);
 	    msgoffs = offs;
 	    va_start(ap, fmt);
 	    offs += (apr_size_t) apr_vsnprintf(message + offs, NX_LOGBUF_SIZE - offs, fmt, ap);
@@ -325,80 +832,21 @@ void nx_log(apr_status_t	code,
 #endif
 	    message[offs] = '\0';
 
-	    if ( (ctx->norepeat == TRUE) && (loglevel >= NX_LOGLEVEL_INFO) )
+	    if ( loglevel < NX_LOGLEVEL_CRITICAL )
 	    {
-		//ASSERT(apr_thread_mutex_lock(_logger_mutex) == APR_SUCCESS);
-		if ( strcmp(ctx->norepeat_buf + ctx->norepeat_offs, message + msgoffs) == 0 )
+		if ( log_submit(message, offs, msgoffs, loglevel, now) == TRUE )
 		{
-		    (ctx->norepeat_cnt)++;
-		    if ( ctx->norepeat_time == 0 )
-		    {
-			ctx->norepeat_time = now;
-		    }
-		    if ( ctx->norepeat_time + APR_USEC_PER_SEC * 3 <= now )
-		    {
-			ctx->norepeat_time = now;
-			if ( ctx->norepeat_cnt > 1 )
-			{
-			    msgoffs += (apr_size_t) apr_snprintf(message + msgoffs, NX_LOGBUF_SIZE - msgoffs,
-								 "last message repeated %d times"NX_LINEFEED,
-								 ctx->norepeat_cnt);
-			    offs = msgoffs;
-			    ctx->norepeat_cnt = -1;
-			}
-		        else
-			{ //print original
-			    ctx->norepeat_cnt = 0;
-			}
-		    }
-		    else
-		    {
-			if ( ctx->norepeat_cnt > 0 )
-			{
-			    return; //we suppress here
-			}
-
-			// TODO: add an event to flush logs after 1 sec , see pm_norepeat
-		    }
+		    return;
 		}
-		else
-		{ // we have a different log message
-		    ctx->norepeat_offs = msgoffs;
-		    if ( ctx->norepeat_cnt > 1 )
-		    {
-			char tmpmsg[NX_LOGBUF_SIZE];
-
-			if ( ctx->formatlog == TRUE )
-			{
-			    nx_date_to_iso(tmpmsg, sizeof(tmpmsg), now);
-			    msgoffs = strlen(tmpmsg);
-			    msgoffs += (apr_size_t) apr_snprintf(tmpmsg + msgoffs, NX_LOGBUF_SIZE - msgoffs,
-								 " %s last message repeated %d times"NX_LINEFEED,
-								 nx_loglevel_to_string(ctx->norepeat_loglevel),
-								 ctx->norepeat_cnt);
-			}
-			else
-			{
-			    msgoffs = (apr_size_t) apr_snprintf(tmpmsg, NX_LOGBUF_SIZE,
-								"last message repeated %d times"NX_LINEFEED,
-								ctx->norepeat_cnt);
-			}
-			write_log(tmpmsg, msgoffs, NX_LOGLEVEL_INFO, ctx->logfile);
-		    }
-		    else if ( ctx->norepeat_cnt == 1 )
-		    {
-			write_log(ctx->norepeat_buf, strlen(ctx->norepeat_buf), NX_LOGLEVEL_INFO, ctx->logfile);
-		    }
-
-		    ctx->norepeat_cnt = 0;
-		    ctx->norepeat_time = now;
-		    memcpy(ctx->norepeat_buf, message, NX_LOGBUF_SIZE);
-		    ctx->norepeat_loglevel = loglevel;
-		}
-		//ASSERT(apr_thread_mutex_unlock(_logger_mutex) == APR_SUCCESS);
+	    }
+	    else if ( nx_atomic_read32(&(_logger.running)) != 0 )
+	    { // let the queued messages go first, a critical message may be followed by an abort
+		log_wait_empty();
 	    }
 
-	    write_log(message, offs, loglevel, ctx->logfile);
+	    log_lock();
+	    log_output(ctx, message, offs, msgoffs, loglevel, now);
+	    log_unlock();
 	}
     }
 }
@@ -11,6 +11,8 @@
 #include "types.h"
 
 #define NX_LOGBUF_SIZE 1024
+#define NX_LOGGER_RING_SIZE 512 /* messages queued for the logger thread, must be a power of 2 */
+#define NX_LOGGER_NOREPEAT_INTERVAL (APR_USEC_PER_SEC * 3) /* flush suppressed repeats after this */
 
 
 typedef enum nx_loglevel_t
@@ -56,6 +58,9 @@ typedef enum nx_logmodule_t
 #define nx_abort(fmt, args...) _nx_panic(__FILE__, __LINE__, __FUNCTION__, NX_LOGMODULE, fmt , ## args )
 
 void nx_logger_mutex_set(apr_thread_mutex_t *mutex);
+void nx_logger_start();
+void nx_logger_stop();
+uint64_t nx_logger_get_drops();
 const char *nx_loglevel_to_string(nx_loglevel_t type);
 nx_loglevel_t nx_loglevel_from_string(const char *str);
 const char *nx_logmodule_to_string(nx_logmodule_t module);
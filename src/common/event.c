@@ -438,7 +438,10 @@ void nx_event_process(nx_event_t *event)
 	    nx_module_var_expiry(module, event);
 	    break;
 	case NX_EVENT_STAT_EXPIRY:
+	    // module->stats is also read by the metrics exporter
+	    nx_module_lock(module);
 	    nx_module_stat_expiry(module, event);
+	    nx_module_unlock(module);
 	    break;
 	default:
 	    ASSERT(module->decl->event != NULL);
@@ -14,6 +14,7 @@
 #include "../core/nxlog.h"
 #include "../core/ctx.h"
 #include "alloc.h"
+#include "atomic.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
@@ -540,7 +541,7 @@ void nx_expr_func__to_datetime(nx_expr_eval_ctx_t *eval_ctx UNUSED,
 
 
 
-void nx_expr_func__parsedate(nx_expr_eval_ctx_t *eval_ctx UNUSED,
+void nx_expr_func__parsedate(nx_expr_eval_ctx_t *eval_ctx,
 			     nx_module_t *module UNUSED,
 			     nx_value_t *retval,
 			     int32_t num_arg,
@@ -562,7 +563,8 @@ void nx_expr_func__parsedate(nx_expr_eval_ctx_t *eval_ctx UNUSED,
 	return;
     }
 
-    if ( nx_date_parse(&(retval->datetime), args[0].string->buf, NULL) == APR_SUCCESS )
+    if ( nx_date_parse_format(&(retval->datetime), args[0].string->buf, NULL,
+			      (eval_ctx->module == NULL) ? NULL : &(eval_ctx->module->date_format)) == APR_SUCCESS )
     {
 	retval->defined = TRUE;
     }
@@ -834,10 +836,11 @@ static void nx_expr_proc__log(nx_expr_eval_ctx_t *eval_ctx,
     int i, j;
     nx_expr_list_elem_t *arg;
     char *buf;
-    char **argvalues;
+    const char **argvalues;
     char *tmpstr;
     nx_value_t value;
     size_t len = 0;
+    nx_scratch_mark_t mark;
 
     ASSERT(args != NULL);
 
@@ -845,7 +848,8 @@ static void nx_expr_proc__log(nx_expr_eval_ctx_t *eval_ctx,
 	  arg != NULL;
 	  arg = NX_DLIST_NEXT(arg, link), i++ );
 
-    argvalues = malloc((size_t) i * sizeof(char *));
+    nx_scratch_mark(&mark);
+    argvalues = nx_scratch_alloc((size_t) i * sizeof(char *));
 
     for ( i = 0, arg = NX_DLIST_FIRST(args);
 	  arg != NULL;
@@ -853,29 +857,27 @@ static void nx_expr_proc__log(nx_expr_eval_ctx_t *eval_ctx,
     {
 	ASSERT(arg->expr != NULL);
 	nx_expr_evaluate(eval_ctx, &value, arg->expr);
-	argvalues[i] = nx_value_to_string(&value);
+	argvalues[i] = nx_value_to_scratch_string(&value);
 	nx_value_kill(&value);
 	if ( argvalues[i] == NULL )
 	{
-	    argvalues[i] = strdup("");
+	    argvalues[i] = "";
 	}
 	len += strlen(argvalues[i]);
     }
 
-    buf = malloc(len + 1);
+    buf = nx_scratch_alloc(len + 1);
     tmpstr = buf;
     for ( j = 0; j < i; j++ )
     {
 	ASSERT(argvalues[j] != NULL);
 	memcpy(tmpstr, argvalues[j], strlen(argvalues[j]));
 	tmpstr += strlen(argvalues[j]);
-	free(argvalues[j]);
     }
     ASSERT(tmpstr == buf + len);
     buf[len] = '\0';
     nx_log(APR_SUCCESS, loglevel, NX_LOGMODULE_CORE, "%s", buf);
-    free(buf);
-    free(argvalues);
+    nx_scratch_release(&mark);
 }
 
 
@@ -1802,9 +1804,7 @@ void nx_expr_proc__add_to_route(nx_expr_eval_ctx_t *eval_ctx,
     }
     nx_value_kill(&routeval);
 
-    nx_module_lock(module);
-    (module->evt_fwd)++;
-    nx_module_unlock(module);
+    nx_atomic_add64(&(module->evt_fwd), 1);
 
     nx_module_add_logdata_to_route(module, route, logdata);
 }
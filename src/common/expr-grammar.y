@@ -9,6 +9,7 @@
 #include "error_debug.h"
 #include "expr.h"
 #include "expr-parser.h"
+#include "expr-vm.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 extern int nx_expr_parser_lex();
@@ -393,6 +394,7 @@ nx_expr_statement_list_t *nx_expr_parse_statements(nx_module_t *module,
     nx_expr_parser_t parser;
 
     parser_do(&parser, module, str, FALSE, pool, filename, currline, currpos);
+    nx_expr_statement_list_compile(pool, parser.statements);
 
     return ( parser.statements );
 }
@@ -0,0 +1,551 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "error_debug.h"
+#include "expr-vm.h"
+#include "expr-grammar.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_CORE
+
+
+
+static boolean _value_is_true(const nx_value_t *value)
+{
+    if ( (value->defined == FALSE) ||
+	 ((value->type == NX_VALUE_TYPE_BOOLEAN) && (value->boolean == FALSE)) ||
+	 ((value->type == NX_VALUE_TYPE_INTEGER) && (value->integer == 0)) )
+    {
+	return ( FALSE );
+    }
+
+    return ( TRUE );
+}
+
+
+
+static int32_t _count_insn(const nx_expr_statement_t *stmnt)
+{
+    const nx_expr_statement_t *child;
+    int32_t retval = 0;
+
+    if ( stmnt == NULL )
+    {
+	return ( 0 );
+    }
+
+    switch ( stmnt->type )
+    {
+	case NX_EXPR_STATEMENT_TYPE_BLOCK:
+	    if ( stmnt->block.statements != NULL )
+	    {
+		for ( child = NX_DLIST_FIRST(stmnt->block.statements);
+		      child != NULL;
+		      child = NX_DLIST_NEXT(child, link) )
+		{
+		    retval += _count_insn(child);
+		}
+	    }
+	    break;
+	case NX_EXPR_STATEMENT_TYPE_IFELSE:
+	    // condition + jump over the else branch
+	    retval = 2 + _count_insn(stmnt->ifelse.cond_true) + _count_insn(stmnt->ifelse.cond_false);
+	    break;
+	default:
+	    retval = 1;
+	    break;
+    }
+
+    return ( retval );
+}
+
+
+
+static int32_t _count_scope(const nx_expr_statement_t *stmnt)
+{
+    const nx_expr_statement_t *child;
+    int32_t retval = 0;
+
+    if ( stmnt == NULL )
+    {
+	return ( 0 );
+    }
+
+    switch ( stmnt->type )
+    {
+	case NX_EXPR_STATEMENT_TYPE_BLOCK:
+	    if ( stmnt->block.statements != NULL )
+	    {
+		for ( child = NX_DLIST_FIRST(stmnt->block.statements);
+		      child != NULL;
+		      child = NX_DLIST_NEXT(child, link) )
+		{
+		    retval += _count_scope(child);
+		}
+	    }
+	    break;
+	case NX_EXPR_STATEMENT_TYPE_IFELSE:
+	    retval = 1 + _count_scope(stmnt->ifelse.cond_true) + _count_scope(stmnt->ifelse.cond_false);
+	    break;
+	default:
+	    break;
+    }
+
+    return ( retval );
+}
+
+
+
+static nx_expr_insn_t *_emit(nx_expr_program_t *program,
+			     nx_expr_opcode_t opcode,
+			     const nx_expr_statement_t *stmnt,
+			     int32_t scope)
+{
+    nx_expr_insn_t *insn;
+
+    insn = &(program->insns[program->num_insn]);
+    (program->num_insn)++;
+    insn->opcode = opcode;
+    insn->stmnt = stmnt;
+    insn->scope = scope;
+    insn->target = -1;
+
+    return ( insn );
+}
+
+
+
+static boolean _is_comparable_constant(const nx_expr_t *expr)
+{
+    if ( (expr->type != NX_EXPR_TYPE_VALUE) || (expr->value.defined == FALSE) )
+    {
+	return ( FALSE );
+    }
+
+    switch ( expr->value.type )
+    {
+	case NX_VALUE_TYPE_STRING:
+	case NX_VALUE_TYPE_INTEGER:
+	case NX_VALUE_TYPE_BOOLEAN:
+	case NX_VALUE_TYPE_DATETIME:
+	case NX_VALUE_TYPE_IP4ADDR:
+	    return ( TRUE );
+	default:
+	    break;
+    }
+
+    return ( FALSE );
+}
+
+
+
+/**
+ * Pick an opcode for the condition of an if statement.
+ * The generic one evaluates the expression tree.
+ */
+static void _compile_condition(nx_expr_insn_t *insn, const nx_expr_t *cond)
+{
+    const nx_expr_t *left, *right, *op;
+
+    insn->opcode = NX_EXPR_OP_JUMP_UNLESS;
+    insn->cond = cond;
+
+    if ( cond->type == NX_EXPR_TYPE_BINOP )
+    {
+	if ( !((cond->binop.token == TOKEN_EQUAL) || (cond->binop.token == TOKEN_NOTEQUAL)) )
+	{
+	    return;
+	}
+	left = cond->binop.left;
+	right = cond->binop.right;
+	if ( (left->type == NX_EXPR_TYPE_VALUE) && (right->type == NX_EXPR_TYPE_FIELD) )
+	{ // 'constant' == $field
+	    left = cond->binop.right;
+	    right = cond->binop.left;
+	}
+	if ( (left->type != NX_EXPR_TYPE_FIELD) || (_is_comparable_constant(right) != TRUE) )
+	{
+	    return;
+	}
+	insn->opcode = (cond->binop.token == TOKEN_EQUAL) ?
+	    NX_EXPR_OP_JUMP_UNLESS_EQUAL : NX_EXPR_OP_JUMP_UNLESS_NOTEQUAL;
+	insn->field = left->field;
+	insn->value = &(right->value);
+    }
+    else if ( cond->type == NX_EXPR_TYPE_UNOP )
+    {
+	op = cond->unop.op;
+	if ( (cond->unop.token == TOKEN_DEFINED) && (op->type == NX_EXPR_TYPE_FIELD) )
+	{
+	    insn->opcode = NX_EXPR_OP_JUMP_UNLESS_DEFINED;
+	    insn->field = op->field;
+	}
+	else if ( (cond->unop.token == TOKEN_NOT) && (op->type == NX_EXPR_TYPE_UNOP) &&
+		  (op->unop.token == TOKEN_DEFINED) && (op->unop.op->type == NX_EXPR_TYPE_FIELD) )
+	{
+	    insn->opcode = NX_EXPR_OP_JUMP_IF_DEFINED;
+	    insn->field = op->unop.op->field;
+	}
+    }
+}
+
+
+
+static void _compile_statement(nx_expr_program_t *program,
+			       const nx_expr_statement_t *stmnt,
+			       int32_t scope)
+{
+    const nx_expr_statement_t *child;
+    nx_expr_insn_t *insn;
+    int32_t cond_idx, jump_idx;
+    int32_t ifscope;
+
+    if ( stmnt == NULL )
+    {
+	return;
+    }
+
+    switch ( stmnt->type )
+    {
+	case NX_EXPR_STATEMENT_TYPE_BLOCK:
+	    if ( stmnt->block.statements != NULL )
+	    {
+		for ( child = NX_DLIST_FIRST(stmnt->block.statements);
+		      child != NULL;
+		      child = NX_DLIST_NEXT(child, link) )
+		{
+		    _compile_statement(program, child, scope);
+		}
+	    }
+	    break;
+	case NX_EXPR_STATEMENT_TYPE_IFELSE:
+	    ifscope = program->num_scope;
+	    (program->num_scope)++;
+	    program->scopes[ifscope].stmnt = stmnt;
+	    program->scopes[ifscope].parent = scope;
+
+	    if ( stmnt->ifelse.cond->type == NX_EXPR_TYPE_VALUE )
+	    { // constant condition, only one of the branches is compiled
+		if ( _value_is_true(&(stmnt->ifelse.cond->value)) == TRUE )
+		{
+		    _compile_statement(program, stmnt->ifelse.cond_true, ifscope);
+		}
+		else
+		{
+		    _compile_statement(program, stmnt->ifelse.cond_false, ifscope);
+		}
+		break;
+	    }
+
+	    cond_idx = program->num_insn;
+	    insn = _emit(program, NX_EXPR_OP_JUMP_UNLESS, stmnt, ifscope);
+	    _compile_condition(insn, stmnt->ifelse.cond);
+	    _compile_statement(program, stmnt->ifelse.cond_true, ifscope);
+	    if ( stmnt->ifelse.cond_false != NULL )
+	    {
+		jump_idx = program->num_insn;
+		_emit(program, NX_EXPR_OP_JUMP, stmnt, ifscope);
+		program->insns[cond_idx].target = program->num_insn;
+		_compile_statement(program, stmnt->ifelse.cond_false, ifscope);
+		program->insns[jump_idx].target = program->num_insn;
+	    }
+	    else
+	    {
+		program->insns[cond_idx].target = program->num_insn;
+	    }
+	    break;
+	case NX_EXPR_STATEMENT_TYPE_ASSIGNMENT:
+	    if ( stmnt->assignment.rval->type == NX_EXPR_TYPE_VALUE )
+	    {
+		insn = _emit(program, NX_EXPR_OP_ASSIGN_CONST, stmnt, scope);
+		insn->field = stmnt->assignment.lval->field;
+		insn->value = &(stmnt->assignment.rval->value);
+	    }
+	    else
+	    {
+		_emit(program, NX_EXPR_OP_STATEMENT, stmnt, scope);
+	    }
+	    break;
+	default:
+	    _emit(program, NX_EXPR_OP_STATEMENT, stmnt, scope);
+	    break;
+    }
+}
+
+
+
+nx_expr_program_t *nx_expr_program_compile(apr_pool_t *pool,
+					   const nx_expr_statement_list_t *stmnts)
+{
+    nx_expr_program_t *program;
+    const nx_expr_statement_t *stmnt;
+    int32_t num_insn = 0;
+    int32_t num_scope = 0;
+
+    ASSERT(pool != NULL);
+    ASSERT(stmnts != NULL);
+
+    for ( stmnt = NX_DLIST_FIRST(stmnts);
+	  stmnt != NULL;
+	  stmnt = NX_DLIST_NEXT(stmnt, link) )
+    {
+	num_insn += _count_insn(stmnt);
+	num_scope += _count_scope(stmnt);
+    }
+
+    program = apr_pcalloc(pool, sizeof(nx_expr_program_t));
+    program->first = NX_DLIST_FIRST(stmnts);
+    program->last = NX_DLIST_LAST(stmnts);
+    program->insns = apr_pcalloc(pool, sizeof(nx_expr_insn_t) * (size_t) (num_insn + 1));
+    program->scopes = apr_pcalloc(pool, sizeof(nx_expr_scope_t) * (size_t) (num_scope + 1));
+
+    for ( stmnt = NX_DLIST_FIRST(stmnts);
+	  stmnt != NULL;
+	  stmnt = NX_DLIST_NEXT(stmnt, link) )
+    {
+	_compile_statement(program, stmnt, -1);
+    }
+    ASSERT(program->num_insn <= num_insn);
+    ASSERT(program->num_scope <= num_scope);
+
+    log_debug("statement list compiled into %d instructions", program->num_insn);
+
+    return ( program );
+}
+
+
+
+/**
+ * Compile the list and attach the result to it. This must be called again
+ * when statements are added to the list, otherwise the tree is walked.
+ */
+void nx_expr_statement_list_compile(apr_pool_t *pool,
+				    nx_expr_statement_list_t *stmnts)
+{
+    if ( stmnts == NULL )
+    {
+	return;
+    }
+
+    stmnts->program = nx_expr_program_compile(pool, stmnts);
+}
+
+
+
+boolean nx_expr_program_valid(const nx_expr_program_t *program,
+			      const nx_expr_statement_list_t *stmnts)
+{
+    if ( program == NULL )
+    {
+	return ( FALSE );
+    }
+
+    if ( (program->first != NX_DLIST_FIRST(stmnts)) ||
+	 (program->last != NX_DLIST_LAST(stmnts)) )
+    {
+	return ( FALSE );
+    }
+
+    return ( TRUE );
+}
+
+
+
+static boolean _eval_condition(nx_expr_eval_ctx_t *eval_ctx,
+			       const nx_expr_t *cond)
+{
+    nx_value_t value;
+    boolean retval;
+
+    nx_expr_evaluate(eval_ctx, &value, cond);
+    retval = _value_is_true(&value);
+    nx_value_kill(&value);
+
+    return ( retval );
+}
+
+
+
+/**
+ * Same as _equal() in expr.c without copying the field value.
+ * Returns -1 when the generic code path must be used (type mismatch or no logdata)
+ * so that the same exception is thrown.
+ */
+static int _field_equals(nx_expr_eval_ctx_t *eval_ctx,
+			 const char *field,
+			 const nx_value_t *value)
+{
+    nx_value_t fieldval;
+
+    if ( eval_ctx->logdata == NULL )
+    {
+	return ( -1 );
+    }
+
+    if ( (nx_logdata_get_field_value(eval_ctx->logdata, field, &fieldval) == FALSE) ||
+	 (fieldval.defined == FALSE) )
+    { // undef == value is undef
+	return ( -2 );
+    }
+
+    if ( fieldval.type != value->type )
+    {
+	return ( -1 );
+    }
+
+    switch ( value->type )
+    {
+	case NX_VALUE_TYPE_STRING:
+	    return ( strcmp(fieldval.string->buf, value->string->buf) == 0 );
+	case NX_VALUE_TYPE_INTEGER:
+	    return ( fieldval.integer == value->integer );
+	case NX_VALUE_TYPE_BOOLEAN:
+	    return ( fieldval.boolean == value->boolean );
+	case NX_VALUE_TYPE_DATETIME:
+	    return ( fieldval.datetime == value->datetime );
+	case NX_VALUE_TYPE_IP4ADDR:
+	    return ( (fieldval.ip4addr[0] == value->ip4addr[0]) &&
+		     (fieldval.ip4addr[1] == value->ip4addr[1]) &&
+		     (fieldval.ip4addr[2] == value->ip4addr[2]) &&
+		     (fieldval.ip4addr[3] == value->ip4addr[3]) );
+	default:
+	    break;
+    }
+
+    return ( -1 );
+}
+
+
+
+static void _assign_const(nx_expr_eval_ctx_t *eval_ctx,
+			  const nx_expr_insn_t *insn)
+{
+    nx_value_t *value;
+
+    if ( eval_ctx->logdata == NULL )
+    { // let it fail with the same message
+	nx_expr_statement_execute(eval_ctx, insn->stmnt);
+	return;
+    }
+
+    value = malloc(sizeof(nx_value_t));
+    nx_value_clone(value, insn->value);
+    nx_logdata_set_field_value(eval_ctx->logdata, insn->field, value);
+}
+
+
+
+/**
+ * Add the error message of each enclosing if statement, the same as
+ * the recursive nx_expr_statement_execute() does.
+ */
+static void _rethrow_in_scope(const nx_expr_program_t *program,
+			      int32_t scope,
+			      nx_exception_t *e)
+{
+    const nx_expr_statement_t *stmnt;
+    nx_exception_t e2;
+
+    if ( scope < 0 )
+    {
+	rethrow(*e);
+    }
+
+    stmnt = program->scopes[scope].stmnt;
+    try
+    {
+	rethrow_msg(*e, "%s failed at line %d, character %d in %s. "
+		    "statement execution has been aborted",
+		    stmnt->decl.name, stmnt->decl.line, stmnt->decl.pos,
+		    stmnt->decl.file);
+    }
+    catch(e2)
+    {
+	_rethrow_in_scope(program, program->scopes[scope].parent, &e2);
+    }
+}
+
+
+
+void nx_expr_program_execute(nx_expr_eval_ctx_t *eval_ctx,
+			     const nx_expr_program_t *program)
+{
+    const nx_expr_insn_t *insn;
+    int32_t volatile pc = 0;
+    int result;
+    nx_exception_t e;
+
+    ASSERT(eval_ctx != NULL);
+    ASSERT(program != NULL);
+
+    try
+    {
+	while ( (pc < program->num_insn) && (eval_ctx->dropped == FALSE) )
+	{
+	    insn = &(program->insns[pc]);
+
+	    switch ( insn->opcode )
+	    {
+		case NX_EXPR_OP_STATEMENT:
+		    nx_expr_statement_execute(eval_ctx, insn->stmnt);
+		    pc++;
+		    break;
+		case NX_EXPR_OP_ASSIGN_CONST:
+		    _assign_const(eval_ctx, insn);
+		    pc++;
+		    break;
+		case NX_EXPR_OP_JUMP:
+		    pc = insn->target;
+		    break;
+		case NX_EXPR_OP_JUMP_UNLESS:
+		    pc = (_eval_condition(eval_ctx, insn->cond) == TRUE) ? pc + 1 : insn->target;
+		    break;
+		case NX_EXPR_OP_JUMP_UNLESS_EQUAL:
+		case NX_EXPR_OP_JUMP_UNLESS_NOTEQUAL:
+		    result = _field_equals(eval_ctx, insn->field, insn->value);
+		    if ( result == -1 )
+		    {
+			result = _eval_condition(eval_ctx, insn->cond);
+		    }
+		    else if ( result == -2 )
+		    { // undefined, the condition is false for both operators
+			result = FALSE;
+		    }
+		    else if ( insn->opcode == NX_EXPR_OP_JUMP_UNLESS_NOTEQUAL )
+		    {
+			result = !result;
+		    }
+		    pc = (result != FALSE) ? pc + 1 : insn->target;
+		    break;
+		case NX_EXPR_OP_JUMP_UNLESS_DEFINED:
+		case NX_EXPR_OP_JUMP_IF_DEFINED:
+		    if ( eval_ctx->logdata == NULL )
+		    {
+			result = _eval_condition(eval_ctx, insn->cond);
+		    }
+		    else
+		    {
+			nx_value_t fieldval;
+
+			nx_logdata_get_field_value(eval_ctx->logdata, insn->field, &fieldval);
+			result = fieldval.defined;
+			if ( insn->opcode == NX_EXPR_OP_JUMP_IF_DEFINED )
+			{
+			    result = !result;
+			}
+		    }
+		    pc = (result != FALSE) ? pc + 1 : insn->target;
+		    break;
+		default:
+		    nx_panic("invalid opcode %d", insn->opcode);
+	    }
+	}
+    }
+    catch(e)
+    {
+	_rethrow_in_scope(program, program->insns[pc].scope, &e);
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_EXPR_VM_H
+#define __NX_EXPR_VM_H
+
+#include "expr.h"
+
+/*
+ * Statement lists are compiled into a flat instruction array after parsing.
+ * Blocks and if-else statements are turned into jumps so that the executor
+ * is a single loop instead of a recursive walk over the statement tree.
+ * Leaf statements (procedure calls, assignments, regexp) keep using
+ * nx_expr_statement_execute() so the semantics and error messages are the same.
+ */
+
+typedef enum nx_expr_opcode_t
+{
+    NX_EXPR_OP_STATEMENT = 1,		///< execute a leaf statement
+    NX_EXPR_OP_ASSIGN_CONST,		///< $field = constant
+    NX_EXPR_OP_JUMP,			///< unconditional jump
+    NX_EXPR_OP_JUMP_UNLESS,		///< evaluate the condition, jump if it is false
+    NX_EXPR_OP_JUMP_UNLESS_EQUAL,	///< $field == constant, the field value is not copied
+    NX_EXPR_OP_JUMP_UNLESS_NOTEQUAL,	///< $field != constant, the field value is not copied
+    NX_EXPR_OP_JUMP_UNLESS_DEFINED,	///< defined $field
+    NX_EXPR_OP_JUMP_IF_DEFINED,		///< not defined $field
+} nx_expr_opcode_t;
+
+
+
+typedef struct nx_expr_insn_t
+{
+    nx_expr_opcode_t		opcode;
+    int32_t			target;	///< jump target
+    int32_t			scope;	///< innermost if statement enclosing this instruction, -1 at the top
+    const nx_expr_statement_t	*stmnt;	///< statement this instruction was compiled from
+    const nx_expr_t		*cond;	///< condition, also used when the fast path cannot decide
+    const char			*field;	///< field operand of the specialized opcodes
+    const nx_value_t		*value;	///< constant operand
+} nx_expr_insn_t;
+
+
+
+typedef struct nx_expr_scope_t
+{
+    const nx_expr_statement_t	*stmnt;	///< the if statement, used in error messages
+    int32_t			parent;	///< enclosing scope, -1 at the top
+} nx_expr_scope_t;
+
+
+
+struct nx_expr_program_t
+{
+    const nx_expr_statement_t	*first;	///< first and last statement of the list at compile time
+    const nx_expr_statement_t	*last;
+    int32_t			num_insn;
+    nx_expr_insn_t		*insns;
+    int32_t			num_scope;
+    nx_expr_scope_t		*scopes;
+};
+
+nx_expr_program_t *nx_expr_program_compile(apr_pool_t *pool,
+					   const nx_expr_statement_list_t *stmnts);
+void nx_expr_statement_list_compile(apr_pool_t *pool,
+				    nx_expr_statement_list_t *stmnts);
+boolean nx_expr_program_valid(const nx_expr_program_t *program,
+			      const nx_expr_statement_list_t *stmnts);
+void nx_expr_program_execute(nx_expr_eval_ctx_t *eval_ctx,
+			     const nx_expr_program_t *program);
+
+#endif	/* __NX_EXPR_VM_H */
@@ -10,9 +10,11 @@
 
 #include "error_debug.h"
 #include "value.h"
+#include "alloc.h"
 #include "expr.h"
 #include "expr-grammar.h"
 #include "expr-parser.h"
+#include "expr-vm.h"
 #include "../core/ctx.h"
 #include "date.h"
 
@@ -55,6 +57,12 @@ void nx_expr_statement_list_execute(nx_expr_eval_ctx_t *eval_ctx,
     
     log_debug("executing statements");
 
+    if ( nx_expr_program_valid(stmnts->program, stmnts) == TRUE )
+    {
+	nx_expr_program_execute(eval_ctx, stmnts->program);
+	return;
+    }
+
     for ( stmnt = NX_DLIST_FIRST(stmnts);
 	  stmnt != NULL;
 	  stmnt = NX_DLIST_NEXT(stmnt, link) )
@@ -241,6 +249,7 @@ static void nx_expr_eval_func(nx_expr_eval_ctx_t *eval_ctx,
     int volatile argc, i;
     nx_value_t *values;
     nx_expr_list_elem_t *arg;
+    nx_scratch_mark_t mark;
     nx_exception_t e;
     
     if ( expr->function.args == NULL )
@@ -253,7 +262,8 @@ static void nx_expr_eval_func(nx_expr_eval_ctx_t *eval_ctx,
 	  arg != NULL;
 	  arg = NX_DLIST_NEXT(arg, link), argc++ );
 
-    values = malloc((size_t) argc * sizeof(nx_value_t));
+    nx_scratch_mark(&mark);
+    values = nx_scratch_alloc((size_t) argc * sizeof(nx_value_t));
     memset(values, 0, (size_t) argc * sizeof(nx_value_t));
 
     try
@@ -275,7 +285,7 @@ static void nx_expr_eval_func(nx_expr_eval_ctx_t *eval_ctx,
 	{
 	    nx_value_kill(&(values[i]));
 	}
-	free(values);
+	nx_scratch_release(&mark);
 	rethrow(e);
     }
 
@@ -286,7 +296,7 @@ static void nx_expr_eval_func(nx_expr_eval_ctx_t *eval_ctx,
 	//log_debug("KILL: %ld", values);
 	nx_value_kill(&(values[i]));
     }
-    free(values);
+    nx_scratch_release(&mark);
 }
 
 
@@ -335,7 +345,8 @@ static void _inop(nx_expr_eval_ctx_t *eval_ctx,
     nx_exception_t e;
     nx_expr_list_elem_t *elem;
     int volatile elemcount = 0;
-    nx_value_t *values = NULL;
+    nx_value_t *values;
+    nx_scratch_mark_t mark;
     int i = 0;
 
     ASSERT(expr != NULL);
@@ -349,9 +360,6 @@ static void _inop(nx_expr_eval_ctx_t *eval_ctx,
 	  elem != NULL;
 	  elem = NX_DLIST_NEXT(elem, link), elemcount++ );
 
-    values = malloc((size_t) elemcount * sizeof(nx_value_t));
-    memset(values, 0, (size_t) elemcount * sizeof(nx_value_t));
-	
     nx_expr_evaluate(eval_ctx, &exprval, expr);
 
     if ( exprval.defined == FALSE )
@@ -361,6 +369,10 @@ static void _inop(nx_expr_eval_ctx_t *eval_ctx,
 	return;
     }
 
+    nx_scratch_mark(&mark);
+    values = nx_scratch_alloc((size_t) elemcount * sizeof(nx_value_t));
+    memset(values, 0, (size_t) elemcount * sizeof(nx_value_t));
+
     try
     {
 	for ( elem = NX_DLIST_FIRST(exprs), i = 0;
@@ -383,10 +395,7 @@ static void _inop(nx_expr_eval_ctx_t *eval_ctx,
 	    nx_value_kill(&(values[i]));
 	}
 	nx_value_kill(&exprval);
-	if ( values != NULL )
-	{
-	    free(values);
-	}
+	nx_scratch_release(&mark);
 	rethrow(e);
     }
 
@@ -395,10 +404,7 @@ static void _inop(nx_expr_eval_ctx_t *eval_ctx,
 	nx_value_kill(&(values[i]));
     }
     nx_value_kill(&exprval);
-    if ( values != NULL )
-    {
-	free(values);
-    }
+    nx_scratch_release(&mark);
 
     return;
 }
@@ -516,15 +522,52 @@ void nx_expr_evaluate(nx_expr_eval_ctx_t *eval_ctx,
 
 
 
+/**
+ * Literals and fields are not copied for a regexp match, the value is only
+ * valid until the field is modified. Returns TRUE if the value is borrowed.
+ */
+static boolean _regmatch_operand(nx_expr_eval_ctx_t *eval_ctx,
+				 nx_value_t *value,
+				 const nx_expr_t *expr)
+{
+    if ( expr->type == NX_EXPR_TYPE_VALUE )
+    {
+	*value = expr->value;
+	return ( TRUE );
+    }
+    if ( (expr->type == NX_EXPR_TYPE_FIELD) && (eval_ctx->logdata != NULL) )
+    {
+	nx_logdata_get_field_value(eval_ctx->logdata, expr->field, value);
+	return ( TRUE );
+    }
+    nx_expr_evaluate(eval_ctx, value, expr);
+
+    return ( FALSE );
+}
+
+
+
+static void _regmatch_operand_kill(nx_value_t *value, boolean borrowed)
+{
+    if ( borrowed == FALSE )
+    {
+	nx_value_kill(value);
+    }
+}
+
+
+
 static void _regmatch(nx_expr_eval_ctx_t *eval_ctx,
 		      nx_value_t *retval,
 		      const nx_expr_t *left,
 		      const nx_expr_t *right)
 {
     nx_value_t lval, rval;
-    const pcre *regexp = NULL;
+    boolean lborrowed, rborrowed;
+    const nx_regexp_t *regexp = NULL;
     const char *regexpstr = NULL;
     char *subject = NULL;
+    int subject_len = 0;
     const char *replacement = NULL;
     size_t replacement_length = 0;
     uint8_t modifiers;
@@ -555,7 +598,7 @@ static void _regmatch(nx_expr_eval_ctx_t *eval_ctx,
 	eval_ctx->captured = NULL;
     }
 
-    nx_expr_evaluate(eval_ctx, &lval, left);
+    lborrowed = _regmatch_operand(eval_ctx, &lval, left);
 
     if ( lval.defined == FALSE )
     {
@@ -563,31 +606,33 @@ static void _regmatch(nx_expr_eval_ctx_t *eval_ctx,
 	return;
     }
 
-    nx_expr_evaluate(eval_ctx, &rval, right);
+    rborrowed = _regmatch_operand(eval_ctx, &rval, right);
     if ( rval.defined == FALSE )
     {
 	retval->defined = FALSE;
-	nx_value_kill(&lval);
+	_regmatch_operand_kill(&lval, lborrowed);
 	return;
     }
 
     if ( lval.type == NX_VALUE_TYPE_STRING )
     {
 	ASSERT(rval.type == NX_VALUE_TYPE_REGEXP);
-	regexp = rval.regexp.pcre;
+	regexp = rval.regexp.compiled;
 	regexpstr = rval.regexp.str;
 	replacement = rval.regexp.replacement;
 	modifiers = rval.regexp.modifiers;
 	subject = lval.string->buf;
+	subject_len = (int) lval.string->len;
     }
     else if ( rval.type == NX_VALUE_TYPE_STRING )
     {
 	ASSERT(lval.type == NX_VALUE_TYPE_REGEXP);
-	regexp = lval.regexp.pcre;
+	regexp = lval.regexp.compiled;
 	regexpstr = lval.regexp.str;
 	replacement = lval.regexp.replacement;
 	modifiers = lval.regexp.modifiers;
 	subject = rval.string->buf;
+	subject_len = (int) rval.string->len;
     }
     else
     {
@@ -595,8 +640,8 @@ static void _regmatch(nx_expr_eval_ctx_t *eval_ctx,
 
 	rtype = rval.type;
 	ltype = lval.type;
-	nx_value_kill(&rval);
-	nx_value_kill(&lval);
+	_regmatch_operand_kill(&rval, rborrowed);
+	_regmatch_operand_kill(&lval, lborrowed);
 
 	throw_msg("invalid types in operation: %s =~ %s",
 		  nx_value_type_to_string(ltype), nx_value_type_to_string(rtype));
@@ -620,14 +665,15 @@ static void _regmatch(nx_expr_eval_ctx_t *eval_ctx,
 	ASSERT(fieldval.type == NX_VALUE_TYPE_STRING);
 	ASSERT(fieldval.defined == TRUE);
 	subject = fieldval.string->buf;
+	subject_len = (int) fieldval.string->len;
     }
 
     retval->boolean = FALSE;
     retval->defined = TRUE;
 
   match_global:
-    result = pcre_exec(regexp, NULL, subject, (int) strlen(subject), 0, options,
-		       ovector, NX_EXPR_MAX_CAPTURED_FIELDS * 3);
+    result = nx_regexp_exec(regexp, subject, subject_len, 0, options,
+			    ovector, NX_EXPR_MAX_CAPTURED_FIELDS * 3);
     
     if ( result >= 0 )
     {
@@ -713,13 +759,14 @@ static void _regmatch(nx_expr_eval_ctx_t *eval_ctx,
 	    ASSERT(fieldval.string->len >= (uint32_t) (ovector[1] - ovector[0]));
 	    fieldval.string->len += ((uint32_t) (replacement_length - (size_t) (ovector[1] - ovector[0])));
 	    subject = fieldval.string->buf;
+	    subject_len = (int) fieldval.string->len;
 	    if ( modifiers & NX_EXPR_REGEXP_MODIFIER_MATCH_GLOBAL )
 	    {
 		global_match_recursion_cnt++;
 		if ( global_match_recursion_cnt > 10000 ) 
 		{ // avoid an infinite loop with s/TEST/TEST/
-		    nx_value_kill(&lval);
-		    nx_value_kill(&rval);
+		    _regmatch_operand_kill(&lval, lborrowed);
+		    _regmatch_operand_kill(&rval, rborrowed);
 		    throw_msg("likely infinite loop detected in regexp substitution");
 		}
 		else
@@ -730,8 +777,8 @@ static void _regmatch(nx_expr_eval_ctx_t *eval_ctx,
 	}
     }
 
-    nx_value_kill(&lval);
-    nx_value_kill(&rval);
+    _regmatch_operand_kill(&lval, lborrowed);
+    _regmatch_operand_kill(&rval, rborrowed);
 }
 
 
@@ -1363,20 +1410,20 @@ static void _plus(nx_expr_eval_ctx_t *eval_ctx, nx_value_t *retval, const nx_exp
 	// string + string = string
 	// ? + string = string
 	// string + ? = string
-	char *l, *r;
-	boolean free_r = FALSE, free_l = FALSE;
+	const char *l, *r;
+	nx_scratch_mark_t mark;
 
 	retval->defined = TRUE;
 	retval->type = NX_VALUE_TYPE_STRING;
 
+	nx_scratch_mark(&mark);
 	if ( rval.type == NX_VALUE_TYPE_STRING )
 	{
 	    r = rval.string->buf;
 	}
 	else
 	{
-	    r = nx_value_to_string(&rval);
-	    free_r = TRUE;
+	    r = nx_value_to_scratch_string(&rval);
 	}
 
 	if ( lval.type == NX_VALUE_TYPE_STRING )
@@ -1385,19 +1432,11 @@ static void _plus(nx_expr_eval_ctx_t *eval_ctx, nx_value_t *retval, const nx_exp
 	}
 	else
 	{
-	    l = nx_value_to_string(&lval);
-	    free_l = TRUE;
+	    l = nx_value_to_scratch_string(&lval);
 	}
 
 	retval->string = nx_string_sprintf(NULL, "%s%s", l, r);
-	if ( free_l == TRUE )
-	{
-	    free(l);
-	}
-	if ( free_r == TRUE )
-	{
-	    free(r);
-	}
+	nx_scratch_release(&mark);
 	nx_value_kill(&lval);
 	nx_value_kill(&rval);
 
@@ -1656,6 +1695,40 @@ static void _mod(nx_expr_eval_ctx_t *eval_ctx, nx_value_t *retval, const nx_expr
 
 
 
+/**
+ * Operations on literals are evaluated once here instead of for each event.
+ * If the evaluation fails the expression is left as is so that the error
+ * is reported when it is executed.
+ */
+static void nx_expr_fold_constant(nx_expr_t *expr)
+{
+    nx_expr_eval_ctx_t eval_ctx;
+    nx_value_t value;
+    nx_exception_t e;
+
+    nx_expr_eval_ctx_init(&eval_ctx, NULL, NULL, NULL);
+    try
+    {
+	nx_expr_evaluate(&eval_ctx, &value, expr);
+    }
+    catch(e)
+    {
+	log_debug("not folding constant expression: %s", nx_exception_get_message(&e, 0));
+	nx_expr_eval_ctx_destroy(&eval_ctx);
+	return;
+    }
+    nx_expr_eval_ctx_destroy(&eval_ctx);
+
+    expr->type = NX_EXPR_TYPE_VALUE;
+    expr->value = value;
+    if ( value.defined == TRUE )
+    {
+	expr->rettype = value.type;
+    }
+}
+
+
+
 nx_expr_t *nx_expr_new_binop(nx_expr_parser_t *parser,
 			     int token,
 			     const nx_expr_t *left,
@@ -1677,6 +1750,7 @@ nx_expr_t *nx_expr_new_binop(nx_expr_parser_t *parser,
     expr->type = NX_EXPR_TYPE_BINOP;
     expr->binop.left = left;
     expr->binop.right = right;
+    expr->binop.token = token;
     nx_expr_decl_init(&(expr->decl), parser, "binary operation");
 
     switch ( token )
@@ -2051,6 +2125,12 @@ nx_expr_t *nx_expr_new_binop(nx_expr_parser_t *parser,
 	    nx_panic("invalid/unhandled token");
     }
 
+    if ( (token != TOKEN_REGMATCH) && (token != TOKEN_NOTREGMATCH) &&
+	 (left->type == NX_EXPR_TYPE_VALUE) && (right->type == NX_EXPR_TYPE_VALUE) )
+    {
+	nx_expr_fold_constant(expr);
+    }
+
     return ( expr );
 }
 
@@ -2149,6 +2229,7 @@ nx_expr_t *nx_expr_new_unop(nx_expr_parser_t *parser,
     expr->type = NX_EXPR_TYPE_UNOP;
     expr->rettype = NX_VALUE_TYPE_BOOLEAN;
     expr->unop.op = op;
+    expr->unop.token = token;
     nx_expr_decl_init(&(expr->decl), parser, "unary operation");
 
     switch ( token )
@@ -2180,6 +2261,11 @@ nx_expr_t *nx_expr_new_unop(nx_expr_parser_t *parser,
 	    nx_panic("invalid/unhandled token");
     }
 
+    if ( op->type == NX_EXPR_TYPE_VALUE )
+    {
+	nx_expr_fold_constant(expr);
+    }
+
     return ( expr );
 }
 
@@ -2251,13 +2337,8 @@ nx_expr_t *nx_expr_new_regexp(nx_expr_parser_t *parser,
 			      const char *modifiers)
 {
     nx_expr_t *expr;
-    const char *error = NULL;
-    int erroroffs = 0;
-    pcre *regexp;
-    pcre *tmppcre;
-    int rc;
-    size_t size;
-    int capturecount;
+    nx_regexp_t * volatile regexp = NULL;
+    nx_exception_t e;
     uint8_t mod = 0;
     size_t i;
     int options = 0;
@@ -2312,40 +2393,21 @@ nx_expr_t *nx_expr_new_regexp(nx_expr_parser_t *parser,
 	options |= PCRE_CASELESS;
     }
 
-    regexp = pcre_compile(str, options, &error,  &erroroffs, NULL);
-
-    if ( regexp == NULL )
+    try
     {
-	nx_expr_parser_error_fmt(parser, NULL,
-				 "failed to compile regular expression '%s', error at position %d: %s",
-				 str, erroroffs, error);
+	regexp = nx_regexp_compile(parser->pool, str, options);
     }
-
-    rc = pcre_fullinfo(regexp, NULL, PCRE_INFO_SIZE, &size); 
-    if ( rc < 0 )
+    catch(e)
     {
-	pcre_free(regexp);
-	throw_msg("failed to get compiled regexp size");
+	nx_expr_parser_error_fmt(parser, NULL, "%s", nx_exception_get_message(&e, 0));
     }
-    ASSERT(size > 0);
 
-    rc = pcre_fullinfo(regexp, NULL, PCRE_INFO_CAPTURECOUNT, &capturecount); 
-    if ( rc < 0 )
-    {
-	pcre_free(regexp);
-	throw_msg("failed to get regexp captured count");
-    }
-    if ( capturecount >= NX_EXPR_MAX_CAPTURED_FIELDS )
+    if ( regexp->capturecount >= NX_EXPR_MAX_CAPTURED_FIELDS )
     {
-	pcre_free(regexp);
 	throw_msg("maximum number of captured substrings is limited to %d",
 		  NX_EXPR_MAX_CAPTURED_FIELDS);
     }
 
-    tmppcre = apr_palloc(parser->pool, (apr_size_t) size);
-    memcpy(tmppcre, regexp, (apr_size_t) size);
-    pcre_free(regexp);
-
     expr = apr_pcalloc(parser->pool, sizeof(nx_expr_t));
 
     if ( replacement != NULL )
@@ -2354,8 +2416,7 @@ nx_expr_t *nx_expr_new_regexp(nx_expr_parser_t *parser,
 	expr->rettype = NX_VALUE_TYPE_REGEXP;
 	expr->value.type = NX_VALUE_TYPE_REGEXP;
 	expr->value.defined = TRUE;
-	expr->value.regexp.pcre = tmppcre;
-	expr->value.regexp.pcre_size = size;
+	expr->value.regexp.compiled = regexp;
 	expr->value.regexp.str = apr_pstrdup(parser->pool, str);
 	expr->value.regexp.replacement = apr_pstrdup(parser->pool, replacement);
 	expr->value.regexp.modifiers = mod;
@@ -2367,8 +2428,7 @@ nx_expr_t *nx_expr_new_regexp(nx_expr_parser_t *parser,
 	expr->rettype = NX_VALUE_TYPE_REGEXP;
 	expr->value.type = NX_VALUE_TYPE_REGEXP;
 	expr->value.defined = TRUE;
-	expr->value.regexp.pcre = tmppcre;
-	expr->value.regexp.pcre_size = size;
+	expr->value.regexp.compiled = regexp;
 	expr->value.regexp.str = apr_pstrdup(parser->pool, str);
 	expr->value.regexp.replacement = NULL;
 	expr->value.regexp.modifiers = mod;
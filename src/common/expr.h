@@ -49,7 +49,14 @@ typedef struct nx_expr_t nx_expr_t;
 typedef struct nx_expr_parser_t nx_expr_parser_t;
 typedef struct nx_expr_statement_t nx_expr_statement_t;
 typedef struct nx_expr_statement_list_t nx_expr_statement_list_t;
-NX_DLIST_HEAD(nx_expr_statement_list_t, nx_expr_statement_t);
+typedef struct nx_expr_program_t nx_expr_program_t;
+
+struct nx_expr_statement_list_t
+{
+    nx_expr_statement_t	*first;
+    nx_expr_statement_t	*last;
+    nx_expr_program_t	*program;	///< compiled form, see nx_expr_statement_list_compile()
+};
 
 typedef struct nx_expr_eval_ctx_t
 {
@@ -143,6 +150,7 @@ struct nx_expr_t
 	{
 	    void		(*cb)(nx_expr_eval_ctx_t *eval_ctx, nx_value_t *retval, const nx_expr_t *operand);
 	    const nx_expr_t	*op;
+	    int			token;	///< operator token
 	} unop;
 
 	struct nx_exp_binop
@@ -150,6 +158,7 @@ struct nx_expr_t
 	    void		(*cb)(nx_expr_eval_ctx_t *eval_ctx, nx_value_t *retval, const nx_expr_t *left, const nx_expr_t *right);
 	    const nx_expr_t	*left;
 	    const nx_expr_t	*right;
+	    int			token;	///< operator token
 	} binop;
 
 	struct nx_exp_inop
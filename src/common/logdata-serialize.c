@@ -35,6 +35,7 @@ apr_size_t nx_logdata_serialized_size(const nx_logdata_t *logdata)
 
     size += 2; //num_fields
 
+    nx_logdata_materialize(logdata);
     for ( field = NX_DLIST_FIRST(&(logdata->fields));
 	  field != NULL;
 	  field = NX_DLIST_NEXT(field, link) )
@@ -61,6 +62,8 @@ apr_size_t nx_logdata_to_membuf(const nx_logdata_t *logdata, char *buf, apr_size
     ASSERT(logdata != NULL);
     ASSERT(buf != NULL);
 
+    nx_logdata_materialize(logdata);
+
     ptr = buf;
     num_field_ptr = ptr;
     ptr += 2; //skip num_field, will be stored after the loop so we don't have to iterate twice
@@ -5,13 +5,197 @@
  * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
  */
 
+#include <apr_lib.h>
+
 #include "error_debug.h"
 #include "exception.h"
 #include "logdata.h"
 #include "date.h"
+#include "ack.h"
+#include "trace.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
+static void lazy_free(nx_logdata_lazy_t *lazy)
+{
+	int i;
+
+	for (i = 0; i < lazy->num_key; i++)
+	{
+		free(lazy->keys[i].key);
+	}
+	if (lazy->keys != NULL)
+	{
+		free(lazy->keys);
+	}
+	free(lazy);
+}
+
+/*
+ *  Entry of a name looked up with the get function of the deferred parse
+ */
+static nx_logdata_lazy_key_t *lazy_find_key(nx_logdata_lazy_t *lazy, const char *key)
+{
+	int i;
+
+	for (i = 0; i < lazy->num_key; i++)
+	{
+		if (strcasecmp(lazy->keys[i].key, key) == 0)
+		{
+			return (&(lazy->keys[i]));
+		}
+	}
+
+	return (NULL);
+}
+
+static void lazy_add_key(nx_logdata_lazy_t *lazy,
+						 const char *key,
+						 boolean found,
+						 boolean appended)
+{
+	if (lazy->num_key == lazy->keys_size)
+	{
+		lazy->keys_size = (lazy->keys_size == 0) ? 4 : lazy->keys_size * 2;
+		lazy->keys = realloc(lazy->keys, (size_t)lazy->keys_size * sizeof(nx_logdata_lazy_key_t));
+		ASSERT(lazy->keys != NULL);
+	}
+	lazy->keys[lazy->num_key].key = strdup(key);
+	lazy->keys[lazy->num_key].found = found;
+	lazy->keys[lazy->num_key].appended = appended;
+	(lazy->num_key)++;
+}
+
+static nx_logdata_field_t *logdata_find_field(const nx_logdata_t *logdata,
+											  const char *key)
+{
+	nx_logdata_field_t *field;
+
+	for (field = NX_DLIST_FIRST(&(logdata->fields));
+		 field != NULL;
+		 field = NX_DLIST_NEXT(field, link))
+	{
+		if (strcasecmp(field->key, key) == 0)
+		{
+			return (field);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ *  Replace the value if the field exists, otherwise append setfield.
+ *  Returns TRUE if it was appended.
+ */
+static boolean logdata_place_field(nx_logdata_t *logdata,
+								   nx_logdata_field_t *setfield)
+{
+	nx_logdata_field_t *field;
+
+	field = logdata_find_field(logdata, setfield->key);
+	if (field == NULL)
+	{
+		NX_DLIST_INSERT_TAIL(&(logdata->fields), setfield, link);
+		return (TRUE);
+	}
+	nx_value_free(field->value);
+	field->value = setfield->value;
+	free(setfield->key);
+	free(setfield);
+
+	return (FALSE);
+}
+
+/*
+ *  Called by the setters. While the deferred parse runs, the fields which
+ *  were extracted before already have their final value, the parsed one is
+ *  dropped and an appended field is moved after the ones added so far to
+ *  get the same order as without the deferral. Otherwise the parse is
+ *  completed before the field is set. Returns TRUE if value was consumed.
+ */
+static boolean lazy_set_field(nx_logdata_t *logdata,
+							  const char *key,
+							  nx_value_t *value)
+{
+	nx_logdata_lazy_key_t *lazykey;
+	nx_logdata_field_t *field;
+
+	if (logdata->lazy->busy == FALSE)
+	{
+		nx_logdata_materialize(logdata);
+		return (FALSE);
+	}
+
+	lazykey = lazy_find_key(logdata->lazy, key);
+	if ((lazykey == NULL) || (lazykey->found == FALSE))
+	{
+		return (FALSE);
+	}
+	if (lazykey->appended == TRUE)
+	{
+		field = logdata_find_field(logdata, key);
+		ASSERT(field != NULL);
+		NX_DLIST_REMOVE(&(logdata->fields), field, link);
+		NX_DLIST_INSERT_TAIL(&(logdata->fields), field, link);
+		lazykey->appended = FALSE;
+	}
+	nx_value_free(value);
+
+	return (TRUE);
+}
+
+/*
+ *  Find a field, it is extracted from the pending deferred parse first if
+ *  this wasn't done yet. The fields are a cache of the parse, so this is
+ *  allowed on a const logdata.
+ */
+static nx_logdata_field_t *logdata_lookup(const nx_logdata_t *logdata,
+										  const char *key)
+{
+	nx_logdata_lazy_t *lazy = logdata->lazy;
+	nx_logdata_field_t *field = NULL;
+	nx_logdata_lazy_result_t volatile result = NX_LOGDATA_LAZY_UNKNOWN;
+	nx_exception_t e;
+
+	if ((lazy == NULL) || (lazy->busy == TRUE) ||
+		(strcasecmp(key, "raw_event") == 0) || (lazy_find_key(lazy, key) != NULL))
+	{
+		return (logdata_find_field(logdata, key));
+	}
+
+	if (lazy->get != NULL)
+	{
+		lazy->busy = TRUE;
+		try
+		{
+			result = lazy->get((nx_logdata_t *)logdata, lazy, key, &field);
+		}
+		catch (e)
+		{
+			lazy->busy = FALSE;
+			rethrow(e);
+		}
+		lazy->busy = FALSE;
+	}
+
+	switch (result)
+	{
+	case NX_LOGDATA_LAZY_FOUND:
+		ASSERT(field != NULL);
+		lazy_add_key(lazy, key, TRUE, logdata_place_field((nx_logdata_t *)logdata, field));
+		break;
+	case NX_LOGDATA_LAZY_ABSENT:
+		lazy_add_key(lazy, key, FALSE, FALSE);
+		break;
+	default:
+		nx_logdata_materialize(logdata);
+		break;
+	}
+
+	return (logdata_find_field(logdata, key));
+}
+
 void nx_logdata_free(nx_logdata_t *logdata)
 {
 	nx_logdata_field_t *field, *tmpfield;
@@ -20,6 +204,11 @@ void nx_logdata_free(nx_logdata_t *logdata)
 	ASSERT(logdata->link.next == NULL);
 	ASSERT(logdata->link.prev == NULL);
 
+	if (logdata->ack_source != NULL)
+	{ // this is the point where delivery is acknowledged
+		nx_ack_release(logdata);
+	}
+
 	field = NX_DLIST_FIRST(&(logdata->fields));
 	while (field != NULL)
 	{
@@ -29,6 +218,14 @@ void nx_logdata_free(nx_logdata_t *logdata)
 		field = NX_DLIST_NEXT(field, link);
 		free(tmpfield);
 	}
+	if (logdata->lazy != NULL)
+	{
+		lazy_free(logdata->lazy);
+	}
+	if (logdata->trace != NULL)
+	{ // the end of the trace, summarized if an output was done with it
+		nx_trace_end(logdata->trace);
+	}
 	free(logdata);
 }
 
@@ -107,6 +304,8 @@ nx_logdata_t *nx_logdata_clone(nx_logdata_t *logdata)
 
 	ASSERT(logdata != NULL);
 
+	nx_logdata_materialize(logdata);
+
 	new = malloc(sizeof(nx_logdata_t));
 	memset(new, 0, sizeof(nx_logdata_t));
 
@@ -125,6 +324,17 @@ nx_logdata_t *nx_logdata_clone(nx_logdata_t *logdata)
 	}
 	ASSERT(new->raw_event != NULL);
 
+	if (logdata->ack_source != NULL)
+	{
+		new->ack_source = logdata->ack_source;
+		new->ack_seq = logdata->ack_seq;
+		nx_ack_ref(new);
+	}
+	if (logdata->trace != NULL)
+	{
+		new->trace = nx_trace_clone(logdata->trace);
+	}
+
 	return (new);
 }
 
@@ -142,6 +352,11 @@ void nx_logdata_append_field_value(nx_logdata_t *logdata,
 	ASSERT(key != NULL);
 	ASSERT(value != NULL);
 
+	if ((logdata->lazy != NULL) && (lazy_set_field(logdata, key, value) == TRUE))
+	{
+		return;
+	}
+
 	field = malloc(sizeof(nx_logdata_field_t));
 	ASSERT(field != NULL);
 	field->value = value;
@@ -163,6 +378,11 @@ void nx_logdata_set_field_value(nx_logdata_t *logdata,
 	ASSERT(key != NULL);
 	ASSERT(value != NULL);
 
+	if ((logdata->lazy != NULL) && (lazy_set_field(logdata, key, value) == TRUE))
+	{
+		return;
+	}
+
 	for (field = NX_DLIST_FIRST(&(logdata->fields));
 		 field != NULL;
 		 field = NX_DLIST_NEXT(field, link))
@@ -197,6 +417,76 @@ void nx_logdata_set_field_value(nx_logdata_t *logdata,
 	nx_logdata_append_field_value(logdata, key, value);
 }
 
+/*
+ *  Bit of the field name in a 64 bit bloom filter of field names. Names are
+ *  compared case insensitively, so only the length and the case folded first
+ *  and last characters are used.
+ */
+uint64_t nx_logdata_key_bloom_bit(const char *key)
+{
+	size_t len;
+
+	ASSERT(key != NULL);
+
+	len = strlen(key);
+	if (len == 0)
+	{
+		return (1);
+	}
+
+	return (1ULL << ((len * 7 + (size_t)apr_tolower(key[0]) +
+					  (size_t)apr_tolower(key[len - 1]) * 3) & 63));
+}
+
+/*
+ *  Bloom filter of the field names in logdata
+ */
+uint64_t nx_logdata_key_bloom(const nx_logdata_t *logdata)
+{
+	nx_logdata_field_t *field;
+	uint64_t keys = 0;
+
+	ASSERT(logdata != NULL);
+
+	nx_logdata_materialize(logdata);
+
+	for (field = NX_DLIST_FIRST(&(logdata->fields));
+		 field != NULL;
+		 field = NX_DLIST_NEXT(field, link))
+	{
+		keys |= nx_logdata_key_bloom_bit(field->key);
+	}
+
+	return (keys);
+}
+
+/*
+ *  Same as nx_logdata_set_field_value(), keys is the bloom filter of the field
+ *  names maintained by the caller. When the bit of the name is not set the
+ *  field can't exist and the value is appended without looking at the others.
+ *  Parsers setting many fields use this to avoid a linear lookup per field.
+ */
+void nx_logdata_bloom_set_field_value(nx_logdata_t *logdata,
+									  uint64_t *keys,
+									  const char *key,
+									  nx_value_t *value)
+{
+	uint64_t bit;
+
+	ASSERT(keys != NULL);
+
+	bit = nx_logdata_key_bloom_bit(key);
+	if ((*keys & bit) == 0)
+	{
+		nx_logdata_append_field_value(logdata, key, value);
+		*keys |= bit;
+	}
+	else
+	{
+		nx_logdata_set_field_value(logdata, key, value);
+	}
+}
+
 /*
  *  Append if doesn't exist, otherwise replace old value
  */
@@ -207,6 +497,8 @@ void nx_logdata_set_field(nx_logdata_t *logdata, nx_logdata_field_t *setfield)
 	ASSERT(logdata != NULL);
 	ASSERT(setfield != NULL);
 
+	nx_logdata_materialize(logdata);
+
 	for (field = NX_DLIST_FIRST(&(logdata->fields));
 		 field != NULL;
 		 field = NX_DLIST_NEXT(field, link))
@@ -249,6 +541,8 @@ void nx_logdata_rename_field(nx_logdata_t *logdata,
 	ASSERT(old != NULL);
 	ASSERT(new != NULL);
 
+	nx_logdata_materialize(logdata);
+
 	if (strcmp(old, "raw_event") == 0)
 	{
 		throw_msg("cannot rename field 'raw_event'");
@@ -301,15 +595,11 @@ boolean nx_logdata_get_field_value(const nx_logdata_t *logdata,
 	ASSERT(key != NULL);
 	ASSERT(value != NULL);
 
-	for (field = NX_DLIST_FIRST(&(logdata->fields));
-		 field != NULL;
-		 field = NX_DLIST_NEXT(field, link))
+	field = logdata_lookup(logdata, key);
+	if (field != NULL)
 	{
-		if (strcasecmp(field->key, key) == 0)
-		{
-			*value = *(field->value);
-			return (TRUE);
-		}
+		*value = *(field->value);
+		return (TRUE);
 	}
 
 	value->type = NX_VALUE_TYPE_UNKNOWN;
@@ -321,22 +611,10 @@ boolean nx_logdata_get_field_value(const nx_logdata_t *logdata,
 nx_logdata_field_t *nx_logdata_get_field(const nx_logdata_t *logdata,
 										 const char *key)
 {
-	nx_logdata_field_t *field = NULL;
-
 	ASSERT(logdata != NULL);
 	ASSERT(key != NULL);
 
-	for (field = NX_DLIST_FIRST(&(logdata->fields));
-		 field != NULL;
-		 field = NX_DLIST_NEXT(field, link))
-	{
-		if (strcasecmp(field->key, key) == 0)
-		{
-			return (field);
-		}
-	}
-
-	return (NULL);
+	return (logdata_lookup(logdata, key));
 }
 
 /**
@@ -350,6 +628,8 @@ boolean nx_logdata_delete_field(nx_logdata_t *logdata,
 	ASSERT(logdata != NULL);
 	ASSERT(key != NULL);
 
+	nx_logdata_materialize(logdata);
+
 	for (field = NX_DLIST_FIRST(&(logdata->fields));
 		 field != NULL;
 		 field = NX_DLIST_NEXT(field, link))
@@ -452,6 +732,8 @@ void nx_logdata_dump_fields(nx_logdata_t *logdata)
 
 	ASSERT(logdata != NULL);
 
+	nx_logdata_materialize(logdata);
+
 	for (field = NX_DLIST_FIRST(&(logdata->fields));
 		 field != NULL;
 		 field = NX_DLIST_NEXT(field, link))
@@ -462,3 +744,110 @@ void nx_logdata_dump_fields(nx_logdata_t *logdata)
 		free(value);
 	}
 }
+
+/*
+ *  A deferred parse must not set raw_event, that would free the buffer the
+ *  caller is still using. Returns FALSE if src may contain the name, the
+ *  parsers can replace the byte in the middle.
+ */
+boolean nx_logdata_lazy_allowed(const char *src, size_t len)
+{
+	static const char name[] = "raw_event";
+	size_t i, j;
+
+	ASSERT(src != NULL);
+
+	for (i = 0; i + sizeof(name) - 1 <= len; i++)
+	{
+		for (j = 0; j < sizeof(name) - 1; j++)
+		{
+			if ((j != 3) && (apr_tolower(src[i + j]) != name[j]))
+			{
+				break;
+			}
+		}
+		if (j == sizeof(name) - 1)
+		{
+			return (FALSE);
+		}
+	}
+
+	return (TRUE);
+}
+
+/*
+ *  Defer a parse until the fields are accessed. A copy of src and data is
+ *  kept with the parse functions. Lookups go through get if it is not NULL,
+ *  anything else runs parse to materialize all fields.
+ */
+nx_logdata_lazy_t *nx_logdata_set_lazy(nx_logdata_t *logdata,
+									   nx_logdata_lazy_parse_func_t *parse,
+									   nx_logdata_lazy_get_func_t *get,
+									   const void *data,
+									   size_t datasize,
+									   const char *src,
+									   size_t len)
+{
+	nx_logdata_lazy_t *lazy;
+	size_t offs;
+
+	ASSERT(logdata != NULL);
+	ASSERT(parse != NULL);
+	ASSERT(src != NULL);
+
+	nx_logdata_materialize(logdata);
+	ASSERT(logdata->lazy == NULL);
+
+	// data follows the source, aligned for any type
+	offs = (sizeof(nx_logdata_lazy_t) + len + 1 + sizeof(apr_time_t) - 1) & ~(sizeof(apr_time_t) - 1);
+	lazy = malloc(offs + datasize);
+	ASSERT(lazy != NULL);
+	memset(lazy, 0, sizeof(nx_logdata_lazy_t));
+	lazy->parse = parse;
+	lazy->get = get;
+	lazy->time = apr_time_now();
+	lazy->len = len;
+	memcpy(lazy->src, src, len);
+	lazy->src[len] = '\0';
+	if (datasize > 0)
+	{
+		lazy->data = (char *)lazy + offs;
+		memcpy(lazy->data, data, datasize);
+	}
+	logdata->lazy = lazy;
+
+	return (lazy);
+}
+
+/*
+ *  Run the pending parse, the fields of logdata are complete afterwards.
+ *  Everything accessing the fields other than the lookups calls this.
+ */
+void nx_logdata_materialize(const nx_logdata_t *logdata)
+{
+	nx_logdata_t *mutable = (nx_logdata_t *)logdata;
+	nx_logdata_lazy_t *lazy;
+	nx_exception_t e;
+
+	ASSERT(logdata != NULL);
+
+	lazy = logdata->lazy;
+	if ((lazy == NULL) || (lazy->busy == TRUE))
+	{
+		return;
+	}
+
+	lazy->busy = TRUE;
+	try
+	{
+		lazy->parse(mutable, lazy);
+	}
+	catch (e)
+	{
+		mutable->lazy = NULL;
+		lazy_free(lazy);
+		rethrow(e);
+	}
+	mutable->lazy = NULL;
+	lazy_free(lazy);
+}
@@ -31,12 +31,63 @@ typedef struct nx_logdata_field_list_t nx_logdata_field_list_t;
 NX_DLIST_HEAD(nx_logdata_field_list_t, nx_logdata_field_t);
 
 
-typedef struct nx_logdata_t
+typedef struct nx_logdata_t nx_logdata_t;
+typedef struct nx_logdata_lazy_t nx_logdata_lazy_t;
+typedef struct nx_trace_t nx_trace_t;
+
+typedef enum nx_logdata_lazy_result_t
+{
+    NX_LOGDATA_LAZY_UNKNOWN = 0,	///< only the full parse can tell
+    NX_LOGDATA_LAZY_FOUND,
+    NX_LOGDATA_LAZY_ABSENT,
+} nx_logdata_lazy_result_t;
+
+/// sets all fields of the deferred parse in logdata
+typedef void (nx_logdata_lazy_parse_func_t)(nx_logdata_t *logdata,
+					    nx_logdata_lazy_t *lazy);
+/// extracts a single field, *field is allocated with nx_logdata_field_t when found
+typedef nx_logdata_lazy_result_t (nx_logdata_lazy_get_func_t)(nx_logdata_t *logdata,
+							      nx_logdata_lazy_t *lazy,
+							      const char *key,
+							      nx_logdata_field_t **field);
+
+typedef struct nx_logdata_lazy_key_t
+{
+    char		*key;
+    boolean		found;	///< FALSE if the parse doesn't set the field
+    boolean		appended; ///< the extracted field was added after the others
+} nx_logdata_lazy_key_t;
+
+/**
+ * A parse deferred until the fields are accessed. The parser keeps a copy
+ * of the source, the fields are materialized when something other than a
+ * lookup touches logdata.
+ */
+struct nx_logdata_lazy_t
+{
+    nx_logdata_lazy_parse_func_t *parse;
+    nx_logdata_lazy_get_func_t	*get;	///< NULL if fields can't be extracted one by one
+    void			*data;	///< parser state, copied after the struct
+    apr_time_t			time;	///< when the parser was called, used instead of the current time
+    boolean			busy;	///< the parser is running, logdata is accessed directly
+    nx_logdata_lazy_key_t	*keys;	///< names already looked up with get
+    int				num_key;
+    int				keys_size;
+    size_t			len;
+    char			src[];	///< NUL terminated copy of the source
+};
+
+struct nx_logdata_t
 {
     NX_DLIST_ENTRY(nx_logdata_t) link; ///< all messages are linked together in a queue
     nx_string_t *raw_event; ///< shortcut to the raw_event field
     nx_logdata_field_list_t fields;	///< linked list of key-value pairs
-} nx_logdata_t;
+    nx_ack_source_t *ack_source; ///< source to acknowledge when freed, NULL if not tracked
+    apr_uint32_t ack_seq;	///< slot sequence number within ack_source
+    nx_logdata_lazy_t *lazy;	///< pending parse, NULL if the fields are complete
+    apr_time_t queued;		///< when it was pushed to the last logqueue, 0 once it was peeked
+    nx_trace_t *trace;		///< sampled latency trace, NULL for most events
+};
 
 nx_logdata_t *nx_logdata_new_logline(const char *ptr, int len);
 nx_logdata_t *nx_logdata_new();
@@ -53,6 +104,12 @@ void nx_logdata_set_field_value(nx_logdata_t *logdata,
 				const char *key,
 				nx_value_t *value);
 void nx_logdata_set_field(nx_logdata_t *logdata, nx_logdata_field_t *setfield);
+uint64_t nx_logdata_key_bloom_bit(const char *key);
+uint64_t nx_logdata_key_bloom(const nx_logdata_t *logdata);
+void nx_logdata_bloom_set_field_value(nx_logdata_t *logdata,
+				      uint64_t *keys,
+				      const char *key,
+				      nx_value_t *value);
 void nx_logdata_rename_field(nx_logdata_t *logdata,
 			     const char *old,
 			     const char *new);
@@ -80,6 +137,15 @@ void nx_logdata_set_boolean(nx_logdata_t *logdata,
 			    const char *key,
 			    boolean value);
 void nx_logdata_dump_fields(nx_logdata_t *logdata);
+boolean nx_logdata_lazy_allowed(const char *src, size_t len);
+nx_logdata_lazy_t *nx_logdata_set_lazy(nx_logdata_t *logdata,
+				       nx_logdata_lazy_parse_func_t *parse,
+				       nx_logdata_lazy_get_func_t *get,
+				       const void *data,
+				       size_t datasize,
+				       const char *src,
+				       size_t len);
+void nx_logdata_materialize(const nx_logdata_t *logdata);
 
 // serialize
 apr_size_t nx_logdata_serialized_size(const nx_logdata_t *logdata);
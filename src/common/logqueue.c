@@ -11,6 +11,7 @@
 #include "exception.h"
 #include "alloc.h"
 #include "module.h"
+#include "trace.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
 
@@ -54,6 +55,11 @@ int nx_logqueue_push(nx_logqueue_t *logqueue, nx_logdata_t *logdata)
     ASSERT(logqueue != NULL);
     ASSERT(logdata != NULL);
 
+    logdata->queued = apr_time_now();
+    if ( logdata->trace != NULL )
+    {
+	nx_trace_stamp(logdata->trace, NX_TRACE_PUSH, logqueue->name);
+    }
     {
 	CHECKERR(apr_thread_mutex_lock(logqueue->mutex));
     
@@ -64,6 +70,10 @@ int nx_logqueue_push(nx_logqueue_t *logqueue, nx_logdata_t *logdata)
 	NX_DLIST_INSERT_TAIL(logqueue->list, logdata, link);
 	(logqueue->size)++;
 	retval = logqueue->size;
+	if ( retval > logqueue->highwater )
+	{
+	    logqueue->highwater = retval;
+	}
 
 	CHECKERR(apr_thread_mutex_unlock(logqueue->mutex));
     }
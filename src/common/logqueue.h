@@ -25,6 +25,7 @@ typedef struct nx_logqueue_t
     nx_logqueue_list_t *list;		///< List of logdata structures (the real queue)
     int			size;		///< number of elements in the queue
     int			limit;
+    int			highwater;	///< largest size seen since start
     const char		*name;
     const char		*basedir;
     boolean		needpop;	///< TRUE after nx_logqueue_peek has been called
@@ -0,0 +1,322 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include <time.h>
+
+#include "error_debug.h"
+#include "context.h"
+#include "atomic.h"
+#include "metrics.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_CORE
+
+
+static apr_uint32_t _next_shard = 0;
+
+
+/**
+ * Return the shard of the calling thread. Threads get the shards in a round
+ * robin fashion when they first update a counter, threads without a
+ * context share the first one.
+ */
+static nx_metrics_shard_t *nx_metrics_shard(nx_metrics_t *metrics)
+{
+    nx_context_t *context;
+
+    context = nx_find_thread_context();
+    if ( context == NULL )
+    {
+	return ( &(metrics->shards[0]) );
+    }
+    if ( context->metrics_shard == 0 )
+    {
+	nx_atomic_add32(&_next_shard, 1);
+	context->metrics_shard = (int) (nx_atomic_read32(&_next_shard) % NX_METRICS_SHARDS) + 1;
+    }
+
+    return ( &(metrics->shards[context->metrics_shard - 1]) );
+}
+
+
+
+nx_metrics_t *nx_metrics_new(apr_pool_t *pool)
+{
+    return ( apr_pcalloc(pool, sizeof(nx_metrics_t)) );
+}
+
+
+
+/**
+ * Increment a counter, does nothing if metrics is NULL.
+ */
+void nx_metrics_add(nx_metrics_t *metrics, nx_metrics_counter_t counter, uint64_t value)
+{
+    nx_metrics_shard_t *shard;
+
+    if ( metrics == NULL )
+    {
+	return;
+    }
+    ASSERT(counter < NX_METRICS_COUNTER_LAST);
+
+    shard = nx_metrics_shard(metrics);
+    nx_atomic_add64(&(shard->counters[counter]), value);
+}
+
+
+
+int nx_histogram_bucket(uint64_t value)
+{
+    int bits;
+
+    if ( value < NX_HISTOGRAM_SUB_BUCKETS )
+    {
+	return ( (int) value );
+    }
+    if ( value >= ((uint64_t) 1 << NX_HISTOGRAM_MAX_BITS) )
+    {
+	return ( NX_HISTOGRAM_BUCKETS - 1 );
+    }
+
+    bits = 63 - __builtin_clzll(value);
+
+    return ( (bits - NX_HISTOGRAM_SUB_BITS + 1) * NX_HISTOGRAM_SUB_BUCKETS +
+	     (int) ((value >> (bits - NX_HISTOGRAM_SUB_BITS)) & (NX_HISTOGRAM_SUB_BUCKETS - 1)) );
+}
+
+
+
+/**
+ * Return the smallest value which is above the given bucket
+ */
+uint64_t nx_histogram_bucket_limit(int bucket)
+{
+    int bits;
+    int sub;
+
+    ASSERT((bucket >= 0) && (bucket < NX_HISTOGRAM_BUCKETS));
+
+    if ( bucket < NX_HISTOGRAM_SUB_BUCKETS )
+    {
+	return ( (uint64_t) bucket + 1 );
+    }
+    bits = bucket / NX_HISTOGRAM_SUB_BUCKETS + NX_HISTOGRAM_SUB_BITS - 1;
+    sub = bucket % NX_HISTOGRAM_SUB_BUCKETS;
+
+    return ( ((uint64_t) (NX_HISTOGRAM_SUB_BUCKETS + sub + 1)) << (bits - NX_HISTOGRAM_SUB_BITS) );
+}
+
+
+
+/**
+ * Record a duration in microseconds, does nothing if metrics is NULL.
+ */
+void nx_metrics_record(nx_metrics_t *metrics, nx_metrics_histogram_t histogram, apr_time_t usec)
+{
+    nx_histogram_t *hist;
+    uint64_t value;
+    uint64_t max;
+
+    if ( metrics == NULL )
+    {
+	return;
+    }
+    ASSERT(histogram < NX_METRICS_HISTOGRAM_LAST);
+
+    hist = &(nx_metrics_shard(metrics)->histograms[histogram]);
+    value = (usec < 0) ? 0 : (uint64_t) usec;
+
+    nx_atomic_add64(&(hist->count), 1);
+    nx_atomic_add64(&(hist->sum), value);
+    nx_atomic_add64(&(hist->buckets[nx_histogram_bucket(value)]), 1);
+    for ( max = nx_atomic_read64(&(hist->max));
+	  max < value;
+	  max = nx_atomic_read64(&(hist->max)) )
+    {
+	if ( nx_atomic_cas64(&(hist->max), max, value) )
+	{
+	    break;
+	}
+    }
+}
+
+
+
+/**
+ * Add a value to a histogram which is not shared between threads,
+ * the caller must serialize the updates.
+ */
+void nx_histogram_add(nx_histogram_t *histogram, uint64_t value)
+{
+    ASSERT(histogram != NULL);
+
+    (histogram->count)++;
+    histogram->sum += value;
+    (histogram->buckets[nx_histogram_bucket(value)])++;
+    if ( value > histogram->max )
+    {
+	histogram->max = value;
+    }
+}
+
+
+
+/**
+ * Sum the shards into total. The shards are read without locking,
+ * so the result may be slightly behind concurrent updates.
+ */
+void nx_metrics_get(const nx_metrics_t *metrics, nx_metrics_shard_t *total)
+{
+    const nx_metrics_shard_t *shard;
+    const nx_histogram_t *hist;
+    uint64_t max;
+    int i, j, k;
+
+    ASSERT(total != NULL);
+
+    memset(total, 0, sizeof(nx_metrics_shard_t));
+    if ( metrics == NULL )
+    {
+	return;
+    }
+
+    for ( i = 0; i < NX_METRICS_SHARDS; i++ )
+    {
+	shard = &(metrics->shards[i]);
+	for ( j = 0; j < NX_METRICS_COUNTER_LAST; j++ )
+	{
+	    total->counters[j] += nx_atomic_read64(&(shard->counters[j]));
+	}
+	for ( j = 0; j < NX_METRICS_HISTOGRAM_LAST; j++ )
+	{
+	    hist = &(shard->histograms[j]);
+	    total->histograms[j].count += nx_atomic_read64(&(hist->count));
+	    total->histograms[j].sum += nx_atomic_read64(&(hist->sum));
+	    max = nx_atomic_read64(&(hist->max));
+	    if ( max > total->histograms[j].max )
+	    {
+		total->histograms[j].max = max;
+	    }
+	    for ( k = 0; k < NX_HISTOGRAM_BUCKETS; k++ )
+	    {
+		total->histograms[j].buckets[k] += nx_atomic_read64(&(hist->buckets[k]));
+	    }
+	}
+    }
+}
+
+
+
+/**
+ * Return the highest value of the bucket which contains the given
+ * percentile (0-100), but not more than the largest recorded value.
+ */
+uint64_t nx_histogram_percentile(const nx_histogram_t *histogram, double percentile)
+{
+    uint64_t target;
+    uint64_t seen = 0;
+    uint64_t limit;
+    int i;
+
+    ASSERT(histogram != NULL);
+
+    if ( histogram->count == 0 )
+    {
+	return ( 0 );
+    }
+
+    target = (uint64_t) ((double) histogram->count * percentile / 100.0 + 0.999999);
+    if ( target == 0 )
+    {
+	target = 1;
+    }
+    for ( i = 0; i < NX_HISTOGRAM_BUCKETS; i++ )
+    {
+	seen += histogram->buckets[i];
+	if ( seen >= target )
+	{
+	    limit = nx_histogram_bucket_limit(i) - 1;
+	    return ( limit < histogram->max ? limit : histogram->max );
+	}
+    }
+
+    return ( histogram->max );
+}
+
+
+
+const char *nx_metrics_counter_to_string(nx_metrics_counter_t counter)
+{
+    switch ( counter )
+    {
+	case NX_METRICS_BYTES_IN:
+	    return "bytes_in";
+	case NX_METRICS_BYTES_OUT:
+	    return "bytes_out";
+	case NX_METRICS_DROPS:
+	    return "drops";
+	case NX_METRICS_PAUSES:
+	    return "pauses";
+	case NX_METRICS_CPUTIME:
+	    return "cpu_usec";
+	case NX_METRICS_SLOW_EVENTS:
+	    return "slow_events";
+	default:
+	    break;
+    }
+
+    return "unknown";
+}
+
+
+
+const char *nx_metrics_histogram_to_string(nx_metrics_histogram_t histogram)
+{
+    switch ( histogram )
+    {
+	case NX_METRICS_PROCTIME:
+	    return "processing_time";
+	case NX_METRICS_QUEUETIME:
+	    return "queue_time";
+	default:
+	    break;
+    }
+
+    return "unknown";
+}
+
+
+
+/**
+ * Return the CPU time used by the calling thread in microseconds,
+ * or 0 if this is not supported on the platform.
+ */
+apr_time_t nx_metrics_thread_cputime()
+{
+#ifdef WIN32
+    FILETIME created, exited, kernel, user;
+    ULARGE_INTEGER k, u;
+
+    if ( GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user) != 0 )
+    {
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	// 100 nanosecond units
+	return ( (apr_time_t) ((k.QuadPart + u.QuadPart) / 10) );
+    }
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec ts;
+
+    if ( clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0 )
+    {
+	return ( (apr_time_t) ts.tv_sec * APR_USEC_PER_SEC + ts.tv_nsec / 1000 );
+    }
+#endif
+    return ( 0 );
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_METRICS_H
+#define __NX_METRICS_H
+
+#include "types.h"
+
+/*
+ * Per-module counters and latency histograms. Every thread updates its own
+ * shard with relaxed atomic operations so that no lock is taken and threads
+ * do not write the same cache lines. Readers sum the shards.
+ *
+ * Histograms are log-linear like HDR histograms: values below
+ * NX_HISTOGRAM_SUB_BUCKETS have their own bucket, above that every power of
+ * two is split into NX_HISTOGRAM_SUB_BUCKETS buckets, which keeps the
+ * relative error below 12.5%. Values are in microseconds, anything above
+ * 2^NX_HISTOGRAM_MAX_BITS (~71 minutes) goes into the last bucket.
+ */
+
+#define NX_METRICS_SHARDS 8
+#define NX_HISTOGRAM_SUB_BITS 3
+#define NX_HISTOGRAM_SUB_BUCKETS (1 << NX_HISTOGRAM_SUB_BITS)
+#define NX_HISTOGRAM_MAX_BITS 32
+#define NX_HISTOGRAM_BUCKETS ((NX_HISTOGRAM_MAX_BITS - NX_HISTOGRAM_SUB_BITS + 1) * NX_HISTOGRAM_SUB_BUCKETS)
+
+typedef enum nx_metrics_counter_t
+{
+    NX_METRICS_BYTES_IN = 0,	///< size of the raw events received
+    NX_METRICS_BYTES_OUT,	///< size of the raw events forwarded
+    NX_METRICS_DROPS,		///< events discarded by drop() or because the next queue was full
+    NX_METRICS_PAUSES,		///< times the module was paused by flow control
+    NX_METRICS_CPUTIME,		///< CPU time in usec spent processing events of the module
+    NX_METRICS_SLOW_EVENTS,	///< events which ran longer than SlowEventThreshold
+    NX_METRICS_COUNTER_LAST,
+} nx_metrics_counter_t;
+
+typedef enum nx_metrics_histogram_t
+{
+    NX_METRICS_PROCTIME = 0,	///< time spent processing an event of the module
+    NX_METRICS_QUEUETIME,	///< time a log message spent in the module's queue
+    NX_METRICS_HISTOGRAM_LAST,
+} nx_metrics_histogram_t;
+
+typedef struct nx_histogram_t
+{
+    uint64_t		count;
+    uint64_t		sum;
+    uint64_t		max;
+    uint64_t		buckets[NX_HISTOGRAM_BUCKETS];
+} nx_histogram_t;
+
+typedef struct nx_metrics_shard_t
+{
+    uint64_t		counters[NX_METRICS_COUNTER_LAST];
+    nx_histogram_t	histograms[NX_METRICS_HISTOGRAM_LAST];
+} nx_metrics_shard_t;
+
+typedef struct nx_metrics_t
+{
+    nx_metrics_shard_t	shards[NX_METRICS_SHARDS];
+} nx_metrics_t;
+
+nx_metrics_t *nx_metrics_new(apr_pool_t *pool);
+void nx_metrics_add(nx_metrics_t *metrics, nx_metrics_counter_t counter, uint64_t value);
+void nx_metrics_record(nx_metrics_t *metrics, nx_metrics_histogram_t histogram, apr_time_t usec);
+void nx_metrics_get(const nx_metrics_t *metrics, nx_metrics_shard_t *total);
+int nx_histogram_bucket(uint64_t value);
+uint64_t nx_histogram_bucket_limit(int bucket);
+void nx_histogram_add(nx_histogram_t *histogram, uint64_t value);
+uint64_t nx_histogram_percentile(const nx_histogram_t *histogram, double percentile);
+const char *nx_metrics_counter_to_string(nx_metrics_counter_t counter);
+const char *nx_metrics_histogram_to_string(nx_metrics_histogram_t histogram);
+apr_time_t nx_metrics_thread_cputime();
+
+#endif	/* __NX_METRICS_H */
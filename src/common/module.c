@@ -10,11 +10,14 @@
 #include "error_debug.h"
 #include "module.h"
 #include "date.h"
+#include "atomic.h"
+#include "trace.h"
 #include "../core/job.h"
 #include "../core/nxlog.h"
 #include "../common/serialize.h"
 #include "../common/expr.h"
 #include "../common/expr-parser.h"
+#include "../common/expr-vm.h"
 #include "../common/alloc.h"
 #include "../common/atomic.h"
 
@@ -439,7 +442,7 @@ boolean nx_module_can_send(nx_module_t *module, double multiplier)
  * This is only called from reroute() and add_to_route() procedures
  * Flow Control is not supported here because it cannot be.
  */
-void nx_module_add_logdata_to_route(nx_module_t *module UNUSED,
+void nx_module_add_logdata_to_route(nx_module_t *module,
 				    nx_route_t *route,
 				    nx_logdata_t *logdata)
 {
@@ -455,10 +458,15 @@ void nx_module_add_logdata_to_route(nx_module_t *module UNUSED,
 	{
 	    if ( nx_logqueue_size(curr->queue) >= curr->queue->limit )
 	    { // cannot forward so we drop it since there is no flow-control
+		nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
 	    }
 	    else
 	    {
 		tmp = nx_logdata_clone(logdata);
+		if ( tmp->trace != NULL )
+		{
+		    nx_trace_set_route(tmp->trace, route->name);
+		}
 		nx_logqueue_push(curr->queue, tmp);
 		nx_module_data_available(curr);
 	    }
@@ -469,10 +477,15 @@ void nx_module_add_logdata_to_route(nx_module_t *module UNUSED,
 	{
 	    if ( nx_logqueue_size(curr->queue) >= curr->queue->limit )
 	    { // cannot forward so we drop it since there is no flow-control
+		nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
 	    }
 	    else
 	    {
 		tmp = nx_logdata_clone(logdata);
+		if ( tmp->trace != NULL )
+		{
+		    nx_trace_set_route(tmp->trace, route->name);
+		}
 		nx_logqueue_push(curr->queue, tmp);
 		nx_module_data_available(curr);
 	    }
@@ -482,11 +495,23 @@ void nx_module_add_logdata_to_route(nx_module_t *module UNUSED,
 
 
 
+static uint64_t nx_module_logdata_size(nx_logdata_t *logdata)
+{
+    if ( logdata->raw_event == NULL )
+    {
+	return ( 0 );
+    }
+    return ( (uint64_t) logdata->raw_event->len );
+}
+
+
+
 void nx_module_add_logdata_input(nx_module_t *module,
 				 nx_module_input_t *input,
 				 nx_logdata_t *logdata)
 {
     int i, j, cnt = 0;
+    uint64_t size;
     nx_logdata_t *tmp = logdata;
     nx_route_t *route;
     nx_module_t *curr;
@@ -496,6 +521,12 @@ void nx_module_add_logdata_input(nx_module_t *module,
     ASSERT(logdata != NULL);
     ASSERT(module->type == NX_MODULE_TYPE_INPUT);
 
+    if ( NX_TRACE_SAMPLE(module->trace_countdown) )
+    {
+	module->trace_countdown = nx_trace_rate();
+	nx_trace_begin(logdata, module->name);
+    }
+
     if ( nx_logdata_get_field(logdata, "EventReceivedTime") == NULL )
     {
 	nx_logdata_set_datetime(logdata, "EventReceivedTime", apr_time_now());
@@ -509,9 +540,8 @@ void nx_module_add_logdata_input(nx_module_t *module,
 	nx_logdata_set_string(logdata, "SourceModuleType", module->dsoname);
     }
 
-    nx_module_lock(module);
-    (module->evt_recvd)++;
-    nx_module_unlock(module);
+    nx_atomic_add64(&(module->evt_recvd), 1);
+    nx_metrics_add(module->metrics, NX_METRICS_BYTES_IN, nx_module_logdata_size(logdata));
 
     if ( module->exec != NULL )
     {
@@ -529,12 +559,15 @@ void nx_module_add_logdata_input(nx_module_t *module,
 	}
 	if ( eval_ctx.logdata == NULL )
 	{ // dropped ?
+	    nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
 	    nx_logdata_free(logdata);
 	    nx_expr_eval_ctx_destroy(&eval_ctx);
 	    return;
 	}
 	nx_expr_eval_ctx_destroy(&eval_ctx);
     }
+    // the logdata cannot be accessed after it was pushed
+    size = nx_module_logdata_size(logdata);
 
     // count how many we need to add
     for ( i = 0; i < module->routes->nelts; i++ )
@@ -579,10 +612,15 @@ void nx_module_add_logdata_input(nx_module_t *module,
 		{
 		    tmp = logdata;
 		}
+		if ( tmp->trace != NULL )
+		{
+		    nx_trace_set_route(tmp->trace, route->name);
+		}
 		if ( module->flowcontrol == FALSE )
 		{
 		    if ( nx_logqueue_size(curr->queue) >= curr->queue->limit )
 		    { // cannot forward, drop it
+			nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
 			nx_logdata_free(tmp);
 		    }
 		    else
@@ -619,10 +657,15 @@ void nx_module_add_logdata_input(nx_module_t *module,
 		{
 		    tmp = logdata;
 		}
+		if ( tmp->trace != NULL )
+		{
+		    nx_trace_set_route(tmp->trace, route->name);
+		}
 		if ( module->flowcontrol == FALSE )
 		{
 		    if ( nx_logqueue_size(curr->queue) >= curr->queue->limit )
 		    { // cannot forward, drop it
+			nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
 			nx_logdata_free(tmp);
 		    }
 		    else
@@ -652,9 +695,8 @@ void nx_module_add_logdata_input(nx_module_t *module,
 
     if ( sent == TRUE )
     {
-	nx_module_lock(module);
-	(module->evt_fwd)++;
-	nx_module_unlock(module);
+	nx_atomic_add64(&(module->evt_fwd), 1);
+	nx_metrics_add(module->metrics, NX_METRICS_BYTES_OUT, size);
     }
 }
 
@@ -667,11 +709,14 @@ void nx_module_progress_logdata(nx_module_t *module, nx_logdata_t *logdata)
     nx_logdata_t *tmp = logdata;
     int i;
     boolean sent = FALSE;
+    uint64_t size;
 
     ASSERT(module != NULL);
     ASSERT(logdata != NULL);
     ASSERT(module->type == NX_MODULE_TYPE_PROCESSOR);
 
+    size = nx_module_logdata_size(logdata);
+
     log_debug("%s nx_module_progress_logdata()", module->name);
 
     // FIXME: this is popped before it is added to the destination
@@ -700,6 +745,7 @@ void nx_module_progress_logdata(nx_module_t *module, nx_logdata_t *logdata)
 	{
 	    if ( nx_logqueue_size(curr->queue) >= curr->queue->limit )
 	    { // cannot forward, drop it
+		nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
 		nx_logdata_free(tmp);
 	    }
 	    else
@@ -742,6 +788,7 @@ void nx_module_progress_logdata(nx_module_t *module, nx_logdata_t *logdata)
 	    {
 		if ( nx_logqueue_size(curr->queue) >= curr->queue->limit )
 		{ // cannot forward, drop it
+		    nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
 		    nx_logdata_free(tmp);
 		}
 		else
@@ -770,9 +817,8 @@ void nx_module_progress_logdata(nx_module_t *module, nx_logdata_t *logdata)
 
     if ( sent == TRUE )
     {
-	nx_module_lock(module);
-	(module->evt_fwd)++;
-	nx_module_unlock(module);
+	nx_atomic_add64(&(module->evt_fwd), 1);
+	nx_metrics_add(module->metrics, NX_METRICS_BYTES_OUT, size);
     }
 }
 
@@ -895,6 +941,7 @@ nx_logdata_t *nx_module_logqueue_peek(nx_module_t *module)
 {
     nx_logdata_t *logdata = NULL;
     int queuesize;
+    boolean dequeued = FALSE;
 
     ASSERT(module != NULL);
     ASSERT(module->type != NX_MODULE_TYPE_INPUT );
@@ -913,9 +960,19 @@ nx_logdata_t *nx_module_logqueue_peek(nx_module_t *module)
 
     if ( logdata != NULL )
     {
-	nx_module_lock(module);
-	(module->evt_recvd)++;
-	nx_module_unlock(module);
+	if ( logdata->trace != NULL )
+	{
+	    nx_trace_stamp(logdata->trace, NX_TRACE_PEEK, module->name);
+	}
+	// the same event is returned again until it is popped, count it once
+	if ( logdata->queued != 0 )
+	{
+	    dequeued = TRUE;
+	    nx_metrics_record(module->metrics, NX_METRICS_QUEUETIME, apr_time_now() - logdata->queued);
+	    logdata->queued = 0;
+	    nx_atomic_add64(&(module->evt_recvd), 1);
+	    nx_metrics_add(module->metrics, NX_METRICS_BYTES_IN, nx_module_logdata_size(logdata));
+	}
 
 	if ( module->exec != NULL )
 	{
@@ -933,6 +990,7 @@ nx_logdata_t *nx_module_logqueue_peek(nx_module_t *module)
 	    }
 	    if ( eval_ctx.logdata == NULL )
 	    { // dropped?
+		nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
 		nx_logqueue_pop(module->queue, logdata);
 		nx_logdata_free(logdata);
 		logdata = NULL;
@@ -941,12 +999,11 @@ nx_logdata_t *nx_module_logqueue_peek(nx_module_t *module)
 	}
     }
 
-    if ( (logdata != NULL) && (module->type == NX_MODULE_TYPE_OUTPUT) )
+    if ( (logdata != NULL) && (dequeued == TRUE) && (module->type == NX_MODULE_TYPE_OUTPUT) )
     {
 	// increase counters
-	nx_module_lock(module);
-	(module->evt_fwd)++;
-	nx_module_unlock(module);
+	nx_atomic_add64(&(module->evt_fwd), 1);
+	nx_metrics_add(module->metrics, NX_METRICS_BYTES_OUT, nx_module_logdata_size(logdata));
     }
 
     return ( logdata );
@@ -960,6 +1017,12 @@ void nx_module_logqueue_pop(nx_module_t *module, nx_logdata_t *logdata)
     ASSERT(module->type != NX_MODULE_TYPE_INPUT );
     ASSERT(module->queue != NULL);
 
+    if ( logdata->trace != NULL )
+    {
+	nx_trace_stamp(logdata->trace,
+		       module->type == NX_MODULE_TYPE_OUTPUT ? NX_TRACE_OUTPUT : NX_TRACE_POP,
+		       module->name);
+    }
     nx_logqueue_pop(module->queue, logdata);
 }
 
@@ -971,10 +1034,10 @@ void nx_module_logqueue_drop(nx_module_t *module, nx_logdata_t *logdata)
     ASSERT(module->type != NX_MODULE_TYPE_INPUT );
     ASSERT(module->queue != NULL);
 
-    // increase counters
-    nx_module_lock(module);
-    (module->evt_fwd)--;
-    nx_module_unlock(module);
+    // the event was counted as forwarded by nx_module_logqueue_peek()
+    nx_atomic_add64(&(module->evt_fwd), (uint64_t) -1);
+    nx_metrics_add(module->metrics, NX_METRICS_BYTES_OUT, (uint64_t) -nx_module_logdata_size(logdata));
+    nx_metrics_add(module->metrics, NX_METRICS_DROPS, 1);
     nx_logqueue_pop(module->queue, logdata);
     nx_logdata_free(logdata);
 }
@@ -1106,6 +1169,10 @@ void nx_module_start_self(nx_module_t *module)
     }
     nx_module_add_scheduled_events(module);
 
+    if ( module->type == NX_MODULE_TYPE_INPUT )
+    {
+	module->trace_countdown = nx_trace_rate();
+    }
     nx_module_set_status(module, NX_MODULE_STATUS_RUNNING);
 
     // process saved queues
@@ -1218,6 +1285,7 @@ void nx_module_pause_self(nx_module_t *module)
 	module->decl->pause(module);
     }
     nx_module_set_status(module, NX_MODULE_STATUS_PAUSED);
+    nx_metrics_add(module->metrics, NX_METRICS_PAUSES, 1);
 }
 
 
@@ -1470,6 +1538,8 @@ nx_expr_statement_list_t *nx_module_parse_exec_block(nx_module_t *module,
 		    NX_DLIST_REMOVE(statements, stmnt, link);
 		    NX_DLIST_INSERT_TAIL(retval, stmnt, link);
 		}
+		// the list has changed, compile it again
+		nx_expr_statement_list_compile(pool, retval);
 	    }
 	}
 	curr = curr->next;
@@ -1635,6 +1705,10 @@ void nx_module_init(nx_module_t *module)
 
 
 
+/**
+ * Return module specific information for the status dump, the string
+ * is allocated with malloc() and must be freed by the caller.
+ */
 char *nx_module_info(nx_module_t *module)
 {
     ASSERT(module != NULL);
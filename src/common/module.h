@@ -25,8 +25,10 @@
 #include "expr.h"
 #include "schedule.h"
 #include "statvar.h"
+#include "date.h"
+#include "metrics.h"
 
-#define NX_MODULE_API_VERSION 4
+#define NX_MODULE_API_VERSION 5
 
 #define NX_MODULE_DEFAULT_OUTPUT_BUFSIZE 65000
 #define NX_MODULE_DEFAULT_INPUT_BUFSIZE 65000
@@ -220,8 +222,8 @@ struct nx_module_t
     nx_module_flag_t   flags;
     void 		*config;
     apr_thread_mutex_t	*mutex;
-    uint64_t		evt_recvd;	///< events received
-    uint64_t		evt_fwd;	///< events sent
+    uint64_t		evt_recvd;	///< events received, updated atomically
+    uint64_t		evt_fwd;	///< events sent, updated atomically
     int			priority;	///< the highest priority of all routes this input/output module is part of
     nx_job_t		*job;		///< job for input and output modules, NULL for processors
     nx_module_data_t 	*data; 		///< custom data for the module, linked list
@@ -238,6 +240,11 @@ struct nx_module_t
     
     volatile apr_uint32_t in_poll;
     apr_pollset_t	*pollset;
+
+    nx_metrics_t	*metrics;	///< sharded counters and latency histograms
+    int			trace_countdown; ///< events until the next traced one, 0 if tracing is off
+    apr_time_t		slow_warned;	///< time of the last SlowEventThreshold warning, updated while the job is busy
+    nx_date_format_t	date_format;	///< last date format parsed for this module, see nx_date_parse_format()
 };
 
 const char *nx_module_type_to_string(nx_module_type_t type);
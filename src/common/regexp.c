@@ -0,0 +1,190 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "error_debug.h"
+#include "atomic.h"
+#include "context.h"
+#include "regexp.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_CORE
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+# define NX_REGEXP_STUDY_OPTIONS PCRE_STUDY_JIT_COMPILE
+# define NX_REGEXP_JIT_STACK_START (32 * 1024)
+# define NX_REGEXP_JIT_STACK_MAX (1024 * 1024)
+#else
+# define NX_REGEXP_STUDY_OPTIONS 0
+#endif
+
+
+
+#ifdef PCRE_STUDY_JIT_COMPILE
+/**
+ * The default JIT stack is 32K on the machine stack which is too small
+ * for some patterns. Each thread gets its own stack when it is first needed.
+ */
+static pcre_jit_stack *_jit_stack_cb(void *data UNUSED)
+{
+    nx_context_t *context;
+
+    context = nx_get_thread_context();
+    if ( context->jit_stack == NULL )
+    {
+	// pcre falls back to the machine stack if this fails
+	context->jit_stack = pcre_jit_stack_alloc(NX_REGEXP_JIT_STACK_START,
+						  NX_REGEXP_JIT_STACK_MAX);
+    }
+
+    return ( (pcre_jit_stack *) context->jit_stack );
+}
+#endif
+
+
+
+static void _regexp_destroy(nx_regexp_t *regexp)
+{
+    if ( regexp->extra != NULL )
+    {
+#ifdef PCRE_STUDY_JIT_COMPILE
+	pcre_free_study(regexp->extra);
+#else
+	pcre_free(regexp->extra);
+#endif
+    }
+    pcre_free(regexp->pcre);
+    free(regexp);
+}
+
+
+
+static apr_status_t _regexp_pool_cleanup(void *data)
+{
+    nx_regexp_free((nx_regexp_t *) data);
+
+    return ( APR_SUCCESS );
+}
+
+
+
+/**
+ * Compile and study the pattern. If pool is not NULL, the reference returned
+ * is released when the pool is destroyed, otherwise the caller must call
+ * nx_regexp_free().
+ */
+nx_regexp_t *nx_regexp_compile(apr_pool_t *pool, const char *str, int options)
+{
+    nx_regexp_t *retval;
+    pcre *re;
+    pcre_extra *extra;
+    const char *error = NULL;
+    int erroroffs = 0;
+    int capturecount = 0;
+
+    ASSERT(str != NULL);
+
+    re = pcre_compile(str, options, &error,  &erroroffs, NULL);
+    if ( re == NULL )
+    {
+	throw_msg("failed to compile regular expression '%s', error at position %d: %s",
+		  str, erroroffs, error);
+    }
+
+    error = NULL;
+    extra = pcre_study(re, NX_REGEXP_STUDY_OPTIONS, &error);
+    if ( error != NULL )
+    {
+	pcre_free(re);
+	throw_msg("failed to study regular expression '%s': %s", str, error);
+    }
+#ifdef PCRE_STUDY_JIT_COMPILE
+    if ( extra != NULL )
+    {
+	pcre_assign_jit_stack(extra, &_jit_stack_cb, NULL);
+    }
+#endif
+
+    if ( pcre_fullinfo(re, extra, PCRE_INFO_CAPTURECOUNT, &capturecount) < 0 )
+    {
+	capturecount = 0;
+    }
+
+    retval = malloc(sizeof(nx_regexp_t));
+    ASSERT(retval != NULL);
+    retval->pcre = re;
+    retval->extra = extra;
+    retval->capturecount = capturecount;
+    retval->refcnt = 1;
+
+    if ( pool != NULL )
+    {
+	apr_pool_cleanup_register(pool, retval, _regexp_pool_cleanup, apr_pool_cleanup_null);
+    }
+
+    return ( retval );
+}
+
+
+
+nx_regexp_t *nx_regexp_ref(nx_regexp_t *regexp)
+{
+    ASSERT(regexp != NULL);
+
+    nx_atomic_add32(&(regexp->refcnt), 1);
+
+    return ( regexp );
+}
+
+
+
+void nx_regexp_free(nx_regexp_t *regexp)
+{
+    ASSERT(regexp != NULL);
+
+    if ( nx_atomic_dec32(&(regexp->refcnt)) == 0 )
+    {
+	_regexp_destroy(regexp);
+    }
+}
+
+
+
+/**
+ * Same as pcre_exec(), the length of the subject must be known by the caller.
+ */
+int nx_regexp_exec(const nx_regexp_t *regexp,
+		   const char *subject,
+		   int length,
+		   int startoffset,
+		   int options,
+		   int *ovector,
+		   int ovecsize)
+{
+    ASSERT(regexp != NULL);
+    ASSERT(subject != NULL);
+
+    return ( pcre_exec(regexp->pcre, regexp->extra, subject, length, startoffset,
+		       options, ovector, ovecsize) );
+}
+
+
+
+/**
+ * Free the resources allocated for the calling thread.
+ */
+void nx_regexp_thread_cleanup()
+{
+#ifdef PCRE_STUDY_JIT_COMPILE
+    nx_context_t *context;
+
+    context = nx_get_thread_context();
+    if ( context->jit_stack != NULL )
+    {
+	pcre_jit_stack_free((pcre_jit_stack *) context->jit_stack);
+	context->jit_stack = NULL;
+    }
+#endif
+}
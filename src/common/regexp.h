@@ -0,0 +1,39 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_REGEXP_H
+#define __NX_REGEXP_H
+
+#include <pcre.h>
+#include "types.h"
+
+/*
+ * Compiled regular expression shared by the expression engine, values and modules.
+ * Patterns are studied (and JIT compiled when pcre supports it) once when they are
+ * compiled. The object is reference counted so copying a regexp value is cheap.
+ */
+typedef struct nx_regexp_t
+{
+    pcre			*pcre;
+    pcre_extra			*extra;		///< result of pcre_study(), can be NULL
+    int				capturecount;	///< number of capturing subpatterns
+    volatile apr_uint32_t	refcnt;
+} nx_regexp_t;
+
+nx_regexp_t *nx_regexp_compile(apr_pool_t *pool, const char *str, int options);
+nx_regexp_t *nx_regexp_ref(nx_regexp_t *regexp);
+void nx_regexp_free(nx_regexp_t *regexp);
+int nx_regexp_exec(const nx_regexp_t *regexp,
+		   const char *subject,
+		   int length,
+		   int startoffset,
+		   int options,
+		   int *ovector,
+		   int ovecsize);
+void nx_regexp_thread_cleanup();
+
+#endif	/* __NX_REGEXP_H */
@@ -7,6 +7,9 @@
 
 #include <apr_lib.h>
 #include <stdlib.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #include "error_debug.h"
 #include "exception.h"
@@ -979,3 +982,107 @@ nx_string_t *nx_string_strip_crlf(nx_string_t *str)
 
     return ( str );
 }
+
+
+
+void nx_string_scan_init(nx_string_scan_t *scan)
+{
+    ASSERT(scan != NULL);
+
+    memset(scan, 0, sizeof(nx_string_scan_t));
+}
+
+
+
+void nx_string_scan_add(nx_string_scan_t *scan, char c)
+{
+    unsigned char u = (unsigned char) c;
+
+    ASSERT(scan != NULL);
+
+    if ( (scan->map[u >> 5] & (1U << (u & 31))) != 0 )
+    {
+	return;
+    }
+    ASSERT(scan->num < NX_STRING_SCAN_MAX);
+    scan->map[u >> 5] |= 1U << (u & 31);
+    scan->chars[(scan->num)++] = c;
+}
+
+
+
+/**
+ * Return the offset of the first byte in src which is in the set,
+ * len if there is none. Checks 32 bytes at a time with SSE2.
+ */
+size_t nx_string_scan(const nx_string_scan_t *scan, const char *src, size_t len)
+{
+    size_t i = 0;
+    const unsigned char *ptr = (const unsigned char *) src;
+
+    ASSERT(scan != NULL);
+
+    if ( scan->num == 0 )
+    {
+	return ( len );
+    }
+
+#ifdef __SSE2__
+    if ( len >= 16 )
+    {
+	__m128i set[NX_STRING_SCAN_MAX];
+	__m128i chunk1, chunk2, found1, found2;
+	unsigned int mask;
+	int j;
+
+	for ( j = 0; j < scan->num; j++ )
+	{
+	    set[j] = _mm_set1_epi8(scan->chars[j]);
+	}
+
+	for ( ; i + 32 <= len; i += 32 )
+	{
+	    chunk1 = _mm_loadu_si128((const __m128i *) (ptr + i));
+	    chunk2 = _mm_loadu_si128((const __m128i *) (ptr + i + 16));
+	    found1 = _mm_cmpeq_epi8(chunk1, set[0]);
+	    found2 = _mm_cmpeq_epi8(chunk2, set[0]);
+	    for ( j = 1; j < scan->num; j++ )
+	    {
+		found1 = _mm_or_si128(found1, _mm_cmpeq_epi8(chunk1, set[j]));
+		found2 = _mm_or_si128(found2, _mm_cmpeq_epi8(chunk2, set[j]));
+	    }
+	    mask = (unsigned int) _mm_movemask_epi8(found1) |
+		((unsigned int) _mm_movemask_epi8(found2) << 16);
+	    if ( mask != 0 )
+	    {
+		return ( i + (size_t) __builtin_ctz(mask) );
+	    }
+	}
+
+	for ( ; i + 16 <= len; i += 16 )
+	{
+	    chunk1 = _mm_loadu_si128((const __m128i *) (ptr + i));
+	    found1 = _mm_cmpeq_epi8(chunk1, set[0]);
+	    for ( j = 1; j < scan->num; j++ )
+	    {
+		found1 = _mm_or_si128(found1, _mm_cmpeq_epi8(chunk1, set[j]));
+	    }
+	    mask = (unsigned int) _mm_movemask_epi8(found1);
+	    if ( mask != 0 )
+	    {
+		return ( i + (size_t) __builtin_ctz(mask) );
+	    }
+	}
+    }
+#endif
+
+    for ( ; i < len; i++ )
+    {
+	if ( (scan->map[ptr[i] >> 5] & (1U << (ptr[i] & 31))) != 0 )
+	{
+	    break;
+	}
+    }
+
+    return ( i );
+}
@@ -19,6 +19,18 @@ typedef enum nx_string_flag_t
     NX_STRING_FLAG_CONST = 1 << 1, // buf is not allocated by malloc, should not be free()-d
 } nx_string_flag_t;
 
+#define NX_STRING_SCAN_MAX 8
+
+/**
+ * Set of bytes searched for by nx_string_scan()
+ */
+typedef struct nx_string_scan_t
+{
+    uint32_t		map[8];		///< bitmap of the bytes
+    int			num;
+    char		chars[NX_STRING_SCAN_MAX];
+} nx_string_scan_t;
+
 typedef struct nx_string_t
 {
     nx_string_flag_t	flags;
@@ -50,6 +62,9 @@ nx_string_t *nx_string_escape(nx_string_t *str);
 size_t nx_string_unescape_c(char *str);
 boolean nx_string_validate_utf8(nx_string_t *str, boolean needfix, boolean throw);
 nx_string_t *nx_string_strip_crlf(nx_string_t *str);
+void nx_string_scan_init(nx_string_scan_t *scan);
+void nx_string_scan_add(nx_string_scan_t *scan, char c);
+size_t nx_string_scan(const nx_string_scan_t *scan, const char *src, size_t len);
 
 char *nx_utf8_find_next_char(char *p,
 			     char *end);
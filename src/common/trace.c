@@ -0,0 +1,485 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include <time.h>
+
+#include "error_debug.h"
+#include "exception.h"
+#include "alloc.h"
+#include "trace.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_CORE
+
+
+typedef struct nx_trace_span_summary_t
+{
+    nx_trace_stage_t	stage;	///< the stage which ends the span
+    char		*module;
+    nx_histogram_t	histogram;
+} nx_trace_span_summary_t;
+
+typedef struct nx_trace_route_summary_t
+{
+    char		*name;
+    nx_histogram_t	total;	///< from the input module to the output
+    apr_array_header_t	*spans;	///< nx_trace_span_summary_t *
+} nx_trace_route_summary_t;
+
+typedef struct nx_tracer_t
+{
+    apr_pool_t		*pool;	///< kept until exit, the summaries survive reloads
+    apr_thread_mutex_t	*mutex;	///< protects everything below
+    apr_array_header_t	*routes; ///< nx_trace_route_summary_t *
+    apr_pool_t		*filepool;
+    apr_file_t		*file;	///< TraceFile, NULL if not set
+    const char		*filename;
+    uint64_t		next_id;
+    int			rate;	///< read without the lock by nx_trace_rate()
+} nx_tracer_t;
+
+static nx_tracer_t _tracer = { NULL, NULL, NULL, NULL, NULL, NULL, 0, 0 };
+
+
+/// the spans are named after what happened before the stamp which ends them
+static const char *_span_names[NX_TRACE_STAGE_LAST] =
+{
+    "start",
+    "forward",
+    "queued",
+    "process",
+    "output",
+};
+
+
+
+/**
+ * Enable tracing one in rate events, 0 disables sampling. Spans are
+ * appended to filename unless it is NULL.
+ */
+void nx_trace_start(int rate, const char *filename)
+{
+    nx_exception_t e;
+
+    ASSERT(rate >= 0);
+
+    if ( _tracer.pool == NULL )
+    {
+	_tracer.pool = nx_pool_create_core();
+	CHECKERR(apr_thread_mutex_create(&(_tracer.mutex), APR_THREAD_MUTEX_UNNESTED, _tracer.pool));
+	_tracer.routes = apr_array_make(_tracer.pool, 5, sizeof(nx_trace_route_summary_t *));
+    }
+
+    CHECKERR(apr_thread_mutex_lock(_tracer.mutex));
+    try
+    {
+	ASSERT(_tracer.file == NULL);
+	if ( (rate > 0) && (filename != NULL) )
+	{
+	    _tracer.filepool = nx_pool_create_core();
+	    _tracer.filename = apr_pstrdup(_tracer.filepool, filename);
+	    CHECKERR_MSG(apr_file_open(&(_tracer.file), filename,
+				       APR_WRITE | APR_CREATE | APR_APPEND | APR_BUFFERED,
+				       APR_OS_DEFAULT, _tracer.filepool),
+			 "couldn't open TraceFile '%s'", filename);
+	}
+	_tracer.rate = rate;
+    }
+    catch(e)
+    {
+	if ( _tracer.filepool != NULL )
+	{
+	    apr_pool_destroy(_tracer.filepool);
+	    _tracer.filepool = NULL;
+	}
+	_tracer.file = NULL;
+	CHECKERR(apr_thread_mutex_unlock(_tracer.mutex));
+	rethrow(e);
+    }
+    CHECKERR(apr_thread_mutex_unlock(_tracer.mutex));
+
+    if ( rate > 0 )
+    {
+	log_info("tracing 1 in %d events%s%s", rate,
+		 filename == NULL ? "" : ", writing spans to ",
+		 filename == NULL ? "" : filename);
+    }
+}
+
+
+
+/**
+ * Stop sampling new events and close the TraceFile. Events which are
+ * already traced still update the summaries when they are freed.
+ */
+void nx_trace_stop()
+{
+    if ( _tracer.pool == NULL )
+    {
+	return;
+    }
+
+    CHECKERR(apr_thread_mutex_lock(_tracer.mutex));
+    _tracer.rate = 0;
+    if ( _tracer.file != NULL )
+    {
+	apr_file_close(_tracer.file);
+	_tracer.file = NULL;
+    }
+    if ( _tracer.filepool != NULL )
+    {
+	apr_pool_destroy(_tracer.filepool);
+	_tracer.filepool = NULL;
+    }
+    CHECKERR(apr_thread_mutex_unlock(_tracer.mutex));
+}
+
+
+
+/**
+ * Return the value the sampling countdown of modules should be reset to,
+ * 0 if tracing is off.
+ */
+int nx_trace_rate()
+{
+    return ( _tracer.rate );
+}
+
+
+
+/**
+ * A monotonic timestamp in microseconds which is not affected by clock
+ * adjustments. Falls back to the wall clock where this is not available.
+ */
+apr_time_t nx_trace_now()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if ( clock_gettime(CLOCK_MONOTONIC, &ts) == 0 )
+    {
+	return ( (apr_time_t) ts.tv_sec * APR_USEC_PER_SEC + ts.tv_nsec / 1000 );
+    }
+#endif
+    return ( apr_time_now() );
+}
+
+
+
+/**
+ * Attach a trace to logdata and record its first stamp.
+ */
+void nx_trace_begin(nx_logdata_t *logdata, const char *module)
+{
+    nx_trace_t *trace;
+
+    ASSERT(logdata != NULL);
+
+    if ( (logdata->trace != NULL) || (_tracer.pool == NULL) )
+    {
+	return;
+    }
+
+    trace = malloc(sizeof(nx_trace_t));
+    memset(trace, 0, sizeof(nx_trace_t));
+    trace->started = apr_time_now();
+
+    CHECKERR(apr_thread_mutex_lock(_tracer.mutex));
+    (_tracer.next_id)++;
+    trace->id = _tracer.next_id;
+    CHECKERR(apr_thread_mutex_unlock(_tracer.mutex));
+
+    nx_trace_stamp(trace, NX_TRACE_INPUT, module);
+    logdata->trace = trace;
+}
+
+
+
+/**
+ * Set the route the event is sent on. This is called on each copy when the
+ * input module forwards it to more than one route.
+ */
+void nx_trace_set_route(nx_trace_t *trace, const char *route)
+{
+    ASSERT(trace != NULL);
+    ASSERT(route != NULL);
+
+    apr_cpystrn(trace->route, route, sizeof(trace->route));
+}
+
+
+
+void nx_trace_stamp(nx_trace_t *trace, nx_trace_stage_t stage, const char *module)
+{
+    nx_trace_stamp_t *last;
+
+    ASSERT(trace != NULL);
+    ASSERT(stage < NX_TRACE_STAGE_LAST);
+
+    if ( module == NULL )
+    {
+	module = "";
+    }
+    if ( trace->num_stamp > 0 )
+    { // outputs peek again while they are blocked, the first one ends the queue wait
+	last = &(trace->stamps[trace->num_stamp - 1]);
+	if ( (last->stage == stage) && (strcmp(last->module, module) == 0) )
+	{
+	    return;
+	}
+    }
+    if ( trace->num_stamp >= NX_TRACE_MAX_STAMPS )
+    {
+	trace->truncated = TRUE;
+	return;
+    }
+
+    last = &(trace->stamps[trace->num_stamp]);
+    last->stage = stage;
+    apr_cpystrn(last->module, module, sizeof(last->module));
+    last->time = nx_trace_now();
+    (trace->num_stamp)++;
+}
+
+
+
+nx_trace_t *nx_trace_clone(const nx_trace_t *trace)
+{
+    nx_trace_t *new;
+
+    ASSERT(trace != NULL);
+
+    new = malloc(sizeof(nx_trace_t));
+    memcpy(new, trace, sizeof(nx_trace_t));
+
+    return ( new );
+}
+
+
+
+static nx_trace_route_summary_t *nx_trace_route_summary(const char *name)
+{
+    nx_trace_route_summary_t *route;
+    int i;
+
+    for ( i = 0; i < _tracer.routes->nelts; i++ )
+    {
+	route = ((nx_trace_route_summary_t **) _tracer.routes->elts)[i];
+	if ( strcmp(route->name, name) == 0 )
+	{
+	    return ( route );
+	}
+    }
+
+    route = apr_pcalloc(_tracer.pool, sizeof(nx_trace_route_summary_t));
+    route->name = apr_pstrdup(_tracer.pool, name);
+    route->spans = apr_array_make(_tracer.pool, 5, sizeof(nx_trace_span_summary_t *));
+    *((nx_trace_route_summary_t **) apr_array_push(_tracer.routes)) = route;
+
+    return ( route );
+}
+
+
+
+static nx_trace_span_summary_t *nx_trace_span_summary(nx_trace_route_summary_t *route,
+						      const nx_trace_stamp_t *stamp)
+{
+    nx_trace_span_summary_t *span;
+    int i;
+
+    for ( i = 0; i < route->spans->nelts; i++ )
+    {
+	span = ((nx_trace_span_summary_t **) route->spans->elts)[i];
+	if ( (span->stage == stamp->stage) && (strcmp(span->module, stamp->module) == 0) )
+	{
+	    return ( span );
+	}
+    }
+
+    span = apr_pcalloc(_tracer.pool, sizeof(nx_trace_span_summary_t));
+    span->stage = stamp->stage;
+    span->module = apr_pstrdup(_tracer.pool, stamp->module);
+    *((nx_trace_span_summary_t **) apr_array_push(route->spans)) = span;
+
+    return ( span );
+}
+
+
+
+/**
+ * Add the spans of a delivered event to the summary of its route.
+ * Must be called with the mutex held.
+ */
+static void nx_trace_summarize(const nx_trace_t *trace)
+{
+    nx_trace_route_summary_t *route;
+    nx_trace_span_summary_t *span;
+    int i;
+
+    route = nx_trace_route_summary(trace->route);
+    nx_histogram_add(&(route->total),
+		     (uint64_t) (trace->stamps[trace->num_stamp - 1].time - trace->stamps[0].time));
+    for ( i = 1; i < trace->num_stamp; i++ )
+    {
+	span = nx_trace_span_summary(route, &(trace->stamps[i]));
+	nx_histogram_add(&(span->histogram),
+			 (uint64_t) (trace->stamps[i].time - trace->stamps[i - 1].time));
+    }
+}
+
+
+
+/**
+ * Write the spans as a JSON object on a single line.
+ * Must be called with the mutex held.
+ */
+static void nx_trace_write(const nx_trace_t *trace, boolean delivered)
+{
+    nx_string_t *str;
+    int i;
+    apr_status_t rv;
+
+    str = nx_string_new();
+    nx_string_sprintf_append(str, "{\"id\":%" APR_UINT64_T_FMT ",\"time\":%" APR_INT64_T_FMT
+			     ",\"route\":\"%s\",\"delivered\":%s,\"spans\":[",
+			     trace->id, trace->started, trace->route,
+			     delivered == TRUE ? "true" : "false");
+    for ( i = 1; i < trace->num_stamp; i++ )
+    {
+	nx_string_sprintf_append(str, "%s{\"name\":\"%s\",\"module\":\"%s\",\"start\":%" APR_INT64_T_FMT
+				 ",\"duration\":%" APR_INT64_T_FMT "}",
+				 i == 1 ? "" : ",", _span_names[trace->stamps[i].stage],
+				 trace->stamps[i].module,
+				 trace->stamps[i - 1].time - trace->stamps[0].time,
+				 trace->stamps[i].time - trace->stamps[i - 1].time);
+    }
+    nx_string_append(str, "]}" NX_LINEFEED, -1);
+
+    if ( (rv = apr_file_write_full(_tracer.file, str->buf, str->len, NULL)) != APR_SUCCESS )
+    { // don't keep failing for every sampled event
+	log_aprerror(rv, "couldn't write TraceFile '%s', no more spans will be written",
+		     _tracer.filename);
+	apr_file_close(_tracer.file);
+	_tracer.file = NULL;
+    }
+    nx_string_free(str);
+}
+
+
+
+/**
+ * Called when the traced event is freed. Only events which were popped by
+ * an output module are summarized, all are written to the TraceFile.
+ */
+void nx_trace_end(nx_trace_t *trace)
+{
+    boolean delivered;
+
+    ASSERT(trace != NULL);
+
+    delivered = (trace->truncated == FALSE) && (trace->num_stamp > 1) &&
+		(trace->stamps[trace->num_stamp - 1].stage == NX_TRACE_OUTPUT);
+
+    CHECKERR(apr_thread_mutex_lock(_tracer.mutex));
+    if ( delivered == TRUE )
+    {
+	nx_trace_summarize(trace);
+    }
+    if ( _tracer.file != NULL )
+    {
+	nx_trace_write(trace, delivered);
+    }
+    CHECKERR(apr_thread_mutex_unlock(_tracer.mutex));
+
+    free(trace);
+}
+
+
+
+/**
+ * Copy the end-to-end latency histogram of a route. Returns FALSE if no
+ * traced event was delivered on the route.
+ */
+boolean nx_trace_get_route_latency(const char *route, nx_histogram_t *total)
+{
+    nx_trace_route_summary_t *summary;
+    boolean retval = FALSE;
+    int i;
+
+    ASSERT(route != NULL);
+    ASSERT(total != NULL);
+
+    memset(total, 0, sizeof(nx_histogram_t));
+    if ( _tracer.pool == NULL )
+    {
+	return ( FALSE );
+    }
+
+    CHECKERR(apr_thread_mutex_lock(_tracer.mutex));
+    for ( i = 0; i < _tracer.routes->nelts; i++ )
+    {
+	summary = ((nx_trace_route_summary_t **) _tracer.routes->elts)[i];
+	if ( strcmp(summary->name, route) == 0 )
+	{
+	    memcpy(total, &(summary->total), sizeof(nx_histogram_t));
+	    retval = TRUE;
+	    break;
+	}
+    }
+    CHECKERR(apr_thread_mutex_unlock(_tracer.mutex));
+
+    return ( retval );
+}
+
+
+
+static void nx_trace_histogram_append(nx_string_t *str, const nx_histogram_t *histogram)
+{
+    nx_string_sprintf_append(str, "p50: %" APR_UINT64_T_FMT ", p90: %" APR_UINT64_T_FMT
+			     ", p99: %" APR_UINT64_T_FMT ", max: %" APR_UINT64_T_FMT,
+			     nx_histogram_percentile(histogram, 50),
+			     nx_histogram_percentile(histogram, 90),
+			     nx_histogram_percentile(histogram, 99),
+			     histogram->max);
+}
+
+
+
+/**
+ * Append the per-route latency percentiles of the traced events in
+ * microseconds, does nothing if nothing was traced.
+ */
+void nx_trace_summary_append(nx_string_t *str)
+{
+    nx_trace_route_summary_t *route;
+    nx_trace_span_summary_t *span;
+    int i, j;
+
+    ASSERT(str != NULL);
+
+    if ( _tracer.pool == NULL )
+    {
+	return;
+    }
+
+    CHECKERR(apr_thread_mutex_lock(_tracer.mutex));
+    for ( i = 0; i < _tracer.routes->nelts; i++ )
+    {
+	route = ((nx_trace_route_summary_t **) _tracer.routes->elts)[i];
+	nx_string_sprintf_append(str, "[trace route %s] %" APR_UINT64_T_FMT " events, total usec ",
+				 route->name, route->total.count);
+	nx_trace_histogram_append(str, &(route->total));
+	nx_string_append(str, NX_LINEFEED, -1);
+	for ( j = 0; j < route->spans->nelts; j++ )
+	{
+	    span = ((nx_trace_span_summary_t **) route->spans->elts)[j];
+	    nx_string_sprintf_append(str, " - %s %s: ", _span_names[span->stage], span->module);
+	    nx_trace_histogram_append(str, &(span->histogram));
+	    nx_string_append(str, NX_LINEFEED, -1);
+	}
+    }
+    CHECKERR(apr_thread_mutex_unlock(_tracer.mutex));
+}
@@ -0,0 +1,77 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_TRACE_H
+#define __NX_TRACE_H
+
+#include "types.h"
+#include "str.h"
+#include "logdata.h"
+#include "metrics.h"
+
+/*
+ * Sampled end-to-end latency tracing. One in TraceSampleRate events
+ * received by an input module carries a trace which collects monotonic
+ * timestamps at each stage boundary as the event travels along its route.
+ * When the event is freed after the output popped it, the durations between
+ * the stamps are added to the per-route histograms and the spans are
+ * written to TraceFile if it is set.
+ *
+ * Events without a trace pay for a single branch at each boundary.
+ */
+
+#define NX_TRACE_MAX_STAMPS 24
+#define NX_TRACE_NAME_SIZE 64
+
+typedef enum nx_trace_stage_t
+{
+    NX_TRACE_INPUT = 0,	///< the input module passed the event to nx_module_add_logdata_input()
+    NX_TRACE_PUSH,	///< pushed to the queue of a processor or output module
+    NX_TRACE_PEEK,	///< taken from the queue by the module
+    NX_TRACE_POP,	///< a processor is done with it and removed it from its queue
+    NX_TRACE_OUTPUT,	///< an output is done with it and removed it from its queue
+    NX_TRACE_STAGE_LAST,
+} nx_trace_stage_t;
+
+typedef struct nx_trace_stamp_t
+{
+    nx_trace_stage_t	stage;
+    char		module[NX_TRACE_NAME_SIZE];
+    apr_time_t		time;	///< monotonic, in microseconds
+} nx_trace_stamp_t;
+
+struct nx_trace_t
+{
+    uint64_t		id;	///< shared by the clones of the same event
+    apr_time_t		started; ///< wall clock time of the first stamp
+    char		route[NX_TRACE_NAME_SIZE];
+    int			num_stamp;
+    boolean		truncated; ///< stamps were lost because the array was full
+    nx_trace_stamp_t	stamps[NX_TRACE_MAX_STAMPS];
+};
+
+/**
+ * Decrement the sampling countdown of a module and evaluate to TRUE if the
+ * current event should be traced. The countdown stays at 0 while tracing is
+ * off so this is a single branch. It is not updated atomically, a race
+ * can only skew the sampling.
+ */
+#define NX_TRACE_SAMPLE(countdown) (((countdown) != 0) && (--(countdown) == 0))
+
+void nx_trace_start(int rate, const char *filename);
+void nx_trace_stop();
+int nx_trace_rate();
+apr_time_t nx_trace_now();
+void nx_trace_begin(nx_logdata_t *logdata, const char *module);
+void nx_trace_set_route(nx_trace_t *trace, const char *route);
+void nx_trace_stamp(nx_trace_t *trace, nx_trace_stage_t stage, const char *module);
+nx_trace_t *nx_trace_clone(const nx_trace_t *trace);
+void nx_trace_end(nx_trace_t *trace);
+void nx_trace_summary_append(nx_string_t *str);
+boolean nx_trace_get_route_latency(const char *route, nx_histogram_t *total);
+
+#endif	/* __NX_TRACE_H */
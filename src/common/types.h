@@ -77,6 +77,7 @@ typedef struct nx_module_input_t nx_module_input_t;
 typedef struct nx_module_t nx_module_t;
 typedef struct nx_event_t nx_event_t;
 typedef struct nx_job_t nx_job_t;
+typedef struct nx_ack_source_t nx_ack_source_t;
 
 #ifdef __GNUC__
 # define NORETURN __attribute__ ((noreturn))
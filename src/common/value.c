@@ -12,6 +12,7 @@
 #include "value.h"
 #include "date.h"
 #include "exception.h"
+#include "alloc.h"
 #include "../core/nxlog.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
@@ -65,10 +66,10 @@ void nx_value_kill(nx_value_t *value)
 		}
 		break;
 	    case NX_VALUE_TYPE_REGEXP:
-		if ( value->regexp.pcre != NULL )
+		if ( value->regexp.compiled != NULL )
 		{
-		    pcre_free(value->regexp.pcre);
-		    value->regexp.pcre = NULL;
+		    nx_regexp_free(value->regexp.compiled);
+		    value->regexp.compiled = NULL;
 		}
 		if ( value->regexp.str != NULL )
 		{
@@ -144,10 +145,8 @@ nx_value_t *nx_value_clone(nx_value_t *dst, const nx_value_t *value)
 		retval->binary.len = value->binary.len;
 		break;    
 	    case NX_VALUE_TYPE_REGEXP:
-		ASSERT(value->regexp.pcre_size > 0);
-		retval->regexp.pcre = malloc(value->regexp.pcre_size);
-		memcpy(retval->regexp.pcre, value->regexp.pcre, value->regexp.pcre_size);
-		retval->regexp.pcre_size = value->regexp.pcre_size;
+		ASSERT(value->regexp.compiled != NULL);
+		retval->regexp.compiled = nx_regexp_ref(value->regexp.compiled);
 		retval->regexp.str = strdup(value->regexp.str);
 		if ( value->regexp.replacement == NULL )
 		{
@@ -206,37 +205,17 @@ nx_value_t *nx_value_new_string(const char *str)
 nx_value_t *nx_value_new_regexp(const char *str)
 {
     nx_value_t *retval;
-    pcre *regexp;
-    const char *error = NULL;
-    int erroroffs = 0;
-    int rc;
-    size_t size;
+    nx_regexp_t *regexp;
 
     ASSERT(str != NULL);
 
+    regexp = nx_regexp_compile(NULL, str, 0);
+
     retval = malloc(sizeof(nx_value_t));
+    memset(retval, 0, sizeof(nx_value_t));
     retval->type = NX_VALUE_TYPE_REGEXP;
     retval->defined = TRUE;
-
-    regexp = pcre_compile(str, 0, &error,  &erroroffs, NULL);
-
-    if ( regexp == NULL )
-    {
-	throw_msg("failed to compile regular expression '%s', error at position %d: %s",
-		  str, erroroffs, error);
-    }
-
-    rc = pcre_fullinfo(regexp, NULL, PCRE_INFO_SIZE, &size); 
-    if ( rc < 0 )
-    {
-	free(retval);
-	pcre_free(regexp);
-	throw_msg("failed to get compiled regexp size");
-    }
-    ASSERT(size > 0);
-
-    retval->regexp.pcre = regexp;
-    retval->regexp.pcre_size = (size_t) size;
+    retval->regexp.compiled = regexp;
     retval->regexp.str = strdup(str);
 
     return ( retval );
@@ -448,11 +427,35 @@ void nx_ascii2bin(const char *src, unsigned int srclen, char *dst)
 
 
 
-/**
- * \return NULL if the value is undefined
- */
+static char *value_string_alloc(size_t size, boolean scratch)
+{
+    char *retval;
 
-char *nx_value_to_string(nx_value_t *value)
+    if ( scratch == TRUE )
+    {
+	return ( nx_scratch_alloc(size) );
+    }
+    retval = malloc(size);
+    ASSERT(retval != NULL);
+
+    return ( retval );
+}
+
+
+
+static char *value_string_dup(const char *str, boolean scratch)
+{
+    if ( scratch == TRUE )
+    {
+	return ( nx_scratch_strdup(str, -1) );
+    }
+
+    return ( strdup(str) );
+}
+
+
+
+static char *value_to_string(const nx_value_t *value, boolean scratch)
 {
     char *retval = NULL;
     nx_exception_t e;
@@ -470,34 +473,34 @@ char *nx_value_to_string(nx_value_t *value)
 	switch ( value->type )
 	{
 	    case NX_VALUE_TYPE_INTEGER:
-		retval = malloc(32);
+		retval = value_string_alloc(32, scratch);
 		apr_snprintf(retval, 31, "%"APR_INT64_T_FMT, value->integer);
 		break;
 	    case NX_VALUE_TYPE_STRING:
 		ASSERT(value->string != NULL);
 		ASSERT(value->string->buf != NULL);
-		retval = strdup(value->string->buf);
+		retval = value_string_dup(value->string->buf, scratch);
 		break;
 	    case NX_VALUE_TYPE_DATETIME:
-		retval = malloc(20);
+		retval = value_string_alloc(20, scratch);
 		CHECKERR_MSG(nx_date_to_iso(retval, 20, value->datetime),
 			     "failed to convert time value to string");
 		break;
 	    case NX_VALUE_TYPE_REGEXP:
-		retval = strdup(value->regexp.str);
+		retval = value_string_dup(value->regexp.str, scratch);
 		break;
 	    case NX_VALUE_TYPE_BOOLEAN:
 		if ( value->boolean == TRUE )
 		{
-		    retval = strdup("TRUE");
+		    retval = value_string_dup("TRUE", scratch);
 		}
 		else
 		{
-		    retval = strdup("FALSE");
+		    retval = value_string_dup("FALSE", scratch);
 		}
 		break;
 	    case NX_VALUE_TYPE_IP4ADDR:
-		retval = malloc(20);
+		retval = value_string_alloc(20, scratch);
 		apr_snprintf(retval, 20, "%d.%d.%d.%d", value->ip4addr[0], value->ip4addr[1],
 			     value->ip4addr[2], value->ip4addr[3]);
 		break;
@@ -515,7 +518,7 @@ char *nx_value_to_string(nx_value_t *value)
 		    sockaddr.sa.sin6.sin6_addr.s6_addr[i] = value->ip6addr[i];
 		}
 		
-		retval = malloc(64);
+		retval = value_string_alloc(64, scratch);
 		
 		CHECKERR_MSG(apr_sockaddr_ip_getbuf(retval, 64, &sockaddr),
 		"couldn't convert IPv6 address to string");
@@ -525,7 +528,7 @@ char *nx_value_to_string(nx_value_t *value)
 		break;    
 	    }
 	    case NX_VALUE_TYPE_BINARY:
-		retval = malloc((size_t) value->binary.len * 2 + 1);
+		retval = value_string_alloc((size_t) value->binary.len * 2 + 1, scratch);
 		nx_bin2ascii(value->binary.value, value->binary.len, retval);
 		break;
 	    default:
@@ -534,7 +537,7 @@ char *nx_value_to_string(nx_value_t *value)
     }
     catch(e)
     {
-	if ( retval != NULL )
+	if ( (retval != NULL) && (scratch == FALSE) )
 	{
 	    free(retval);
 	}
@@ -546,6 +549,30 @@ char *nx_value_to_string(nx_value_t *value)
 
 
 
+/**
+ * \return NULL if the value is undefined
+ */
+
+char *nx_value_to_string(nx_value_t *value)
+{
+    return ( value_to_string(value, FALSE) );
+}
+
+
+
+/**
+ * Same as nx_value_to_string() but the result is allocated from the
+ * scratch arena of the thread, see nx_scratch_alloc().
+ * \return NULL if the value is undefined
+ */
+
+char *nx_value_to_scratch_string(const nx_value_t *value)
+{
+    return ( value_to_string(value, TRUE) );
+}
+
+
+
 int64_t nx_value_parse_int(const char *string)
 {
     int i = 0;
@@ -8,10 +8,10 @@
 #ifndef __NX_VALUE_H
 #define __NX_VALUE_H
 
-#include <pcre.h>
 #include <apr_file_io.h>
 #include "types.h"
 #include "str.h"
+#include "regexp.h"
 
 
 typedef enum nx_value_type_t
@@ -46,8 +46,7 @@ typedef struct nx_value_t
 	{
 	    char	*str;
 	    char	*replacement; 	///< only used for s/a/b/ regexp replacement, not serialized!
-	    pcre	*pcre;
-	    size_t	pcre_size;
+	    nx_regexp_t	*compiled;	///< shared between copies of the value
 	    uint8_t	modifiers;	///< TODO: not serialized, do we need it to?
 	} regexp;
 	boolean		boolean;
@@ -74,6 +73,7 @@ nx_value_t *nx_value_new_binary(const char *value, unsigned int len);
 const char *nx_value_type_to_string(nx_value_type_t type);
 nx_value_type_t nx_value_type_from_string(const char *str);
 char *nx_value_to_string(nx_value_t *value);
+char *nx_value_to_scratch_string(const nx_value_t *value);
 nx_value_t *nx_value_from_string(const char *string, nx_value_type_t type);
 apr_size_t nx_value_serialized_size(const nx_value_t *value);
 apr_size_t nx_value_to_membuf(const nx_value_t *value, char *buf, apr_size_t bufsize);
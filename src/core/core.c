@@ -5,6 +5,12 @@
  * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE /* for cpu_set_t */
+#endif
+#ifdef __linux__
+# include <sched.h>
+#endif
 #include <apr_thread_proc.h>
 #include <apr_thread_cond.h>
 #include "../common/exception.h"
@@ -12,6 +18,8 @@
 #include "../common/context.h"
 #include "../common/alloc.h"
 #include "../common/atomic.h"
+#include "../common/regexp.h"
+#include "../common/date.h"
 #include "core.h"
 
 
@@ -31,6 +39,10 @@ struct thread_start_data
 };
 typedef struct thread_start_data thread_start_data;
 
+static apr_threadkey_t *_thread_exit_key = NULL;
+
+static void _thread_cleanup(void *data);
+
 
 boolean nx_init(int *argc, char const *const **argv, char const *const **env)
 {
@@ -52,6 +64,9 @@ boolean nx_init(int *argc, char const *const **argv, char const *const **env)
     ASSERT(apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_UNNESTED, context->pool) == APR_SUCCESS);
     nx_logger_mutex_set(mutex);
 
+    // threads created with nx_thread_create() may end in apr_thread_exit()
+    ASSERT(apr_threadkey_private_create(&_thread_exit_key, _thread_cleanup, context->pool) == APR_SUCCESS);
+
 #ifdef NX_NOATOMIC
     ASSERT(apr_thread_mutex_create(&nx_atomic_mutex, APR_THREAD_MUTEX_UNNESTED, context->pool) == APR_SUCCESS);
 #endif
@@ -61,28 +76,63 @@ boolean nx_init(int *argc, char const *const **argv, char const *const **env)
 
 
 
+/**
+ * Free the per-thread resources of a thread created with nx_thread_create().
+ * This is the destructor of _thread_exit_key so that it also runs when the
+ * thread leaves through apr_thread_exit(). The context key may already have
+ * been cleared by then, so it is set again for the cleanup functions.
+ */
+static void _thread_cleanup(void *data)
+{
+    nx_context_t *context = (nx_context_t *) data;
+
+    if ( context == NULL )
+    {
+	return;
+    }
+    apr_threadkey_private_set(context, nx_get_context_key());
+    nx_regexp_thread_cleanup();
+    nx_date_thread_cleanup();
+    nx_scratch_thread_cleanup();
+    apr_threadkey_private_set(NULL, nx_get_context_key());
+    free(context);
+}
+
+
+
 static void * APR_THREAD_FUNC _thread_helper(apr_thread_t *thd, void *d)
 {
     thread_start_data *data = d;
-    nx_context_t thread_context;
+    nx_context_t *thread_context;
     void *arg, *ret;
     apr_thread_start_t startfunc;
 
     startfunc = data->startfunc;
     arg	= data->arg;
 
-    memset(&thread_context, 0, sizeof(nx_context_t));
-    init_exception_context(&thread_context.exception_context);
+    // not on the stack, the stack is unwound before the destructor runs
+    thread_context = malloc(sizeof(nx_context_t));
+    ASSERT(thread_context != NULL);
+    memset(thread_context, 0, sizeof(nx_context_t));
+    init_exception_context(&(thread_context->exception_context));
 
     ASSERT(apr_thread_mutex_lock(data->mutex) == APR_SUCCESS);
 
-    data->rv = apr_threadkey_private_set(&thread_context, nx_get_context_key());
+    data->rv = apr_threadkey_private_set(thread_context, nx_get_context_key());
+    if ( data->rv == APR_SUCCESS )
+    {
+	data->rv = apr_threadkey_private_set(thread_context, _thread_exit_key);
+    }
 
     ASSERT(apr_thread_cond_signal(data->cond) == APR_SUCCESS);
     ASSERT(apr_thread_mutex_unlock(data->mutex) == APR_SUCCESS);
 
     ret	= startfunc(thd, arg);
 
+    // the destructor does not run on all platforms, do it here
+    apr_threadkey_private_set(NULL, _thread_exit_key);
+    _thread_cleanup(thread_context);
+
     return ( ret );
 }
 
@@ -119,3 +169,32 @@ void nx_thread_create(apr_thread_t **thread,
     CHECKERR_MSG(rv, "couldn't create thread");
 }
 
+
+
+/**
+ * Pin the calling thread to a CPU. Returns FALSE if this failed or
+ * is not supported on the platform.
+ */
+boolean nx_thread_set_affinity(int cpu)
+{
+    ASSERT((cpu >= 0) && (cpu < NX_THREAD_MAX_CPU));
+
+#ifdef WIN32
+    if ( cpu >= (int) (sizeof(DWORD_PTR) * 8) )
+    {
+	return ( FALSE );
+    }
+    return ( SetThreadAffinityMask(GetCurrentThread(), ((DWORD_PTR) 1) << cpu) != 0 );
+#elif defined(__linux__)
+    {
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	// pid 0 is the calling thread
+	return ( sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0 );
+    }
+#else
+    return ( FALSE );
+#endif
+}
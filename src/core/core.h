@@ -11,6 +11,8 @@
 #include <apr_thread_proc.h>
 #include <apr_thread_cond.h>
 
+#define NX_THREAD_MAX_CPU 1024 ///< CPUs above this can't be used with nx_thread_set_affinity()
+
 boolean nx_init(int *argc, char const *const **argv, char const *const **env);
 
 void nx_thread_create(apr_thread_t **thread,
@@ -18,5 +20,6 @@ void nx_thread_create(apr_thread_t **thread,
 		      apr_thread_start_t func,
 		      void *data,
 		      apr_pool_t *pool);
+boolean nx_thread_set_affinity(int cpu);
 
 #endif	/* __NX_CORE_H */
@@ -8,6 +8,7 @@
 #define APR_WANT_STDIO
 #define APR_WANT_STRFUNC
 #include <apr_want.h>
+#include <apr_lib.h>
 
 #include "../core/nxlog.h"
 #include "../common/error_debug.h"
@@ -21,6 +22,7 @@
 #include "ctx.h"
 #include "job.h"
 #include "modules.h"
+#include "core.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
@@ -45,6 +47,8 @@ nx_ctx_t *nx_ctx_new()
 
     ctx->config_cache = apr_hash_make(ctx->pool);
     CHECKERR(apr_thread_mutex_create(&(ctx->config_cache_mutex), APR_THREAD_MUTEX_UNNESTED, ctx->pool));
+    ctx->cc_flush_interval = NX_CONFIG_CACHE_DEFAULT_FLUSH_INTERVAL * APR_USEC_PER_SEC;
+    ctx->cc_last_flush = apr_time_now();
 
     ctx->resources = apr_palloc(ctx->pool, sizeof(nx_resource_list_t));
     NX_DLIST_INIT(ctx->resources, nx_resource_t, link);
@@ -67,6 +71,7 @@ nx_ctx_t *nx_ctx_new()
 
     ctx->ignoreerrors = TRUE;
     ctx->norepeat = TRUE;
+    ctx->slow_event_threshold = APR_USEC_PER_SEC;
 
     ctx->coremodule = nx_module_new(NX_MODULE_TYPE_EXTENSION, "__CORE__", 0);
     ctx->coremodule->priority = 1;
@@ -75,9 +80,14 @@ nx_ctx_t *nx_ctx_new()
 
 
 
-void nx_ctx_parse_cfg(nx_ctx_t *ctx, const char *cfgpath)
+/**
+ * Parse the configuration file into a directive tree allocated from pool
+ * and check the top level keywords. Returns the first top level directive.
+ */
+nx_directive_t *nx_ctx_parse_cfgtree(apr_pool_t *pool, const char *cfgpath)
 {
     nx_cfgfile_t cfgfile;
+    nx_directive_t *root;
     const nx_directive_t *curr;
     static const char *keywords[] = { "root", "route", "moduledir",
 				      "pidfile", "input", "output",
@@ -86,52 +96,49 @@ void nx_ctx_parse_cfg(nx_ctx_t *ctx, const char *cfgpath)
 				      "user", "group", "rootdir", "spooldir",
 				      "nofreeonexit", "panic", "threads", 
 				      "ignoreerrors", "suppressrepeatinglogs",
-				      "flowcontrol",
+				      "flowcontrol", "cacheflushinterval",
+				      "cacheflushcount", "cachesync",
+				      "metricslisten", "tracesamplerate", "tracefile",
+				      "sloweventthreshold", "minthreads", "maxthreads",
+				      "cpuaffinity",
 				      NULL };
     int i;
     boolean found;
     nx_cfg_parser_ctx_t cfg_ctx;
-    const char *tmpstr;
-    nxlog_t *nxlog;
-
-    nxlog = nxlog_get();
 
     if ( cfgpath == NULL )
     {
-	cfgfile.name = apr_pstrdup(ctx->pool, NX_CONFIGFILE);
+	cfgfile.name = apr_pstrdup(pool, NX_CONFIGFILE);
     }
     else
     {
 	cfgfile.name = cfgpath;
     }
 
-    nx_cfg_open_file(&cfgfile, ctx->pool);
+    nx_cfg_open_file(&cfgfile, pool);
 
-    ctx->cfgtree = apr_pcalloc(ctx->pool, sizeof(nx_directive_t));
-    ctx->cfgtree->directive = apr_pstrdup(ctx->pool, "Root");
-    ctx->cfgtree->args = NULL;
-    ctx->cfgtree->first_child = NULL;
+    root = apr_pcalloc(pool, sizeof(nx_directive_t));
+    root->directive = apr_pstrdup(pool, "Root");
+    root->args = NULL;
+    root->first_child = NULL;
 
     memset(&cfg_ctx, 0, sizeof(nx_cfg_parser_ctx_t));
-    cfg_ctx.pool = ctx->pool;
-    cfg_ctx.root = ctx->cfgtree;
-    cfg_ctx.current = ctx->cfgtree;
+    cfg_ctx.pool = pool;
+    cfg_ctx.root = root;
+    cfg_ctx.current = root;
     cfg_ctx.next_is_child = TRUE;
     cfg_ctx.cfg = &cfgfile;
 
     nx_cfg_parse(&cfg_ctx);
 
-    if ( ctx->cfgtree->first_child == NULL )
+    if ( root->first_child == NULL )
     {
 	throw_msg("Empty configuration");
     }
 
-    ctx->cfgtree = ctx->cfgtree->first_child;
-    //nx_cfg_dump(ctx->cfgtree, 0);
-
-    curr = ctx->cfgtree;
+    //nx_cfg_dump(root->first_child, 0);
 
-    while ( curr != NULL )
+    for ( curr = root->first_child; curr != NULL; curr = curr->next )
     {
 	found = FALSE;
 	for ( i = 0; keywords[i] != NULL; i++ )
@@ -146,7 +153,115 @@ void nx_ctx_parse_cfg(nx_ctx_t *ctx, const char *cfgpath)
 	{
 	    nx_conf_error(curr, "Invalid keyword: %s", curr->directive);
 	}
-	
+    }
+
+    return ( root->first_child );
+}
+
+
+
+/**
+ * Parse a list of CPUs such as '0-3,8' for CPUAffinity.
+ */
+apr_array_header_t *nx_ctx_parse_cpu_list(apr_pool_t *pool, const nx_directive_t *curr)
+{
+    apr_array_header_t *cpus;
+    const char *ptr;
+    char *end;
+    long first, last, cpu;
+
+    cpus = apr_array_make(pool, 8, sizeof(int));
+    for ( ptr = curr->args; *ptr != '\0'; )
+    {
+	first = strtol(ptr, &end, 10);
+	if ( (end == ptr) || (first < 0) )
+	{
+	    nx_conf_error(curr, "invalid 'CPUAffinity': %s", curr->args);
+	}
+	last = first;
+	ptr = end;
+	if ( *ptr == '-' )
+	{
+	    ptr++;
+	    last = strtol(ptr, &end, 10);
+	    if ( (end == ptr) || (last < first) )
+	    {
+		nx_conf_error(curr, "invalid 'CPUAffinity': %s", curr->args);
+	    }
+	    ptr = end;
+	}
+	if ( last >= NX_THREAD_MAX_CPU )
+	{
+	    nx_conf_error(curr, "invalid CPU number in 'CPUAffinity', must be less than %d: %s",
+			  NX_THREAD_MAX_CPU, curr->args);
+	}
+	for ( cpu = first; cpu <= last; cpu++ )
+	{
+	    *((int *) apr_array_push(cpus)) = (int) cpu;
+	}
+	while ( apr_isspace(*ptr) )
+	{
+	    ptr++;
+	}
+	if ( *ptr == ',' )
+	{
+	    ptr++;
+	    while ( apr_isspace(*ptr) )
+	    {
+		ptr++;
+	    }
+	    if ( *ptr == '\0' )
+	    { // trailing comma
+		nx_conf_error(curr, "invalid 'CPUAffinity': %s", curr->args);
+	    }
+	}
+	else if ( *ptr != '\0' )
+	{
+	    nx_conf_error(curr, "invalid 'CPUAffinity': %s", curr->args);
+	}
+    }
+    if ( cpus->nelts == 0 )
+    {
+	nx_conf_error(curr, "'CPUAffinity' requires a list of CPUs");
+    }
+
+    return ( cpus );
+}
+
+
+
+/**
+ * Parse the worker count of MinThreads and MaxThreads.
+ */
+static unsigned int nx_ctx_parse_thread_count(const nx_directive_t *curr, const char *name)
+{
+    long count;
+    char *end;
+
+    count = strtol(curr->args, &end, 10);
+    if ( (end == curr->args) || (*end != '\0') || (count < 1) || (count > NXLOG_MAX_WORKER_THREAD) )
+    {
+	nx_conf_error(curr, "invalid '%s' count, must be between 1 and %d: %s",
+		      name, NXLOG_MAX_WORKER_THREAD, curr->args);
+    }
+
+    return ( (unsigned int) count );
+}
+
+
+
+void nx_ctx_parse_cfg(nx_ctx_t *ctx, const char *cfgpath)
+{
+    const nx_directive_t *curr;
+    const char *tmpstr;
+    nxlog_t *nxlog;
+
+    nxlog = nxlog_get();
+
+    ctx->cfgtree = nx_ctx_parse_cfgtree(ctx->pool, cfgpath);
+
+    for ( curr = ctx->cfgtree; curr != NULL; curr = curr->next )
+    {
 	if ( strcasecmp(curr->directive, "threads") == 0 )
 	{
 	    if ( sscanf(curr->args, "%u", &(nxlog->num_worker_thread)) != 1 )
@@ -154,10 +269,39 @@ void nx_ctx_parse_cfg(nx_ctx_t *ctx, const char *cfgpath)
 		nx_conf_error(curr, "invalid 'Threads' count:  %s", curr->args);
 	    }
 	}
-	curr = curr->next;
+	else if ( strcasecmp(curr->directive, "minthreads") == 0 )
+	{
+	    nxlog->min_worker_thread = nx_ctx_parse_thread_count(curr, "MinThreads");
+	}
+	else if ( strcasecmp(curr->directive, "maxthreads") == 0 )
+	{
+	    nxlog->max_worker_thread = nx_ctx_parse_thread_count(curr, "MaxThreads");
+	}
+	else if ( strcasecmp(curr->directive, "cpuaffinity") == 0 )
+	{
+	    ctx->cpu_affinity = nx_ctx_parse_cpu_list(ctx->pool, curr);
+	}
+	else if ( strcasecmp(curr->directive, "cacheflushinterval") == 0 )
+	{
+	    float flush_interval;
+
+	    if ( (sscanf(curr->args, "%f", &flush_interval) != 1) || (flush_interval < 0) )
+	    {
+		nx_conf_error(curr, "invalid 'CacheFlushInterval': %s", curr->args);
+	    }
+	    ctx->cc_flush_interval = (apr_interval_time_t) (flush_interval * APR_USEC_PER_SEC);
+	}
+	else if ( strcasecmp(curr->directive, "cacheflushcount") == 0 )
+	{
+	    if ( sscanf(curr->args, "%u", &(ctx->cc_flush_count)) != 1 )
+	    {
+		nx_conf_error(curr, "invalid 'CacheFlushCount': %s", curr->args);
+	    }
+	}
     }
 
     nx_cfg_get_boolean(ctx->cfgtree, "nocache", &(ctx->nocache));
+    nx_cfg_get_boolean(ctx->cfgtree, "cachesync", &(ctx->cc_sync));
 
     if ( nx_cfg_get_value(ctx->cfgtree, "moduledir") != NULL )
     {
@@ -188,6 +332,35 @@ void nx_ctx_parse_cfg(nx_ctx_t *ctx, const char *cfgpath)
 	ctx->spooldir = apr_pstrdup(ctx->pool, nx_cfg_get_value(ctx->cfgtree, "spooldir"));
     }
 
+    if ( nx_cfg_get_value(ctx->cfgtree, "metricslisten") != NULL )
+    {
+	ctx->metrics_listen = apr_pstrdup(ctx->pool, nx_cfg_get_value(ctx->cfgtree, "metricslisten"));
+    }
+
+    if ( (tmpstr = nx_cfg_get_value(ctx->cfgtree, "tracesamplerate")) != NULL )
+    {
+	if ( (sscanf(tmpstr, "%d", &(ctx->trace_rate)) != 1) || (ctx->trace_rate < 0) )
+	{
+	    nx_conf_error(ctx->cfgtree, "invalid 'TraceSampleRate': %s", tmpstr);
+	}
+    }
+
+    if ( nx_cfg_get_value(ctx->cfgtree, "tracefile") != NULL )
+    {
+	ctx->trace_file = apr_pstrdup(ctx->pool, nx_cfg_get_value(ctx->cfgtree, "tracefile"));
+    }
+
+    if ( (tmpstr = nx_cfg_get_value(ctx->cfgtree, "sloweventthreshold")) != NULL )
+    {
+	float threshold;
+
+	if ( (sscanf(tmpstr, "%f", &threshold) != 1) || (threshold < 0) )
+	{
+	    nx_conf_error(ctx->cfgtree, "invalid 'SlowEventThreshold': %s", tmpstr);
+	}
+	ctx->slow_event_threshold = (apr_interval_time_t) (threshold * APR_USEC_PER_SEC);
+    }
+
     if ( (tmpstr = nx_cfg_get_value(ctx->cfgtree, "panic")) != NULL )
     {
 	if ( strcasecmp(tmpstr, "hard") == 0 )
@@ -352,6 +525,107 @@ void nx_ctx_init_jobs(nx_ctx_t *ctx)
 
 
 
+/**
+ * Create the job of a module added after nx_ctx_init_jobs().
+ * Must be called with nx_lock() held.
+ */
+void nx_ctx_add_job(nx_ctx_t *ctx, nx_module_t *module)
+{
+    nx_jobgroup_t *jobgroup;
+    nx_job_t *job;
+
+    ASSERT(ctx != NULL);
+    ASSERT(module != NULL);
+    ASSERT(module->job == NULL);
+
+    jobgroup = nx_ctx_get_jobgroup(ctx, module->priority);
+    job = apr_pcalloc(ctx->pool, sizeof(nx_job_t));
+    NX_DLIST_INSERT_TAIL(&(jobgroup->jobs), job, link);
+    module->job = job;
+}
+
+
+
+/**
+ * Remove the job of a module so that the worker threads no longer pick it.
+ * The job memory belongs to the context pool and stays valid, a worker which
+ * is processing an event of the job can finish it.
+ * Must be called with nx_lock() held.
+ */
+void nx_ctx_remove_job(nx_ctx_t *ctx, nx_module_t *module)
+{
+    nx_jobgroup_t *jobgroup;
+    nx_job_t *job;
+
+    ASSERT(ctx != NULL);
+    ASSERT(module != NULL);
+
+    if ( module->job == NULL )
+    {
+	return;
+    }
+
+    for ( jobgroup = NX_DLIST_FIRST(ctx->jobgroups);
+	  jobgroup != NULL;
+	  jobgroup = NX_DLIST_NEXT(jobgroup, link) )
+    {
+	for ( job = NX_DLIST_FIRST(&(jobgroup->jobs));
+	      job != NULL;
+	      job = NX_DLIST_NEXT(job, link) )
+	{
+	    if ( job == module->job )
+	    {
+		break;
+	    }
+	}
+	if ( job == NULL )
+	{
+	    continue;
+	}
+	if ( jobgroup->last == job )
+	{ // nx_ctx_next_job() continues from the previous one
+	    if ( job == NX_DLIST_FIRST(&(jobgroup->jobs)) )
+	    {
+		jobgroup->last = NULL;
+	    }
+	    else
+	    {
+		jobgroup->last = NX_DLIST_PREV(job, link);
+	    }
+	}
+	NX_DLIST_REMOVE(&(jobgroup->jobs), job, link);
+	if ( NX_DLIST_EMPTY(&(jobgroup->jobs)) == TRUE )
+	{
+	    NX_DLIST_REMOVE(ctx->jobgroups, jobgroup, link);
+	}
+	break;
+    }
+}
+
+
+
+/**
+ * Put back a job removed with nx_ctx_remove_job(), its pending events
+ * are kept. Must be called with nx_lock() held.
+ */
+void nx_ctx_restore_job(nx_ctx_t *ctx, nx_module_t *module)
+{
+    nx_jobgroup_t *jobgroup;
+
+    ASSERT(ctx != NULL);
+    ASSERT(module != NULL);
+
+    if ( module->job == NULL )
+    {
+	return;
+    }
+
+    jobgroup = nx_ctx_get_jobgroup(ctx, module->priority);
+    NX_DLIST_INSERT_TAIL(&(jobgroup->jobs), module->job, link);
+}
+
+
+
 boolean nx_ctx_next_job(nx_ctx_t *ctx,
 			nx_job_t **jobresult,
 			nx_event_t **eventresult)
@@ -45,6 +45,8 @@ typedef struct nx_ctx_t
 {
     apr_pool_t 		*pool;
     nx_directive_t	*cfgtree; ///< configuration parsed into directives
+    apr_pool_t		*cfgtree_pool; ///< pool of cfgtree after a partial reload, NULL if it is in pool
+    apr_array_header_t	*old_cfgtrees; ///< trees replaced by partial reloads and still used by modules
 
     char		*moduledir;
     nx_loglevel_t	loglevel;
@@ -52,23 +54,27 @@ typedef struct nx_ctx_t
     apr_file_t		*logfile;
     boolean		formatlog;	///< output with timestamp+severity
     boolean		norepeat;
-    char		norepeat_buf[NX_LOGBUF_SIZE];
-    apr_time_t		norepeat_time;
-    int			norepeat_cnt;
-    apr_size_t		norepeat_offs;
-    nx_loglevel_t	norepeat_loglevel;
     boolean		nofreeonexit; ///< do not free memory on exit: used for debugging with valgrind to allow stack traces with dso modules
     boolean		ignoreerrors; ///< try to ignore configuration errors and start anyway
     boolean		flowcontrol;  ///< use flow-control in all modules (default: true)
     char		*cachedir;
     char		*rootdir;
     char		*spooldir;
+    char		*metrics_listen; ///< MetricsListen, host:port or a unix socket path, NULL if disabled
+    int			trace_rate;	///< TraceSampleRate, trace one in this many events, 0 = disabled
+    char		*trace_file;	///< TraceFile, spans of the traced events are appended here
+    apr_interval_time_t	slow_event_threshold; ///< SlowEventThreshold, warn about event handlers running longer, 0 = disabled
+    apr_array_header_t	*cpu_affinity;	///< CPUAffinity, CPUs (int) the worker threads are pinned to, NULL if not set
 
     boolean		nocache;
     char		*ccfilename;
-    apr_file_t		*ccfile;	///< file descriptor for config cache for writes
     apr_hash_t		*config_cache;
     apr_thread_mutex_t	*config_cache_mutex;
+    apr_uint32_t	cc_dirty;	///< number of config cache updates since the last checkpoint
+    apr_interval_time_t	cc_flush_interval; ///< CacheFlushInterval, 0 = only on shutdown
+    apr_uint32_t	cc_flush_count;	///< CacheFlushCount, checkpoint after this many updates, 0 = disabled
+    boolean		cc_sync;	///< CacheSync, fsync the config cache on each checkpoint
+    apr_time_t		cc_last_flush;	///< time of the last checkpoint
 
     nx_module_list_t	*modules;	///< linked list of modules loaded
     nx_route_list_t	*routes;	///< linked list of routes
@@ -84,11 +90,16 @@ typedef struct nx_ctx_t
 
 nx_ctx_t *nx_ctx_new();
 nx_ctx_t *nx_ctx_get();
+nx_directive_t *nx_ctx_parse_cfgtree(apr_pool_t *pool, const char *cfgpath);
 void nx_ctx_parse_cfg(nx_ctx_t *ctx, const char *cfgfile);
+apr_array_header_t *nx_ctx_parse_cpu_list(apr_pool_t *pool, const nx_directive_t *curr);
 void nx_ctx_init_logging(nx_ctx_t *ctx);
 void nx_ctx_free(nx_ctx_t *ctx);
 
 void nx_ctx_init_jobs(nx_ctx_t *ctx);
+void nx_ctx_add_job(nx_ctx_t *ctx, nx_module_t *module);
+void nx_ctx_remove_job(nx_ctx_t *ctx, nx_module_t *module);
+void nx_ctx_restore_job(nx_ctx_t *ctx, nx_module_t *module);
 boolean nx_ctx_next_job(nx_ctx_t *ctx,
 			nx_job_t **jobresult,
 			nx_event_t **eventresult);
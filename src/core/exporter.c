@@ -0,0 +1,680 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include <apr_portable.h>
+#include <apr_thread_rwlock.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#endif
+
+#include "../common/error_debug.h"
+#include "../common/module.h"
+#include "../common/statvar.h"
+#include "../common/alloc.h"
+#include "../common/atomic.h"
+#include "core.h"
+#include "exporter.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_CORE
+
+#define NX_EXPORTER_REQUEST_SIZE 4096
+#define NX_EXPORTER_TIMEOUT (APR_USEC_PER_SEC / 2)
+#define NX_EXPORTER_CONTENT_TYPE "text/plain; version=0.0.4"
+
+typedef struct nx_exporter_t
+{
+    apr_pool_t		*pool;
+    apr_socket_t	*listensock;
+    apr_thread_t	*thread;
+    apr_thread_rwlock_t	*lock;		///< write locked while a reload changes the module list
+    const char		*sun_path;	///< path of the unix socket, NULL for tcp
+    apr_uint32_t	stop;		///< non-zero when the thread should exit
+    nxlog_t		*nxlog;
+} nx_exporter_t;
+
+typedef struct nx_exporter_module_t
+{
+    nx_module_t		*module;
+    nx_module_status_t	status;
+    int			queuesize;
+    nx_metrics_shard_t	metrics;
+} nx_exporter_module_t;
+
+static nx_exporter_t *_exporter = NULL;
+
+/* upper bounds of the histogram buckets in microseconds, the fine grained
+   buckets of nx_histogram_t are summed into these */
+static const uint64_t _histogram_bounds[] = { 100, 1000, 10000, 100000, 1000000, 10000000 };
+
+
+
+/**
+ * Append a label value, quotes, backslashes and newlines must be escaped
+ */
+static void nx_exporter_append_label(nx_string_t *str, const char *value)
+{
+    const char *ptr;
+
+    for ( ptr = value; *ptr != '\0'; ptr++ )
+    {
+	switch ( *ptr )
+	{
+	    case '"':
+		nx_string_append(str, "\\\"", 2);
+		break;
+	    case '\\':
+		nx_string_append(str, "\\\\", 2);
+		break;
+	    case '\n':
+		nx_string_append(str, "\\n", 2);
+		break;
+	    default:
+		nx_string_append(str, ptr, 1);
+		break;
+	}
+    }
+}
+
+
+
+static void nx_exporter_family(nx_string_t *str, const char *name,
+			       const char *type, const char *help)
+{
+    nx_string_sprintf_append(str, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+
+
+static void nx_exporter_histogram(nx_string_t *str, const char *name,
+				  const char *modulename, const nx_histogram_t *histogram)
+{
+    uint64_t cumulative = 0;
+    int i, j = 0;
+    int num_bound = (int) (sizeof(_histogram_bounds) / sizeof(uint64_t));
+
+    for ( i = 0; i < NX_HISTOGRAM_BUCKETS; i++ )
+    {
+	for ( ; (j < num_bound) && (nx_histogram_bucket_limit(i) > _histogram_bounds[j]); j++ )
+	{
+	    nx_string_sprintf_append(str, "%s_bucket{module=\"%s\",le=\"%g\"} %" APR_UINT64_T_FMT "\n",
+				     name, modulename,
+				     (double) _histogram_bounds[j] / APR_USEC_PER_SEC, cumulative);
+	}
+	cumulative += histogram->buckets[i];
+    }
+    for ( ; j < num_bound; j++ )
+    {
+	nx_string_sprintf_append(str, "%s_bucket{module=\"%s\",le=\"%g\"} %" APR_UINT64_T_FMT "\n",
+				 name, modulename,
+				 (double) _histogram_bounds[j] / APR_USEC_PER_SEC, cumulative);
+    }
+    nx_string_sprintf_append(str, "%s_bucket{module=\"%s\",le=\"+Inf\"} %" APR_UINT64_T_FMT "\n",
+			     name, modulename, histogram->count);
+    nx_string_sprintf_append(str, "%s_sum{module=\"%s\"} %f\n", name, modulename,
+			     (double) histogram->sum / APR_USEC_PER_SEC);
+    nx_string_sprintf_append(str, "%s_count{module=\"%s\"} %" APR_UINT64_T_FMT "\n",
+			     name, modulename, histogram->count);
+}
+
+
+
+static void nx_exporter_module_stats(nx_string_t *str, nx_module_t *module)
+{
+    apr_hash_index_t *idx;
+    nx_module_stat_t *stat;
+    apr_time_t now;
+
+    now = apr_time_now();
+    nx_module_lock(module);
+    if ( module->stats != NULL )
+    {
+	for ( idx = apr_hash_first(NULL, module->stats); idx != NULL; idx = apr_hash_next(idx) )
+	{
+	    apr_hash_this(idx, NULL, NULL, (void **) &stat);
+	    nx_module_stat_update(stat, now);
+	    if ( (stat->value.defined != TRUE) || (stat->value.type != NX_VALUE_TYPE_INTEGER) )
+	    {
+		continue;
+	    }
+	    nx_string_sprintf_append(str, "nxlog_module_stat{module=\"%s\",name=\"", module->name);
+	    nx_exporter_append_label(str, stat->name);
+	    nx_string_sprintf_append(str, "\",type=\"%s\"} %" APR_INT64_T_FMT "\n",
+				     nx_module_stat_type_to_string(stat->type), stat->value.integer);
+	}
+    }
+    nx_module_unlock(module);
+}
+
+
+
+#ifndef WIN32
+static void nx_exporter_memory(nx_string_t *str, apr_pool_t *pool)
+{
+    apr_file_t *file;
+    char buf[256];
+    apr_size_t nbytes = sizeof(buf) - 1;
+    unsigned long size, resident;
+
+    if ( apr_file_open(&file, "/proc/self/statm", APR_READ, APR_OS_DEFAULT, pool) != APR_SUCCESS )
+    {
+	return;
+    }
+    if ( apr_file_read(file, buf, &nbytes) == APR_SUCCESS )
+    {
+	buf[nbytes] = '\0';
+	if ( sscanf(buf, "%lu %lu", &size, &resident) == 2 )
+	{
+	    nx_exporter_family(str, "nxlog_resident_memory_bytes", "gauge", "Resident memory size.");
+	    nx_string_sprintf_append(str, "nxlog_resident_memory_bytes %lu\n",
+				     resident * (unsigned long) sysconf(_SC_PAGESIZE));
+	}
+    }
+    apr_file_close(file);
+}
+#endif
+
+
+
+/**
+ * Format the metrics in Prometheus text format. The caller must hold the
+ * exporter lock if the exporter thread is running.
+ */
+nx_string_t *nx_exporter_format(nxlog_t *nxlog)
+{
+    nx_string_t *str;
+    nx_ctx_t *ctx;
+    nx_module_t *module;
+    nx_exporter_module_t *modules;
+    nx_scratch_stats_t scratch;
+    apr_pool_t *pool;
+    int num_module = 0;
+    int i, j;
+    unsigned int worker;
+
+    ctx = nxlog->ctx;
+    ASSERT(ctx != NULL);
+
+    pool = nx_pool_create_child(NULL);
+    str = nx_string_new();
+
+    // snapshot the modules first, the samples of a metric family must be together
+    for ( module = NX_DLIST_FIRST(ctx->modules); module != NULL; module = NX_DLIST_NEXT(module, link) )
+    {
+	num_module++;
+    }
+    modules = apr_pcalloc(pool, sizeof(nx_exporter_module_t) * (apr_size_t) (num_module + 1));
+    for ( i = 0, module = NX_DLIST_FIRST(ctx->modules);
+	  (module != NULL) && (i < num_module);
+	  i++, module = NX_DLIST_NEXT(module, link) )
+    {
+	modules[i].module = module;
+	modules[i].status = nx_module_get_status(module);
+	modules[i].queuesize = (module->queue == NULL) ? 0 : nx_logqueue_size(module->queue);
+	nx_metrics_get(module->metrics, &(modules[i].metrics));
+    }
+
+    nx_exporter_family(str, "nxlog_uptime_seconds", "gauge", "Seconds since the agent was started.");
+    nx_string_sprintf_append(str, "nxlog_uptime_seconds %" APR_INT64_T_FMT "\n",
+			     apr_time_sec(apr_time_now() - nxlog->started));
+
+    nx_exporter_family(str, "nxlog_module_status", "gauge", "Status of the module instance.");
+    for ( i = 0; i < num_module; i++ )
+    {
+	nx_string_sprintf_append(str, "nxlog_module_status{module=\"%s\",type=\"%s\",status=\"%s\"} 1\n",
+				 modules[i].module->name,
+				 nx_module_type_to_string(modules[i].module->type),
+				 nx_module_status_to_string(modules[i].status));
+    }
+
+    nx_exporter_family(str, "nxlog_module_queue_size", "gauge", "Number of events in the queue of the module.");
+    for ( i = 0; i < num_module; i++ )
+    {
+	if ( modules[i].module->queue != NULL )
+	{
+	    nx_string_sprintf_append(str, "nxlog_module_queue_size{module=\"%s\"} %d\n",
+				     modules[i].module->name, modules[i].queuesize);
+	}
+    }
+    nx_exporter_family(str, "nxlog_module_queue_limit", "gauge", "LogqueueSize of the module.");
+    for ( i = 0; i < num_module; i++ )
+    {
+	if ( modules[i].module->queue != NULL )
+	{
+	    nx_string_sprintf_append(str, "nxlog_module_queue_limit{module=\"%s\"} %d\n",
+				     modules[i].module->name, modules[i].module->queue->limit);
+	}
+    }
+    nx_exporter_family(str, "nxlog_module_queue_highwater", "gauge", "Largest queue size seen.");
+    for ( i = 0; i < num_module; i++ )
+    {
+	if ( modules[i].module->queue != NULL )
+	{
+	    nx_string_sprintf_append(str, "nxlog_module_queue_highwater{module=\"%s\"} %d\n",
+				     modules[i].module->name, modules[i].module->queue->highwater);
+	}
+    }
+
+    nx_exporter_family(str, "nxlog_module_events_received_total", "counter", "Events received by the module.");
+    for ( i = 0; i < num_module; i++ )
+    {
+	nx_string_sprintf_append(str, "nxlog_module_events_received_total{module=\"%s\"} %" APR_UINT64_T_FMT "\n",
+				 modules[i].module->name, nx_atomic_read64(&(modules[i].module->evt_recvd)));
+    }
+    nx_exporter_family(str, "nxlog_module_events_forwarded_total", "counter", "Events forwarded by the module.");
+    for ( i = 0; i < num_module; i++ )
+    {
+	nx_string_sprintf_append(str, "nxlog_module_events_forwarded_total{module=\"%s\"} %" APR_UINT64_T_FMT "\n",
+				 modules[i].module->name, nx_atomic_read64(&(modules[i].module->evt_fwd)));
+    }
+    for ( j = 0; j < NX_METRICS_COUNTER_LAST; j++ )
+    {
+	const char *name;
+
+	name = apr_psprintf(pool, "nxlog_module_%s_total", nx_metrics_counter_to_string(j));
+	nx_exporter_family(str, name, "counter", "Module counter, see nxlog(8).");
+	for ( i = 0; i < num_module; i++ )
+	{
+	    nx_string_sprintf_append(str, "%s{module=\"%s\"} %" APR_UINT64_T_FMT "\n",
+				     name, modules[i].module->name, modules[i].metrics.counters[j]);
+	}
+    }
+    for ( j = 0; j < NX_METRICS_HISTOGRAM_LAST; j++ )
+    {
+	const char *name;
+
+	name = apr_psprintf(pool, "nxlog_module_%s_seconds", nx_metrics_histogram_to_string(j));
+	nx_exporter_family(str, name, "histogram", "Module latency, see nxlog(8).");
+	for ( i = 0; i < num_module; i++ )
+	{
+	    nx_exporter_histogram(str, name, modules[i].module->name, &(modules[i].metrics.histograms[j]));
+	}
+    }
+
+    nx_exporter_family(str, "nxlog_module_stat", "gauge", "Statistical counters created with create_stat().");
+    for ( i = 0; i < num_module; i++ )
+    {
+	nx_exporter_module_stats(str, modules[i].module);
+    }
+
+    nx_exporter_family(str, "nxlog_worker_threads", "gauge", "Worker threads in use.");
+    nx_string_sprintf_append(str, "nxlog_worker_threads %u\n", nxlog->active_worker_thread);
+
+    if ( nxlog->worker_busy != NULL )
+    {
+	nx_exporter_family(str, "nxlog_worker_busy_seconds_total", "counter",
+			   "Time the worker thread spent processing events.");
+	for ( worker = 0; worker < nxlog->num_worker_thread; worker++ )
+	{
+	    nx_string_sprintf_append(str, "nxlog_worker_busy_seconds_total{worker=\"%u\"} %f\n", worker,
+				     (double) nx_atomic_read64(&(nxlog->worker_busy[worker])) / APR_USEC_PER_SEC);
+	}
+    }
+
+    if ( nxlog->event_stats != NULL )
+    {
+	nxlog_event_stats_t stats[NXLOG_EVENT_TYPES];
+
+	nxlog_get_event_stats(nxlog, stats);
+	nx_exporter_family(str, "nxlog_events_processed_total", "counter",
+			   "Events processed by the worker threads by type.");
+	for ( j = 0; j < NXLOG_EVENT_TYPES; j++ )
+	{
+	    nx_string_sprintf_append(str, "nxlog_events_processed_total{type=\"%s\"} %" APR_UINT64_T_FMT "\n",
+				     nx_event_type_to_string(j), stats[j].count);
+	}
+	nx_exporter_family(str, "nxlog_event_handler_seconds_total", "counter",
+			   "Wall clock time spent in the event handlers by type.");
+	for ( j = 0; j < NXLOG_EVENT_TYPES; j++ )
+	{
+	    nx_string_sprintf_append(str, "nxlog_event_handler_seconds_total{type=\"%s\"} %f\n",
+				     nx_event_type_to_string(j), (double) stats[j].usec / APR_USEC_PER_SEC);
+	}
+	nx_exporter_family(str, "nxlog_event_handler_cpu_seconds_total", "counter",
+			   "CPU time spent in the event handlers by type.");
+	for ( j = 0; j < NXLOG_EVENT_TYPES; j++ )
+	{
+	    nx_string_sprintf_append(str, "nxlog_event_handler_cpu_seconds_total{type=\"%s\"} %f\n",
+				     nx_event_type_to_string(j), (double) stats[j].cpu_usec / APR_USEC_PER_SEC);
+	}
+    }
+
+    nx_scratch_get_stats(&scratch);
+    nx_exporter_family(str, "nxlog_scratch_arenas", "gauge", "Threads having a scratch arena.");
+    nx_string_sprintf_append(str, "nxlog_scratch_arenas %u\n", scratch.arenas);
+    nx_exporter_family(str, "nxlog_scratch_blocks_total", "counter",
+		       "Scratch arena blocks allocated beyond the first block.");
+    nx_string_sprintf_append(str, "nxlog_scratch_blocks_total %" APR_UINT64_T_FMT "\n", scratch.blocks);
+#ifndef WIN32
+    nx_exporter_memory(str, pool);
+#endif
+
+    apr_pool_destroy(pool);
+
+    return ( str );
+}
+
+
+
+static void nx_exporter_send(apr_socket_t *sock, const char *buf, apr_size_t len)
+{
+    apr_size_t nbytes;
+
+    while ( len > 0 )
+    {
+	nbytes = len;
+	if ( apr_socket_send(sock, buf, &nbytes) != APR_SUCCESS )
+	{
+	    return;
+	}
+	buf += nbytes;
+	len -= nbytes;
+    }
+}
+
+
+
+static void nx_exporter_respond(nx_exporter_t *exporter, apr_socket_t *sock, apr_pool_t *pool)
+{
+    char request[NX_EXPORTER_REQUEST_SIZE];
+    apr_size_t len = 0;
+    apr_size_t nbytes;
+    const char *status = "404 Not Found";
+    nx_string_t * volatile body = NULL;
+    const char *header;
+    nx_exception_t e;
+
+    // read the request header, the body is ignored
+    while ( len < sizeof(request) - 1 )
+    {
+	nbytes = sizeof(request) - 1 - len;
+	if ( apr_socket_recv(sock, request + len, &nbytes) != APR_SUCCESS )
+	{
+	    break;
+	}
+	len += nbytes;
+	request[len] = '\0';
+	if ( strstr(request, "\r\n\r\n") != NULL )
+	{
+	    break;
+	}
+    }
+    request[len] = '\0';
+
+    if ( strncmp(request, "GET ", 4) != 0 )
+    {
+	status = "405 Method Not Allowed";
+    }
+    else if ( (strncmp(request + 4, "/metrics ", 9) == 0) || (strncmp(request + 4, "/ ", 2) == 0) )
+    {
+	status = "200 OK";
+	CHECKERR(apr_thread_rwlock_rdlock(exporter->lock));
+	try
+	{
+	    body = nx_exporter_format(exporter->nxlog);
+	}
+	catch(e)
+	{
+	    apr_thread_rwlock_unlock(exporter->lock);
+	    rethrow(e);
+	}
+	CHECKERR(apr_thread_rwlock_unlock(exporter->lock));
+    }
+
+    header = apr_psprintf(pool, "HTTP/1.0 %s\r\nContent-Type: " NX_EXPORTER_CONTENT_TYPE "\r\n"
+			  "Content-Length: %u\r\nConnection: close\r\n\r\n",
+			  status, body == NULL ? 0 : (unsigned int) body->len);
+    nx_exporter_send(sock, header, strlen(header));
+    if ( body != NULL )
+    {
+	nx_exporter_send(sock, body->buf, body->len);
+	nx_string_free(body);
+    }
+}
+
+
+
+static void* APR_THREAD_FUNC nx_exporter_thread(apr_thread_t *thd, void *data)
+{
+    nx_exporter_t *exporter = (nx_exporter_t *) data;
+    apr_socket_t *sock;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    nx_exception_t e;
+
+    log_debug("metrics exporter thread started");
+
+    while ( nx_atomic_read32(&(exporter->stop)) == 0 )
+    {
+	pool = nx_pool_create_child(exporter->pool);
+	// the listen socket has a timeout so that stop is noticed
+	rv = apr_socket_accept(&sock, exporter->listensock, pool);
+	if ( rv != APR_SUCCESS )
+	{
+	    if ( !(APR_STATUS_IS_TIMEUP(rv) || APR_STATUS_IS_EAGAIN(rv) || APR_STATUS_IS_EINTR(rv)) )
+	    {
+		log_aprerror(rv, "metrics exporter failed to accept connection");
+		apr_sleep(NX_EXPORTER_TIMEOUT);
+	    }
+	    apr_pool_destroy(pool);
+	    continue;
+	}
+	try
+	{
+	    CHECKERR(apr_socket_timeout_set(sock, APR_USEC_PER_SEC));
+	    nx_exporter_respond(exporter, sock, pool);
+	}
+	catch(e)
+	{
+	    log_exception_msg(e, "metrics exporter failed to serve request");
+	}
+	apr_socket_close(sock);
+	apr_pool_destroy(pool);
+    }
+
+    log_debug("metrics exporter thread exiting");
+    apr_thread_exit(thd, APR_SUCCESS);
+
+    return ( NULL );
+}
+
+
+
+#ifndef WIN32
+static apr_socket_t *nx_exporter_listen_unix(nx_exporter_t *exporter, const char *path)
+{
+    struct sockaddr_un uds;
+    apr_os_sock_info_t sockinfo;
+    apr_socket_t *listensock = NULL;
+    int sock;
+
+    if ( strlen(path) >= sizeof(uds.sun_path) )
+    {
+	throw_msg("MetricsListen socket path is too long: %s", path);
+    }
+    unlink(path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( sock < 0 )
+    {
+	throw_errno("couldn't create AF_UNIX socket");
+    }
+
+    memset(&uds, 0, sizeof(uds));
+    uds.sun_family = AF_UNIX;
+#ifdef HAVE_STRUCT_SOCKADDR_SA_LEN
+    uds.s_un.sun_len = sizeof(struct sockaddr_un);
+#endif
+    apr_cpystrn(uds.sun_path, path, sizeof(uds.sun_path));
+
+    if ( bind(sock, (struct sockaddr *) &uds, sizeof(struct sockaddr_un)) < 0 )
+    {
+	close(sock);
+	throw_errno("couldn't bind socket %s", path);
+    }
+    if ( chmod(path, 0660) < 0 )
+    {
+	log_errno("couldn't chmod %s", path);
+    }
+    if ( listen(sock, SOMAXCONN) < 0 )
+    {
+	close(sock);
+	throw_errno("couldn't listen on socket %s", path);
+    }
+
+    memset(&sockinfo, 0, sizeof(apr_os_sock_info_t));
+    sockinfo.family = AF_UNIX;
+    sockinfo.type = SOCK_STREAM;
+    sockinfo.protocol = 0;
+    sockinfo.os_sock = &sock;
+    CHECKERR_MSG(apr_os_sock_make(&listensock, &sockinfo, exporter->pool),
+		 "apr_os_sock_make failed");
+    exporter->sun_path = apr_pstrdup(exporter->pool, path);
+
+    return ( listensock );
+}
+#endif
+
+
+
+static apr_socket_t *nx_exporter_listen_tcp(nx_exporter_t *exporter, const char *addr)
+{
+    apr_socket_t *listensock = NULL;
+    apr_sockaddr_t *sa;
+    char *host = NULL, *scope = NULL;
+    apr_port_t port = 0;
+
+    CHECKERR_MSG(apr_parse_addr_port(&host, &scope, &port, addr, exporter->pool),
+		 "invalid MetricsListen address: %s", addr);
+    if ( port == 0 )
+    {
+	throw_msg("port is missing from MetricsListen: %s", addr);
+    }
+    if ( host == NULL )
+    {
+	host = "localhost";
+    }
+
+    CHECKERR_MSG(apr_sockaddr_info_get(&sa, host, APR_UNSPEC, port, 0, exporter->pool),
+		 "apr_sockaddr_info failed for %s:%d", host, port);
+    CHECKERR_MSG(apr_socket_create(&listensock, sa->family, SOCK_STREAM, APR_PROTO_TCP, exporter->pool),
+		 "couldn't create tcp socket");
+    CHECKERR_MSG(apr_socket_opt_set(listensock, APR_SO_REUSEADDR, 1),
+		 "couldn't set SO_REUSEADDR on listen socket");
+    CHECKERR_MSG(apr_socket_bind(listensock, sa),
+		 "couldn't bind tcp socket to %s:%d", host, port);
+    CHECKERR_MSG(apr_socket_listen(listensock, SOMAXCONN),
+		 "couldn't listen to tcp socket on %s:%d", host, port);
+
+    return ( listensock );
+}
+
+
+
+/**
+ * Start the exporter thread if MetricsListen is set. Errors are logged,
+ * the agent keeps running without the endpoint.
+ */
+void nx_exporter_start(nxlog_t *nxlog)
+{
+    nx_exporter_t * volatile exporter;
+    const char *listen;
+    nx_exception_t e;
+
+    ASSERT(_exporter == NULL);
+
+    listen = nxlog->ctx->metrics_listen;
+    if ( listen == NULL )
+    {
+	return;
+    }
+
+    exporter = malloc(sizeof(nx_exporter_t));
+    memset(exporter, 0, sizeof(nx_exporter_t));
+    exporter->pool = nx_pool_create_core();
+    exporter->nxlog = nxlog;
+
+    try
+    {
+#ifndef WIN32
+	if ( listen[0] == '/' )
+	{
+	    exporter->listensock = nx_exporter_listen_unix(exporter, listen);
+	}
+	else
+#endif
+	{
+	    exporter->listensock = nx_exporter_listen_tcp(exporter, listen);
+	}
+	CHECKERR(apr_socket_timeout_set(exporter->listensock, NX_EXPORTER_TIMEOUT));
+	CHECKERR(apr_thread_rwlock_create(&(exporter->lock), exporter->pool));
+    }
+    catch(e)
+    {
+	log_exception_msg(e, "couldn't start metrics exporter on %s", listen);
+	if ( exporter->listensock != NULL )
+	{
+	    apr_socket_close(exporter->listensock);
+	}
+	apr_pool_destroy(exporter->pool);
+	free(exporter);
+	return;
+    }
+
+    _exporter = exporter;
+    nx_thread_create(&(exporter->thread), NULL, nx_exporter_thread, exporter, exporter->pool);
+    log_info("serving metrics on %s", listen);
+}
+
+
+
+void nx_exporter_stop()
+{
+    apr_status_t rv;
+
+    if ( _exporter == NULL )
+    {
+	return;
+    }
+
+    nx_atomic_set32(&(_exporter->stop), 1);
+    apr_thread_join(&rv, _exporter->thread);
+    apr_socket_close(_exporter->listensock);
+#ifndef WIN32
+    if ( _exporter->sun_path != NULL )
+    {
+	unlink(_exporter->sun_path);
+    }
+#endif
+    apr_pool_destroy(_exporter->pool);
+    free(_exporter);
+    _exporter = NULL;
+}
+
+
+
+/**
+ * Block the exporter while modules are added to or removed from the context
+ */
+void nx_exporter_lock()
+{
+    if ( _exporter != NULL )
+    {
+	CHECKERR(apr_thread_rwlock_wrlock(_exporter->lock));
+    }
+}
+
+
+
+void nx_exporter_unlock()
+{
+    if ( _exporter != NULL )
+    {
+	CHECKERR(apr_thread_rwlock_unlock(_exporter->lock));
+    }
+}
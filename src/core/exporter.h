@@ -0,0 +1,29 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_EXPORTER_H
+#define __NX_EXPORTER_H
+
+#include "../common/types.h"
+#include "../common/str.h"
+#include "nxlog.h"
+
+/*
+ * Serves the module and process counters in Prometheus text format over
+ * HTTP on the address given with the MetricsListen global directive. The
+ * exporter runs on its own thread and does not take nx_lock(), module
+ * lists are protected by a read-write lock which is only taken for writing
+ * while a reload adds or frees modules.
+ */
+
+void nx_exporter_start(nxlog_t *nxlog);
+void nx_exporter_stop();
+void nx_exporter_lock();
+void nx_exporter_unlock();
+nx_string_t *nx_exporter_format(nxlog_t *nxlog);
+
+#endif	/* __NX_EXPORTER_H */
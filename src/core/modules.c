@@ -79,6 +79,38 @@ void nx_module_register_exports(const nx_ctx_t *ctx, nx_module_t *module)
 
 
 
+/**
+ * Remove the functions and procedures registered by nx_module_register_exports()
+ * so that a module can be destroyed while the context keeps running.
+ */
+void nx_module_unregister_exports(const nx_ctx_t *ctx, const nx_module_t *module)
+{
+    nx_expr_func_t *func, *nextfunc;
+    nx_expr_proc_t *proc, *nextproc;
+
+    for ( func = NX_DLIST_FIRST(ctx->expr_funcs); func != NULL; func = nextfunc )
+    {
+	nextfunc = NX_DLIST_NEXT(func, link);
+	if ( func->module == module )
+	{
+	    log_debug("unregistering function %s", func->name);
+	    NX_DLIST_REMOVE(ctx->expr_funcs, func, link);
+	}
+    }
+
+    for ( proc = NX_DLIST_FIRST(ctx->expr_procs); proc != NULL; proc = nextproc )
+    {
+	nextproc = NX_DLIST_NEXT(proc, link);
+	if ( proc->module == module )
+	{
+	    log_debug("unregistering procedure %s", proc->name);
+	    NX_DLIST_REMOVE(ctx->expr_procs, proc, link);
+	}
+    }
+}
+
+
+
 void nx_module_load_dso(nx_module_t *module,
 			const nx_ctx_t *ctx,
 			const char *dsopath)
@@ -169,6 +201,7 @@ nx_module_t *nx_module_new(nx_module_type_t type, const char *name, apr_size_t b
     module->priority = 99; // modules with no routes will have this
     module->type = type;
     module->name = apr_pstrdup(pool, name);
+    module->metrics = nx_metrics_new(pool);
 #if (APR_POOL_DEBUG == 1)
 	log_info("%s module pool size after alloc is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
 		 module->name, apr_pool_num_bytes(module->pool, FALSE),
@@ -355,10 +388,81 @@ static void nx_module_add(const nx_ctx_t *ctx,
 
 
 
+/**
+ * Load and set up the module of an Input, Processor, Output or Extension block.
+ * Other directives are ignored.
+ */
+void nx_ctx_add_module(nx_ctx_t *ctx, const nx_directive_t *block)
+{
+    if ( strcasecmp(block->directive, "input") == 0 )
+    {
+	if ( block->first_child == NULL )
+	{
+	    nx_conf_error(block, "empty 'Input' block");
+	}
+
+	nx_module_add(ctx, block->first_child, block->args, NX_MODULE_TYPE_INPUT);
+    }
+    else if ( strcasecmp(block->directive, "processor") == 0 )
+    {
+	if ( block->first_child == NULL )
+	{
+	    nx_conf_error(block, "empty 'Processor' block");
+	}
+		
+	nx_module_add(ctx, block->first_child, block->args, NX_MODULE_TYPE_PROCESSOR);
+    }
+    else if ( strcasecmp(block->directive, "output") == 0 )
+    {
+	if ( block->first_child == NULL )
+	{
+	    nx_conf_error(block, "empty 'Output' block");
+	}
+	nx_module_add(ctx, block->first_child, block->args, NX_MODULE_TYPE_OUTPUT);
+    }
+    else if ( strcasecmp(block->directive, "extension") == 0 )
+    {
+	if ( block->first_child == NULL )
+	{
+	    nx_conf_error(block, "empty 'Extension' block");
+	}
+		
+	nx_module_add(ctx, block->first_child, block->args, NX_MODULE_TYPE_EXTENSION);
+    }
+}
+
+
+
+void nx_ctx_config_module(nx_ctx_t *ctx, nx_module_t *module)
+{
+    nx_exception_t e;
+
+    try
+    {
+	nx_module_config(module);
+    }
+    catch(e)
+    {
+	module->has_config_errors = TRUE;
+	if ( ctx->ignoreerrors != TRUE )
+	{
+	    rethrow(e);
+	}
+	log_exception(e);
+    }
+#if (APR_POOL_DEBUG == 1)
+    log_info("%s module pool size after config is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
+	     module->name, apr_pool_num_bytes(module->pool, FALSE),
+	     apr_pool_num_bytes(module->pool, TRUE));
+#endif
+}
+
+
+
 void nx_ctx_config_modules(nx_ctx_t *ctx)
 {
     const nx_directive_t * volatile curr = ctx->cfgtree;
-    nx_module_t * volatile module;
+    nx_module_t *module;
     nx_exception_t e;
 
     ASSERT(ctx->cfgtree != NULL);
@@ -367,41 +471,7 @@ void nx_ctx_config_modules(nx_ctx_t *ctx)
     {
 	try
 	{
-	    if ( strcasecmp(curr->directive, "input") == 0 )
-	    {
-		if ( curr->first_child == NULL )
-		{
-		    nx_conf_error(curr, "empty 'Input' block");
-		}
-
-		nx_module_add(ctx, curr->first_child, curr->args, NX_MODULE_TYPE_INPUT);
-	    }
-	    else if ( strcasecmp(curr->directive, "processor") == 0 )
-	    {
-		if ( curr->first_child == NULL )
-		{
-		    nx_conf_error(curr, "empty 'Processor' block");
-		}
-		
-		nx_module_add(ctx, curr->first_child, curr->args, NX_MODULE_TYPE_PROCESSOR);
-	    }
-	    else if ( strcasecmp(curr->directive, "output") == 0 )
-	    {
-		if ( curr->first_child == NULL )
-		{
-		    nx_conf_error(curr, "empty 'Output' block");
-		}
-		nx_module_add(ctx, curr->first_child, curr->args, NX_MODULE_TYPE_OUTPUT);
-	    }
-	    else if ( strcasecmp(curr->directive, "extension") == 0 )
-	    {
-		if ( curr->first_child == NULL )
-		{
-		    nx_conf_error(curr, "empty 'Extension' block");
-		}
-		
-		nx_module_add(ctx, curr->first_child, curr->args, NX_MODULE_TYPE_EXTENSION);
-	    }
+	    nx_ctx_add_module(ctx, curr);
 	}
 	catch(e)
 	{
@@ -418,24 +488,7 @@ void nx_ctx_config_modules(nx_ctx_t *ctx)
           module != NULL;
 	  module = NX_DLIST_NEXT(module, link) )
     {
-	try
-	{
-	    nx_module_config(module);
-	}
-	catch(e)
-	{
-	    module->has_config_errors = TRUE;
-	    if ( ctx->ignoreerrors != TRUE )
-	    {
-		rethrow(e);
-	    }
-	    log_exception(e);
-	}
-#if (APR_POOL_DEBUG == 1)
-	log_info("%s module pool size after config is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
-		 module->name, apr_pool_num_bytes(module->pool, FALSE),
-		 apr_pool_num_bytes(module->pool, TRUE));
-#endif
+	nx_ctx_config_module(ctx, module);
     }
 }
 
@@ -524,38 +577,49 @@ static boolean check_module_routes(nx_module_t *module)
 
 
 
+/**
+ * Start a module unless it is already running, unused or
+ * part of an incomplete route.
+ */
+void nx_ctx_start_module(nx_module_t *module)
+{
+    if ( nx_module_get_status(module) == NX_MODULE_STATUS_RUNNING )
+    {
+	return;
+    }
+    if ( (module->refcount == 0) && (module->type != NX_MODULE_TYPE_EXTENSION) )
+    {
+	log_warn("not starting unused module %s", module->name);
+	return;
+    }
+
+    if ( check_module_routes(module) != TRUE )
+    {
+	log_warn("not starting module %s because it is part of an incomplete route", module->name);
+	return;
+    }
+
+    nx_module_start(module);
+
+#if (APR_POOL_DEBUG == 1)
+    log_info("%s module pool size after start is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
+	     module->name, apr_pool_num_bytes(module->pool, FALSE),
+	     apr_pool_num_bytes(module->pool, TRUE));
+#endif
+}
+
+
+
 void nx_ctx_start_modules(nx_ctx_t *ctx)
 {
-    nx_module_t * volatile module;
+    nx_module_t *module;
     nxlog_t *nxlog;
 
     for ( module = NX_DLIST_FIRST(ctx->modules);
 	  module != NULL;
 	  module = NX_DLIST_NEXT(module, link) )
     {
-	if ( nx_module_get_status(module) == NX_MODULE_STATUS_RUNNING )
-	{
-	    continue;
-	}
-	if ( (module->refcount == 0) && (module->type != NX_MODULE_TYPE_EXTENSION) )
-	{
-	    log_warn("not starting unused module %s", module->name);
-	    continue;
-	}
-
-	if ( check_module_routes(module) != TRUE )
-	{
-	    log_warn("not starting module %s because it is part of an incomplete route", module->name);
-	    continue;
-	}
-
-	nx_module_start(module);
-
-#if (APR_POOL_DEBUG == 1)
-	log_info("%s module pool size after start is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
-		 module->name, apr_pool_num_bytes(module->pool, FALSE),
-		 apr_pool_num_bytes(module->pool, TRUE));
-#endif
+	nx_ctx_start_module(module);
     }
 /*
 	for ( i = 0; i < 100; i++ )
@@ -602,68 +666,79 @@ void nx_ctx_start_modules(nx_ctx_t *ctx)
 
 
 
-void nx_ctx_stop_modules(nx_ctx_t *ctx, nx_module_type_t type)
+/**
+ * Ask the module to stop and wait 10 sec at most for it to do so.
+ */
+void nx_ctx_stop_module(nx_module_t *module)
 {
-    nx_module_t * volatile module;
     int i;
     nx_exception_t e;
     nx_module_status_t status;
 
-    log_debug("stopping %s modules", nx_module_type_to_string(type));
-
-    for ( module = NX_DLIST_FIRST(ctx->modules);
-	  module != NULL;
-	  module = NX_DLIST_NEXT(module, link) )
+    log_debug("stopping module %s", module->name);
+#if (APR_POOL_DEBUG == 1)
+    log_info("%s module pool size before stop is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
+	     module->name, apr_pool_num_bytes(module->pool, FALSE),
+	     apr_pool_num_bytes(module->pool, TRUE));
+#endif
+    for ( i = 0; i < 100; i++ )
     {
-	if ( module->type != type )
+	status = nx_module_get_status(module);
+	if ( (status == NX_MODULE_STATUS_RUNNING) || (status == NX_MODULE_STATUS_PAUSED) )
 	{
-	    continue;
+	    nx_module_stop(module);
+	    apr_sleep(APR_USEC_PER_SEC / 10);
 	}
-	log_debug("stopping module %s", module->name);
-#if (APR_POOL_DEBUG == 1)
-	log_info("%s module pool size before stop is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
-		 module->name, apr_pool_num_bytes(module->pool, FALSE),
-		 apr_pool_num_bytes(module->pool, TRUE));
-#endif
-    	for ( i = 0; i < 100; i++ )
+	else
 	{
-	    status = nx_module_get_status(module);
-	    if ( (status == NX_MODULE_STATUS_RUNNING) || (status == NX_MODULE_STATUS_PAUSED) )
+	    break;
+	}
+    }
+    if ( i == 100 ) 
+    {
+	if ( module->job != NULL )
+	{
+	    if ( nx_atomic_read32(&(module->job->busy)) == TRUE )
 	    {
-		nx_module_stop(module);
-		apr_sleep(APR_USEC_PER_SEC / 10);
+		log_error("failed to stop module %s, module is busy", module->name);
 	    }
 	    else
 	    {
-		break;
-	    }
-	}
-	if ( i == 100 ) 
-	{
-	    if ( module->job != NULL )
-	    {
-		if ( nx_atomic_read32(&(module->job->busy)) == TRUE )
+		try
 		{
-		    log_error("failed to stop module %s, module is busy", module->name);
+		    nx_module_stop_self(module);
 		}
-		else
+		catch(e)
 		{
-		    try
-		    {
-			nx_module_stop_self(module);
-		    }
-		    catch(e)
-		    {
-			log_exception(e);
-		    }
+		    log_exception(e);
 		}
 	    }
 	}
+    }
 #if (APR_POOL_DEBUG == 1)
-	log_info("%s module pool size after stop is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
-		 module->name, apr_pool_num_bytes(module->pool, FALSE),
-		 apr_pool_num_bytes(module->pool, TRUE));
+    log_info("%s module pool size after stop is %"APR_SIZE_T_FMT" non-recursive, %"APR_SIZE_T_FMT" with children",
+	     module->name, apr_pool_num_bytes(module->pool, FALSE),
+	     apr_pool_num_bytes(module->pool, TRUE));
 #endif
+}
+
+
+
+void nx_ctx_stop_modules(nx_ctx_t *ctx, nx_module_type_t type)
+{
+    nx_module_t *module;
+
+    log_debug("stopping %s modules", nx_module_type_to_string(type));
+
+    for ( module = NX_DLIST_FIRST(ctx->modules);
+	  module != NULL;
+	  module = NX_DLIST_NEXT(module, link) )
+    {
+	if ( module->type != type )
+	{
+	    continue;
+	}
+	nx_ctx_stop_module(module);
     }
 }
 
@@ -12,9 +12,14 @@
 #include "ctx.h"
 
 nx_module_t *nx_module_new(nx_module_type_t type, const char *name, apr_size_t bufsize);
+void nx_module_unregister_exports(const nx_ctx_t *ctx, const nx_module_t *module);
+void nx_ctx_add_module(nx_ctx_t *ctx, const nx_directive_t *block);
+void nx_ctx_config_module(nx_ctx_t *ctx, nx_module_t *module);
 void nx_ctx_config_modules(nx_ctx_t *ctx);
 void nx_ctx_init_modules(nx_ctx_t *ctx);
+void nx_ctx_start_module(nx_module_t *module);
 void nx_ctx_start_modules(nx_ctx_t *ctx);
+void nx_ctx_stop_module(nx_module_t *module);
 void nx_ctx_stop_modules(nx_ctx_t *ctx, nx_module_type_t type);
 void nx_ctx_shutdown_modules(nx_ctx_t *ctx, nx_module_type_t type);
 void nx_ctx_save_queues(nx_ctx_t *ctx);
@@ -21,9 +21,12 @@
 #include "../common/route.h"
 #include "../common/alloc.h"
 #include "../common/atomic.h"
+#include "../common/trace.h"
 #include "job.h"
 #include "modules.h"
 #include "router.h"
+#include "reload.h"
+#include "exporter.h"
 #include "nxlog.h"
 #include "core.h"
 
@@ -71,6 +74,9 @@ void nxlog_wait_threads(nxlog_t *nxlog)
 
 	ASSERT(nxlog->terminating == TRUE);
 
+	nx_exporter_stop();
+	nx_trace_stop();
+
 	if (nxlog->worker_threads_running == NULL)
 	{
 		return;
@@ -98,6 +104,7 @@ void nxlog_wait_threads(nxlog_t *nxlog)
 			if (j > 10 * 55) // wait 55 sec at most for threads to exit
 			{
 				log_error("timed out waiting for threads to exit");
+				nx_logger_stop();
 				return;
 			}
 			nx_lock();
@@ -118,6 +125,18 @@ void nxlog_wait_threads(nxlog_t *nxlog)
 
 	CHECKERR(apr_thread_join(&thrv, nxlog->event_thread));
 	nxlog->event_thread = NULL;
+
+	// join the workers including those retired by a dynamic pool
+	for (i = 0; i < nxlog->num_worker_thread; i++)
+	{
+		if (nxlog->worker_threads[i] != NULL)
+		{
+			CHECKERR(apr_thread_join(&thrv, nxlog->worker_threads[i]));
+			nxlog->worker_threads[i] = NULL;
+		}
+	}
+
+	nx_logger_stop();
 }
 
 void nxlog_init(nxlog_t *nxlog)
@@ -143,6 +162,8 @@ void nxlog_init(nxlog_t *nxlog)
 
 	nxlog->daemonized = FALSE;
 	nxlog->num_worker_thread = 0;
+	nxlog->min_worker_thread = 0;
+	nxlog->max_worker_thread = 0;
 
 	nxlog->pid = (int)getpid();
 
@@ -201,6 +222,8 @@ void nxlog_reload(nxlog_t *nxlog)
 	apr_status_t rv;
 	apr_file_t *file;
 	nx_ctx_t *ctx_old;
+	boolean reloaded = FALSE;
+	nx_exception_t e;
 	log_info("reloading configuration and restarting modules");
 
 	ASSERT(nxlog->cfgfile != NULL);
@@ -214,6 +237,24 @@ void nxlog_reload(nxlog_t *nxlog)
 	}
 	apr_file_close(file);
 
+	// restart only what changed if possible, the exporter must not see the modules being replaced
+	nx_exporter_lock();
+	try
+	{
+		reloaded = nxlog_reload_modules(nxlog);
+	}
+	catch (e)
+	{
+		nx_exporter_unlock();
+		rethrow(e);
+	}
+	nx_exporter_unlock();
+	if (reloaded == TRUE)
+	{
+		nx_atomic_set32(&(nxlog->reload_request), FALSE);
+		return;
+	}
+
 	nx_ctx_stop_modules(nxlog->ctx, NX_MODULE_TYPE_INPUT);
 	nx_ctx_stop_modules(nxlog->ctx, NX_MODULE_TYPE_PROCESSOR);
 	nx_ctx_stop_modules(nxlog->ctx, NX_MODULE_TYPE_OUTPUT);
@@ -239,6 +280,8 @@ void nxlog_reload(nxlog_t *nxlog)
 	nxlog->ctx = nx_ctx_new();
 	nx_ctx_free(ctx_old);
 	nxlog->num_worker_thread = 0;
+	nxlog->min_worker_thread = 0;
+	nxlog->max_worker_thread = 0;
 
 	// reset flags
 	nx_atomic_set32(&(nxlog->reload_request), FALSE);
@@ -280,6 +323,163 @@ void nxlog_reload(nxlog_t *nxlog)
 	log_info("configuration reloaded successfully.");
 }
 
+#define NXLOG_POOL_INTERVAL APR_USEC_PER_SEC /* how often the size of a dynamic worker pool is checked */
+
+typedef struct nxlog_pool_stats_t
+{
+	apr_time_t last_check;
+	uint64_t last_busy;				///< sum of worker_busy at last_check
+	unsigned int samples;			///< taken by the event thread since last_check
+	unsigned int backlog_samples;	///< samples with runnable jobs not picked by a worker
+	unsigned int idle_intervals;
+} nxlog_pool_stats_t;
+
+static nxlog_pool_stats_t _pool_stats;
+
+static void *APR_THREAD_FUNC nxlog_worker_thread(apr_thread_t *thd, void *data);
+
+/**
+ * Start the worker thread of a slot, a retired thread which had the slot
+ * is joined first. Called with nx_lock() held.
+ */
+static void nxlog_start_worker(nxlog_t *nxlog, unsigned int worker_id)
+{
+	apr_status_t thrv;
+
+	if (nxlog->worker_threads[worker_id] != NULL)
+	{ // it does not take the lock after it retired
+		CHECKERR(apr_thread_join(&thrv, nxlog->worker_threads[worker_id]));
+		nxlog->worker_threads[worker_id] = NULL;
+	}
+	nx_atomic_set32(&(nxlog->worker_threads_running[worker_id]), TRUE);
+	nx_thread_create(&(nxlog->worker_threads[worker_id]), NULL, nxlog_worker_thread,
+					 (void *)(apr_size_t)worker_id, nxlog->pool);
+}
+
+/**
+ * Decide whether a dynamic worker pool should grow or shrink. busy is the
+ * time the workers spent processing events during the elapsed interval,
+ * backlog_samples is how many of the samples found runnable jobs waiting
+ * for a free worker. idle_intervals counts the low utilization intervals
+ * in a row and is updated by the call.
+ */
+nxlog_pool_action_t nxlog_pool_decide(uint64_t busy,
+									  apr_interval_time_t elapsed,
+									  unsigned int samples,
+									  unsigned int backlog_samples,
+									  unsigned int active,
+									  unsigned int min,
+									  unsigned int max,
+									  unsigned int *idle_intervals)
+{
+	double utilization;
+	double backlog = 0;
+
+	if ((elapsed <= 0) || (active == 0))
+	{
+		return (NXLOG_POOL_KEEP);
+	}
+
+	utilization = (double)busy / ((double)elapsed * active);
+	if (samples > 0)
+	{
+		backlog = (double)backlog_samples / samples;
+	}
+
+	if ((utilization >= NXLOG_POOL_GROW_UTIL) && (backlog >= NXLOG_POOL_GROW_BACKLOG))
+	{
+		*idle_intervals = 0;
+		if (active < max)
+		{
+			return (NXLOG_POOL_GROW);
+		}
+	}
+	else if (utilization < NXLOG_POOL_SHRINK_UTIL)
+	{
+		(*idle_intervals)++;
+		if ((*idle_intervals >= NXLOG_POOL_SHRINK_INTERVALS) && (active > min))
+		{
+			*idle_intervals = 0;
+			return (NXLOG_POOL_SHRINK);
+		}
+	}
+	else
+	{
+		*idle_intervals = 0;
+	}
+
+	return (NXLOG_POOL_KEEP);
+}
+
+/**
+ * Grow or shrink a dynamic worker pool between MinThreads and MaxThreads
+ * as decided by nxlog_pool_decide(). Called by the event thread with
+ * nx_lock() held.
+ */
+static void nxlog_adjust_workers(nxlog_t *nxlog, apr_time_t now)
+{
+	uint64_t busy = 0;
+	unsigned int i;
+	nxlog_pool_action_t action;
+
+	if ((nxlog->max_worker_thread == 0) || (nxlog->terminating == TRUE))
+	{
+		return;
+	}
+
+	(_pool_stats.samples)++;
+	if (nx_ctx_has_jobs(nxlog->ctx) == TRUE)
+	{
+		(_pool_stats.backlog_samples)++;
+	}
+
+	for (i = 0; i < nxlog->num_worker_thread; i++)
+	{
+		busy += nx_atomic_read64(&(nxlog->worker_busy[i]));
+	}
+	if (_pool_stats.last_check == 0)
+	{
+		_pool_stats.last_check = now;
+		_pool_stats.last_busy = busy;
+		return;
+	}
+	if (now - _pool_stats.last_check < NXLOG_POOL_INTERVAL)
+	{
+		return;
+	}
+
+	action = nxlog_pool_decide(busy - _pool_stats.last_busy, now - _pool_stats.last_check,
+							   _pool_stats.samples, _pool_stats.backlog_samples,
+							   nxlog->active_worker_thread, nxlog->min_worker_thread,
+							   nxlog->max_worker_thread, &(_pool_stats.idle_intervals));
+	_pool_stats.last_check = now;
+	_pool_stats.last_busy = busy;
+	_pool_stats.samples = 0;
+	_pool_stats.backlog_samples = 0;
+
+	switch (action)
+	{
+		case NXLOG_POOL_GROW:
+			i = nxlog->active_worker_thread;
+			(nxlog->active_worker_thread)++;
+			log_debug("increasing worker threads to %u", nxlog->active_worker_thread);
+			// a retiring thread may still be using the slot, it carries on in that case
+			if (nx_atomic_read32(&(nxlog->worker_threads_running[i])) != TRUE)
+			{
+				nxlog_start_worker(nxlog, i);
+			}
+			break;
+		case NXLOG_POOL_SHRINK:
+			(nxlog->active_worker_thread)--;
+			log_debug("decreasing worker threads to %u", nxlog->active_worker_thread);
+			// wake up the idle workers so that the retired one exits
+			CHECKERR(apr_thread_cond_broadcast(nxlog->worker_cond));
+			break;
+		default:
+			break;
+	}
+}
+
 static void *APR_THREAD_FUNC nxlog_event_thread(apr_thread_t *thd, void *data UNUSED)
 {
 	nx_event_t *event = NULL;
@@ -336,11 +536,18 @@ static void *APR_THREAD_FUNC nxlog_event_thread(apr_thread_t *thd, void *data UN
 			}
 		}
 
+		nxlog_adjust_workers(nxlog, now);
+
 		// wait for new event
 		if (next_run > 0)
 		{
 			apr_interval_time_t next_run_relative = next_run - now;
 
+			if ((nxlog->max_worker_thread > 0) && (next_run_relative > NXLOG_POOL_INTERVAL))
+			{ // the pool size is checked from this loop
+				next_run_relative = NXLOG_POOL_INTERVAL;
+			}
+
 			if (next_run_relative > 0)
 			{
 				log_debug("future event, event thread sleeping %ldms in cond_timedwait",
@@ -383,39 +590,123 @@ static void *APR_THREAD_FUNC nxlog_event_thread(apr_thread_t *thd, void *data UN
 	return (NULL);
 }
 
-static void *APR_THREAD_FUNC nxlog_worker_thread(apr_thread_t *thd, void *data UNUSED)
+/**
+ * Record the time an event handler ran and warn if it took longer than
+ * SlowEventThreshold. The warning is logged at most once a minute per
+ * module, the slow_events counter has the total.
+ */
+static void nxlog_account_event(nxlog_t *nxlog,
+								unsigned int worker_id,
+								nx_module_t *module,
+								nx_event_type_t type,
+								apr_time_t elapsed,
+								apr_time_t cputime)
+{
+	nxlog_event_stats_t *stats;
+	apr_interval_time_t threshold;
+	apr_time_t now;
+
+	stats = &(nxlog->event_stats[worker_id * NXLOG_EVENT_TYPES + type]);
+	nx_atomic_add64(&(stats->count), 1);
+	nx_atomic_add64(&(stats->usec), (uint64_t)elapsed);
+	nx_atomic_add64(&(stats->cpu_usec), (uint64_t)cputime);
+	nx_atomic_add64(&(nxlog->worker_busy[worker_id]), (uint64_t)elapsed);
+
+	if (module == NULL)
+	{
+		return;
+	}
+	nx_metrics_record(module->metrics, NX_METRICS_PROCTIME, elapsed);
+	nx_metrics_add(module->metrics, NX_METRICS_CPUTIME, (uint64_t)cputime);
+
+	threshold = nxlog->ctx->slow_event_threshold;
+	if ((threshold > 0) && (elapsed >= threshold))
+	{
+		nx_metrics_add(module->metrics, NX_METRICS_SLOW_EVENTS, 1);
+		now = apr_time_now();
+		if (module->slow_warned + APR_USEC_PER_SEC * 60 <= now)
+		{
+			module->slow_warned = now;
+			log_warn("%s event of module %s took %.3f seconds (%.3f seconds CPU), "
+					 "exceeding SlowEventThreshold",
+					 nx_event_type_to_string(type), module->name,
+					 (double)elapsed / APR_USEC_PER_SEC, (double)cputime / APR_USEC_PER_SEC);
+		}
+	}
+}
+
+/**
+ * Sum the per worker event statistics into total, which must have
+ * NXLOG_EVENT_TYPES elements.
+ */
+void nxlog_get_event_stats(nxlog_t *nxlog, nxlog_event_stats_t *total)
+{
+	nxlog_event_stats_t *stats;
+	unsigned int i;
+	int type;
+
+	memset(total, 0, sizeof(nxlog_event_stats_t) * NXLOG_EVENT_TYPES);
+	if (nxlog->event_stats == NULL)
+	{
+		return;
+	}
+	for (i = 0; i < nxlog->num_worker_thread; i++)
+	{
+		for (type = 0; type < NXLOG_EVENT_TYPES; type++)
+		{
+			stats = &(nxlog->event_stats[i * NXLOG_EVENT_TYPES + type]);
+			total[type].count += nx_atomic_read64(&(stats->count));
+			total[type].usec += nx_atomic_read64(&(stats->usec));
+			total[type].cpu_usec += nx_atomic_read64(&(stats->cpu_usec));
+		}
+	}
+}
+
+static void *APR_THREAD_FUNC nxlog_worker_thread(apr_thread_t *thd, void *data)
 {
 	nx_event_t *event = NULL;
 	nxlog_t *nxlog;
 	boolean done = FALSE;
 	unsigned int worker_id;
-	boolean found = FALSE;
+	int cpu;
 	nx_job_t *job;
 	nx_ctx_t *ctx;
 	boolean terminating = FALSE;
 	nx_exception_t e;
+	nx_module_t *module;
+	apr_time_t started;
+	apr_time_t elapsed;
+	apr_time_t cpustarted;
+	nx_event_type_t type;
 
 	nxlog = nxlog_get();
 	ctx = nx_ctx_get();
 
-	for (worker_id = 0; worker_id < nxlog->num_worker_thread; worker_id++)
+	worker_id = (unsigned int)(apr_size_t)data;
+	ASSERT(worker_id < nxlog->num_worker_thread);
+
+	log_debug("worker thread %d started", worker_id);
+
+	if (ctx->cpu_affinity != NULL)
 	{
-		if (nxlog->worker_threads[worker_id] == thd)
+		cpu = ((int *)ctx->cpu_affinity->elts)[worker_id % (unsigned int)ctx->cpu_affinity->nelts];
+		if (nx_thread_set_affinity(cpu) != TRUE)
 		{
-			found = TRUE;
-			break;
+			log_warn("couldn't pin worker thread %u to CPU %d", worker_id, cpu);
 		}
 	}
-	ASSERT(found == TRUE);
-
-	nx_atomic_set32(&(nxlog->worker_threads_running[worker_id]), TRUE);
-
-	log_debug("worker thread %d started", worker_id);
 
 	while (done != TRUE)
 	{
 		nx_lock();
 
+		if (worker_id >= nxlog->active_worker_thread)
+		{ // retired by nxlog_adjust_workers()
+			nx_atomic_set32(&(nxlog->worker_threads_running[worker_id]), FALSE);
+			nx_unlock();
+			break;
+		}
+
 		job = NULL;
 		event = NULL;
 		if (nx_ctx_next_job(ctx, &job, &event) != TRUE)
@@ -423,7 +714,10 @@ static void *APR_THREAD_FUNC nxlog_worker_thread(apr_thread_t *thd, void *data U
 			log_debug("worker %u waiting for new event", worker_id);
 			CHECKERR(apr_thread_cond_wait(nxlog->worker_cond, nxlog->mutex));
 			log_debug("worker %u got signal for new job", worker_id);
-			nx_ctx_next_job(ctx, &job, &event);
+			if (worker_id < nxlog->active_worker_thread)
+			{
+				nx_ctx_next_job(ctx, &job, &event);
+			}
 		}
 		if (job != NULL)
 		{
@@ -436,6 +730,11 @@ static void *APR_THREAD_FUNC nxlog_worker_thread(apr_thread_t *thd, void *data U
 		if (event != NULL)
 		{
 			log_debug("worker %u processing event 0x%lx", worker_id, (long unsigned)event);
+			// the module is not freed while its job is busy
+			module = event->module;
+			type = event->type;
+			started = apr_time_now();
+			cpustarted = nx_metrics_thread_cputime();
 			try
 			{
 				nx_event_process(event);
@@ -444,7 +743,11 @@ static void *APR_THREAD_FUNC nxlog_worker_thread(apr_thread_t *thd, void *data U
 			{
 				log_exception(e);
 			}
+			elapsed = apr_time_now() - started;
+			nxlog_account_event(nxlog, worker_id, module, type, elapsed,
+								nx_metrics_thread_cputime() - cpustarted);
 			nx_event_free(event);
+			nx_scratch_reset();
 			nx_atomic_set32(&(job->busy), FALSE);
 		}
 		else
@@ -473,9 +776,12 @@ void nxlog_create_threads(nxlog_t *nxlog)
 	unsigned int pollset_cnt = 0;
 	unsigned int module_cnt = 0;
 	unsigned int thread_cnt = 0;
+	nx_exception_t e;
 
 	ASSERT(nxlog->ctx != NULL);
 
+	nx_logger_start();
+
 	// calculate the number of worker threads needed for optimal operation
 	for (module = NX_DLIST_FIRST(nxlog->ctx->modules);
 		 module != NULL;
@@ -528,7 +834,7 @@ void nxlog_create_threads(nxlog_t *nxlog)
 	}
 	if (nxlog->num_worker_thread > 0)
 	{
-		if (thread_cnt > nxlog->num_worker_thread)
+		if ((thread_cnt > nxlog->num_worker_thread) && (nxlog->max_worker_thread == 0))
 		{
 			log_warn("Worker thread count should be increased to %d. Using the value of %d explicitely defined in Threads may result in decreased performance!", thread_cnt, nxlog->num_worker_thread);
 		}
@@ -538,20 +844,59 @@ void nxlog_create_threads(nxlog_t *nxlog)
 		nxlog->num_worker_thread = thread_cnt;
 	}
 
+	nxlog->active_worker_thread = nxlog->num_worker_thread;
+	if (nxlog->max_worker_thread > 0)
+	{ // dynamic pool, Threads or the calculated number is the initial size
+		if (nxlog->min_worker_thread == 0)
+		{
+			nxlog->min_worker_thread = 1;
+		}
+		if (nxlog->min_worker_thread > nxlog->max_worker_thread)
+		{
+			log_warn("MinThreads (%u) is greater than MaxThreads (%u), using %u",
+					 nxlog->min_worker_thread, nxlog->max_worker_thread, nxlog->max_worker_thread);
+			nxlog->min_worker_thread = nxlog->max_worker_thread;
+		}
+		if (nxlog->active_worker_thread < nxlog->min_worker_thread)
+		{
+			nxlog->active_worker_thread = nxlog->min_worker_thread;
+		}
+		if (nxlog->active_worker_thread > nxlog->max_worker_thread)
+		{
+			nxlog->active_worker_thread = nxlog->max_worker_thread;
+		}
+		nxlog->num_worker_thread = nxlog->max_worker_thread;
+	}
+	memset(&_pool_stats, 0, sizeof(nxlog_pool_stats_t));
+
 	nx_lock();
 
-	nxlog->worker_threads = apr_palloc(nxlog->pool, sizeof(apr_thread_t *) * nxlog->num_worker_thread);
+	nxlog->worker_threads = apr_pcalloc(nxlog->pool, sizeof(apr_thread_t *) * nxlog->num_worker_thread);
 	nxlog->worker_threads_running = apr_pcalloc(nxlog->pool, sizeof(uint32_t) * nxlog->num_worker_thread);
+	nxlog->worker_busy = apr_pcalloc(nxlog->pool, sizeof(uint64_t) * nxlog->num_worker_thread);
+	nxlog->event_stats = apr_pcalloc(nxlog->pool, sizeof(nxlog_event_stats_t) * NXLOG_EVENT_TYPES *
+													  nxlog->num_worker_thread);
 
-	log_debug("spawning %d worker threads", nxlog->num_worker_thread);
-	for (i = 0; i < nxlog->num_worker_thread; i++)
+	log_debug("spawning %d worker threads", nxlog->active_worker_thread);
+	for (i = 0; i < nxlog->active_worker_thread; i++)
 	{
-		nx_thread_create(&(nxlog->worker_threads[i]), NULL, nxlog_worker_thread, NULL, nxlog->pool);
+		nxlog_start_worker(nxlog, i);
 	}
 
 	nx_thread_create(&(nxlog->event_thread), NULL, nxlog_event_thread, NULL, nxlog->pool);
 
 	nx_unlock();
+
+	nx_exporter_start(nxlog);
+
+	try
+	{
+		nx_trace_start(nxlog->ctx->trace_rate, nxlog->ctx->trace_file);
+	}
+	catch (e)
+	{ // tracing stays off, this should not prevent startup
+		log_exception(e);
+	}
 }
 
 boolean nxlog_data_available()
@@ -687,6 +1032,7 @@ void nxlog_mainloop(nxlog_t *nxlog, boolean offline)
 		{
 			nxlog_reload(nxlog);
 		}
+		nx_config_cache_checkpoint();
 	}
 	if (offline != TRUE)
 	{
@@ -694,8 +1040,180 @@ void nxlog_mainloop(nxlog_t *nxlog, boolean offline)
 	}
 }
 
+static void nxlog_metrics_info(nx_string_t *infostr, nx_module_t *module)
+{
+	nx_metrics_shard_t total;
+	nx_histogram_t *proctime;
+	nx_histogram_t *queuetime;
+
+	nx_metrics_get(module->metrics, &total);
+	proctime = &(total.histograms[NX_METRICS_PROCTIME]);
+	queuetime = &(total.histograms[NX_METRICS_QUEUETIME]);
+
+	nx_string_sprintf_append(infostr, "   events in: %" APR_UINT64_T_FMT ", out: %" APR_UINT64_T_FMT
+									  ", bytes in: %" APR_UINT64_T_FMT ", out: %" APR_UINT64_T_FMT
+									  ", drops: %" APR_UINT64_T_FMT ", pauses: %" APR_UINT64_T_FMT
+									  ", queue highwater: %d" NX_LINEFEED,
+							 nx_atomic_read64(&(module->evt_recvd)), nx_atomic_read64(&(module->evt_fwd)),
+							 total.counters[NX_METRICS_BYTES_IN], total.counters[NX_METRICS_BYTES_OUT],
+							 total.counters[NX_METRICS_DROPS], total.counters[NX_METRICS_PAUSES],
+							 module->queue == NULL ? 0 : module->queue->highwater);
+	nx_string_sprintf_append(infostr, "   processing time usec p50: %" APR_UINT64_T_FMT ", p99: %" APR_UINT64_T_FMT
+									  ", max: %" APR_UINT64_T_FMT "; queue time usec p50: %" APR_UINT64_T_FMT
+									  ", p99: %" APR_UINT64_T_FMT ", max: %" APR_UINT64_T_FMT NX_LINEFEED,
+							 nx_histogram_percentile(proctime, 50), nx_histogram_percentile(proctime, 99),
+							 proctime->max, nx_histogram_percentile(queuetime, 50),
+							 nx_histogram_percentile(queuetime, 99), queuetime->max);
+	nx_string_sprintf_append(infostr, "   cpu time usec: %" APR_UINT64_T_FMT ", slow events: %" APR_UINT64_T_FMT
+									  NX_LINEFEED,
+							 total.counters[NX_METRICS_CPUTIME], total.counters[NX_METRICS_SLOW_EVENTS]);
+}
+
+static void nxlog_event_stats_info(nx_string_t *infostr, nxlog_t *nxlog)
+{
+	nxlog_event_stats_t stats[NXLOG_EVENT_TYPES];
+	int type;
+
+	nxlog_get_event_stats(nxlog, stats);
+	nx_string_append(infostr, "event handlers:" NX_LINEFEED, -1);
+	for (type = 0; type < NXLOG_EVENT_TYPES; type++)
+	{
+		if (stats[type].count == 0)
+		{
+			continue;
+		}
+		nx_string_sprintf_append(infostr, " - %s: count %" APR_UINT64_T_FMT ", time usec: %" APR_UINT64_T_FMT
+										  ", cpu time usec: %" APR_UINT64_T_FMT NX_LINEFEED,
+								 nx_event_type_to_string(type), stats[type].count, stats[type].usec,
+								 stats[type].cpu_usec);
+	}
+}
+
+static void nxlog_histogram_to_json(nx_string_t *str, const char *name, const nx_histogram_t *histogram)
+{
+	int i;
+	boolean first = TRUE;
+
+	nx_string_sprintf_append(str, ",\"%s\":{\"count\":%" APR_UINT64_T_FMT ",\"sum\":%" APR_UINT64_T_FMT
+								  ",\"max\":%" APR_UINT64_T_FMT ",\"p50\":%" APR_UINT64_T_FMT
+								  ",\"p90\":%" APR_UINT64_T_FMT ",\"p99\":%" APR_UINT64_T_FMT
+								  ",\"buckets\":{",
+							 name, histogram->count, histogram->sum, histogram->max,
+							 nx_histogram_percentile(histogram, 50), nx_histogram_percentile(histogram, 90),
+							 nx_histogram_percentile(histogram, 99));
+	// only the non-empty buckets, keyed by their upper limit
+	for (i = 0; i < NX_HISTOGRAM_BUCKETS; i++)
+	{
+		if (histogram->buckets[i] == 0)
+		{
+			continue;
+		}
+		nx_string_sprintf_append(str, "%s\"%" APR_UINT64_T_FMT "\":%" APR_UINT64_T_FMT, first == TRUE ? "" : ",",
+								 nx_histogram_bucket_limit(i), histogram->buckets[i]);
+		first = FALSE;
+	}
+	nx_string_append(str, "}}", -1);
+}
+
+/**
+ * Return the counters and histograms of all modules as a JSON object.
+ * The caller must free the returned string.
+ */
+nx_string_t *nxlog_metrics_to_json()
+{
+	nx_ctx_t *ctx;
+	nx_module_t *module;
+	nx_metrics_shard_t total;
+	nx_string_t *str;
+	int i;
+
+	ctx = nx_ctx_get();
+	str = nx_string_new();
+
+	nx_string_sprintf_append(str, "{\"time\":%" APR_INT64_T_FMT ",\"modules\":[", apr_time_now());
+	// a reload removes the modules from the list under the lock
+	nx_lock();
+	for (module = NX_DLIST_FIRST(ctx->modules);
+		 module != NULL;
+		 module = NX_DLIST_NEXT(module, link))
+	{
+		nx_metrics_get(module->metrics, &total);
+		nx_string_sprintf_append(str, "%s{\"name\":\"%s\",\"module\":\"%s\",\"type\":\"%s\""
+									  ",\"events_in\":%" APR_UINT64_T_FMT ",\"events_out\":%" APR_UINT64_T_FMT
+									  ",\"queue_size\":%d,\"queue_highwater\":%d",
+								 module == NX_DLIST_FIRST(ctx->modules) ? "" : ",",
+								 module->name, module->dsoname, nx_module_type_to_string(module->type),
+								 nx_atomic_read64(&(module->evt_recvd)), nx_atomic_read64(&(module->evt_fwd)),
+								 module->queue == NULL ? 0 : nx_logqueue_size(module->queue),
+								 module->queue == NULL ? 0 : module->queue->highwater);
+		for (i = 0; i < NX_METRICS_COUNTER_LAST; i++)
+		{
+			nx_string_sprintf_append(str, ",\"%s\":%" APR_UINT64_T_FMT,
+									 nx_metrics_counter_to_string(i), total.counters[i]);
+		}
+		for (i = 0; i < NX_METRICS_HISTOGRAM_LAST; i++)
+		{
+			nxlog_histogram_to_json(str, nx_metrics_histogram_to_string(i), &(total.histograms[i]));
+		}
+		nx_string_append(str, "}", -1);
+	}
+	nx_unlock();
+	nx_string_append(str, "]}" NX_LINEFEED, -1);
+
+	return (str);
+}
+
+/**
+ * Write the metrics to metrics.json in the CacheDir. It is written to a
+ * temporary file first so that readers never see a partial file.
+ */
+static void nxlog_dump_metrics()
+{
+	nx_ctx_t *ctx;
+	nx_string_t *str;
+	apr_pool_t *pool;
+	apr_file_t *file = NULL;
+	const char *filename;
+	const char *tmpfilename;
+	nx_exception_t e;
+
+	ctx = nx_ctx_get();
+	if (ctx->cachedir == NULL)
+	{
+		return;
+	}
+	pool = nx_pool_create_core();
+	filename = apr_psprintf(pool, "%s" NX_DIR_SEPARATOR "metrics.json", ctx->cachedir);
+	tmpfilename = apr_psprintf(pool, "%s.tmp", filename);
+	str = nxlog_metrics_to_json();
+
+	try
+	{
+		CHECKERR_MSG(apr_file_open(&file, tmpfilename, APR_WRITE | APR_CREATE | APR_TRUNCATE | APR_BINARY,
+								   APR_OS_DEFAULT, pool),
+					 "couldn't open '%s' for writing", tmpfilename);
+		CHECKERR_MSG(apr_file_write_full(file, str->buf, str->len, NULL), "couldn't write '%s'", tmpfilename);
+		CHECKERR_MSG(apr_file_close(file), "couldn't close '%s'", tmpfilename);
+		file = NULL;
+		CHECKERR_MSG(apr_file_rename(tmpfilename, filename, pool), "couldn't rename '%s' to '%s'", tmpfilename,
+					 filename);
+	}
+	catch (e)
+	{
+		if (file != NULL)
+		{
+			apr_file_close(file);
+		}
+		apr_file_remove(tmpfilename, pool);
+		log_exception(e);
+	}
+	nx_string_free(str);
+	apr_pool_destroy(pool);
+}
+
 void nxlog_dump_info()
 {
+	nxlog_t *nxlog;
 	nx_ctx_t *ctx;
 	nx_route_t *route;
 	int queuesize = 0;
@@ -706,8 +1224,10 @@ void nxlog_dump_info()
 	int i;
 	nx_module_t *module;
 	nx_string_t *infostr;
+	char *info;
 	nx_event_type_t eventtypes[NX_EVENT_TYPE_LAST + 1];
 
+	nxlog = nxlog_get();
 	ctx = nx_ctx_get();
 
 	infostr = nx_string_new();
@@ -720,6 +1240,15 @@ void nxlog_dump_info()
 		events++;
 	}
 	nx_string_sprintf_append(infostr, "event queue has %d events" NX_LINEFEED, events);
+	if (nxlog->max_worker_thread > 0)
+	{
+		nx_string_sprintf_append(infostr, "worker threads: %u (MinThreads: %u, MaxThreads: %u)" NX_LINEFEED,
+								 nxlog->active_worker_thread, nxlog->min_worker_thread, nxlog->max_worker_thread);
+	}
+	else
+	{
+		nx_string_sprintf_append(infostr, "worker threads: %u" NX_LINEFEED, nxlog->active_worker_thread);
+	}
 
 	for (jobgroup = NX_DLIST_FIRST(ctx->jobgroups);
 		 jobgroup != NULL;
@@ -791,9 +1320,22 @@ void nxlog_dump_info()
 									 module->name, nx_module_type_to_string(module->type),
 									 nx_module_status_to_string(nx_module_get_status(module)),
 									 queuesize);
+			info = nx_module_info(module);
+			if (info != NULL)
+			{
+				nx_string_append(infostr, info, -1);
+				free(info);
+			}
+			nxlog_metrics_info(infostr, module);
 		}
 	}
+	nxlog_event_stats_info(infostr, nxlog);
+	nx_trace_summary_append(infostr);
+	nx_string_sprintf_append(infostr, "internal log messages dropped: %" APR_UINT64_T_FMT NX_LINEFEED,
+							 nx_logger_get_drops());
 
 	log_info("%s", infostr->buf);
 	nx_string_free(infostr);
+
+	nxlog_dump_metrics();
 }
@@ -20,6 +20,28 @@
 #define NX_POLL_TIMEOUT (APR_USEC_PER_SEC / 20)
 //#define NX_POLL_TIMEOUT (APR_USEC_PER_SEC * 10)
 
+#define NXLOG_EVENT_TYPES (NX_EVENT_TYPE_LAST + 1)
+
+#define NXLOG_MAX_WORKER_THREAD 256     ///< upper limit of MinThreads and MaxThreads
+#define NXLOG_POOL_GROW_UTIL 0.75       ///< add a worker above this utilization if jobs were waiting
+#define NXLOG_POOL_GROW_BACKLOG 0.5     ///< in at least this ratio of the samples
+#define NXLOG_POOL_SHRINK_UTIL 0.25     ///< remove a worker below this utilization
+#define NXLOG_POOL_SHRINK_INTERVALS 10  ///< for this many intervals in a row
+
+typedef enum nxlog_pool_action_t
+{
+    NXLOG_POOL_KEEP = 0,
+    NXLOG_POOL_GROW,
+    NXLOG_POOL_SHRINK,
+} nxlog_pool_action_t;
+
+typedef struct nxlog_event_stats_t
+{
+    uint64_t count;    ///< events processed
+    uint64_t usec;     ///< wall clock time spent in the handlers
+    uint64_t cpu_usec; ///< CPU time of the worker thread spent in the handlers
+} nxlog_event_stats_t;
+
 typedef struct nxlog_t
 {
     apr_pool_t *pool;
@@ -40,10 +62,15 @@ typedef struct nxlog_t
     boolean verify_conf; ///< verify configuration file then exit
     boolean do_stop;     ///< stop a running instance
     boolean do_restart;  ///< restart a running instance
-    unsigned int num_worker_thread;
+    unsigned int num_worker_thread;       ///< worker thread slots, MaxThreads with a dynamic pool
+    unsigned int active_worker_thread;    ///< workers in use, changed under nx_lock() by the pool sizing
+    unsigned int min_worker_thread;       ///< MinThreads
+    unsigned int max_worker_thread;       ///< MaxThreads, 0 if the pool has a fixed size
     apr_thread_t **worker_threads;
     apr_thread_cond_t *worker_cond;
     apr_uint32_t *worker_threads_running; ///< non-zero if running (array)
+    uint64_t *worker_busy;                ///< usec spent processing events (array)
+    nxlog_event_stats_t *event_stats;     ///< per worker and event type (array of num_worker_thread * NXLOG_EVENT_TYPES)
     apr_thread_cond_t *event_cond;
     apr_thread_t *event_thread;
 
@@ -57,14 +84,20 @@ typedef struct nxlog_t
 } nxlog_t;
 
 nxlog_t *nxlog_get();
+void nxlog_get_event_stats(nxlog_t *nxlog, nxlog_event_stats_t *total);
 void nxlog_init(nxlog_t *nxlog);
 void nxlog_init_poller(nxlog_t *nxlog);
 void nxlog_reload(nxlog_t *nxlog);
 void nxlog_shutdown(nxlog_t *nxlog);
 void nxlog_create_threads(nxlog_t *nxlog);
 void nxlog_wait_threads(nxlog_t *nxlog);
+nxlog_pool_action_t nxlog_pool_decide(uint64_t busy, apr_interval_time_t elapsed,
+                                      unsigned int samples, unsigned int backlog_samples,
+                                      unsigned int active, unsigned int min, unsigned int max,
+                                      unsigned int *idle_intervals);
 boolean nxlog_data_available();
 void nxlog_mainloop(nxlog_t *nxlog, boolean offline);
 void nxlog_set(nxlog_t *nxlog);
 void nxlog_dump_info();
+nx_string_t *nxlog_metrics_to_json();
 #endif /* __NXLOG_H */
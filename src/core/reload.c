@@ -0,0 +1,839 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include <apr_lib.h>
+
+#include "../common/error_debug.h"
+#include "../common/module.h"
+#include "../common/cfgfile.h"
+#include "../common/route.h"
+#include "../common/alloc.h"
+#include "../common/atomic.h"
+#include "job.h"
+#include "modules.h"
+#include "router.h"
+#include "reload.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_CORE
+
+#define NX_RELOAD_BUSY_WAIT 100 /* wait this many 100ms for a busy module to finish its event */
+
+
+typedef struct nx_reload_item_t
+{
+    const char		*name;
+    boolean		is_route;
+    const nx_directive_t *oldconf;	///< block in the running configuration
+    const nx_directive_t *newconf;	///< block in the new configuration
+    apr_array_header_t	*members;	///< module names in the old and new Path of a route
+    boolean		affected;
+} nx_reload_item_t;
+
+/// a configuration tree replaced by a partial reload, see nx_ctx_t.old_cfgtrees
+typedef struct nx_reload_cfgtree_t
+{
+    apr_pool_t		*pool;
+    const nx_directive_t *cfgtree;
+} nx_reload_cfgtree_t;
+
+
+
+static boolean nx_reload_str_equal(const char *s1, const char *s2)
+{
+    if ( (s1 == NULL) || (s2 == NULL) )
+    {
+	return ( s1 == s2 );
+    }
+
+    return ( strcmp(s1, s2) == 0 );
+}
+
+
+
+/**
+ * Compare a directive with its children, the file name and line number
+ * where it was found do not matter.
+ */
+static boolean nx_reload_directive_equal(const nx_directive_t *d1,
+					 const nx_directive_t *d2)
+{
+    const nx_directive_t *c1, *c2;
+
+    if ( strcasecmp(d1->directive, d2->directive) != 0 )
+    {
+	return ( FALSE );
+    }
+    if ( nx_reload_str_equal(d1->args, d2->args) != TRUE )
+    {
+	return ( FALSE );
+    }
+
+    for ( c1 = d1->first_child, c2 = d2->first_child;
+	  (c1 != NULL) && (c2 != NULL);
+	  c1 = c1->next, c2 = c2->next )
+    {
+	if ( nx_reload_directive_equal(c1, c2) != TRUE )
+	{
+	    return ( FALSE );
+	}
+    }
+
+    return ( (c1 == NULL) && (c2 == NULL) );
+}
+
+
+
+static boolean nx_reload_str_contains(const char *str, const char *needle)
+{
+    apr_size_t len;
+
+    if ( str == NULL )
+    {
+	return ( FALSE );
+    }
+
+    len = strlen(needle);
+    for ( ; *str != '\0'; str++ )
+    {
+	if ( strncasecmp(str, needle, len) == 0 )
+	{
+	    return ( TRUE );
+	}
+    }
+
+    return ( FALSE );
+}
+
+
+
+/**
+ * Check whether the arguments of a directive or its children contain needle
+ */
+static boolean nx_reload_directive_contains(const nx_directive_t *directive,
+					    const char *needle)
+{
+    const nx_directive_t *child;
+
+    if ( nx_reload_str_contains(directive->args, needle) == TRUE )
+    {
+	return ( TRUE );
+    }
+    for ( child = directive->first_child; child != NULL; child = child->next )
+    {
+	if ( nx_reload_directive_contains(child, needle) == TRUE )
+	{
+	    return ( TRUE );
+	}
+    }
+
+    return ( FALSE );
+}
+
+
+
+static boolean nx_reload_is_module_block(const nx_directive_t *directive)
+{
+    if ( (strcasecmp(directive->directive, "input") == 0) ||
+	 (strcasecmp(directive->directive, "processor") == 0) ||
+	 (strcasecmp(directive->directive, "output") == 0) ||
+	 (strcasecmp(directive->directive, "extension") == 0) )
+    {
+	return ( TRUE );
+    }
+
+    return ( FALSE );
+}
+
+
+
+static nx_reload_item_t *nx_reload_item_get(apr_array_header_t *items,
+					    const char *name,
+					    boolean is_route)
+{
+    nx_reload_item_t *item;
+    int i;
+
+    for ( i = 0; i < items->nelts; i++ )
+    {
+	item = ((nx_reload_item_t *) items->elts) + i;
+	if ( (item->is_route == is_route) && (strcasecmp(item->name, name) == 0) )
+	{
+	    return ( item );
+	}
+    }
+
+    return ( NULL );
+}
+
+
+
+/**
+ * Collect the module names from the Path of a route,
+ * they are separated with commas and arrows.
+ */
+static void nx_reload_add_members(apr_pool_t *pool,
+				  apr_array_header_t *members,
+				  const nx_directive_t *routeconf)
+{
+    const char *path = NULL;
+    const char *start, *end;
+    const char *name;
+    int i;
+
+    if ( routeconf->first_child != NULL )
+    {
+	path = nx_cfg_get_value(routeconf->first_child, "path");
+    }
+    if ( path == NULL )
+    {
+	return;
+    }
+
+    for ( start = path; *start != '\0'; )
+    {
+	if ( apr_isspace(*start) || (*start == ',') )
+	{
+	    start++;
+	    continue;
+	}
+	if ( strncmp(start, "=>", 2) == 0 )
+	{
+	    start += 2;
+	    continue;
+	}
+	for ( end = start;
+	      (*end != '\0') && !apr_isspace(*end) && (*end != ',') && (strncmp(end, "=>", 2) != 0);
+	      end++ );
+	name = apr_pstrndup(pool, start, (apr_size_t) (end - start));
+	for ( i = 0; i < members->nelts; i++ )
+	{
+	    if ( strcasecmp(((const char **) members->elts)[i], name) == 0 )
+	    {
+		break;
+	    }
+	}
+	if ( i == members->nelts )
+	{
+	    *((const char **) apr_array_push(members)) = name;
+	}
+	start = end;
+    }
+}
+
+
+
+/**
+ * Record the blocks of a configuration tree. Returns FALSE if the blocks
+ * cannot be told apart, the full reload reports the problem in this case.
+ */
+static boolean nx_reload_collect(apr_pool_t *pool,
+				 apr_array_header_t *items,
+				 apr_array_header_t *globals,
+				 const nx_directive_t *tree,
+				 boolean is_new)
+{
+    const nx_directive_t *curr;
+    nx_reload_item_t *item;
+    boolean is_route;
+
+    for ( curr = tree; curr != NULL; curr = curr->next )
+    {
+	is_route = (strcasecmp(curr->directive, "route") == 0) ? TRUE : FALSE;
+	if ( (is_route != TRUE) && (nx_reload_is_module_block(curr) != TRUE) )
+	{
+	    *((const nx_directive_t **) apr_array_push(globals)) = curr;
+	    continue;
+	}
+	if ( (curr->args == NULL) || (curr->args[0] == '\0') )
+	{
+	    return ( FALSE );
+	}
+	item = nx_reload_item_get(items, curr->args, is_route);
+	if ( item == NULL )
+	{
+	    item = (nx_reload_item_t *) apr_array_push(items);
+	    memset(item, 0, sizeof(nx_reload_item_t));
+	    // the old tree may be freed while the plan is used
+	    item->name = apr_pstrdup(pool, curr->args);
+	    item->is_route = is_route;
+	    item->members = apr_array_make(pool, 5, sizeof(const char *));
+	}
+	if ( ((is_new == TRUE) && (item->newconf != NULL)) ||
+	     ((is_new != TRUE) && (item->oldconf != NULL)) )
+	{ // defined twice
+	    return ( FALSE );
+	}
+	if ( is_new == TRUE )
+	{
+	    item->newconf = curr;
+	}
+	else
+	{
+	    item->oldconf = curr;
+	}
+	if ( is_route == TRUE )
+	{
+	    nx_reload_add_members(pool, item->members, curr);
+	}
+    }
+
+    return ( TRUE );
+}
+
+
+
+static boolean nx_reload_set_affected(nx_reload_item_t *item)
+{
+    if ( item->affected == TRUE )
+    {
+	return ( FALSE );
+    }
+    log_debug("%s %s is affected by the configuration change",
+	      item->is_route == TRUE ? "route" : "module", item->name);
+    item->affected = TRUE;
+
+    return ( TRUE );
+}
+
+
+
+/**
+ * Compare the running and the new configuration and decide
+ * which modules and routes need to be restarted.
+ */
+nx_reload_plan_t *nx_reload_plan(apr_pool_t *pool,
+				 const nx_directive_t *oldtree,
+				 const nx_directive_t *newtree)
+{
+    nx_reload_plan_t *plan;
+    apr_array_header_t *items;
+    apr_array_header_t *oldglobals, *newglobals;
+    nx_reload_item_t *item, *member;
+    const char *needle;
+    boolean changed;
+    int num_kept = 0;
+    int i, j;
+
+    plan = apr_pcalloc(pool, sizeof(nx_reload_plan_t));
+    plan->modules = apr_array_make(pool, 5, sizeof(const char *));
+    plan->routes = apr_array_make(pool, 5, sizeof(const char *));
+
+    items = apr_array_make(pool, 20, sizeof(nx_reload_item_t));
+    oldglobals = apr_array_make(pool, 10, sizeof(const nx_directive_t *));
+    newglobals = apr_array_make(pool, 10, sizeof(const nx_directive_t *));
+
+    if ( (nx_reload_collect(pool, items, oldglobals, oldtree, FALSE) != TRUE) ||
+	 (nx_reload_collect(pool, items, newglobals, newtree, TRUE) != TRUE) )
+    {
+	plan->full = TRUE;
+	plan->reason = "duplicate or unnamed block";
+	return ( plan );
+    }
+
+    if ( oldglobals->nelts != newglobals->nelts )
+    {
+	plan->full = TRUE;
+	plan->reason = "global directives changed";
+	return ( plan );
+    }
+    for ( i = 0; i < oldglobals->nelts; i++ )
+    {
+	if ( nx_reload_directive_equal(((const nx_directive_t **) oldglobals->elts)[i],
+				       ((const nx_directive_t **) newglobals->elts)[i]) != TRUE )
+	{
+	    plan->full = TRUE;
+	    plan->reason = "global directives changed";
+	    return ( plan );
+	}
+    }
+
+    for ( i = 0; i < items->nelts; i++ )
+    {
+	item = ((nx_reload_item_t *) items->elts) + i;
+
+	// routes are looked up by name at runtime, the list cannot change underneath
+	if ( ((item->oldconf != NULL) &&
+	      ((nx_reload_directive_contains(item->oldconf, "reroute") == TRUE) ||
+	       (nx_reload_directive_contains(item->oldconf, "add_to_route") == TRUE))) ||
+	     ((item->newconf != NULL) &&
+	      ((nx_reload_directive_contains(item->newconf, "reroute") == TRUE) ||
+	       (nx_reload_directive_contains(item->newconf, "add_to_route") == TRUE))) )
+	{
+	    plan->full = TRUE;
+	    plan->reason = "routes are referenced from Exec";
+	    return ( plan );
+	}
+
+	if ( (item->oldconf == NULL) || (item->newconf == NULL) ||
+	     (nx_reload_directive_equal(item->oldconf, item->newconf) != TRUE) )
+	{
+	    if ( (item->is_route != TRUE) &&
+		 (((item->oldconf != NULL) && (strcasecmp(item->oldconf->directive, "extension") == 0)) ||
+		  ((item->newconf != NULL) && (strcasecmp(item->newconf->directive, "extension") == 0))) )
+	    { // functions and procedures are resolved when the other modules are configured
+		plan->full = TRUE;
+		plan->reason = "extension modules changed";
+		return ( plan );
+	    }
+	    nx_reload_set_affected(item);
+	}
+    }
+
+    // restart everything that is connected to a changed module or route
+    do
+    {
+	changed = FALSE;
+	for ( i = 0; i < items->nelts; i++ )
+	{
+	    item = ((nx_reload_item_t *) items->elts) + i;
+	    if ( item->is_route == TRUE )
+	    {
+		for ( j = 0; (j < item->members->nelts) && (item->affected != TRUE); j++ )
+		{
+		    member = nx_reload_item_get(items, ((const char **) item->members->elts)[j], FALSE);
+		    if ( (member != NULL) && (member->affected == TRUE) )
+		    {
+			changed |= nx_reload_set_affected(item);
+		    }
+		}
+		for ( j = 0; (j < item->members->nelts) && (item->affected == TRUE); j++ )
+		{
+		    member = nx_reload_item_get(items, ((const char **) item->members->elts)[j], FALSE);
+		    if ( member != NULL )
+		    {
+			changed |= nx_reload_set_affected(member);
+		    }
+		}
+	    }
+	    else if ( item->affected == TRUE )
+	    { // modules calling the functions of this one with 'name->'
+		needle = apr_pstrcat(pool, item->name, "->", NULL);
+		for ( j = 0; j < items->nelts; j++ )
+		{
+		    member = ((nx_reload_item_t *) items->elts) + j;
+		    if ( (member->is_route != TRUE) && (member->affected != TRUE) &&
+			 (nx_reload_directive_contains(member->oldconf, needle) == TRUE) )
+		    {
+			changed |= nx_reload_set_affected(member);
+		    }
+		}
+	    }
+	}
+    } while ( changed == TRUE );
+
+    for ( i = 0; i < items->nelts; i++ )
+    {
+	item = ((nx_reload_item_t *) items->elts) + i;
+	if ( item->affected != TRUE )
+	{
+	    if ( (item->is_route != TRUE) &&
+		 (strcasecmp(item->oldconf->directive, "extension") != 0) )
+	    {
+		num_kept++;
+	    }
+	}
+	else if ( item->is_route == TRUE )
+	{
+	    *((const char **) apr_array_push(plan->routes)) = item->name;
+	}
+	else
+	{
+	    *((const char **) apr_array_push(plan->modules)) = item->name;
+	}
+    }
+
+    if ( (plan->modules->nelts == 0) && (plan->routes->nelts == 0) )
+    { // files referenced by the modules may have changed
+	plan->full = TRUE;
+	plan->reason = "configuration is unchanged";
+    }
+    else if ( num_kept == 0 )
+    {
+	plan->full = TRUE;
+	plan->reason = "all modules changed";
+    }
+
+    return ( plan );
+}
+
+
+
+static boolean nx_reload_name_in(const apr_array_header_t *names, const char *name)
+{
+    int i;
+
+    for ( i = 0; i < names->nelts; i++ )
+    {
+	if ( strcasecmp(((const char **) names->elts)[i], name) == 0 )
+	{
+	    return ( TRUE );
+	}
+    }
+
+    return ( FALSE );
+}
+
+
+
+boolean nx_reload_plan_has_module(const nx_reload_plan_t *plan, const char *name)
+{
+    return ( nx_reload_name_in(plan->modules, name) );
+}
+
+
+
+boolean nx_reload_plan_has_route(const nx_reload_plan_t *plan, const char *name)
+{
+    return ( nx_reload_name_in(plan->routes, name) );
+}
+
+
+
+/**
+ * Return TRUE if a module still points to its directives in the tree.
+ */
+static boolean nx_reload_cfgtree_in_use(nx_ctx_t *ctx, const nx_directive_t *cfgtree)
+{
+    const nx_directive_t *curr;
+    nx_module_t *module;
+
+    for ( curr = cfgtree; curr != NULL; curr = curr->next )
+    {
+	if ( (nx_reload_is_module_block(curr) != TRUE) || (curr->first_child == NULL) )
+	{
+	    continue;
+	}
+	for ( module = NX_DLIST_FIRST(ctx->modules);
+	      module != NULL;
+	      module = NX_DLIST_NEXT(module, link) )
+	{
+	    if ( module->directives == curr->first_child )
+	    {
+		return ( TRUE );
+	    }
+	}
+    }
+
+    return ( FALSE );
+}
+
+
+
+/**
+ * Keep the tree replaced by a partial reload while the unchanged modules
+ * use its directives and free the earlier ones which are no longer used.
+ */
+static void nx_reload_replace_cfgtree(nx_ctx_t *ctx,
+				      apr_pool_t *pool,
+				      nx_directive_t *cfgtree)
+{
+    nx_reload_cfgtree_t *old;
+    int i;
+
+    if ( ctx->cfgtree_pool != NULL )
+    { // the first tree is in ctx->pool and is kept
+	if ( ctx->old_cfgtrees == NULL )
+	{
+	    ctx->old_cfgtrees = apr_array_make(ctx->pool, 2, sizeof(nx_reload_cfgtree_t));
+	}
+	old = (nx_reload_cfgtree_t *) apr_array_push(ctx->old_cfgtrees);
+	old->pool = ctx->cfgtree_pool;
+	old->cfgtree = ctx->cfgtree;
+    }
+    ctx->cfgtree = cfgtree;
+    ctx->cfgtree_pool = pool;
+
+    if ( ctx->old_cfgtrees == NULL )
+    {
+	return;
+    }
+    for ( i = ctx->old_cfgtrees->nelts - 1; i >= 0; i-- )
+    {
+	old = ((nx_reload_cfgtree_t *) ctx->old_cfgtrees->elts) + i;
+	if ( nx_reload_cfgtree_in_use(ctx, old->cfgtree) == TRUE )
+	{
+	    continue;
+	}
+	apr_pool_destroy(old->pool);
+	// move the last one in its place
+	*old = ((nx_reload_cfgtree_t *) ctx->old_cfgtrees->elts)[ctx->old_cfgtrees->nelts - 1];
+	(ctx->old_cfgtrees->nelts)--;
+    }
+}
+
+
+
+/**
+ * Restart only the modules and routes affected by the configuration change
+ * while the worker threads and the other modules keep running.
+ * Returns FALSE if the whole context needs to be rebuilt.
+ */
+boolean nxlog_reload_modules(nxlog_t *nxlog)
+{
+    nx_ctx_t *ctx;
+    apr_pool_t *pool;
+    nx_directive_t * volatile cfgtree = NULL;
+    const nx_directive_t * volatile curr;
+    nx_reload_plan_t *plan;
+    nx_module_t * volatile module;
+    nx_module_t *next;
+    nx_module_t *busy = NULL;
+    nx_route_t *route, *nextroute;
+    apr_array_header_t *modules, *routes;
+    nx_exception_t e;
+    int i, j;
+    static const nx_module_type_t stop_order[] = { NX_MODULE_TYPE_INPUT,
+						   NX_MODULE_TYPE_PROCESSOR,
+						   NX_MODULE_TYPE_OUTPUT };
+
+    ctx = nxlog->ctx;
+    ASSERT(ctx != NULL);
+
+    pool = nx_pool_create_child(ctx->pool);
+    try
+    {
+	cfgtree = nx_ctx_parse_cfgtree(pool, nxlog->cfgfile);
+    }
+    catch(e)
+    {
+	log_exception_msg(e, "couldn't parse '%s', keeping the running configuration",
+			  nxlog->cfgfile);
+	apr_pool_destroy(pool);
+	return ( TRUE );
+    }
+
+    plan = nx_reload_plan(pool, ctx->cfgtree, cfgtree);
+    if ( plan->full == TRUE )
+    {
+	log_debug("%s, restarting all modules", plan->reason);
+	apr_pool_destroy(pool);
+	return ( FALSE );
+    }
+
+    log_info("restarting %d modules and %d routes affected by the configuration change",
+	     plan->modules->nelts, plan->routes->nelts);
+
+    for ( j = 0; j < (int) (sizeof(stop_order) / sizeof(nx_module_type_t)); j++ )
+    {
+	for ( module = NX_DLIST_FIRST(ctx->modules);
+	      module != NULL;
+	      module = NX_DLIST_NEXT(module, link) )
+	{
+	    if ( (module->type == stop_order[j]) &&
+		 (nx_reload_plan_has_module(plan, module->name) == TRUE) )
+	    {
+		nx_ctx_stop_module(module);
+	    }
+	}
+    }
+
+    // detach so that the worker threads do not pick them anymore
+    modules = apr_array_make(pool, plan->modules->nelts, sizeof(nx_module_t *));
+    routes = apr_array_make(pool, plan->routes->nelts, sizeof(nx_route_t *));
+    nx_lock();
+    for ( module = NX_DLIST_FIRST(ctx->modules); module != NULL; module = next )
+    {
+	next = NX_DLIST_NEXT(module, link);
+	if ( nx_reload_plan_has_module(plan, module->name) == TRUE )
+	{
+	    NX_DLIST_REMOVE(ctx->modules, module, link);
+	    nx_ctx_remove_job(ctx, module);
+	    *((nx_module_t **) apr_array_push(modules)) = module;
+	}
+    }
+    for ( route = NX_DLIST_FIRST(ctx->routes); route != NULL; route = nextroute )
+    {
+	nextroute = NX_DLIST_NEXT(route, link);
+	if ( nx_reload_plan_has_route(plan, route->name) == TRUE )
+	{
+	    NX_DLIST_REMOVE(ctx->routes, route, link);
+	    *((nx_route_t **) apr_array_push(routes)) = route;
+	}
+    }
+    nx_unlock();
+
+    for ( i = 0; (i < modules->nelts) && (busy == NULL); i++ )
+    {
+	module = ((nx_module_t **) modules->elts)[i];
+	if ( module->job != NULL )
+	{
+	    for ( j = 0;
+		  (j < NX_RELOAD_BUSY_WAIT) && (nx_atomic_read32(&(module->job->busy)) == TRUE);
+		  j++ )
+	    {
+		apr_sleep(APR_USEC_PER_SEC / 10);
+	    }
+	    if ( j == NX_RELOAD_BUSY_WAIT )
+	    {
+		busy = module;
+	    }
+	}
+    }
+
+    if ( busy != NULL )
+    { // a replacement would run next to it, let the full reload wait for the worker threads
+	log_error("module %s is busy, cannot restart it without restarting all modules",
+		  busy->name);
+	nx_lock();
+	for ( i = 0; i < modules->nelts; i++ )
+	{
+	    module = ((nx_module_t **) modules->elts)[i];
+	    NX_DLIST_INSERT_TAIL(ctx->modules, module, link);
+	    nx_ctx_restore_job(ctx, module);
+	}
+	for ( i = 0; i < routes->nelts; i++ )
+	{
+	    NX_DLIST_INSERT_TAIL(ctx->routes, ((nx_route_t **) routes->elts)[i], link);
+	}
+	nx_unlock();
+	apr_pool_destroy(pool);
+
+	return ( FALSE );
+    }
+
+    for ( i = 0; i < modules->nelts; i++ )
+    {
+	module = ((nx_module_t **) modules->elts)[i];
+	if ( module->queue != NULL )
+	{
+	    try
+	    {
+		nx_logqueue_to_file(module->queue);
+	    }
+	    catch(e)
+	    {
+		log_exception(e);
+	    }
+	}
+	nx_module_unregister_exports(ctx, module);
+	try
+	{
+	    nx_module_shutdown_self(module);
+	}
+	catch(e)
+	{
+	    log_exception(e);
+	}
+    }
+    for ( i = 0; i < routes->nelts; i++ )
+    {
+	route = ((nx_route_t **) routes->elts)[i];
+	nx_route_free(&route);
+    }
+
+    // the unchanged modules still point to their directives in the old tree
+    nx_reload_replace_cfgtree(ctx, pool, cfgtree);
+
+    for ( curr = cfgtree; curr != NULL; curr = curr->next )
+    {
+	if ( (nx_reload_is_module_block(curr) == TRUE) &&
+	     (nx_reload_plan_has_module(plan, curr->args) == TRUE) )
+	{
+	    try
+	    {
+		nx_ctx_add_module(ctx, curr);
+	    }
+	    catch(e)
+	    {
+		if ( ctx->ignoreerrors != TRUE )
+		{
+		    rethrow(e);
+		}
+		log_exception(e);
+	    }
+	}
+    }
+
+    for ( module = NX_DLIST_FIRST(ctx->modules);
+	  module != NULL;
+	  module = NX_DLIST_NEXT(module, link) )
+    {
+	if ( nx_reload_plan_has_module(plan, module->name) == TRUE )
+	{
+	    nx_ctx_config_module(ctx, module);
+	}
+    }
+
+    for ( module = NX_DLIST_FIRST(ctx->modules);
+	  module != NULL;
+	  module = NX_DLIST_NEXT(module, link) )
+    {
+	if ( nx_reload_plan_has_module(plan, module->name) != TRUE )
+	{
+	    continue;
+	}
+	try
+	{
+	    nx_module_init(module);
+	}
+	catch(e)
+	{
+	    if ( ctx->ignoreerrors != TRUE )
+	    {
+		rethrow(e);
+	    }
+	    log_exception(e);
+	}
+    }
+
+    for ( curr = cfgtree; curr != NULL; curr = curr->next )
+    {
+	if ( (strcasecmp(curr->directive, "route") == 0) &&
+	     (nx_reload_plan_has_route(plan, curr->args) == TRUE) )
+	{
+	    nx_add_route(ctx, curr, curr->args);
+	}
+    }
+
+    for ( module = NX_DLIST_FIRST(ctx->modules);
+	  module != NULL;
+	  module = NX_DLIST_NEXT(module, link) )
+    {
+	if ( (module->queue != NULL) &&
+	     (nx_reload_plan_has_module(plan, module->name) == TRUE) )
+	{
+	    try
+	    {
+		nx_logqueue_from_file(module->queue);
+	    }
+	    catch(e)
+	    {
+		log_exception(e);
+	    }
+	}
+    }
+
+    nx_lock();
+    for ( module = NX_DLIST_FIRST(ctx->modules);
+	  module != NULL;
+	  module = NX_DLIST_NEXT(module, link) )
+    {
+	if ( nx_reload_plan_has_module(plan, module->name) == TRUE )
+	{
+	    nx_ctx_add_job(ctx, module);
+	}
+    }
+    nx_unlock();
+
+    for ( module = NX_DLIST_FIRST(ctx->modules);
+	  module != NULL;
+	  module = NX_DLIST_NEXT(module, link) )
+    {
+	if ( nx_reload_plan_has_module(plan, module->name) == TRUE )
+	{
+	    nx_ctx_start_module(module);
+	}
+    }
+
+    nx_lock();
+    apr_thread_cond_broadcast(nxlog->worker_cond);
+    nx_unlock();
+
+    log_info("configuration reloaded successfully.");
+
+    return ( TRUE );
+}
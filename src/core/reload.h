@@ -0,0 +1,36 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_RELOAD_H
+#define __NX_RELOAD_H
+
+#include "../common/types.h"
+#include "../common/cfgfile.h"
+#include "nxlog.h"
+
+/**
+ * The result of comparing the running configuration with the new one.
+ * Modules and routes are connected through the Path of the routes, when
+ * one of them changes the whole connected group is restarted so that
+ * unchanged modules never reference a module or route which goes away.
+ */
+typedef struct nx_reload_plan_t
+{
+    boolean		full;		///< the whole context must be rebuilt
+    const char		*reason;	///< why a full reload is needed
+    apr_array_header_t	*modules;	///< names of the modules to restart
+    apr_array_header_t	*routes;	///< names of the routes to rebuild
+} nx_reload_plan_t;
+
+nx_reload_plan_t *nx_reload_plan(apr_pool_t *pool,
+				 const nx_directive_t *oldtree,
+				 const nx_directive_t *newtree);
+boolean nx_reload_plan_has_module(const nx_reload_plan_t *plan, const char *name);
+boolean nx_reload_plan_has_route(const nx_reload_plan_t *plan, const char *name);
+boolean nxlog_reload_modules(nxlog_t *nxlog);
+
+#endif	/* __NX_RELOAD_H */
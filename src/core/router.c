@@ -161,7 +161,7 @@ static void nx_route_remove_modules(nx_route_t *route)
 
 
 
-static void nx_route_free(nx_route_t **route)
+void nx_route_free(nx_route_t **route)
 {
     ASSERT(route != NULL);
 
@@ -191,9 +191,9 @@ static nx_route_t *nx_route_new(const nx_ctx_t *ctx)
 
 
 
-static boolean nx_add_route(const nx_ctx_t *ctx,
-			    const nx_directive_t *routeconf,
-			    const char *routename)
+boolean nx_add_route(const nx_ctx_t *ctx,
+		     const nx_directive_t *routeconf,
+		     const char *routename)
 {
     const char *path = NULL;
     const char *curr, *start, *pathend;
@@ -13,6 +13,10 @@
 #include "../common/route.h"
 #include "nxlog.h"
 
+void nx_route_free(nx_route_t **route);
+boolean nx_add_route(const nx_ctx_t *ctx,
+		     const nx_directive_t *routeconf,
+		     const char *routename);
 void nx_ctx_init_routes(nx_ctx_t *ctx);
 
 
@@ -100,6 +100,7 @@ void nx_expr_proc__convert_fields(nx_expr_eval_ctx_t *eval_ctx,
 
 	log_debug("converting from %s to %s", srcenc.string->buf, dstenc.string->buf);
 
+	nx_logdata_materialize(eval_ctx->logdata);
 	for ( field = NX_DLIST_FIRST(&(eval_ctx->logdata->fields));
 	      field != NULL;
 	      field = NX_DLIST_NEXT(field, link) )
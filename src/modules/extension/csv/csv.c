@@ -7,6 +7,7 @@
 
 #include "../../../common/error_debug.h"
 #include "../../../common/exception.h"
+#include "../../../common/alloc.h"
 #include "csv.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
@@ -18,6 +19,14 @@ typedef enum nx_csv_state_t
     NX_CSV_STATE_QUOTE,	///< quote inside quoted field
 } nx_csv_state_t;
 
+typedef struct nx_csv_field_t
+{
+    char	*dst;	///< buffer of the unescaped field
+    char	*ptr;	///< end of the data in dst
+    const char	*src;	///< the field is srclen bytes of the input if not NULL
+    size_t	srclen;
+} nx_csv_field_t;
+
 
 
 void nx_csv_ctx_set_quotechar(nx_csv_ctx_t *ctx, const char quotechar)
@@ -140,9 +149,11 @@ static void add_logdata_field(nx_csv_ctx_t *ctx,
 			      nx_logdata_t *logdata, 
 			      const char *key,
 			      const char *strval,
+			      size_t len,
 			      nx_value_type_t type)
 {
     nx_value_t *value;
+    const char *end;
 
     ASSERT(key != NULL);
     ASSERT(strval != NULL);
@@ -153,13 +164,25 @@ static void add_logdata_field(nx_csv_ctx_t *ctx,
 	type = NX_VALUE_TYPE_STRING;
     }
 
-    if ( (ctx->undefvalue != NULL) && (strcmp(ctx->undefvalue, strval) == 0) )
+    // the value ends at a NUL byte, same as when it is copied into a C string
+    if ( (end = memchr(strval, '\0', len)) != NULL )
+    {
+	len = (size_t) (end - strval);
+    }
+
+    if ( (ctx->undefvalue != NULL) && (strlen(ctx->undefvalue) == len) &&
+	 (memcmp(ctx->undefvalue, strval, len) == 0) )
     {
 	value = nx_value_new(type);
 	value->defined = FALSE;
     }
-    else
+    else if ( type == NX_VALUE_TYPE_STRING )
     {
+	value = nx_value_new(type);
+	value->string = nx_string_create(strval, (int) len);
+    }
+    else
+    { // strval is NUL terminated for the other types
 	value = nx_value_from_string(strval, type);
     }
     if ( value != NULL )
@@ -170,6 +193,79 @@ static void add_logdata_field(nx_csv_ctx_t *ctx,
 
 
 
+/**
+ * The field is used from the input as long as it is a single run of bytes,
+ * it is only copied into dst if it needs unescaping.
+ */
+static void csv_field_materialize(nx_csv_field_t *field)
+{
+    if ( field->src != NULL )
+    {
+	memcpy(field->ptr, field->src, field->srclen);
+	field->ptr += field->srclen;
+	field->src = NULL;
+	field->srclen = 0;
+    }
+}
+
+
+
+static void csv_field_append(nx_csv_field_t *field, const char *src, size_t len)
+{
+    if ( field->ptr == field->dst )
+    {
+	if ( field->src == NULL )
+	{
+	    field->src = src;
+	    field->srclen = len;
+	    return;
+	}
+	if ( field->src + field->srclen == src )
+	{
+	    field->srclen += len;
+	    return;
+	}
+	csv_field_materialize(field);
+    }
+    memcpy(field->ptr, src, len);
+    field->ptr += len;
+}
+
+
+
+static boolean csv_field_is_empty(const nx_csv_field_t *field)
+{
+    return ( (field->ptr == field->dst) && (field->src == NULL) );
+}
+
+
+
+static void csv_field_add(nx_csv_ctx_t *ctx,
+			  nx_logdata_t *logdata,
+			  nx_csv_field_t *field,
+			  int currfield)
+{
+    nx_value_type_t type = ctx->types[currfield];
+
+    if ( (field->src != NULL) && ((type == 0) || (type == NX_VALUE_TYPE_STRING)) )
+    {
+	add_logdata_field(ctx, logdata, ctx->fields[currfield],
+			  field->src, field->srclen, type);
+    }
+    else
+    {
+	csv_field_materialize(field);
+	*(field->ptr) = '\0';
+	add_logdata_field(ctx, logdata, ctx->fields[currfield],
+			  field->dst, (size_t) (field->ptr - field->dst), type);
+    }
+    field->ptr = field->dst;
+    field->src = NULL;
+    field->srclen = 0;
+}
+
+
+
 static void unescape_string(nx_csv_ctx_t *ctx,
 			    const char chr,
 			    char **ptr)
@@ -226,22 +322,36 @@ static void parse_fields(nx_logdata_t *logdata,
 			 const char *src,
 			 size_t len)
 {
-    int pos = 0;
+    size_t pos;
+    size_t n;
     nx_csv_state_t state;
-    char *ptr;
+    nx_csv_field_t field;
+    nx_string_scan_t quoted;	///< bytes ending a run inside a quoted field
+    nx_string_scan_t unquoted;	///< bytes ending a run inside an unquoted field
     int currfield = 0;
     boolean unescape = FALSE;
 
-    ptr = dst;
+    field.dst = dst;
+    field.ptr = dst;
+    field.src = NULL;
+    field.srclen = 0;
     state = NX_CSV_STATE_START;
 
-    for ( pos = 0; pos < (int) len; pos++ )
+    nx_string_scan_init(&quoted);
+    nx_string_scan_add(&quoted, ctx->quotechar);
+    nx_string_scan_add(&quoted, ctx->escapechar);
+    nx_string_scan_init(&unquoted);
+    nx_string_scan_add(&unquoted, ctx->delimiter);
+    nx_string_scan_add(&unquoted, ctx->escapechar);
+
+    for ( pos = 0; pos < len; pos++ )
     {
 	//log_info("parse [%c]", src[pos]);
 
 	if ( unescape == TRUE )
 	{
-	    unescape_string(ctx, src[pos], &ptr);
+	    csv_field_materialize(&field);
+	    unescape_string(ctx, src[pos], &(field.ptr));
 	    unescape = FALSE;
 	    continue;
 	}
@@ -258,17 +368,17 @@ static void parse_fields(nx_logdata_t *logdata,
 		    unescape = TRUE;
 		}
 		else
-		{
-		    *ptr = src[pos];
-		    ptr++;
+		{ // copy up to the next quote or escape
+		    n = nx_string_scan(&quoted, src + pos, len - pos);
+		    csv_field_append(&field, src + pos, n);
+		    pos += n - 1;
 		}
 		break;
 	    case NX_CSV_STATE_QUOTE:
 		if ( src[pos] == ctx->quotechar )
 		{
 		    state = NX_CSV_STATE_INSIDE_FIELD;
-		    *ptr = src[pos];
-		    ptr++;
+		    csv_field_append(&field, src + pos, 1);
 		}
 		else if ( src[pos] == ctx->delimiter )
 		{
@@ -278,11 +388,8 @@ static void parse_fields(nx_logdata_t *logdata,
 			throw_msg("Too many fields in CSV input, expected %d, got %d in input '%s'",
 				  ctx->num_field, currfield + 1, src);
 		    }
-		    *ptr = '\0';
-		    add_logdata_field(ctx, logdata, ctx->fields[currfield],
-				      dst, ctx->types[currfield]);
+		    csv_field_add(ctx, logdata, &field, currfield);
 		    currfield++;
-		    ptr = dst;
 		}
 		else if ( src[pos] == ctx->escapechar )
 		{
@@ -303,7 +410,7 @@ static void parse_fields(nx_logdata_t *logdata,
 		    unescape = TRUE;
 		    break;
 		}
-		if ( dst == ptr )
+		if ( csv_field_is_empty(&field) == TRUE )
 		{ // no data yet
 		    if ( src[pos] == ' ' )
 		    {
@@ -324,12 +431,11 @@ static void parse_fields(nx_logdata_t *logdata,
 		    }
 		    else
 		    {
-			*ptr = src[pos];
-			ptr++;
+			csv_field_append(&field, src + pos, 1);
 		    }
 		}
 		else
-		{ // there is data in dst
+		{ // there is data in the field
 		    if ( src[pos] == ctx->delimiter )
 		    {
 			if ( currfield >= ctx->num_field )
@@ -337,17 +443,14 @@ static void parse_fields(nx_logdata_t *logdata,
 			    throw_msg("Too many fields in CSV input, expected %d, got %d in input '%s'",
 				      ctx->num_field, currfield + 1, src);
 			}
-
-			*ptr = '\0';
-			add_logdata_field(ctx, logdata, ctx->fields[currfield],
-					  dst, ctx->types[currfield]);
+			csv_field_add(ctx, logdata, &field, currfield);
 			currfield++;
-			ptr = dst;
 		    }
 		    else
-		    {
-			*ptr = src[pos];
-			ptr++;
+		    { // copy up to the next delimiter or escape
+			n = nx_string_scan(&unquoted, src + pos, len - pos);
+			csv_field_append(&field, src + pos, n);
+			pos += n - 1;
 		    }
 		}
 		break;
@@ -366,14 +469,12 @@ static void parse_fields(nx_logdata_t *logdata,
 	    }
 	    else
 	    {
-		*ptr = '\0';
-		add_logdata_field(ctx, logdata, ctx->fields[currfield],
-				  dst, ctx->types[currfield]);
+		csv_field_add(ctx, logdata, &field, currfield);
 		currfield++;
 	    }
 	    break;
 	case NX_CSV_STATE_START:
-	    if ( dst < ptr )
+	    if ( csv_field_is_empty(&field) == FALSE )
 	    { // last data
 		if ( currfield >= ctx->num_field )
 		{
@@ -382,9 +483,7 @@ static void parse_fields(nx_logdata_t *logdata,
 		}
 		else
 		{
-		    *ptr = '\0';
-		    add_logdata_field(ctx, logdata, ctx->fields[currfield],
-				      dst, ctx->types[currfield]);
+		    csv_field_add(ctx, logdata, &field, currfield);
 		    currfield++;
 		}
 	    }
@@ -411,10 +510,10 @@ static void parse_fields(nx_logdata_t *logdata,
 void nx_csv_parse(nx_logdata_t *logdata,
 		  nx_csv_ctx_t *ctx,
 		  const char *src,
-		  size_t volatile len)
+		  size_t len)
 {
-    nx_exception_t e;
-    char *tmpstr = NULL;
+    nx_scratch_mark_t mark;
+    char *tmpstr;
 
     ASSERT(ctx != NULL);
     ASSERT(logdata != NULL);
@@ -432,22 +531,11 @@ void nx_csv_parse(nx_logdata_t *logdata,
 
     ASSERT(ctx->fields[0] != NULL);
 
-    //TODO: use a static memory in ctx that is realloced as needed, see w3c.c ctx->buffer
-    tmpstr = malloc((size_t)len + 1);
-
-    try
-    {
-	parse_fields(logdata, ctx, tmpstr, src, len);
-    }
-    catch(e)
-    {
-	if ( tmpstr != NULL )
-	{
-	    free(tmpstr);
-	}
-	rethrow(e);
-    }
-    free(tmpstr);
+    // only used by fields which need unescaping
+    nx_scratch_mark(&mark);
+    tmpstr = nx_scratch_alloc(len + 1);
+    parse_fields(logdata, ctx, tmpstr, src, len);
+    nx_scratch_release(&mark);
 }
 
 
@@ -551,9 +639,10 @@ static void escape_string(nx_string_t *str, nx_csv_ctx_t *ctx)
 nx_string_t *nx_logdata_to_csv(nx_csv_ctx_t *ctx, nx_logdata_t *logdata)
 {
     nx_string_t *retval = NULL;
-    char *string = NULL;
-    nx_string_t *tmp = NULL;
+    const char *string;
+    nx_string_t *tmp;
     nx_value_t value;
+    nx_scratch_mark_t mark;
     nx_exception_t e;
     int currfield;
 
@@ -564,8 +653,10 @@ nx_string_t *nx_logdata_to_csv(nx_csv_ctx_t *ctx, nx_logdata_t *logdata)
 
     retval = nx_string_new_size(150);
 
+    nx_scratch_mark(&mark);
     try
     {
+	tmp = nx_scratch_string();
 	for ( currfield = 0; currfield < ctx->num_field; currfield++ )
 	{
 	    if ( currfield > 0 )
@@ -592,10 +683,10 @@ nx_string_t *nx_logdata_to_csv(nx_csv_ctx_t *ctx, nx_logdata_t *logdata)
 		    {
 			nx_string_append(retval, &(ctx->quotechar), 1);
 		    }
-		    tmp = nx_string_clone(value.string);
+		    tmp->len = 0;
+		    nx_string_append(tmp, value.string->buf, (int) value.string->len);
 		    escape_string(tmp, ctx);
 		    nx_string_append(retval, tmp->buf, (int) tmp->len);
-		    nx_string_free(tmp);
 		    if ( ctx->quote_method != NX_CSV_QUOTE_METHOD_NONE )
 		    {
 			nx_string_append(retval, &(ctx->quotechar), 1);
@@ -604,46 +695,35 @@ nx_string_t *nx_logdata_to_csv(nx_csv_ctx_t *ctx, nx_logdata_t *logdata)
 	    }
 	    else
 	    {
-		string = nx_value_to_string(&value);
+		string = nx_value_to_scratch_string(&value);
 		if ( string != NULL )
 		{
 		    if ( ctx->quote_method == NX_CSV_QUOTE_METHOD_ALL )
 		    { // quote everything
 			nx_string_append(retval, &(ctx->quotechar), 1);
-			tmp = nx_string_create(string, -1);
+			tmp->len = 0;
+			nx_string_append(tmp, string, -1);
 			escape_string(tmp, ctx);
 			nx_string_append(retval, tmp->buf, (int) tmp->len);
-			nx_string_free(tmp);
 			nx_string_append(retval, &(ctx->quotechar), 1);
 		    }
 		    else
 		    {
-			tmp = nx_string_create(string, -1);
+			tmp->len = 0;
+			nx_string_append(tmp, string, -1);
 			escape_string(tmp, ctx);
 			nx_string_append(retval, tmp->buf, (int) tmp->len);
-			nx_string_free(tmp);
 		    }
-		    free(string);
 		}
 	    }
 	}
     }
     catch(e)
     {
-	if ( string != NULL )
-	{
-	    free(string);
-	}
-	if ( tmp != NULL )
-	{
-	    nx_string_free(tmp);
-	}
-	if ( retval != NULL )
-	{
-	    nx_string_free(retval);
-	}
+	nx_string_free(retval);
 	rethrow(e);
     }
+    nx_scratch_release(&mark);
 
     return ( retval );
 }
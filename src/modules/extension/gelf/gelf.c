@@ -8,6 +8,7 @@
 #include "gelf.h"
 #include "../../../common/exception.h"
 #include "../../../common/module.h"
+#include "../../../common/alloc.h"
 
 #include "../../extension/json/yajl/api/yajl_gen.h"
 #include "../../extension/json/yajl/api/yajl_parse.h"
@@ -15,6 +16,57 @@
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
 
+
+/*
+ * The generator allocates from the scratch arena, everything is released
+ * at once when the record is formatted. The size is stored before the
+ * block for realloc.
+ */
+static void *gelf_scratch_malloc(void *ctx UNUSED, size_t size)
+{
+    size_t *retval;
+
+    retval = nx_scratch_alloc(sizeof(size_t) + size);
+    *retval = size;
+
+    return ( retval + 1 );
+}
+
+
+
+static void *gelf_scratch_realloc(void *ctx, void *ptr, size_t size)
+{
+    void *retval;
+    size_t oldsize;
+
+    retval = gelf_scratch_malloc(ctx, size);
+    if ( ptr != NULL )
+    {
+	oldsize = ((size_t *) ptr)[-1];
+	memcpy(retval, ptr, (oldsize < size) ? oldsize : size);
+    }
+
+    return ( retval );
+}
+
+
+
+static void gelf_scratch_free(void *ctx UNUSED, void *ptr UNUSED)
+{
+}
+
+
+
+static const yajl_alloc_funcs gelf_scratch_funcs =
+{
+    gelf_scratch_malloc,
+    gelf_scratch_realloc,
+    gelf_scratch_free,
+    NULL,
+};
+
+
+
 nx_string_t *nx_logdata_to_gelf(nx_gelf_ctx_t *ctx)
 {
 
@@ -24,6 +76,7 @@ nx_string_t *nx_logdata_to_gelf(nx_gelf_ctx_t *ctx)
     nx_logdata_field_t *field;
     nx_string_t *retval;
     char *value;
+    nx_scratch_mark_t mark;
     const nx_value_t *host = NULL;
     const nx_value_t *message = NULL;
     const nx_value_t *short_message = NULL;
@@ -38,13 +91,15 @@ nx_string_t *nx_logdata_to_gelf(nx_gelf_ctx_t *ctx)
     size_t keylen;
     apr_time_t timestamp;
 
-    gen = yajl_gen_alloc(NULL);
+    nx_scratch_mark(&mark);
+    gen = yajl_gen_alloc(&gelf_scratch_funcs);
     yajl_gen_map_open(gen);
     
     // version: GELF spec version – "1.0" (string); MUST be set by client library.
     ASSERT(yajl_gen_string(gen, (const unsigned char *) "version", 7) == yajl_gen_status_ok);
     ASSERT(yajl_gen_string(gen, (const unsigned char *) "1.1", 3) == yajl_gen_status_ok);
 
+    nx_logdata_materialize(ctx->logdata);
     for ( field = NX_DLIST_FIRST(&(ctx->logdata->fields));
 	  field != NULL;
 	  field = NX_DLIST_NEXT(field, link) )
@@ -147,10 +202,9 @@ nx_string_t *nx_logdata_to_gelf(nx_gelf_ctx_t *ctx)
 				       field->value->string->len) == yajl_gen_status_ok);
 		break;
 	    default:
-		value = nx_value_to_string(field->value);
+		value = nx_value_to_scratch_string(field->value);
 		ASSERT(yajl_gen_string(gen, (const unsigned char *) value,
 				       strlen(value)) == yajl_gen_status_ok);
-		free(value);
 		break;
 	}
     }
@@ -297,6 +351,7 @@ nx_string_t *nx_logdata_to_gelf(nx_gelf_ctx_t *ctx)
     retval = nx_string_create((const char *) json, (int) jsonlen);
 
     yajl_gen_free(gen);
+    nx_scratch_release(&mark);
 
     return ( retval );
 }
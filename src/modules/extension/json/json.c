@@ -6,6 +6,9 @@
  */
 
 #include <apr_lib.h>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #include "json.h"
 #include "../../../common/exception.h"
@@ -13,6 +16,7 @@
 
 #include "yajl/api/yajl_gen.h"
 #include "yajl/api/yajl_parse.h"
+#include "yajl/yajl_encode.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
@@ -447,8 +451,1080 @@ static yajl_callbacks callbacks = {
 
 
   
-void nx_json_parse(nx_json_parser_ctx_t *ctx,
-		   const char *json, size_t len)
+/*
+ * Parser for complete JSON records without yajl. The first stage builds an
+ * index of the quotes and of the structural characters outside strings,
+ * 16 bytes at a time. The second stage walks the index, checks the record
+ * and then walks it again to set the fields. The nested values are passed
+ * to the yajl callbacks above so that they are stringified the same way.
+ * Anything unusual (comments, arrays in objects, surrogate pairs, invalid
+ * input) is left to yajl.
+ */
+
+#define NX_JSON_INDEX_PREALLOC 512	///< index entries on the stack
+#define NX_JSON_INDEX_FLAG 0x80000000U	///< string has escapes, control or non-ASCII bytes
+#define NX_JSON_KEY_MAX 256
+
+#define NX_JSON_POS(fast, i) ((fast)->pos[i] & ~NX_JSON_INDEX_FLAG)
+
+typedef enum nx_json_scalar_t
+{
+    NX_JSON_SCALAR_INVALID = 0,
+    NX_JSON_SCALAR_NULL,
+    NX_JSON_SCALAR_TRUE,
+    NX_JSON_SCALAR_FALSE,
+    NX_JSON_SCALAR_NUMBER,
+} nx_json_scalar_t;
+
+typedef struct nx_json_fast_t
+{
+    nx_json_parser_ctx_t	*ctx;
+    const char			*json;
+    uint32_t			len;
+    uint32_t			*pos;	///< offsets of the quotes and structural characters
+    uint32_t			num;
+    uint32_t			size;
+    uint64_t			keys;	///< bloom filter of the field names in logdata
+    char			*buf;	///< decoded strings
+    size_t			bufsize;
+    char			key[NX_JSON_KEY_MAX];
+    uint32_t			prealloc[NX_JSON_INDEX_PREALLOC];
+} nx_json_fast_t;
+
+
+
+/**
+ * Bitmasks of the quotes, backslashes, structural characters and the bytes
+ * which must be checked inside strings (control characters and non-ASCII)
+ * in 16 bytes.
+ */
+static void json_classify(const unsigned char *p,
+			  unsigned int *quote,
+			  unsigned int *backslash,
+			  unsigned int *structural,
+			  unsigned int *special)
+{
+#ifdef __SSE2__
+    __m128i chunk, lower;
+
+    chunk = _mm_loadu_si128((const __m128i *) p);
+    *quote = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')));
+    *backslash = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\')));
+    // signed compare, bytes >= 0x80 are negative
+    *special = (unsigned int) _mm_movemask_epi8(_mm_cmplt_epi8(chunk, _mm_set1_epi8(0x20)));
+    // '[' and ']' are '{' and '}' without the 0x20 bit
+    lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    *structural = (unsigned int) _mm_movemask_epi8(
+	_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{')),
+				  _mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))),
+		     _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')),
+				  _mm_cmpeq_epi8(chunk, _mm_set1_epi8(',')))));
+#else
+    unsigned int i;
+
+    *quote = 0;
+    *backslash = 0;
+    *structural = 0;
+    *special = 0;
+    for ( i = 0; i < 16; i++ )
+    {
+	switch ( p[i] )
+	{
+	    case '"':
+		*quote |= 1U << i;
+		break;
+	    case '\\':
+		*backslash |= 1U << i;
+		break;
+	    case '{':
+	    case '}':
+	    case '[':
+	    case ']':
+	    case ':':
+	    case ',':
+		*structural |= 1U << i;
+		break;
+	    default:
+		if ( (p[i] < 0x20) || (p[i] >= 0x80) )
+		{
+		    *special |= 1U << i;
+		}
+		break;
+	}
+    }
+#endif
+}
+
+
+
+static void json_index_add(nx_json_fast_t *fast, uint32_t pos)
+{
+    if ( fast->num == fast->size )
+    {
+	fast->size *= 2;
+	if ( fast->pos == fast->prealloc )
+	{
+	    fast->pos = malloc(fast->size * sizeof(uint32_t));
+	    ASSERT(fast->pos != NULL);
+	    memcpy(fast->pos, fast->prealloc, sizeof(fast->prealloc));
+	}
+	else
+	{
+	    fast->pos = realloc(fast->pos, fast->size * sizeof(uint32_t));
+	    ASSERT(fast->pos != NULL);
+	}
+    }
+    fast->pos[(fast->num)++] = pos;
+}
+
+
+
+/**
+ * Stage 1: collect the offsets of the quotes and of the structural characters
+ * outside strings. Closing quotes get NX_JSON_INDEX_FLAG if the string needs
+ * to be checked and decoded. Returns FALSE if a string is not terminated.
+ */
+static boolean json_index_build(nx_json_fast_t *fast)
+{
+    const unsigned char *json = (const unsigned char *) fast->json;
+    const unsigned char *p;
+    unsigned char tail[16];
+    unsigned int quote, backslash, structural, special;
+    unsigned int escaped = 0;	// the first byte of the next block is escaped
+    unsigned int instring = 0;	// the next block starts inside a string
+    boolean strspecial = FALSE;	// the open string has special bytes
+    unsigned int inside, mask, esc, lo, k;
+    uint32_t i;
+
+    for ( i = 0; i < fast->len; i += 16 )
+    {
+	if ( fast->len - i >= 16 )
+	{
+	    p = json + i;
+	}
+	else
+	{ // pad the last block with whitespace
+	    memset(tail, ' ', sizeof(tail));
+	    memcpy(tail, json + i, fast->len - i);
+	    p = tail;
+	}
+	json_classify(p, &quote, &backslash, &structural, &special);
+
+	if ( (backslash | escaped) != 0 )
+	{ // rare enough to resolve the escapes byte by byte
+	    esc = escaped;
+	    for ( k = 0; k < 16; k++ )
+	    {
+		if ( ((backslash & (1U << k)) != 0) && ((esc & (1U << k)) == 0) )
+		{
+		    esc |= 1U << (k + 1);
+		}
+	    }
+	    escaped = esc >> 16;
+	    quote &= ~esc;
+	}
+
+	// prefix xor of the quotes: set from an opening quote up to the closing one
+	inside = quote;
+	inside ^= inside << 1;
+	inside ^= inside << 2;
+	inside ^= inside << 4;
+	inside ^= inside << 8;
+	inside = (inside ^ instring) & 0xFFFF;
+	instring = ((inside & 0x8000) != 0) ? 0xFFFF : 0;
+
+	special = (special | backslash) & inside;
+	mask = quote | (structural & ~inside);
+	lo = 0;
+	while ( mask != 0 )
+	{
+	    k = (unsigned int) __builtin_ctz(mask);
+	    mask &= mask - 1;
+	    if ( (quote & (1U << k)) == 0 )
+	    {
+		json_index_add(fast, i + k);
+		continue;
+	    }
+	    if ( (inside & (1U << k)) != 0 )
+	    { // opening quote
+		strspecial = FALSE;
+		json_index_add(fast, i + k);
+	    }
+	    else
+	    {
+		if ( (special & ((1U << k) - 1) & ~((1U << lo) - 1)) != 0 )
+		{
+		    strspecial = TRUE;
+		}
+		json_index_add(fast, (i + k) | (strspecial == TRUE ? NX_JSON_INDEX_FLAG : 0));
+	    }
+	    lo = k + 1;
+	}
+	if ( (instring != 0) && ((special >> lo) != 0) )
+	{
+	    strspecial = TRUE;
+	}
+    }
+
+    return ( instring == 0 );
+}
+
+
+
+static boolean json_gap_is_empty(const nx_json_fast_t *fast, uint32_t from, uint32_t to)
+{
+    for ( ; from < to; from++ )
+    {
+	switch ( fast->json[from] )
+	{
+	    case ' ':
+	    case '\t':
+	    case '\n':
+	    case '\v':
+	    case '\f':
+	    case '\r':
+		break;
+	    default:
+		return ( FALSE );
+	}
+    }
+
+    return ( TRUE );
+}
+
+
+
+static boolean json_number_is_valid(const char *str, size_t len)
+{
+    size_t i = 0;
+    size_t start;
+
+    if ( (i < len) && (str[i] == '-') )
+    {
+	i++;
+    }
+    if ( (i < len) && (str[i] == '0') )
+    {
+	i++;
+    }
+    else
+    {
+	for ( start = i; (i < len) && apr_isdigit(str[i]); i++ );
+	if ( i == start )
+	{
+	    return ( FALSE );
+	}
+    }
+    if ( (i < len) && (str[i] == '.') )
+    {
+	for ( start = ++i; (i < len) && apr_isdigit(str[i]); i++ );
+	if ( i == start )
+	{
+	    return ( FALSE );
+	}
+    }
+    if ( (i < len) && ((str[i] == 'e') || (str[i] == 'E')) )
+    {
+	i++;
+	if ( (i < len) && ((str[i] == '+') || (str[i] == '-')) )
+	{
+	    i++;
+	}
+	for ( start = i; (i < len) && apr_isdigit(str[i]); i++ );
+	if ( i == start )
+	{
+	    return ( FALSE );
+	}
+    }
+
+    return ( i == len );
+}
+
+
+
+/**
+ * The gap between two index entries must hold exactly one number or literal
+ */
+static nx_json_scalar_t json_scalar(const nx_json_fast_t *fast,
+				    uint32_t from,
+				    uint32_t to,
+				    const char **token,
+				    size_t *tokenlen)
+{
+    const char *str;
+    size_t len;
+    uint32_t end;
+
+    for ( ; (from < to) && json_gap_is_empty(fast, from, from + 1); from++ );
+    for ( end = from; (end < to) && !json_gap_is_empty(fast, end, end + 1); end++ );
+    if ( json_gap_is_empty(fast, end, to) == FALSE )
+    {
+	return ( NX_JSON_SCALAR_INVALID );
+    }
+
+    str = fast->json + from;
+    len = end - from;
+    *token = str;
+    *tokenlen = len;
+
+    if ( (len == 4) && (memcmp(str, "null", 4) == 0) )
+    {
+	return ( NX_JSON_SCALAR_NULL );
+    }
+    if ( (len == 4) && (memcmp(str, "true", 4) == 0) )
+    {
+	return ( NX_JSON_SCALAR_TRUE );
+    }
+    if ( (len == 5) && (memcmp(str, "false", 5) == 0) )
+    {
+	return ( NX_JSON_SCALAR_FALSE );
+    }
+    if ( json_number_is_valid(str, len) == TRUE )
+    {
+	return ( NX_JSON_SCALAR_NUMBER );
+    }
+
+    return ( NX_JSON_SCALAR_INVALID );
+}
+
+
+
+static int json_hexval(unsigned char c)
+{
+    if ( (c >= '0') && (c <= '9') )
+    {
+	return ( c - '0' );
+    }
+    if ( (c >= 'a') && (c <= 'f') )
+    {
+	return ( c - 'a' + 10 );
+    }
+    if ( (c >= 'A') && (c <= 'F') )
+    {
+	return ( c - 'A' + 10 );
+    }
+
+    return ( -1 );
+}
+
+
+
+static int json_codepoint(const unsigned char *str)
+{
+    int i, digit;
+    int retval = 0;
+
+    for ( i = 0; i < 4; i++ )
+    {
+	if ( (digit = json_hexval(str[i])) < 0 )
+	{
+	    return ( -1 );
+	}
+	retval = (retval << 4) | digit;
+    }
+
+    return ( retval );
+}
+
+
+
+/**
+ * Same checks as the yajl lexer. Surrogate pairs are valid but left to yajl.
+ */
+static boolean json_string_is_valid(const unsigned char *str, size_t len)
+{
+    size_t i;
+    int codepoint;
+
+    for ( i = 0; i < len; i++ )
+    {
+	if ( str[i] < 0x20 )
+	{
+	    return ( FALSE );
+	}
+	if ( str[i] != '\\' )
+	{
+	    continue;
+	}
+	// a backslash can't be the last byte, it would escape the closing quote
+	i++;
+	switch ( str[i] )
+	{
+	    case '"':
+	    case '\\':
+	    case '/':
+	    case 'b':
+	    case 'f':
+	    case 'n':
+	    case 'r':
+	    case 't':
+		break;
+	    case 'u':
+		if ( (len - i < 5) ||
+		     ((codepoint = json_codepoint(str + i + 1)) < 0) ||
+		     ((codepoint & 0xFC00) == 0xD800) )
+		{
+		    return ( FALSE );
+		}
+		i += 4;
+		break;
+	    default:
+		return ( FALSE );
+	}
+    }
+
+    return ( yajl_string_validate_utf8(str, len) != 0 );
+}
+
+
+
+/**
+ * Decode a string checked by json_string_is_valid() the same way as
+ * yajl_string_decode(). dst must have room for len + 1 bytes.
+ */
+static size_t json_string_decode(char *dst, const char *src, size_t len)
+{
+    size_t i, j;
+    int codepoint;
+
+    for ( i = 0, j = 0; i < len; i++ )
+    {
+	if ( src[i] != '\\' )
+	{
+	    dst[j++] = src[i];
+	    continue;
+	}
+	i++;
+	switch ( src[i] )
+	{
+	    case 'b':
+		dst[j++] = '\b';
+		break;
+	    case 'f':
+		dst[j++] = '\f';
+		break;
+	    case 'n':
+		dst[j++] = '\n';
+		break;
+	    case 'r':
+		dst[j++] = '\r';
+		break;
+	    case 't':
+		dst[j++] = '\t';
+		break;
+	    case 'u':
+		codepoint = json_codepoint((const unsigned char *) src + i + 1);
+		i += 4;
+		if ( codepoint < 0x80 )
+		{
+		    dst[j++] = (char) codepoint;
+		}
+		else if ( codepoint < 0x800 )
+		{
+		    dst[j++] = (char) ((codepoint >> 6) | 0xC0);
+		    dst[j++] = (char) ((codepoint & 0x3F) | 0x80);
+		}
+		else
+		{
+		    dst[j++] = (char) ((codepoint >> 12) | 0xE0);
+		    dst[j++] = (char) (((codepoint >> 6) & 0x3F) | 0x80);
+		    dst[j++] = (char) ((codepoint & 0x3F) | 0x80);
+		}
+		break;
+	    default: // '"', '\\' and '/'
+		dst[j++] = src[i];
+		break;
+	}
+    }
+    dst[j] = '\0';
+
+    return ( j );
+}
+
+
+
+static boolean json_string_check(const nx_json_fast_t *fast, uint32_t i)
+{
+    if ( (fast->pos[i + 1] & NX_JSON_INDEX_FLAG) == 0 )
+    {
+	return ( TRUE );
+    }
+
+    return ( json_string_is_valid((const unsigned char *) fast->json + NX_JSON_POS(fast, i) + 1,
+				  (size_t) (NX_JSON_POS(fast, i + 1) - NX_JSON_POS(fast, i) - 1)) );
+}
+
+
+
+/**
+ * Return the string between the quotes at index i and i + 1, decoded into
+ * dst if it has escapes. If dst is NULL the decode buffer is used.
+ */
+static void json_string_get(nx_json_fast_t *fast,
+			    uint32_t i,
+			    char *dst,
+			    const char **str,
+			    size_t *len)
+{
+    const char *start;
+    size_t rawlen;
+
+    start = fast->json + NX_JSON_POS(fast, i) + 1;
+    rawlen = (size_t) (NX_JSON_POS(fast, i + 1) - NX_JSON_POS(fast, i) - 1);
+
+    if ( ((fast->pos[i + 1] & NX_JSON_INDEX_FLAG) == 0) ||
+	 (memchr(start, '\\', rawlen) == NULL) )
+    {
+	*str = start;
+	*len = rawlen;
+	return;
+    }
+
+    if ( dst == NULL )
+    {
+	if ( fast->bufsize < rawlen + 1 )
+	{
+	    fast->buf = realloc(fast->buf, rawlen + 1);
+	    ASSERT(fast->buf != NULL);
+	    fast->bufsize = rawlen + 1;
+	}
+	dst = fast->buf;
+    }
+    *len = json_string_decode(dst, start, rawlen);
+    *str = dst;
+}
+
+
+
+/**
+ * Check the top level field name at index i and copy it to fast->key
+ */
+static boolean json_key(nx_json_fast_t *fast, uint32_t i)
+{
+    const char *str;
+    size_t len;
+
+    if ( (NX_JSON_POS(fast, i + 1) - NX_JSON_POS(fast, i) - 1 >= NX_JSON_KEY_MAX) ||
+	 (json_string_check(fast, i) == FALSE) )
+    {
+	return ( FALSE );
+    }
+    json_string_get(fast, i, fast->key, &str, &len);
+    if ( str != fast->key )
+    {
+	memcpy(fast->key, str, len);
+	fast->key[len] = '\0';
+    }
+
+    return ( TRUE );
+}
+
+
+
+/**
+ * Set a top level field. Field names are compared case insensitively, the
+ * bloom filter tells when the name can't be in logdata yet and the value
+ * can be appended without looking at the other fields.
+ */
+static void json_set_field(nx_json_fast_t *fast, nx_value_t *value)
+{
+    nx_logdata_bloom_set_field_value(fast->ctx->logdata, &(fast->keys), fast->key, value);
+}
+
+
+
+/**
+ * Same as yajl_parse_number_cb(), sscanf() is only called if the integer
+ * part could overflow
+ */
+static int64_t json_number_to_integer(const char *str, size_t len)
+{
+    long int intval;
+    int64_t retval = 0;
+    size_t i = 0;
+    size_t maxdigits;
+
+    maxdigits = (sizeof(long int) == 8) ? 18 : 9;
+    if ( str[0] == '-' )
+    {
+	i++;
+	maxdigits++;
+    }
+    for ( ; (i < len) && apr_isdigit(str[i]); i++ )
+    {
+	if ( i >= maxdigits )
+	{
+	    ASSERT(sscanf(str, "%ld", &intval) == 1);
+	    return ( (int64_t) intval );
+	}
+	retval = retval * 10 + (str[i] - '0');
+    }
+
+    return ( (str[0] == '-') ? -retval : retval );
+}
+
+
+
+static void json_set_string(nx_json_fast_t *fast, const char *str, size_t len)
+{
+    nx_value_t *val;
+    apr_time_t t;
+    const char *dateend = NULL;
+
+    // same datetime detection as yajl_parse_string_cb()
+    if ( (len >= 5) && ((str[0] == '1') || (str[0] == '2')) &&
+	 apr_isdigit(str[1]) && apr_isdigit(str[2]) &&
+	 apr_isdigit(str[3]) && (str[4] == '-') &&
+	 (nx_date_parse_iso(&t, str, &dateend) == APR_SUCCESS) &&
+	 (str + len == dateend) )
+    {
+	json_set_field(fast, nx_value_new_datetime(t));
+	return;
+    }
+
+    val = nx_value_new(NX_VALUE_TYPE_STRING);
+    val->string = nx_string_create(str, (int) len);
+    json_set_field(fast, val);
+}
+
+
+
+/**
+ * Walk the object or array value of a top level field starting at index *i
+ * and pass it to the yajl callbacks. Arrays may contain arrays and objects
+ * may contain objects, the callbacks can't handle the other combinations.
+ */
+static boolean json_walk_nested(nx_json_fast_t *fast, uint32_t *i, boolean build)
+{
+    nx_json_parser_ctx_t *ctx = fast->ctx;
+    const char *json = fast->json;
+    const char *str;
+    size_t len;
+    uint32_t prev, cur;
+    int depth = 0;
+    char open, close;
+    boolean first = TRUE;
+    boolean empty;
+
+    open = json[NX_JSON_POS(fast, *i)];
+    close = (open == '{') ? '}' : ']';
+    prev = NX_JSON_POS(fast, *i);
+    (*i)++;
+    depth++;
+    if ( build == TRUE )
+    {
+	if ( open == '{' )
+	{
+	    yajl_parse_start_map_cb(ctx);
+	}
+	else
+	{
+	    yajl_parse_start_array_cb(ctx);
+	}
+    }
+
+    for ( ; ; )
+    {
+	if ( *i >= fast->num )
+	{
+	    return ( FALSE );
+	}
+	cur = NX_JSON_POS(fast, *i);
+	empty = json_gap_is_empty(fast, prev + 1, cur);
+
+	if ( (first == FALSE) || (empty == FALSE) || (json[cur] != close) )
+	{ // not an empty container, the element comes first
+	    if ( open == '{' )
+	    { // key and colon
+		if ( (*i + 2 >= fast->num) || (empty == FALSE) || (json[cur] != '"') ||
+		     (json[NX_JSON_POS(fast, *i + 2)] != ':') ||
+		     (json_gap_is_empty(fast, NX_JSON_POS(fast, *i + 1) + 1,
+					NX_JSON_POS(fast, *i + 2)) == FALSE) ||
+		     (json_string_check(fast, *i) == FALSE) )
+		{
+		    return ( FALSE );
+		}
+		if ( build == TRUE )
+		{
+		    json_string_get(fast, *i, NULL, &str, &len);
+		    yajl_parse_map_key_cb(ctx, (const unsigned char *) str, len);
+		}
+		prev = NX_JSON_POS(fast, *i + 2);
+		*i += 3;
+		if ( *i >= fast->num )
+		{
+		    return ( FALSE );
+		}
+		cur = NX_JSON_POS(fast, *i);
+		empty = json_gap_is_empty(fast, prev + 1, cur);
+	    }
+
+	    if ( (empty == TRUE) && (json[cur] == open) )
+	    { // one level deeper
+		prev = cur;
+		(*i)++;
+		depth++;
+		first = TRUE;
+		if ( build == TRUE )
+		{
+		    if ( open == '{' )
+		    {
+			yajl_parse_start_map_cb(ctx);
+		    }
+		    else
+		    {
+			yajl_parse_start_array_cb(ctx);
+		    }
+		}
+		continue;
+	    }
+
+	    if ( empty == TRUE )
+	    {
+		if ( (json[cur] != '"') || (*i + 1 >= fast->num) ||
+		     (json_string_check(fast, *i) == FALSE) )
+		{
+		    return ( FALSE );
+		}
+		if ( build == TRUE )
+		{
+		    json_string_get(fast, *i, NULL, &str, &len);
+		    yajl_parse_string_cb(ctx, (const unsigned char *) str, len);
+		}
+		prev = NX_JSON_POS(fast, *i + 1);
+		*i += 2;
+	    }
+	    else
+	    {
+		switch ( json_scalar(fast, prev + 1, cur, &str, &len) )
+		{
+		    case NX_JSON_SCALAR_NULL:
+			if ( build == TRUE )
+			{
+			    yajl_parse_null_cb(ctx);
+			}
+			break;
+		    case NX_JSON_SCALAR_TRUE:
+		    case NX_JSON_SCALAR_FALSE:
+			if ( build == TRUE )
+			{
+			    yajl_parse_boolean_cb(ctx, str[0] == 't');
+			}
+			break;
+		    case NX_JSON_SCALAR_NUMBER:
+			if ( build == TRUE )
+			{
+			    yajl_parse_number_cb(ctx, str, len);
+			}
+			break;
+		    default:
+			return ( FALSE );
+		}
+		prev = cur - 1;
+	    }
+	}
+
+	// separator or closing brackets
+	for ( ; ; )
+	{
+	    if ( (*i >= fast->num) ||
+		 (json_gap_is_empty(fast, prev + 1, NX_JSON_POS(fast, *i)) == FALSE) )
+	    {
+		return ( FALSE );
+	    }
+	    prev = NX_JSON_POS(fast, *i);
+	    (*i)++;
+	    if ( json[prev] == ',' )
+	    {
+		break;
+	    }
+	    if ( json[prev] != close )
+	    {
+		return ( FALSE );
+	    }
+	    depth--;
+	    if ( build == TRUE )
+	    {
+		if ( close == '}' )
+		{
+		    yajl_parse_end_map_cb(ctx);
+		}
+		else
+		{
+		    yajl_parse_end_array_cb(ctx);
+		}
+	    }
+	    if ( depth == 0 )
+	    {
+		return ( TRUE );
+	    }
+	}
+	first = FALSE;
+    }
+}
+
+
+
+/**
+ * Stage 2: walk the index. The record is only checked if build is FALSE,
+ * the fields are set if it is TRUE.
+ */
+static boolean json_walk(nx_json_fast_t *fast, boolean build)
+{
+    const char *json = fast->json;
+    const char *str;
+    size_t len;
+    uint32_t i, prev, cur;
+    boolean first = TRUE;
+    boolean rawevent;
+    nx_value_t *val;
+
+    if ( (fast->num < 2) || (json[NX_JSON_POS(fast, 0)] != '{') ||
+	 (json_gap_is_empty(fast, 0, NX_JSON_POS(fast, 0)) == FALSE) )
+    {
+	return ( FALSE );
+    }
+    prev = NX_JSON_POS(fast, 0);
+
+    for ( i = 1; ; )
+    {
+	if ( i >= fast->num )
+	{
+	    return ( FALSE );
+	}
+	cur = NX_JSON_POS(fast, i);
+	if ( (first == TRUE) && (json[cur] == '}') &&
+	     (json_gap_is_empty(fast, prev + 1, cur) == TRUE) )
+	{
+	    prev = cur;
+	    i++;
+	    break;
+	}
+
+	// key and colon
+	if ( (i + 2 >= fast->num) || (json[cur] != '"') ||
+	     (json_gap_is_empty(fast, prev + 1, cur) == FALSE) ||
+	     (json[NX_JSON_POS(fast, i + 2)] != ':') ||
+	     (json_gap_is_empty(fast, NX_JSON_POS(fast, i + 1) + 1,
+				NX_JSON_POS(fast, i + 2)) == FALSE) ||
+	     (json_key(fast, i) == FALSE) )
+	{
+	    return ( FALSE );
+	}
+	// only a string value of raw_event is ignored, leave the rest to yajl
+	rawevent = (strcasecmp(fast->key, "raw_event") == 0);
+	prev = NX_JSON_POS(fast, i + 2);
+	i += 3;
+	if ( i >= fast->num )
+	{
+	    return ( FALSE );
+	}
+	cur = NX_JSON_POS(fast, i);
+
+	if ( json_gap_is_empty(fast, prev + 1, cur) == FALSE )
+	{
+	    if ( rawevent == TRUE )
+	    {
+		return ( FALSE );
+	    }
+	    switch ( json_scalar(fast, prev + 1, cur, &str, &len) )
+	    {
+		case NX_JSON_SCALAR_NULL:
+		    if ( build == TRUE )
+		    {
+			val = nx_value_new(NX_VALUE_TYPE_STRING);
+			val->defined = FALSE;
+			json_set_field(fast, val);
+		    }
+		    break;
+		case NX_JSON_SCALAR_TRUE:
+		case NX_JSON_SCALAR_FALSE:
+		    if ( build == TRUE )
+		    {
+			val = nx_value_new(NX_VALUE_TYPE_BOOLEAN);
+			val->boolean = (str[0] == 't') ? TRUE : FALSE;
+			json_set_field(fast, val);
+		    }
+		    break;
+		case NX_JSON_SCALAR_NUMBER:
+		    if ( build == TRUE )
+		    {
+			json_set_field(fast, nx_value_new_integer(json_number_to_integer(str, len)));
+		    }
+		    break;
+		default:
+		    return ( FALSE );
+	    }
+	    prev = cur - 1;
+	}
+	else if ( (json[cur] == '{') || (json[cur] == '[') )
+	{
+	    if ( rawevent == TRUE )
+	    {
+		return ( FALSE );
+	    }
+	    if ( build == TRUE )
+	    {
+		yajl_parse_map_key_cb(fast->ctx, (const unsigned char *) fast->key,
+				      strlen(fast->key));
+	    }
+	    if ( json_walk_nested(fast, &i, build) == FALSE )
+	    {
+		return ( FALSE );
+	    }
+	    if ( build == TRUE )
+	    {
+		fast->keys |= nx_logdata_key_bloom_bit(fast->key);
+	    }
+	    prev = NX_JSON_POS(fast, i - 1);
+	}
+	else
+	{
+	    if ( (json[cur] != '"') || (i + 1 >= fast->num) ||
+		 (json_string_check(fast, i) == FALSE) ||
+		 ((rawevent == TRUE) && (strcmp(fast->key, "raw_event") != 0)) )
+	    {
+		return ( FALSE );
+	    }
+	    if ( (build == TRUE) && (rawevent == FALSE) )
+	    {
+		json_string_get(fast, i, NULL, &str, &len);
+		json_set_string(fast, str, len);
+	    }
+	    prev = NX_JSON_POS(fast, i + 1);
+	    i += 2;
+	}
+
+	// separator or the closing bracket
+	if ( (i >= fast->num) ||
+	     (json_gap_is_empty(fast, prev + 1, NX_JSON_POS(fast, i)) == FALSE) )
+	{
+	    return ( FALSE );
+	}
+	prev = NX_JSON_POS(fast, i);
+	i++;
+	if ( json[prev] == '}' )
+	{
+	    break;
+	}
+	if ( json[prev] != ',' )
+	{
+	    return ( FALSE );
+	}
+	first = FALSE;
+    }
+
+    return ( (i == fast->num) && (json_gap_is_empty(fast, prev + 1, fast->len) == TRUE) );
+}
+
+
+
+/**
+ * Return TRUE if the parser is at the start of a record and the input is
+ * not too long for the index.
+ */
+static boolean json_fast_usable(const nx_json_parser_ctx_t *ctx, size_t len)
+{
+    return ( (ctx->key == NULL) && (ctx->tmpstr == NULL) &&
+	     (ctx->in_map == 0) && (ctx->in_array == 0) &&
+	     (len < NX_JSON_INDEX_FLAG) );
+}
+
+
+
+static void json_fast_init(nx_json_fast_t *fast,
+			   nx_json_parser_ctx_t *ctx,
+			   const char *json,
+			   size_t len)
+{
+    fast->ctx = ctx;
+    fast->json = json;
+    fast->len = (uint32_t) len;
+    fast->pos = fast->prealloc;
+    fast->num = 0;
+    fast->size = NX_JSON_INDEX_PREALLOC;
+    fast->keys = 0;
+    fast->buf = NULL;
+    fast->bufsize = 0;
+}
+
+
+
+static void json_fast_free(nx_json_fast_t *fast)
+{
+    if ( fast->pos != fast->prealloc )
+    {
+	free(fast->pos);
+    }
+    if ( fast->buf != NULL )
+    {
+	free(fast->buf);
+    }
+}
+
+
+
+/**
+ * Parse a complete JSON object into the fields of ctx->logdata without yajl.
+ * Returns FALSE without touching logdata if the input is not supported,
+ * nx_json_parse() then passes it to yajl.
+ */
+boolean nx_json_parse_fast(nx_json_parser_ctx_t *ctx,
+			   const char *json, size_t len)
+{
+    nx_json_fast_t fast;
+    nx_exception_t e;
+    boolean retval = FALSE;
+
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->logdata != NULL);
+
+    if ( json_fast_usable(ctx, len) == FALSE )
+    {
+	return ( FALSE );
+    }
+
+    json_fast_init(&fast, ctx, json, len);
+    if ( (json_index_build(&fast) == TRUE) && (json_walk(&fast, FALSE) == TRUE) )
+    {
+	fast.keys = nx_logdata_key_bloom(ctx->logdata);
+
+	try
+	{
+	    json_walk(&fast, TRUE);
+	}
+	catch(e)
+	{
+	    if ( ctx->key != NULL )
+	    {
+		free(ctx->key);
+		ctx->key = NULL;
+	    }
+	    if ( ctx->tmpstr != NULL )
+	    {
+		nx_string_free(ctx->tmpstr);
+		ctx->tmpstr = NULL;
+	    }
+	    ctx->in_map = 0;
+	    ctx->in_array = 0;
+	    json_fast_free(&fast);
+	    rethrow(e);
+	}
+	retval = TRUE;
+    }
+    json_fast_free(&fast);
+
+    return ( retval );
+}
+
+
+
+/**
+ * Parse with yajl, this also handles comments and the input which
+ * nx_json_parse_fast() doesn't support.
+ */
+void nx_json_parse_yajl(nx_json_parser_ctx_t *ctx,
+			const char *json, size_t len)
 {
     yajl_handle hand;
     yajl_gen g;
@@ -474,66 +1550,312 @@ void nx_json_parse(nx_json_parser_ctx_t *ctx,
 
 
 
-nx_string_t *nx_logdata_to_json(nx_json_parser_ctx_t *ctx)
+void nx_json_parse(nx_json_parser_ctx_t *ctx,
+		   const char *json, size_t len)
+{
+    if ( nx_json_parse_fast(ctx, json, len) == FALSE )
+    {
+	nx_json_parse_yajl(ctx, json, len);
+    }
+}
+
+
+
+static void json_lazy_parse(nx_logdata_t *logdata, nx_logdata_lazy_t *lazy)
+{
+    nx_json_parser_ctx_t ctx;
+
+    memset(&ctx, 0, sizeof(nx_json_parser_ctx_t));
+    ctx.logdata = logdata;
+    nx_json_parse(&ctx, lazy->src, lazy->len);
+}
+
+
+
+/**
+ * Same as nx_json_parse() but the fields are set when they are first
+ * accessed. The record is validated here, input which nx_json_parse_fast()
+ * doesn't accept is parsed right away so that errors are logged at the call.
+ */
+void nx_json_parse_lazy(nx_json_parser_ctx_t *ctx,
+			const char *json, size_t len)
+{
+    nx_json_fast_t fast;
+    boolean valid = FALSE;
+
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->logdata != NULL);
+
+    if ( json_fast_usable(ctx, len) == TRUE )
+    {
+	json_fast_init(&fast, ctx, json, len);
+	valid = (json_index_build(&fast) == TRUE) && (json_walk(&fast, FALSE) == TRUE);
+	json_fast_free(&fast);
+    }
+
+    if ( valid == TRUE )
+    {
+	nx_logdata_set_lazy(ctx->logdata, json_lazy_parse, NULL, NULL, 0, json, len);
+    }
+    else
+    {
+	nx_json_parse(ctx, json, len);
+    }
+}
+
+
+
+/* Non-zero for the bytes which must be escaped in a JSON string: the control
+ * characters, the quotation mark and the backslash. Same as yajl_string_encode().
+ */
+static const char _json_escape_char[256] =
+{
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+};
+
+
+
+static void json_append(nx_string_t *dst, const char *src, size_t len)
+{
+    nx_string_ensure_size(dst, dst->len + len + 1);
+    memcpy(dst->buf + dst->len, src, len);
+    dst->len += (uint32_t) len;
+}
+
+
+
+/**
+ * Return the number of leading bytes which don't need escaping
+ */
+static size_t json_unescaped_len(const unsigned char *str, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctrlmax = _mm_set1_epi8(0x1F);
+    __m128i chunk, found;
+    int mask;
+
+    // check 16 bytes at a time, x <= 0x1F is min(x, 0x1F) == x
+    for ( ; i + 16 <= len; i += 16 )
+    {
+	chunk = _mm_loadu_si128((const __m128i *) (str + i));
+	found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+					  _mm_cmpeq_epi8(chunk, backslash)),
+			     _mm_cmpeq_epi8(_mm_min_epu8(chunk, ctrlmax), chunk));
+	if ( (mask = _mm_movemask_epi8(found)) != 0 )
+	{
+	    return ( i + (size_t) __builtin_ctz((unsigned int) mask) );
+	}
+    }
+#endif
+
+    for ( ; i < len; i++ )
+    {
+	if ( _json_escape_char[str[i]] != 0 )
+	{
+	    break;
+	}
+    }
+
+    return ( i );
+}
+
+
+
+static void json_append_string(nx_string_t *dst, const char *str, size_t len)
+{
+    static const char hexchar[] = "0123456789ABCDEF";
+    char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+    unsigned char c;
+    size_t clean;
+
+    json_append(dst, "\"", 1);
+    while ( len > 0 )
+    {
+	clean = json_unescaped_len((const unsigned char *) str, len);
+	if ( clean > 0 )
+	{
+	    json_append(dst, str, clean);
+	    str += clean;
+	    len -= clean;
+	    if ( len == 0 )
+	    {
+		break;
+	    }
+	}
+	c = (unsigned char) *str;
+	if ( _json_escape_char[c] == 'u' )
+	{
+	    esc[4] = hexchar[c >> 4];
+	    esc[5] = hexchar[c & 0x0F];
+	    json_append(dst, esc, 6);
+	}
+	else
+	{
+	    esc[1] = _json_escape_char[c];
+	    json_append(dst, esc, 2);
+	    esc[1] = 'u';
+	}
+	str++;
+	len--;
+    }
+    json_append(dst, "\"", 1);
+}
+
+
+
+static void json_append_integer(nx_string_t *dst, int64_t value)
+{
+    char buf[24];
+    char *ptr;
+    uint64_t absval;
+
+    ptr = buf + sizeof(buf);
+    absval = (value < 0) ? -((uint64_t) value) : (uint64_t) value;
+    do
+    {
+	*--ptr = (char) ('0' + absval % 10);
+	absval /= 10;
+    } while ( absval != 0 );
+    if ( value < 0 )
+    {
+	*--ptr = '-';
+    }
+    json_append(dst, ptr, (size_t) (buf + sizeof(buf) - ptr));
+}
+
+
+
+static boolean json_field_is_excluded(nx_json_parser_ctx_t *ctx, nx_logdata_field_t *field)
 {
+    if ( (field->value->type == NX_VALUE_TYPE_STRING) &&
+	 (field->value->string == ctx->logdata->raw_event) )
+    {
+	return ( TRUE );
+    }
+    if ( ctx->include_fields != NULL )
+    {
+	return ( apr_hash_get(ctx->include_fields, field->key, APR_HASH_KEY_STRING) == NULL );
+    }
+    if ( (field->key[0] == '.') || (field->key[0] == '_') )
+    {
+	return ( TRUE );
+    }
+    if ( (ctx->exclude_fields != NULL) &&
+	 (apr_hash_get(ctx->exclude_fields, field->key, APR_HASH_KEY_STRING) != NULL) )
+    {
+	return ( TRUE );
+    }
+
+    return ( FALSE );
+}
 
-    const unsigned char *json;
-    size_t jsonlen;
-    yajl_gen gen;
+
+
+/**
+ * Append the fields of the logdata as a JSON object to dst.
+ * The $raw_event field is always skipped so it can be the destination.
+ */
+void nx_logdata_append_json(nx_json_parser_ctx_t *ctx, nx_string_t *dst)
+{
     nx_logdata_field_t *field;
-    nx_string_t *retval;
+    boolean first = TRUE;
+    char datestr[20];
     char *value;
 
-    gen = yajl_gen_alloc(NULL);
-    yajl_gen_map_open(gen);
+    ASSERT(ctx != NULL);
+    ASSERT(ctx->logdata != NULL);
+    ASSERT(dst != NULL);
 
+    nx_logdata_materialize(ctx->logdata);
+    json_append(dst, "{", 1);
     for ( field = NX_DLIST_FIRST(&(ctx->logdata->fields));
 	  field != NULL;
 	  field = NX_DLIST_NEXT(field, link) )
     {
-	if ( strcmp(field->key, "raw_event") == 0 )
+	if ( json_field_is_excluded(ctx, field) == TRUE )
 	{
 	    continue;
 	}
-	if ( (field->key[0] == '.') || (field->key[0] == '_') )
+
+	if ( first == TRUE )
 	{
-	    continue;
+	    first = FALSE;
+	}
+	else
+	{
+	    json_append(dst, ",", 1);
 	}
+	json_append_string(dst, field->key, strlen(field->key));
+	json_append(dst, ":", 1);
 
-	ASSERT(yajl_gen_string(gen, (const unsigned char *) field->key,
-			       strlen(field->key)) == yajl_gen_status_ok);
 	if ( field->value->defined == FALSE )
 	{
-	    ASSERT(yajl_gen_null(gen) == yajl_gen_status_ok);
+	    json_append(dst, "null", 4);
+	    continue;
 	}
-	else
+	switch ( field->value->type )
 	{
-	    switch ( field->value->type )
-	    {
-		case NX_VALUE_TYPE_BOOLEAN:
-		    ASSERT(yajl_gen_bool(gen, (int) field->value->boolean) == yajl_gen_status_ok);
-		    break;
-		case NX_VALUE_TYPE_INTEGER:
-		    ASSERT(yajl_gen_integer(gen, (long long) field->value->integer) == yajl_gen_status_ok);
+	    case NX_VALUE_TYPE_BOOLEAN:
+		if ( field->value->boolean == TRUE )
+		{
+		    json_append(dst, "true", 4);
+		}
+		else
+		{
+		    json_append(dst, "false", 5);
+		}
+		break;
+	    case NX_VALUE_TYPE_INTEGER:
+		json_append_integer(dst, field->value->integer);
+		break;
+	    case NX_VALUE_TYPE_STRING:
+		json_append_string(dst, field->value->string->buf, field->value->string->len);
+		break;
+	    case NX_VALUE_TYPE_DATETIME:
+		if ( nx_date_to_iso(datestr, sizeof(datestr), field->value->datetime) == APR_SUCCESS )
+		{
+		    json_append_string(dst, datestr, strlen(datestr));
 		    break;
-		case NX_VALUE_TYPE_STRING:
-		    ASSERT(yajl_gen_string(gen, (const unsigned char *) field->value->string->buf,
-					   field->value->string->len) == yajl_gen_status_ok);
-		    break;
-		default:
-		    value = nx_value_to_string(field->value);
-		    ASSERT(yajl_gen_string(gen, (const unsigned char *) value,
-					   strlen(value)) == yajl_gen_status_ok);
-		    free(value);
-		    break;
-	    }
+		}
+		// nx_value_to_string() reports the error
+		// fallthrough
+	    default:
+		value = nx_value_to_string(field->value);
+		json_append_string(dst, value, strlen(value));
+		free(value);
+		break;
 	}
     }
-    yajl_gen_map_close(gen);
-    yajl_gen_get_buf(gen, &json, &jsonlen);
-    
-    retval = nx_string_create((const char *) json, (int) jsonlen);
-    yajl_gen_free(gen);
+    json_append(dst, "}", 1);
+    dst->buf[dst->len] = '\0';
+}
+
+
+
+nx_string_t *nx_logdata_to_json(nx_json_parser_ctx_t *ctx)
+{
+    nx_string_t *retval;
+    nx_exception_t e;
+
+    retval = nx_string_new();
+    try
+    {
+	nx_logdata_append_json(ctx, retval);
+    }
+    catch(e)
+    {
+	nx_string_free(retval);
+	rethrow(e);
+    }
 
     return ( retval );
 }
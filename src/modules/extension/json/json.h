@@ -22,10 +22,19 @@ typedef struct nx_json_parser_ctx_t
     int in_array;
     int in_map;
     char *key;
+    apr_hash_t *include_fields;	///< only these fields are written to JSON if set
+    apr_hash_t *exclude_fields;	///< these fields are not written to JSON
 } nx_json_parser_ctx_t;
 
 void nx_json_parse(nx_json_parser_ctx_t *ctx,
 		   const char *json, size_t len);
+boolean nx_json_parse_fast(nx_json_parser_ctx_t *ctx,
+			   const char *json, size_t len);
+void nx_json_parse_yajl(nx_json_parser_ctx_t *ctx,
+			const char *json, size_t len);
+void nx_json_parse_lazy(nx_json_parser_ctx_t *ctx,
+			const char *json, size_t len);
+void nx_logdata_append_json(nx_json_parser_ctx_t *ctx, nx_string_t *dst);
 nx_string_t *nx_logdata_to_json(nx_json_parser_ctx_t *ctx);
 
 #endif	/* __NX_JSON_H */
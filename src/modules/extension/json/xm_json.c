@@ -11,6 +11,29 @@
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
 
+static apr_hash_t *xm_json_parse_fields(nx_module_t *module, const nx_directive_t *curr)
+{
+    const char *fields[NX_MODULE_MAX_FIELDS];
+    apr_hash_t *retval;
+    int i;
+
+    if ( (curr->args == NULL) || (curr->args[0] == '\0') )
+    {
+	nx_conf_error(curr, "%s needs a parameter", curr->directive);
+    }
+    nx_module_parse_fields(fields, apr_pstrdup(module->pool, curr->args));
+
+    retval = apr_hash_make(module->pool);
+    for ( i = 0; fields[i] != NULL; i++ )
+    {
+	apr_hash_set(retval, fields[i], APR_HASH_KEY_STRING, "");
+    }
+
+    return ( retval );
+}
+
+
+
 static void xm_json_config(nx_module_t *module)
 {
     const nx_directive_t *curr;
@@ -27,6 +50,26 @@ static void xm_json_config(nx_module_t *module)
 	if ( nx_module_common_keyword(curr->directive) == TRUE )
 	{
 	}
+	else if ( strcasecmp(curr->directive, "IncludeFields") == 0 )
+	{
+	    if ( modconf->include_fields != NULL )
+	    {
+		nx_conf_error(curr, "IncludeFields already defined");
+	    }
+	    modconf->include_fields = xm_json_parse_fields(module, curr);
+	}
+	else if ( strcasecmp(curr->directive, "ExcludeFields") == 0 )
+	{
+	    if ( modconf->exclude_fields != NULL )
+	    {
+		nx_conf_error(curr, "ExcludeFields already defined");
+	    }
+	    modconf->exclude_fields = xm_json_parse_fields(module, curr);
+	}
+	else if ( strcasecmp(curr->directive, "LazyParse") == 0 )
+	{
+	    nx_cfg_get_boolean(curr, "LazyParse", &(modconf->lazyparse));
+	}
 	else
 	{
 	    nx_conf_error(curr, "invalid keyword: %s", curr->directive);
@@ -34,6 +77,11 @@ static void xm_json_config(nx_module_t *module)
 
 	curr = curr->next;
     }
+
+    if ( (modconf->include_fields != NULL) && (modconf->exclude_fields != NULL) )
+    {
+	nx_conf_error(module->directives, "IncludeFields and ExcludeFields cannot be used together");
+    }
 }
 
 
@@ -11,7 +11,9 @@
 
 typedef struct nx_xm_json_conf_t
 {
-    boolean tmp;
+    apr_hash_t *include_fields;	///< IncludeFields
+    apr_hash_t *exclude_fields;	///< ExcludeFields
+    boolean lazyparse;		///< LazyParse
 } nx_xm_json_conf_t;
 
 #endif	/* __NX_XM_JSON_H */
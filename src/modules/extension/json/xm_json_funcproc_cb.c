@@ -12,6 +12,22 @@
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
 
+
+static void json_parse(const nx_xm_json_conf_t *modconf,
+		       nx_json_parser_ctx_t *ctx,
+		       const nx_string_t *string)
+{
+    if ( modconf->lazyparse == TRUE )
+    {
+	nx_json_parse_lazy(ctx, string->buf, string->len);
+    }
+    else
+    {
+	nx_json_parse(ctx, string->buf, string->len);
+    }
+}
+
+
 void nx_expr_proc__parse_json(nx_expr_eval_ctx_t *eval_ctx,
 			      nx_module_t *module,
 			      nx_expr_list_t *args)
@@ -51,7 +67,7 @@ void nx_expr_proc__parse_json(nx_expr_eval_ctx_t *eval_ctx,
 
 	try
 	{
-	    nx_json_parse(&ctx, value.string->buf, value.string->len);
+	    json_parse(modconf, &ctx, value.string);
 	}
 	catch(e)
 	{
@@ -75,7 +91,7 @@ void nx_expr_proc__parse_json(nx_expr_eval_ctx_t *eval_ctx,
 	{
 	    throw_msg("string type required for field 'raw_event'");
 	}
-	nx_json_parse(&ctx, value.string->buf, value.string->len);
+	json_parse(modconf, &ctx, value.string);
     }
 }
 
@@ -103,6 +119,8 @@ void nx_expr_func__to_json(nx_expr_eval_ctx_t *eval_ctx,
 
     memset(&ctx, 0, sizeof(nx_json_parser_ctx_t));
     ctx.logdata = eval_ctx->logdata;
+    ctx.include_fields = modconf->include_fields;
+    ctx.exclude_fields = modconf->exclude_fields;
 
     retval->string = nx_logdata_to_json(&ctx);
     retval->type = NX_VALUE_TYPE_STRING;
@@ -119,6 +137,8 @@ void nx_expr_proc__to_json(nx_expr_eval_ctx_t *eval_ctx,
     nx_value_t *val;
     nx_string_t *jsonstr;
     nx_json_parser_ctx_t ctx;
+    uint32_t origlen;
+    nx_exception_t e;
 
     ASSERT(module != NULL);
     if ( eval_ctx->logdata == NULL )
@@ -131,6 +151,30 @@ void nx_expr_proc__to_json(nx_expr_eval_ctx_t *eval_ctx,
 
     memset(&ctx, 0, sizeof(nx_json_parser_ctx_t));
     ctx.logdata = eval_ctx->logdata;
+    ctx.include_fields = modconf->include_fields;
+    ctx.exclude_fields = modconf->exclude_fields;
+
+    if ( (eval_ctx->logdata->raw_event != NULL) &&
+	 !(eval_ctx->logdata->raw_event->flags & NX_STRING_FLAG_CONST) )
+    { // the writer skips $raw_event so its buffer can be reused
+	// append after the original and move it to the front once complete,
+	// a failure must leave $raw_event untouched
+	jsonstr = eval_ctx->logdata->raw_event;
+	origlen = jsonstr->len;
+	try
+	{
+	    nx_logdata_append_json(&ctx, jsonstr);
+	}
+	catch(e)
+	{
+	    jsonstr->len = origlen;
+	    jsonstr->buf[origlen] = '\0';
+	    rethrow(e);
+	}
+	jsonstr->len -= origlen;
+	memmove(jsonstr->buf, jsonstr->buf + origlen, jsonstr->len + 1);
+	return;
+    }
 
     jsonstr = nx_logdata_to_json(&ctx);
 
@@ -7,6 +7,7 @@
 
 #include "../../../common/error_debug.h"
 #include "../../../common/exception.h"
+#include "../../../common/alloc.h"
 #include "kvp.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
@@ -23,6 +24,13 @@ typedef enum nx_kvp_state_t
     NX_KVP_STATE_KVP_DELIMITER,
 } nx_kvp_state_t;
 
+typedef struct nx_kvp_value_t
+{
+    nx_string_t	*str;	///< NULL as long as the value is a single run of the input
+    const char	*src;	///< NULL if there is no value being parsed
+    size_t	len;
+} nx_kvp_value_t;
+
 
 
 void nx_kvp_ctx_init(nx_kvp_ctx_t *ctx)
@@ -185,25 +193,148 @@ static void unescape_value(nx_kvp_ctx_t *ctx,
 
 
 
+static void kvp_value_materialize(nx_kvp_value_t *value)
+{
+    if ( value->str == NULL )
+    {
+	value->str = nx_string_create(value->src, (int) value->len);
+    }
+}
+
+
+
+static void kvp_value_append(nx_kvp_value_t *value, const char *src, size_t len)
+{
+    if ( value->str == NULL )
+    {
+	if ( value->len == 0 )
+	{
+	    value->src = src;
+	    value->len = len;
+	    return;
+	}
+	if ( value->src + value->len == src )
+	{
+	    value->len += len;
+	    return;
+	}
+	kvp_value_materialize(value);
+    }
+    nx_string_append(value->str, src, (int) len);
+}
+
+
+
+/**
+ * Return the string of the value, the caller takes ownership
+ */
+static nx_string_t *kvp_value_take(nx_kvp_value_t *value)
+{
+    nx_string_t *retval;
+
+    kvp_value_materialize(value);
+    retval = value->str;
+    value->str = NULL;
+    value->src = NULL;
+    value->len = 0;
+
+    return ( retval );
+}
+
+
+
+/**
+ * Set the field from the parsed value. logdata is NULL when the input is
+ * only checked for a deferred parse, the value is dropped then.
+ */
+static void kvp_add_field(nx_logdata_t *logdata,
+			  char *key,
+			  int keylen,
+			  boolean keyquoted,
+			  nx_kvp_value_t *value)
+{
+    if ( logdata == NULL )
+    {
+	if ( value->str != NULL )
+	{
+	    nx_string_free(value->str);
+	}
+	value->str = NULL;
+	value->src = NULL;
+	value->len = 0;
+	return;
+    }
+    add_logdata_field(logdata, key, keylen, keyquoted, kvp_value_take(value));
+}
+
+
+
 #define IS_QUOTECHAR(c) ( (c == '\'') || (c == '\"') )
 #define IS_KVDELIMITERCHAR(c) ( (c == ':') || (c == '=') )
 #define IS_KVPDELIMITERCHAR(c) ( (c == ',') || (c == ';') || (c == ' ') )
 
+/**
+ * The bytes which end a run of an unescaped key, the same checks as in
+ * NX_KVP_STATE_KEY.
+ */
+static void kvp_key_scan_init(const nx_kvp_ctx_t *ctx, nx_string_scan_t *scan)
+{
+    nx_string_scan_init(scan);
+    nx_string_scan_add(scan, ctx->keyquotechar);
+    nx_string_scan_add(scan, ctx->escapechar);
+    nx_string_scan_add(scan, ctx->kvdelimiter);
+    if ( ctx->kvdelimiter == '\0' )
+    {
+	nx_string_scan_add(scan, ':');
+	nx_string_scan_add(scan, '=');
+    }
+}
+
+
+
+/**
+ * The bytes which end a run of an unescaped value, the same checks as in
+ * NX_KVP_STATE_VALUE.
+ */
+static void kvp_value_scan_init(const nx_kvp_ctx_t *ctx,
+				nx_string_scan_t *scan,
+				boolean quoted)
+{
+    nx_string_scan_init(scan);
+    nx_string_scan_add(scan, ctx->valquotechar);
+    nx_string_scan_add(scan, ctx->escapechar);
+    if ( quoted == FALSE )
+    {
+	nx_string_scan_add(scan, ctx->kvpdelimiter);
+	if ( ctx->kvpdelimiter == '\0' )
+	{
+	    nx_string_scan_add(scan, ',');
+	    nx_string_scan_add(scan, ';');
+	    nx_string_scan_add(scan, ' ');
+	}
+    }
+}
+
 static void parse_kvp(nx_logdata_t *logdata,
 		      nx_kvp_ctx_t *ctx,
 		      const char *src,
 		      size_t len)
 {
-    nx_string_t *valuestr = NULL;
+    nx_kvp_value_t value = { NULL, NULL, 0 };
+    nx_string_scan_t keyscan;
+    nx_string_scan_t valscan;
     nx_exception_t e;
     nx_kvp_state_t state = NX_KVP_STATE_KEY_START;
     char keyname[256];
     int keylen = 0;
     volatile boolean got_keyquote = FALSE;
 
+    kvp_key_scan_init(ctx, &keyscan);
+
     try
     {
 	int pos = 0;
+	int n;
 	boolean got_valquote = FALSE;
 
 	for ( pos = 0; pos < (int) len; pos++ )
@@ -245,12 +376,20 @@ static void parse_kvp(nx_logdata_t *logdata,
 		    }
 */
 		    else
-		    {
-			if ( keylen < (int) sizeof(keyname) - 1 )
+		    { // copy the run up to the next special byte
+			n = (int) nx_string_scan(&keyscan, src + pos, len - (size_t) pos);
+			ASSERT(n > 0);
+			if ( n > (int) sizeof(keyname) - 1 - keylen )
 			{
-			    keyname[keylen] = src[pos];
-			    keylen++;
+			    memcpy(keyname + keylen, src + pos, sizeof(keyname) - 1 - (size_t) keylen);
+			    keylen = (int) sizeof(keyname) - 1;
+			}
+			else
+			{
+			    memcpy(keyname + keylen, src + pos, (size_t) n);
+			    keylen += n;
 			}
+			pos += n - 1;
 		    }
 		    break;
 
@@ -260,8 +399,9 @@ static void parse_kvp(nx_logdata_t *logdata,
 			break;
 		    }
 		    got_valquote = FALSE;
-		    ASSERT(valuestr == NULL);
-		    valuestr = nx_string_new();
+		    ASSERT(value.src == NULL);
+		    ASSERT(value.str == NULL);
+		    value.src = src + pos;
 
 		    if ( (ctx->valquotechar == '\0') && 
 			 IS_QUOTECHAR(src[pos]) )
@@ -277,6 +417,7 @@ static void parse_kvp(nx_logdata_t *logdata,
 		    {
 			pos--; // handle character in STATE_VALUE
 		    }
+		    kvp_value_scan_init(ctx, &valscan, got_valquote);
 		    state = NX_KVP_STATE_VALUE;
 		    break;
 
@@ -289,9 +430,10 @@ static void parse_kvp(nx_logdata_t *logdata,
 			}
 			else
 			{
-			    if ( valuestr->len > 0)
+			    kvp_value_materialize(&value);
+			    if ( value.str->len > 0)
 			    {
-				throw_msg("invalid value quotation in key-value pair: %s", valuestr->buf);
+				throw_msg("invalid value quotation in key-value pair: %s", value.str->buf);
 			    }
 			}
 		    }
@@ -301,15 +443,13 @@ static void parse_kvp(nx_logdata_t *logdata,
 		    {
 			ctx->kvpdelimiter = src[pos];
 			// add field-value
-			add_logdata_field(logdata, keyname, keylen, got_keyquote, valuestr);
-			valuestr = NULL;
+			kvp_add_field(logdata, keyname, keylen, got_keyquote, &value);
 			state = NX_KVP_STATE_KEY_START;
 		    }
 		    else if ( (src[pos] == ctx->kvpdelimiter) && (got_valquote == FALSE) )
 		    {
 			// add field-value
-			add_logdata_field(logdata, keyname, keylen, got_keyquote, valuestr);
-			valuestr = NULL;
+			kvp_add_field(logdata, keyname, keylen, got_keyquote, &value);
 			state = NX_KVP_STATE_KEY_START;
 		    }
 		    else if ( src[pos] == ctx->escapechar )
@@ -317,13 +457,17 @@ static void parse_kvp(nx_logdata_t *logdata,
 			state = NX_KVP_STATE_VALUE_ESCAPE;
 		    }
 		    else
-		    { // append character to value
-			nx_string_append(valuestr, src + pos, 1);
+		    { // append the run up to the next special byte to the value
+			n = (int) nx_string_scan(&valscan, src + pos, len - (size_t) pos);
+			ASSERT(n > 0);
+			kvp_value_append(&value, src + pos, (size_t) n);
+			pos += n - 1;
 		    }
 		    break;
 
 		case NX_KVP_STATE_VALUE_ESCAPE:
-		    unescape_value(ctx, src[pos], valuestr, got_valquote);
+		    kvp_value_materialize(&value);
+		    unescape_value(ctx, src[pos], value.str, got_valquote);
 		    state = NX_KVP_STATE_VALUE;
 		    break;
 
@@ -351,20 +495,19 @@ static void parse_kvp(nx_logdata_t *logdata,
 		    {
 			ctx->kvpdelimiter = src[pos];
 			state = NX_KVP_STATE_KEY_START;
-			add_logdata_field(logdata, keyname, keylen, got_keyquote, valuestr);
-			valuestr = NULL;
+			kvp_add_field(logdata, keyname, keylen, got_keyquote, &value);
 		    }
 		    else if ( src[pos] == ctx->kvpdelimiter )
 		    {
 			state = NX_KVP_STATE_KEY_START;
-			add_logdata_field(logdata, keyname, keylen, got_keyquote, valuestr);
-			valuestr = NULL;
+			kvp_add_field(logdata, keyname, keylen, got_keyquote, &value);
 		    }
 		    break;
 		    
 		case NX_KVP_STATE_KEY_START:
 		    keylen = 0;
 		    got_keyquote = FALSE;
+		    kvp_key_scan_init(ctx, &keyscan);
 		    if ( src[pos] == ' ' )
 		    { // skip space
 			break;
@@ -373,6 +516,7 @@ static void parse_kvp(nx_logdata_t *logdata,
 			      IS_QUOTECHAR(src[pos]) )
 		    { // auto-detected quotechar
 			ctx->keyquotechar = src[pos];
+			kvp_key_scan_init(ctx, &keyscan);
 			got_keyquote = TRUE;
 			state = NX_KVP_STATE_KEY;
 		    }
@@ -428,9 +572,9 @@ static void parse_kvp(nx_logdata_t *logdata,
     }
     catch(e)
     {
-	if ( valuestr != NULL )
+	if ( value.str != NULL )
 	{
-	    nx_string_free(valuestr);
+	    nx_string_free(value.str);
 	}
 	rethrow(e);
     }
@@ -439,19 +583,19 @@ static void parse_kvp(nx_logdata_t *logdata,
     {
 	case NX_KVP_STATE_VALUE:
 	case NX_KVP_STATE_KVP_DELIMITER:
-	    add_logdata_field(logdata, keyname, keylen, got_keyquote, valuestr);
+	    kvp_add_field(logdata, keyname, keylen, got_keyquote, &value);
 	    break;
 	case NX_KVP_STATE_KEY_START:
-	    ASSERT(valuestr == NULL);
+	    ASSERT(value.src == NULL);
 	    break;
 	case NX_KVP_STATE_KV_DELIMITER:
 	case NX_KVP_STATE_KEY:
 	case NX_KVP_STATE_KEY_ESCAPE:
 	case NX_KVP_STATE_VALUE_START:
 	case NX_KVP_STATE_VALUE_ESCAPE:
-	    if ( valuestr != NULL )
+	    if ( value.str != NULL )
 	    {
-		nx_string_free(valuestr);
+		nx_string_free(value.str);
 	    }
 	    throw_msg("invalid KVP input: '%s' [state: %d]", src, state);
 	    break;
@@ -481,6 +625,63 @@ void nx_kvp_parse(nx_logdata_t *logdata,
 
 
 
+static void kvp_lazy_parse(nx_logdata_t *logdata, nx_logdata_lazy_t *lazy)
+{
+    nx_kvp_ctx_t ctx;
+
+    // the characters detected are the same as with the check in nx_kvp_parse_lazy()
+    ctx = *((nx_kvp_ctx_t *) lazy->data);
+    parse_kvp(logdata, &ctx, lazy->src, lazy->len);
+}
+
+
+
+/**
+ * Same as nx_kvp_parse() but the fields are set when they are first
+ * accessed. The input is checked here without creating the fields, this
+ * detects the delimiters and quote characters in ctx the same way. Input
+ * which fails the check is parsed right away to set the same fields and
+ * throw the same error.
+ */
+void nx_kvp_parse_lazy(nx_logdata_t *logdata,
+		       nx_kvp_ctx_t *ctx,
+		       const char *src,
+		       size_t volatile len)
+{
+    nx_kvp_ctx_t saved;
+    nx_exception_t e;
+
+    ASSERT(ctx != NULL);
+    ASSERT(logdata != NULL);
+    ASSERT(src != NULL);
+
+    if ( len == 0 )
+    {
+	len = strlen(src);
+    }
+
+    if ( nx_logdata_lazy_allowed(src, len) == FALSE )
+    {
+	parse_kvp(logdata, ctx, src, len);
+	return;
+    }
+
+    saved = *ctx;
+    try
+    {
+	parse_kvp(NULL, ctx, src, len);
+    }
+    catch(e)
+    {
+	*ctx = saved;
+	parse_kvp(logdata, ctx, src, len);
+	rethrow(e);
+    }
+    nx_logdata_set_lazy(logdata, kvp_lazy_parse, NULL, &saved, sizeof(nx_kvp_ctx_t), src, len);
+}
+
+
+
 /*
  * If ctx.escapechar is not zero, it is used to prefix the following characters:
  * - The ctx.escapechar character
@@ -613,8 +814,9 @@ static void escape_value(nx_string_t *str, nx_kvp_ctx_t *ctx)
 nx_string_t *nx_logdata_to_kvp(nx_kvp_ctx_t *ctx, nx_logdata_t *logdata)
 {
     nx_string_t *retval = NULL;
-    char *string = NULL;
-    nx_string_t *tmp = NULL;
+    const char *string;
+    nx_string_t *tmp;
+    nx_scratch_mark_t mark;
     nx_exception_t e;
     nx_logdata_field_t *field = NULL;
     char kvpdelimiter = ';';
@@ -633,9 +835,12 @@ nx_string_t *nx_logdata_to_kvp(nx_kvp_ctx_t *ctx, nx_logdata_t *logdata)
     }
 
     retval = nx_string_new_size(150);
+    nx_logdata_materialize(logdata);
 
+    nx_scratch_mark(&mark);
     try
     {
+	tmp = nx_scratch_string();
 	for ( field = NX_DLIST_FIRST(&(logdata->fields));
 	      field != NULL;
 	      field = NX_DLIST_NEXT(field, link) )
@@ -663,20 +868,19 @@ nx_string_t *nx_logdata_to_kvp(nx_kvp_ctx_t *ctx, nx_logdata_t *logdata)
 		{
 		    if ( field->value->string->len > 0 )
 		    {
-			tmp = nx_string_clone(field->value->string);
+			tmp->len = 0;
+			nx_string_append(tmp, field->value->string->buf,
+					 (int) field->value->string->len);
 			escape_value(tmp, ctx);
 			nx_string_append(retval, tmp->buf, (int) tmp->len);
-			nx_string_free(tmp);
 		    }
 		}
 		else
 		{
-		    string = nx_value_to_string(field->value);
+		    string = nx_value_to_scratch_string(field->value);
 		    if ( string != NULL )
 		    {
 			nx_string_append(retval, string, -1);
-			free(string);
-			string = NULL;
 		    }
 		}
 	    }
@@ -685,20 +889,10 @@ nx_string_t *nx_logdata_to_kvp(nx_kvp_ctx_t *ctx, nx_logdata_t *logdata)
     }
     catch(e)
     {
-	if ( string != NULL )
-	{
-	    free(string);
-	}
-	if ( tmp != NULL )
-	{
-	    nx_string_free(tmp);
-	}
-	if ( retval != NULL )
-	{
-	    nx_string_free(retval);
-	}
+	nx_string_free(retval);
 	rethrow(e);
     }
+    nx_scratch_release(&mark);
 
     return ( retval );
 }
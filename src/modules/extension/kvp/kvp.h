@@ -40,6 +40,10 @@ void nx_kvp_parse(nx_logdata_t *logdata,
 		  nx_kvp_ctx_t *ctx,
 		  const char *src,
 		  size_t len);
+void nx_kvp_parse_lazy(nx_logdata_t *logdata,
+		       nx_kvp_ctx_t *ctx,
+		       const char *src,
+		       size_t len);
 nx_string_t *nx_logdata_to_kvp(nx_kvp_ctx_t *ctx, nx_logdata_t *logdata);
 void nx_kvp_ctx_set_fields(nx_kvp_ctx_t *ctx, char *fields);
 void nx_kvp_ctx_set_types(nx_kvp_ctx_t *ctx, char *types);
@@ -101,6 +101,10 @@ static void xm_kvp_config(nx_module_t *module)
 	    nx_cfg_get_boolean(module->directives, "EscapeControl",
 			       &(modconf->ctx.escape_control));
 	}
+	else if ( strcasecmp(curr->directive, "LazyParse") == 0 )
+	{
+	    nx_cfg_get_boolean(curr, "LazyParse", &(modconf->lazyparse));
+	}
 
 	curr = curr->next;
     }
@@ -14,6 +14,7 @@
 typedef struct nx_xm_kvp_conf_t
 {
     nx_kvp_ctx_t ctx;
+    boolean lazyparse;
 } nx_xm_kvp_conf_t;
 
 #endif	/* __NX_XM_KVP_H */
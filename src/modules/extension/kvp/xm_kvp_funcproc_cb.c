@@ -12,13 +12,30 @@
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
+
+
+static void kvp_parse(nx_xm_kvp_conf_t *modconf,
+		      nx_logdata_t *logdata,
+		      const nx_string_t *string)
+{
+    if ( modconf->lazyparse == TRUE )
+    {
+	nx_kvp_parse_lazy(logdata, &(modconf->ctx), string->buf, string->len);
+    }
+    else
+    {
+	nx_kvp_parse(logdata, &(modconf->ctx), string->buf, string->len);
+    }
+}
+
+
+
 void nx_expr_proc__parse_kvp(nx_expr_eval_ctx_t *eval_ctx,
 			     nx_module_t *module,
 			     nx_expr_list_t *args)
 {
     nx_expr_list_elem_t *arg;
     nx_value_t value;
-    nx_kvp_ctx_t *ctx;
     nx_xm_kvp_conf_t *modconf;
     nx_exception_t e;
 
@@ -30,7 +47,6 @@ void nx_expr_proc__parse_kvp(nx_expr_eval_ctx_t *eval_ctx,
 
     modconf = (nx_xm_kvp_conf_t *) module->config;
     ASSERT(modconf != NULL);
-    ctx = &(modconf->ctx);
 
     if ( (args != NULL) && ((arg = NX_DLIST_FIRST(args)) != NULL) )
     {
@@ -48,7 +64,7 @@ void nx_expr_proc__parse_kvp(nx_expr_eval_ctx_t *eval_ctx,
 	}
 	try
 	{
-	    nx_kvp_parse(eval_ctx->logdata, ctx, value.string->buf, value.string->len);
+	    kvp_parse(modconf, eval_ctx->logdata, value.string);
 	}
 	catch(e)
 	{
@@ -71,7 +87,7 @@ void nx_expr_proc__parse_kvp(nx_expr_eval_ctx_t *eval_ctx,
 	{
 	    throw_msg("string type required for field 'raw_event'");
 	}
-	nx_kvp_parse(eval_ctx->logdata, ctx, value.string->buf, value.string->len);
+	kvp_parse(modconf, eval_ctx->logdata, value.string);
     }
 }
 
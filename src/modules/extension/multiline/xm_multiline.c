@@ -35,10 +35,9 @@ static boolean match_line(nx_value_t *pattern, const char *subject, size_t len)
 	int ovector[NX_EXPR_MAX_CAPTURED_FIELDS * 3];
 
 	ASSERT(pattern->type == NX_VALUE_TYPE_REGEXP);
-	pcre_result = pcre_exec(pattern->regexp.pcre, NULL, 
-				subject, 
-				(int) len, 0, 0,
-				ovector, NX_EXPR_MAX_CAPTURED_FIELDS * 3);
+	pcre_result = nx_regexp_exec(pattern->regexp.compiled,
+				     subject, (int) len, 0, 0,
+				     ovector, NX_EXPR_MAX_CAPTURED_FIELDS * 3);
 
 	if ( pcre_result >= 0 )
 	{ // got match
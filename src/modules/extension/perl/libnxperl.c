@@ -429,6 +429,7 @@ XS_EUPXS(XS_Log__Nxlog_field_names)
 
     RETVAL = newAV();
     sv_2mortal((SV*) RETVAL);
+    nx_logdata_materialize(event);
     for ( field = NX_DLIST_FIRST(&(event->fields));
 	  field != NULL;
 	  field = NX_DLIST_NEXT(field, link) )
@@ -437,7 +438,7 @@ XS_EUPXS(XS_Log__Nxlog_field_names)
 	av_push(RETVAL, sv);
     }
 
-#line 441 "libnxperl.c"
+#line 442 "libnxperl.c"
 	{
 	    SV * RETVALSV;
 	    RETVALSV = newRV((SV*)RETVAL);
@@ -458,9 +459,9 @@ XS_EUPXS(XS_Log__Nxlog_log_debug)
     {
 	char *	msg = (char *)SvPV_nolen(ST(0))
 ;
-#line 232 "libnxperl.xs"
+#line 233 "libnxperl.xs"
     log_debug("%s", msg);
-#line 464 "libnxperl.c"
+#line 465 "libnxperl.c"
     }
     XSRETURN_EMPTY;
 }
@@ -475,9 +476,9 @@ XS_EUPXS(XS_Log__Nxlog_log_info)
     {
 	char *	msg = (char *)SvPV_nolen(ST(0))
 ;
-#line 241 "libnxperl.xs"
+#line 242 "libnxperl.xs"
     log_info("%s", msg);
-#line 481 "libnxperl.c"
+#line 482 "libnxperl.c"
     }
     XSRETURN_EMPTY;
 }
@@ -492,9 +493,9 @@ XS_EUPXS(XS_Log__Nxlog_log_warning)
     {
 	char *	msg = (char *)SvPV_nolen(ST(0))
 ;
-#line 250 "libnxperl.xs"
+#line 251 "libnxperl.xs"
     log_warn("%s", msg);
-#line 498 "libnxperl.c"
+#line 499 "libnxperl.c"
     }
     XSRETURN_EMPTY;
 }
@@ -509,9 +510,9 @@ XS_EUPXS(XS_Log__Nxlog_log_error)
     {
 	char *	msg = (char *)SvPV_nolen(ST(0))
 ;
-#line 259 "libnxperl.xs"
+#line 260 "libnxperl.xs"
     log_error("%s", msg);
-#line 515 "libnxperl.c"
+#line 516 "libnxperl.c"
     }
     XSRETURN_EMPTY;
 }
@@ -211,6 +211,7 @@ AV *field_names(event)
 
     RETVAL = newAV();
     sv_2mortal((SV*) RETVAL);
+    nx_logdata_materialize(event);
     for ( field = NX_DLIST_FIRST(&(event->fields));
 	  field != NULL;
 	  field = NX_DLIST_NEXT(field, link) )
@@ -9,6 +9,7 @@
 
 #include "syslog.h"
 #include "../../../common/date.h"
+#include "../../../common/alloc.h"
 #include "../../../common/module.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
@@ -129,28 +130,164 @@ const char *nx_syslog_severity_to_string(nx_syslog_severity_t severity)
 
 
 
-static void set_syslog_hostname(nx_logdata_t *logdata,
+/**
+ * Fields are set through the bloom filter of the field names in logdata,
+ * most of them are new and can be appended without comparing the name
+ * to each field. When lookup is set the parse only extracts the value of
+ * that field for a deferred parse, the other values are not created.
+ */
+typedef struct nx_syslog_parser_t
+{
+    nx_logdata_t	*logdata;
+    uint64_t		keys;	///< bloom filter of the field names in logdata
+    apr_time_t		now;	///< time of the deferred parse, 0 to use the current time
+    const char		*lookup; ///< name of the field to extract, NULL to set all fields
+    nx_logdata_field_t	*found;	///< the extracted field with the last value set
+} nx_syslog_parser_t;
+
+
+
+/**
+ * State of a deferred parse kept with the source
+ */
+typedef struct nx_syslog_lazy_t
+{
+    nx_date_format_t	dateformat;
+    boolean		ietf;
+} nx_syslog_lazy_t;
+
+
+
+static void syslog_parser_init(nx_syslog_parser_t *parser, nx_logdata_t *logdata)
+{
+    parser->logdata = logdata;
+    parser->keys = nx_logdata_key_bloom(logdata);
+    parser->now = 0;
+    parser->lookup = NULL;
+    parser->found = NULL;
+}
+
+
+
+static apr_time_t syslog_now(const nx_syslog_parser_t *parser)
+{
+    if ( parser->now != 0 )
+    {
+	return ( parser->now );
+    }
+
+    return ( apr_time_now() );
+}
+
+
+
+/**
+ * Return TRUE if the value of the field is needed
+ */
+static boolean syslog_wants(const nx_syslog_parser_t *parser, const char *key)
+{
+    return ( (parser->lookup == NULL) || (strcasecmp(parser->lookup, key) == 0) );
+}
+
+
+
+static void syslog_set_field(nx_syslog_parser_t *parser,
+			     const char *key,
+			     nx_value_t *value)
+{
+    if ( parser->lookup == NULL )
+    {
+	nx_logdata_bloom_set_field_value(parser->logdata, &(parser->keys), key, value);
+    }
+    else if ( strcasecmp(parser->lookup, key) == 0 )
+    { // the name of the first one is kept like in nx_logdata_set_field_value()
+	if ( parser->found == NULL )
+	{
+	    parser->found = malloc(sizeof(nx_logdata_field_t));
+	    ASSERT(parser->found != NULL);
+	    parser->found->key = strdup(key);
+	}
+	else
+	{
+	    nx_value_free(parser->found->value);
+	}
+	parser->found->value = value;
+    }
+    else
+    {
+	nx_value_free(value);
+    }
+}
+
+
+
+static void syslog_set_integer(nx_syslog_parser_t *parser,
+			       const char *key,
+			       int64_t value)
+{
+    if ( syslog_wants(parser, key) == TRUE )
+    {
+	syslog_set_field(parser, key, nx_value_new_integer(value));
+    }
+}
+
+
+
+static void syslog_set_datetime(nx_syslog_parser_t *parser,
+				const char *key,
+				apr_time_t value)
+{
+    if ( syslog_wants(parser, key) == TRUE )
+    {
+	syslog_set_field(parser, key, nx_value_new_datetime(value));
+    }
+}
+
+
+
+static void syslog_set_cstring(nx_syslog_parser_t *parser,
+			       const char *key,
+			       const char *value)
+{
+    if ( syslog_wants(parser, key) == TRUE )
+    {
+	syslog_set_field(parser, key, nx_value_new_string(value));
+    }
+}
+
+
+
+static void syslog_set_string(nx_syslog_parser_t *parser,
+			      const char *key,
+			      const char *start,
+			      const char *end)
+{
+    nx_value_t *value;
+
+    if ( (start != NULL) && (end != NULL) && (end > start) &&
+	 (syslog_wants(parser, key) == TRUE) )
+    {
+	value = nx_value_new(NX_VALUE_TYPE_STRING);
+	value->string = nx_string_create(start, (int) (end - start));
+	syslog_set_field(parser, key, value);
+    }
+}
+
+
+
+static void set_syslog_hostname(nx_syslog_parser_t *parser,
 				const char *hoststart,
 				const char *hostend)
 {
-    nx_value_t *hostname = NULL;
-    int len;
-
     if ( (hoststart != NULL) && (hostend != NULL) && (hostend > hoststart) )
     {
-	hostname = malloc(sizeof(nx_value_t));
-	ASSERT(hostname != NULL);
-	hostname->type = NX_VALUE_TYPE_STRING;
-	hostname->defined = TRUE;
-	len = (int) (hostend - hoststart);
-	hostname->string = nx_string_create(hoststart, len);
-	nx_logdata_set_field_value(logdata, "Hostname", hostname);
+	syslog_set_string(parser, "Hostname", hoststart, hostend);
     }
-    else
+    else if ( syslog_wants(parser, "Hostname") == TRUE )
     {
 	nx_value_t recv_from;
 
-	if ( nx_logdata_get_field_value(logdata, "MessageSourceAddress", &recv_from) != TRUE )
+	if ( nx_logdata_get_field_value(parser->logdata, "MessageSourceAddress", &recv_from) != TRUE )
 	{
 	    nx_value_t *val;
 	    const nx_string_t *hoststr;
@@ -159,12 +296,12 @@ static void set_syslog_hostname(nx_logdata_t *logdata,
 	    val = nx_value_new(NX_VALUE_TYPE_STRING);
 	    val->string = nx_string_clone(hoststr);
 	    ASSERT(val->string != NULL);
-	    nx_logdata_set_field_value(logdata, "Hostname", val);
+	    syslog_set_field(parser, "Hostname", val);
 	}
 	else
 	{ // default hostname will be the IP in recv_from field
 	    // FIXME: hostname can be string only
-	    nx_logdata_set_field_value(logdata, "Hostname", nx_value_clone(NULL, &recv_from));
+	    syslog_set_field(parser, "Hostname", nx_value_clone(NULL, &recv_from));
 	}
     }
 }
@@ -172,7 +309,8 @@ static void set_syslog_hostname(nx_logdata_t *logdata,
 
 
 static const char *parse_syslog_priority(const char *string,
-					 nx_logdata_t *logdata,
+					 nx_syslog_facility_t *facility,
+					 nx_syslog_severity_t *severity,
 					 boolean *retval)
 {
     const char *ptr = string;
@@ -180,10 +318,6 @@ static const char *parse_syslog_priority(const char *string,
     nx_syslog_facility_t fac = NX_SYSLOG_FACILITY_USER;
     nx_syslog_severity_t sev = NX_SYSLOG_SEVERITY_NOTICE;
 
-    nx_value_t *facility = NULL;
-    nx_value_t *severity = NULL;
-    nx_loglevel_t loglevel = NX_LOGLEVEL_INFO;
-
     ASSERT(string != NULL);
 
     // parse priority
@@ -238,23 +372,24 @@ static const char *parse_syslog_priority(const char *string,
     }
 
   badpri:
-    facility = malloc(sizeof(nx_value_t));
-    ASSERT(facility != NULL);
-    facility->type = NX_VALUE_TYPE_INTEGER;
-    facility->defined = TRUE;
-    facility->integer = fac;
-    nx_logdata_set_field_value(logdata, "SyslogFacilityValue", facility);
-    nx_logdata_set_field_value(logdata, "SyslogFacility", 
-			       nx_value_new_string(nx_syslog_facility_to_string(fac)));
-
-    severity = malloc(sizeof(nx_value_t));
-    ASSERT(severity != NULL);
-    severity->integer = sev;
-    severity->type = NX_VALUE_TYPE_INTEGER;
-    severity->defined = TRUE;
-    nx_logdata_set_field_value(logdata, "SyslogSeverityValue", severity);
-    nx_logdata_set_field_value(logdata, "SyslogSeverity", 
-			       nx_value_new_string(nx_syslog_severity_to_string(sev)));
+    *facility = fac;
+    *severity = sev;
+
+    return ( ptr );
+}
+
+
+
+static void set_syslog_priority(nx_syslog_parser_t *parser,
+				nx_syslog_facility_t fac,
+				nx_syslog_severity_t sev)
+{
+    nx_loglevel_t loglevel = NX_LOGLEVEL_INFO;
+
+    syslog_set_integer(parser, "SyslogFacilityValue", fac);
+    syslog_set_cstring(parser, "SyslogFacility", nx_syslog_facility_to_string(fac));
+    syslog_set_integer(parser, "SyslogSeverityValue", sev);
+    syslog_set_cstring(parser, "SyslogSeverity", nx_syslog_severity_to_string(sev));
 
     // normalize syslog severity
     switch ( sev )
@@ -290,116 +425,23 @@ static const char *parse_syslog_priority(const char *string,
 	    loglevel = NX_LOGLEVEL_INFO;
 	    break;
     }
-    nx_logdata_set_integer(logdata, "SeverityValue", loglevel);
-    nx_logdata_set_string(logdata, "Severity", nx_loglevel_to_string(loglevel));
-
-    return ( ptr );
-}
-
-
-
-static void set_syslog_appname(nx_logdata_t *logdata,
-			       const char *start,
-			       const char *end)
-{
-    int len;
-    nx_value_t *application = NULL;
-
-    if ( (start != NULL) && (end != NULL) && (end > start) )
-    {
-	application = malloc(sizeof(nx_value_t));
-	application->type = NX_VALUE_TYPE_STRING;
-	application->defined = TRUE;
-	ASSERT(application != NULL);
-	len = (int) (end - start);
-	application->string = nx_string_create(start, len);
-	nx_logdata_set_field_value(logdata, "SourceName", application);
-    }
-}
-
-
-
-static void set_syslog_timestamp(nx_logdata_t *logdata,
-				 apr_time_t date)
-{
-    nx_value_t *timestamp = NULL;
-
-    timestamp = malloc(sizeof(nx_value_t));
-    ASSERT(timestamp != NULL);
-    timestamp->type = NX_VALUE_TYPE_DATETIME;
-    timestamp->defined = TRUE;
-    timestamp->datetime = date;
-    nx_logdata_set_field_value(logdata, "EventTime", timestamp);
-}
-
-
-
-static void set_syslog_procid(nx_logdata_t *logdata,
-			      const char *start,
-			      const char *end)
-{
-    int len;
-    nx_value_t *procid = NULL;
-
-    if ( (start != NULL) && (end != NULL) && (end > start) )
-    {
-	procid = malloc(sizeof(nx_value_t));
-	procid->type = NX_VALUE_TYPE_STRING;
-	procid->defined = TRUE;
-	ASSERT(procid != NULL);
-	len = (int) (end - start);
-	procid->string = nx_string_create(start, len);
-	nx_logdata_set_field_value(logdata, "ProcessID", procid);
-    }
+    syslog_set_integer(parser, "SeverityValue", loglevel);
+    syslog_set_cstring(parser, "Severity", nx_loglevel_to_string(loglevel));
 }
 
 
 
-static void set_syslog_msgid(nx_logdata_t *logdata,
-			     const char *start,
-			     const char *end)
-{
-    int len;
-    nx_value_t *msgid = NULL;
-
-    if ( (start != NULL) && (end != NULL) && (end > start) )
-    {
-	msgid = malloc(sizeof(nx_value_t));
-	msgid->type = NX_VALUE_TYPE_STRING;
-	msgid->defined = TRUE;
-	ASSERT(msgid != NULL);
-	len = (int) (end - start);
-	msgid->string = nx_string_create(start, len);
-	nx_logdata_set_field_value(logdata, "MessageID", msgid);
-    }
-}
-
-
-
-static void set_syslog_message(nx_logdata_t *logdata,
+static void set_syslog_message(nx_syslog_parser_t *parser,
 			       const char *start,
 			       const char *end)
 {
-    int len;
-    nx_value_t *message = NULL;
-
     if ( (start != NULL) && (end != NULL) && (end > start) )
     {
-	len = (int) (end - start);
-	if ( start[len - 1] == '\n' )
+	if ( end[-1] == '\n' )
 	{
-	    len--;
-	    if ( len == 0 )
-	    {
-		return;
-	    }
+	    end--;
 	}
-	message = malloc(sizeof(nx_value_t));
-	message->type = NX_VALUE_TYPE_STRING;
-	message->defined = TRUE;
-	ASSERT(message != NULL);
-	message->string = nx_string_create(start, len);
-	nx_logdata_set_field_value(logdata, "Message", message);
+	syslog_set_string(parser, "Message", start, end);
     }
 }
 
@@ -409,9 +451,14 @@ static void set_syslog_message(nx_logdata_t *logdata,
 #define IS_TAGCHAR(c) ( ((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'z')) || \
   ((c >= 'A') && (c <= 'Z')) || (c == '_') || (c == '-') || (c == '/') || (c == '.') )
 
-boolean nx_syslog_parse_rfc3164(nx_logdata_t *logdata,
-				const char *string,
-				size_t stringlen)
+/**
+ * The header is scanned once recording where the fields are, these are
+ * then created in one go.
+ */
+static boolean syslog_parse_rfc3164(nx_syslog_parser_t *parser,
+				    const char *string,
+				    size_t stringlen,
+				    nx_date_format_t *dateformat)
 {
     boolean retval = TRUE;
     const char *ptr, *hoststart = NULL, *hostend = NULL;
@@ -421,23 +468,18 @@ boolean nx_syslog_parse_rfc3164(nx_logdata_t *logdata,
     apr_time_t date;
     boolean got_date = FALSE;
     boolean got_pri = FALSE;
-
-    ASSERT(logdata != NULL);
-    ASSERT(string != NULL);
-
-    if ( stringlen <= 0 )
-    {
-	stringlen = strlen(string);
-    }
+    nx_syslog_facility_t fac;
+    nx_syslog_severity_t sev;
 
     msgend = string + stringlen;
-    ptr = parse_syslog_priority(string, logdata, &retval);
+    ptr = parse_syslog_priority(string, &fac, &sev, &retval);
+    set_syslog_priority(parser, fac, sev);
     got_pri = retval;
     msgstart = ptr;
     
-    if ( nx_date_parse(&date, ptr, &ptr) != APR_SUCCESS )
+    if ( nx_date_parse_format(&date, ptr, &ptr, dateformat) != APR_SUCCESS )
     {
-	nx_logdata_set_datetime(logdata, "EventTime", apr_time_now());
+	syslog_set_datetime(parser, "EventTime", syslog_now(parser));
 	for ( appstart = ptr; IS_TAGCHAR(*ptr); ptr++ );
 	append = ptr;
     }
@@ -570,21 +612,43 @@ boolean nx_syslog_parse_rfc3164(nx_logdata_t *logdata,
 	appstart = NULL;
     }
 
-    set_syslog_hostname(logdata, hoststart, hostend);
+    set_syslog_hostname(parser, hoststart, hostend);
     if ( got_date == TRUE )
     {
 	nx_date_fix_year(&date);
-	set_syslog_timestamp(logdata, date);
+	syslog_set_datetime(parser, "EventTime", date);
     }
-    set_syslog_appname(logdata, appstart, append);
-    set_syslog_procid(logdata, pidstart, pidend);
-    set_syslog_message(logdata, msgstart, msgend);
+    syslog_set_string(parser, "SourceName", appstart, append);
+    syslog_set_string(parser, "ProcessID", pidstart, pidend);
+    set_syslog_message(parser, msgstart, msgend);
 
     return ( retval );
 }
 
 
 
+boolean nx_syslog_parse_rfc3164(nx_logdata_t *logdata,
+				const char *string,
+				size_t stringlen,
+				nx_date_format_t *dateformat)
+{
+    nx_syslog_parser_t parser;
+
+    ASSERT(logdata != NULL);
+    ASSERT(string != NULL);
+
+    if ( stringlen <= 0 )
+    {
+	stringlen = strlen(string);
+    }
+
+    syslog_parser_init(&parser, logdata);
+
+    return ( syslog_parse_rfc3164(&parser, string, stringlen, dateformat) );
+}
+
+
+
 static int nx_syslog_get_priority(nx_logdata_t *logdata)
 {
     int retval = 0;
@@ -684,23 +748,25 @@ void nx_logdata_to_syslog_rfc3164(nx_logdata_t *logdata)
     nx_value_t application;
     nx_value_t pid;
     nx_value_t msg;
-    nx_string_t *tmpmsg = NULL;
     size_t len;
     char tmpstr[20];
     int i;
+    nx_scratch_mark_t mark;
 
     ASSERT(logdata != NULL);
     ASSERT(logdata->raw_event != NULL);
 
+    nx_scratch_mark(&mark);
+
     if ( (nx_logdata_get_field_value(logdata, "Message", &msg) == TRUE) &&
 	 (msg.type == NX_VALUE_TYPE_STRING) && (msg.defined == TRUE) )
     {
 	// we have a Message field
     }
     else
-    { // otherwise use raw_event
-	tmpmsg = nx_string_clone(logdata->raw_event);
-	msg.string = tmpmsg;
+    { // otherwise use a copy of raw_event, it is overwritten below
+	msg.string = nx_scratch_string();
+	nx_string_append(msg.string, logdata->raw_event->buf, (int) logdata->raw_event->len);
 	msg.type = NX_VALUE_TYPE_STRING;
     }
 
@@ -776,15 +842,12 @@ void nx_logdata_to_syslog_rfc3164(nx_logdata_t *logdata)
 	}
     }
 
-    if (tmpmsg != NULL)
-    { // clean up temp copy
-	nx_string_free(tmpmsg);
-    }
+    nx_scratch_release(&mark);
 }
 
 
 
-static const char *syslog_parse_sd_params(nx_logdata_t *logdata,
+static const char *syslog_parse_sd_params(nx_syslog_parser_t *parser,
 					  const char *sd_name,
 					  size_t sd_namelen,
 					  const char *string)
@@ -793,7 +856,10 @@ static const char *syslog_parse_sd_params(nx_logdata_t *logdata,
     char param_name[80];
     const char *ptr = string;
     int i;
+    size_t len;
+    size_t valuelen;
     nx_value_t *value;
+    boolean wanted;
 
     if ( sd_namelen > 0 )
     {
@@ -843,32 +909,57 @@ static const char *syslog_parse_sd_params(nx_logdata_t *logdata,
 	}
 	ptr++;
 
-	param_value = nx_string_new_size(50);
-
-	// parse param-value
-	for ( i = 0; *ptr != '\0'; i++, ptr++ )
+	// parse param-value, the runs between the escapes are copied at once
+	param_value = NULL;
+	valuelen = 0;
+	wanted = syslog_wants(parser, param_name);
+	for ( ; ; )
 	{
 	    //FIXME: this needs to be utf-8 aware
-	    if ( *ptr == '\\' )
-	    {
-		if ( (ptr[1] == '\\') || (ptr[1] == '"') || (ptr[1] == ']') )
+	    len = strcspn(ptr, "\\\"");
+	    if ( valuelen + len >= 1024*64 )
+	    { // 64K limit
+		if ( param_value != NULL )
 		{
-		    ptr++;
-		    nx_string_append(param_value, ptr, 1);
+		    nx_string_free(param_value);
 		}
+		return ( NULL );
+	    }
+	    if ( wanted == FALSE )
+	    { // only scanned
 	    }
-	    else if ( *ptr == '"' )
+	    else if ( param_value == NULL )
 	    {
-		break;
+		param_value = nx_string_create(ptr, (int) len);
 	    }
-	    else
+	    else if ( len > 0 )
 	    {
-		nx_string_append(param_value, ptr, 1);
+		nx_string_append(param_value, ptr, (int) len);
 	    }
-	    if ( param_value->len >= 1024*64 )
-	    { // 64K limit
-		nx_string_free(param_value);
-		return ( NULL );
+	    valuelen += len;
+	    ptr += len;
+
+	    if ( *ptr != '\\' )
+	    {
+		break;
+	    }
+	    ptr++;
+	    if ( (*ptr == '\\') || (*ptr == '"') || (*ptr == ']') )
+	    {
+		if ( valuelen + 1 >= 1024*64 )
+		{
+		    if ( param_value != NULL )
+		    {
+			nx_string_free(param_value);
+		    }
+		    return ( NULL );
+		}
+		if ( wanted == TRUE )
+		{
+		    nx_string_append(param_value, ptr, 1);
+		}
+		valuelen++;
+		ptr++;
 	    }
 	}
 
@@ -881,9 +972,12 @@ static const char *syslog_parse_sd_params(nx_logdata_t *logdata,
 	    return ( NULL );
 	}
 
-	value = nx_value_new(NX_VALUE_TYPE_STRING);
-	value->string = param_value;
-	nx_logdata_set_field_value(logdata, param_name, value);
+	if ( wanted == TRUE )
+	{
+	    value = nx_value_new(NX_VALUE_TYPE_STRING);
+	    value->string = param_value;
+	    syslog_set_field(parser, param_name, value);
+	}
     }
     
     return ( ptr );
@@ -891,7 +985,7 @@ static const char *syslog_parse_sd_params(nx_logdata_t *logdata,
 
 
 
-static const char *syslog_parse_structured_data(nx_logdata_t *logdata, const char *string)
+static const char *syslog_parse_structured_data(nx_syslog_parser_t *parser, const char *string)
 {
     const char *ptr = string;
     char sd_name[40];
@@ -951,7 +1045,7 @@ static const char *syslog_parse_structured_data(nx_logdata_t *logdata, const cha
 	    sd_namelen = 0;
 	}
 
-	if ( (ptr = syslog_parse_sd_params(logdata, sd_name, (size_t) sd_namelen, ptr)) == NULL )
+	if ( (ptr = syslog_parse_sd_params(parser, sd_name, (size_t) sd_namelen, ptr)) == NULL )
 	{
 	    return ( string );
 	}
@@ -969,10 +1063,37 @@ static const char *syslog_parse_structured_data(nx_logdata_t *logdata, const cha
 
 #define IS_NILVALUE(PTR) ((PTR[0] == '-') && ((PTR[1] == ' ') || (PTR[1] == '\0')))
 
+/**
+ * Find the end of a header field, start is NULL for the NILVALUE
+ */
+static const char *syslog_header_field(const char *ptr,
+				       const char **start,
+				       const char **end)
+{
+    *start = NULL;
+    *end = NULL;
+    if ( IS_NILVALUE(ptr) )
+    {
+	ptr++;
+    }
+    else
+    {
+	*start = ptr;
+	for ( ; (*ptr != ' ') && (*ptr != '\0'); ptr++ );
+	*end = ptr;
+    }
+    for ( ; *ptr == ' '; ptr++ ); // skip space
+
+    return ( ptr );
+}
+
+
+
 // PRI VERSION SP TIMESTAMP SP HOSTNAME SP APP-NAME SP PROCID SP MSGID SP STRUCTURED-DATA [SP MSG]
-boolean nx_syslog_parse_rfc5424(nx_logdata_t *logdata,
-				const char *string,
-				size_t stringlen)
+static boolean syslog_parse_rfc5424(nx_syslog_parser_t *parser,
+				    const char *string,
+				    size_t stringlen,
+				    nx_date_format_t *dateformat)
 {
     boolean retval = TRUE;
     const char *ptr, *hoststart = NULL, *hostend = NULL;
@@ -981,124 +1102,223 @@ boolean nx_syslog_parse_rfc5424(nx_logdata_t *logdata,
     const char *procidstart = NULL, *procidend = NULL;
     const char *msgidstart = NULL, *msgidend = NULL;
     apr_time_t date = 0;
-
-    ASSERT(logdata != NULL);
-    ASSERT(string != NULL);
-
-    if ( stringlen <= 0 )
-    {
-	stringlen = strlen(string);
-    }
+    boolean got_date = FALSE;
+    nx_syslog_facility_t fac;
+    nx_syslog_severity_t sev;
 
     msgend = string + stringlen;
     // PRIORITY
-    ptr = parse_syslog_priority(string, logdata, &retval);
+    ptr = parse_syslog_priority(string, &fac, &sev, &retval);
     if ( (ptr[0] == '1') && (ptr[1] == ' ') )
     { // VERSION
 	ptr += 2;
     }
     else
     { // fall back to bsd syslog
-	return ( nx_syslog_parse_rfc3164(logdata, string, stringlen) );
+	return ( syslog_parse_rfc3164(parser, string, stringlen, dateformat) );
     }
+    set_syslog_priority(parser, fac, sev);
     msgstart = ptr;
 
     // TIMESTAMP
     if ( IS_NILVALUE(ptr) )
     {
-	nx_logdata_set_datetime(logdata, "EventTime", apr_time_now());
 	ptr++;
     }
     else
     {
 	if ( nx_date_parse_iso(&date, ptr, &ptr) != APR_SUCCESS )
 	{
-	    nx_logdata_set_datetime(logdata, "EventTime", apr_time_now());
-	    set_syslog_hostname(logdata, NULL, NULL);
-	    set_syslog_message(logdata, msgstart, msgend);
+	    syslog_set_datetime(parser, "EventTime", syslog_now(parser));
+	    set_syslog_hostname(parser, NULL, NULL);
+	    set_syslog_message(parser, msgstart, msgend);
 	    return ( FALSE );
 	}
-	set_syslog_timestamp(logdata, date);
+	got_date = TRUE;
     }
     for ( ; *ptr == ' '; ptr++ ); // skip space
 
-    // HOSTNAME
+    ptr = syslog_header_field(ptr, &hoststart, &hostend);
+    ptr = syslog_header_field(ptr, &appstart, &append);
+    ptr = syslog_header_field(ptr, &procidstart, &procidend);
+    ptr = syslog_header_field(ptr, &msgidstart, &msgidend);
+
+    syslog_set_datetime(parser, "EventTime", (got_date == TRUE) ? date : syslog_now(parser));
+    set_syslog_hostname(parser, hoststart, hostend);
+    syslog_set_string(parser, "SourceName", appstart, append);
+    syslog_set_string(parser, "ProcessID", procidstart, procidend);
+    syslog_set_string(parser, "MessageID", msgidstart, msgidend);
+
+    // STRUCTURED-DATA
     if ( IS_NILVALUE(ptr) )
     {
 	ptr++;
-	set_syslog_hostname(logdata, NULL, NULL);
     }
     else
     {
-	hoststart = ptr;
-	for ( ; (*ptr != ' ') && (*ptr != '\0'); ptr++ );
-	hostend = ptr;
-	set_syslog_hostname(logdata, hoststart, hostend);
+	ptr = syslog_parse_structured_data(parser, ptr);
     }
-    for ( ; *ptr == ' '; ptr++ ); // skip space
+    if ( *ptr == ' ' ) ptr++; // skip space
 
-    // APP-NAME
-    if ( IS_NILVALUE(ptr) )
-    {
-	ptr++;
+    // MESSAGE
+    if ( (ptr[0] == 0xEF) && (ptr[1] == 0xBB) && (ptr[2] == 0xBF) )
+    { //Skip UTF8 BOM
+	ptr += 3;
     }
-    else
+    msgstart = ptr;
+    set_syslog_message(parser, msgstart, msgend);
+
+    return ( retval );
+}
+
+
+
+boolean nx_syslog_parse_rfc5424(nx_logdata_t *logdata,
+				const char *string,
+				size_t stringlen,
+				nx_date_format_t *dateformat)
+{
+    nx_syslog_parser_t parser;
+
+    ASSERT(logdata != NULL);
+    ASSERT(string != NULL);
+
+    if ( stringlen <= 0 )
     {
-	appstart = ptr;
-	for ( ; (*ptr != ' ') && (*ptr != '\0'); ptr++ );
-	append = ptr;
-	set_syslog_appname(logdata, appstart, append);
+	stringlen = strlen(string);
     }
-    for ( ; *ptr == ' '; ptr++ ); // skip space
 
-    // PROCID
-    if ( IS_NILVALUE(ptr) )
+    syslog_parser_init(&parser, logdata);
+
+    return ( syslog_parse_rfc5424(&parser, string, stringlen, dateformat) );
+}
+
+
+
+static void syslog_lazy_parse(nx_logdata_t *logdata, nx_logdata_lazy_t *lazy)
+{
+    nx_syslog_lazy_t *data = (nx_syslog_lazy_t *) lazy->data;
+    nx_syslog_parser_t parser;
+
+    syslog_parser_init(&parser, logdata);
+    parser.now = lazy->time;
+    if ( data->ietf == TRUE )
     {
-	ptr++;
+	syslog_parse_rfc5424(&parser, lazy->src, lazy->len, &(data->dateformat));
     }
     else
     {
-	procidstart = ptr;
-	for ( ; (*ptr != ' ') && (*ptr != '\0'); ptr++ );
-	procidend = ptr;
-	set_syslog_procid(logdata, procidstart, procidend);
+	syslog_parse_rfc3164(&parser, lazy->src, lazy->len, &(data->dateformat));
     }
-    for ( ; *ptr == ' '; ptr++ ); // skip space
+}
 
-    // MSGID
-    if ( IS_NILVALUE(ptr) )
+
+
+/**
+ * Run the parse for a single field, this only scans the header and the
+ * structured data without creating the other values.
+ */
+static nx_logdata_lazy_result_t syslog_lazy_get(nx_logdata_t *logdata,
+						nx_logdata_lazy_t *lazy,
+						const char *key,
+						nx_logdata_field_t **field)
+{
+    nx_syslog_lazy_t *data = (nx_syslog_lazy_t *) lazy->data;
+    nx_syslog_parser_t parser;
+
+    parser.logdata = logdata;
+    parser.keys = 0;
+    parser.now = lazy->time;
+    parser.lookup = key;
+    parser.found = NULL;
+    if ( data->ietf == TRUE )
     {
-	ptr++;
+	syslog_parse_rfc5424(&parser, lazy->src, lazy->len, &(data->dateformat));
     }
     else
     {
-	msgidstart = ptr;
-	for ( ; (*ptr != ' ') && (*ptr != '\0'); ptr++ );
-	msgidend = ptr;
-	set_syslog_msgid(logdata, msgidstart, msgidend);
+	syslog_parse_rfc3164(&parser, lazy->src, lazy->len, &(data->dateformat));
     }
-    for ( ; *ptr == ' '; ptr++ ); // skip space
 
-    // STRUCTURED-DATA
-    if ( IS_NILVALUE(ptr) )
+    if ( parser.found == NULL )
     {
-	ptr++;
+	return ( NX_LOGDATA_LAZY_ABSENT );
     }
-    else
+    *field = parser.found;
+
+    return ( NX_LOGDATA_LAZY_FOUND );
+}
+
+
+
+/**
+ * Parse the BSD timestamp so that the format recognized is remembered in
+ * dateformat for the next message like with the eager parse. The IETF
+ * timestamp is always ISO and doesn't use it.
+ */
+static void syslog_update_date_format(const char *string,
+				      boolean ietf,
+				      nx_date_format_t *dateformat)
+{
+    const char *ptr;
+    apr_time_t date;
+    boolean retval = TRUE;
+    nx_syslog_facility_t fac;
+    nx_syslog_severity_t sev;
+
+    ptr = parse_syslog_priority(string, &fac, &sev, &retval);
+    if ( (ietf == TRUE) && (ptr[0] == '1') && (ptr[1] == ' ') )
     {
-	ptr = syslog_parse_structured_data(logdata, ptr);
+	return;
     }
-    if ( *ptr == ' ' ) ptr++; // skip space
+    nx_date_parse_format(&date, ptr, &ptr, dateformat);
+}
 
-    // MESSAGE
-    if ( (ptr[0] == 0xEF) && (ptr[1] == 0xBB) && (ptr[2] == 0xBF) )
-    { //Skip UTF8 BOM
-	ptr += 3;
+
+
+/**
+ * Same as nx_syslog_parse_rfc5424() or nx_syslog_parse_rfc3164() but the
+ * parse is deferred until the fields are accessed. Looking up a field only
+ * extracts that one.
+ */
+void nx_syslog_parse_lazy(nx_logdata_t *logdata,
+			  const char *string,
+			  size_t stringlen,
+			  nx_date_format_t *dateformat,
+			  boolean ietf)
+{
+    nx_syslog_lazy_t data;
+
+    ASSERT(logdata != NULL);
+    ASSERT(string != NULL);
+
+    if ( stringlen <= 0 )
+    {
+	stringlen = strlen(string);
     }
-    msgstart = ptr;
-    set_syslog_message(logdata, msgstart, msgend);
 
-    return ( retval );
+    if ( nx_logdata_lazy_allowed(string, stringlen) == FALSE )
+    {
+	if ( ietf == TRUE )
+	{
+	    nx_syslog_parse_rfc5424(logdata, string, stringlen, dateformat);
+	}
+	else
+	{
+	    nx_syslog_parse_rfc3164(logdata, string, stringlen, dateformat);
+	}
+	return;
+    }
+
+    // the deferred parse sees the format as it was before this message
+    data.dateformat = (dateformat == NULL) ? NX_DATE_FORMAT_UNKNOWN : *dateformat;
+    data.ietf = ietf;
+    if ( dateformat != NULL )
+    {
+	syslog_update_date_format(string, ietf, dateformat);
+    }
+    nx_logdata_set_lazy(logdata, syslog_lazy_parse, syslog_lazy_get,
+			&data, sizeof(nx_syslog_lazy_t), string, stringlen);
 }
 
 
@@ -1130,10 +1350,11 @@ static void nx_syslog_add_structured_data(nx_logdata_t *logdata)
     };
     boolean ignore;
 
-    sd = nx_string_new();
+    sd = nx_scratch_string();
 
     nx_string_append(sd, "[NXLOG@14506 ", -1);
 
+    nx_logdata_materialize(logdata);
     for ( field = NX_DLIST_FIRST(&(logdata->fields));
 	  field != NULL;
 	  field = NX_DLIST_NEXT(field, link) )
@@ -1185,9 +1406,8 @@ static void nx_syslog_add_structured_data(nx_logdata_t *logdata)
 	    }
 	    else
 	    {
-		value = nx_value_to_string(field->value);
+		value = nx_value_to_scratch_string(field->value);
 		nx_string_append(sd, value, -1);
-		free(value);
 	    }
 	    nx_string_append(sd, "\"", 1);
 	}
@@ -1203,7 +1423,6 @@ static void nx_syslog_add_structured_data(nx_logdata_t *logdata)
     {
 	nx_string_append(logdata->raw_event, "-", 1);
     }
-    nx_string_free(sd);
 }
 
 
@@ -1217,13 +1436,15 @@ void nx_logdata_to_syslog_rfc5424(nx_logdata_t *logdata, boolean gmt)
     nx_value_t messageid;
     nx_value_t pid;
     nx_value_t msg;
-    nx_string_t *tmpmsg = NULL;
     size_t len;
     char tmpstr[33];
     int i;
+    nx_scratch_mark_t mark;
 
     ASSERT(logdata != NULL);
     ASSERT(logdata->raw_event != NULL);
+
+    nx_scratch_mark(&mark);
     
     if ( (nx_logdata_get_field_value(logdata, "Message", &msg) == TRUE) &&
 	 (msg.type == NX_VALUE_TYPE_STRING) && (msg.defined == TRUE) )
@@ -1231,9 +1452,9 @@ void nx_logdata_to_syslog_rfc5424(nx_logdata_t *logdata, boolean gmt)
 	// we have a Message field
     }
     else
-    { // otherwise use raw_event
-	tmpmsg = nx_string_clone(logdata->raw_event);
-	msg.string = tmpmsg;
+    { // otherwise use a copy of raw_event, it is overwritten below
+	msg.string = nx_scratch_string();
+	nx_string_append(msg.string, logdata->raw_event->buf, (int) logdata->raw_event->len);
 	msg.type = NX_VALUE_TYPE_STRING;
     }
 
@@ -1332,10 +1553,7 @@ void nx_logdata_to_syslog_rfc5424(nx_logdata_t *logdata, boolean gmt)
 	}
     }
 
-    if (tmpmsg != NULL)
-    { // clean up temp copy
-	nx_string_free(tmpmsg);
-    }
+    nx_scratch_release(&mark);
 }
 
 
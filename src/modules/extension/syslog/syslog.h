@@ -10,6 +10,7 @@
 
 #include "types.h"
 #include "logdata.h"
+#include "date.h"
 
 // real + 1
 typedef enum nx_syslog_facility_t
@@ -61,10 +62,17 @@ nx_syslog_severity_t nx_syslog_severity_from_string(const char *str);
 const char *nx_syslog_severity_to_string(nx_syslog_severity_t severity);
 boolean nx_syslog_parse_rfc3164(nx_logdata_t *logdata,
 				const char *string,
-				size_t stringlen);
+				size_t stringlen,
+				nx_date_format_t *dateformat);
 boolean nx_syslog_parse_rfc5424(nx_logdata_t *logdata,
 				const char *string,
-				size_t stringlen);
+				size_t stringlen,
+				nx_date_format_t *dateformat);
+void nx_syslog_parse_lazy(nx_logdata_t *logdata,
+			  const char *string,
+			  size_t stringlen,
+			  nx_date_format_t *dateformat,
+			  boolean ietf);
 void nx_logdata_to_syslog_rfc3164(nx_logdata_t *logdata);
 void nx_logdata_to_syslog_rfc5424(nx_logdata_t *logdata, boolean gmt);
 void nx_logdata_to_syslog_snare(nx_logdata_t *logdata,
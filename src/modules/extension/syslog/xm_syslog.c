@@ -328,6 +328,10 @@ static void xm_syslog_config(nx_module_t *module UNUSED)
 	{
 	    nx_cfg_get_boolean(curr, "IETFTimestampInGMT", &(modconf->ietftimestampingmt));
 	}
+	else if ( strcasecmp(curr->directive, "LazyParse") == 0 )
+	{
+	    nx_cfg_get_boolean(curr, "LazyParse", &(modconf->lazyparse));
+	}
 	else
 	{
 	    nx_conf_error(curr, "invalid keyword: %s", curr->directive);
@@ -14,6 +14,7 @@ typedef struct nx_xm_syslog_conf_t
     char snaredelimiter;
     char snarereplacement;
     boolean ietftimestampingmt;
+    boolean lazyparse;		///< defer parse_syslog*() until the fields are accessed
 } nx_xm_syslog_conf_t;
 
 #endif	/* __NX_XM_SYSLOG_H */
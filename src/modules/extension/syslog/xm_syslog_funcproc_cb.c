@@ -13,6 +13,42 @@
 
 #define NX_LOGMODULE NX_LOGMODULE_CORE
 
+// remember the timestamp format per calling module
+#define NX_SYSLOG_DATE_FORMAT(eval_ctx) \
+    (((eval_ctx)->module == NULL) ? NULL : &((eval_ctx)->module->date_format))
+
+
+
+static void syslog_parse(nx_expr_eval_ctx_t *eval_ctx,
+			 nx_module_t *module,
+			 const nx_string_t *string,
+			 boolean ietf)
+{
+    nx_xm_syslog_conf_t *modconf;
+
+    ASSERT(module != NULL);
+    modconf = (nx_xm_syslog_conf_t *) module->config;
+    ASSERT(modconf != NULL);
+
+    if ( modconf->lazyparse == TRUE )
+    {
+	nx_syslog_parse_lazy(eval_ctx->logdata, string->buf, string->len,
+			     NX_SYSLOG_DATE_FORMAT(eval_ctx), ietf);
+    }
+    else if ( ietf == TRUE )
+    {
+	nx_syslog_parse_rfc5424(eval_ctx->logdata, string->buf, string->len,
+				NX_SYSLOG_DATE_FORMAT(eval_ctx));
+    }
+    else
+    {
+	nx_syslog_parse_rfc3164(eval_ctx->logdata, string->buf, string->len,
+				NX_SYSLOG_DATE_FORMAT(eval_ctx));
+    }
+}
+
+
+
 void nx_expr_func__syslog_facility_value(nx_expr_eval_ctx_t *eval_ctx UNUSED,
 					 nx_module_t *module UNUSED,
 					 nx_value_t *retval,
@@ -122,7 +158,7 @@ void nx_expr_func__syslog_severity_string(nx_expr_eval_ctx_t *eval_ctx UNUSED,
 
 
 void nx_expr_proc__parse_syslog_ietf(nx_expr_eval_ctx_t *eval_ctx,
-				     nx_module_t *module UNUSED,
+				     nx_module_t *module,
 				     nx_expr_list_t *args)
 {
     nx_expr_list_elem_t *arg;
@@ -147,7 +183,7 @@ void nx_expr_proc__parse_syslog_ietf(nx_expr_eval_ctx_t *eval_ctx,
 	    nx_value_kill(&value);
 	    throw_msg("string type required for source string");
 	}
-	nx_syslog_parse_rfc5424(eval_ctx->logdata, value.string->buf, value.string->len);
+	syslog_parse(eval_ctx, module, value.string, TRUE);
 	nx_value_kill(&value);
     }
     else
@@ -164,7 +200,7 @@ void nx_expr_proc__parse_syslog_ietf(nx_expr_eval_ctx_t *eval_ctx,
 	{
 	    throw_msg("string type required for field 'raw_event'");
 	}
-	nx_syslog_parse_rfc5424(eval_ctx->logdata, value.string->buf, value.string->len);
+	syslog_parse(eval_ctx, module, value.string, TRUE);
     }
 }
 
@@ -180,7 +216,7 @@ void nx_expr_proc__parse_syslog(nx_expr_eval_ctx_t *eval_ctx,
 
 
 void nx_expr_proc__parse_syslog_bsd(nx_expr_eval_ctx_t *eval_ctx,
-				    nx_module_t *module UNUSED,
+				    nx_module_t *module,
 				    nx_expr_list_t *args)
 {
     nx_expr_list_elem_t *arg;
@@ -205,7 +241,7 @@ void nx_expr_proc__parse_syslog_bsd(nx_expr_eval_ctx_t *eval_ctx,
 	    nx_value_kill(&value);
 	    throw_msg("string type required for source string");
 	}
-	nx_syslog_parse_rfc3164(eval_ctx->logdata, value.string->buf, value.string->len);
+	syslog_parse(eval_ctx, module, value.string, FALSE);
 	nx_value_kill(&value);
     }
     else
@@ -222,7 +258,7 @@ void nx_expr_proc__parse_syslog_bsd(nx_expr_eval_ctx_t *eval_ctx,
 	{
 	    throw_msg("string type required for field 'raw_event'");
 	}
-	nx_syslog_parse_rfc3164(eval_ctx->logdata, value.string->buf, value.string->len);
+	syslog_parse(eval_ctx, module, value.string, FALSE);
     }
 }
 
@@ -6,6 +6,7 @@
  */
 
 #include "../../../common/module.h"
+#include "../../../common/alloc.h"
 #include "xml.h"
 
 #include <expat.h>
@@ -189,12 +190,15 @@ nx_string_t *nx_logdata_to_xml(nx_xml_parser_ctx_t *ctx)
     int i, start;
     char *value;
     char intstr[32];
+    nx_scratch_mark_t mark;
 
     ASSERT(ctx->logdata != NULL);
 
     //retval = nx_string_create("<?xml version=\"1.0\" encoding=\"UTF-8\"?><event>", 45);
     retval = nx_string_create("<Event>", 7);
 
+    nx_logdata_materialize(ctx->logdata);
+    nx_scratch_mark(&mark);
     for ( field = NX_DLIST_FIRST(&(ctx->logdata->fields));
 	  field != NULL;
 	  field = NX_DLIST_NEXT(field, link) )
@@ -297,9 +301,8 @@ nx_string_t *nx_logdata_to_xml(nx_xml_parser_ctx_t *ctx)
 		    break;
 		default:
 		    //TODO: escape?
-		    value = nx_value_to_string(field->value);
+		    value = nx_value_to_scratch_string(field->value);
 		    nx_string_append(retval, value, -1);
-		    free(value);
 		    break;
 	    }
 	    nx_string_append(retval, "</", 2);
@@ -308,6 +311,8 @@ nx_string_t *nx_logdata_to_xml(nx_xml_parser_ctx_t *ctx)
 	}
     }
 
+    nx_scratch_release(&mark);
+
     nx_string_append(retval, "</Event>", 8);
 
     return ( retval );
@@ -22,7 +22,8 @@
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
 
 #define IM_FILE_DEFAULT_POLL_INTERVAL 1 /* The number of seconds to check the files for new data */
-#define IM_FILE_MAX_READ 50                /* The max number of logs to read in a single iteration */
+#define IM_FILE_READ_BUDGET (APR_USEC_PER_SEC / 100) /* The max time to spend reading in a single iteration */
+#define IM_FILE_BUDGET_CHECK 16         /* Check the time after reading this many logs */
 #define IM_FILE_DEFAULT_ACTIVE_FILES 10 /* The number of files which will be open at a time */
 #define MAX_LINENUMBER_SIZE ~(sizeof(int64_t) * 8 - 1)
 
@@ -36,6 +37,51 @@ static void im_file_linenumber_recorder(nx_im_file_conf_t *imconf, nx_logdata_t
     nx_logdata_set_integer(logdata, "LineNumber", imconf->currsrc->current_line_number);
 }
 
+/* record the position after this event for delivery acknowledgement */
+static void im_file_ack_track(nx_im_file_input_t *file, nx_logdata_t *logdata) {
+    if ((file->ack == NULL) || (file->input == NULL)) {
+        return;
+    }
+    nx_ack_source_track(file->ack, logdata, (int64_t) (file->readpos - file->input->buflen),
+                        file->current_line_number);
+}
+
+/* start tracking from the current position, events in flight keep the old source alive */
+static void im_file_ack_reset(nx_im_file_conf_t *imconf, nx_im_file_input_t *file) {
+    if (imconf->saveposonack != TRUE) {
+        return;
+    }
+    if (file->ack != NULL) {
+        nx_ack_source_free(file->ack);
+    }
+    file->ack = nx_ack_source_new(NX_ACK_DEFAULT_WINDOW, (int64_t) file->filepos,
+                                  file->current_line_number);
+}
+
+/* store the position in the config cache, the acknowledged one with SavePosOnAck */
+static void im_file_save_position(nx_module_t *module, nx_im_file_input_t *file) {
+    int64_t filepos;
+    int64_t linenumber;
+
+    if (file->ack != NULL) {
+        nx_ack_source_committed(file->ack, &filepos, &linenumber);
+    } else {
+        filepos = (int64_t) file->filepos;
+        linenumber = file->current_line_number;
+    }
+    // only updates the in-memory cache, it is persisted by the periodic checkpoint
+    nx_config_cache_set_int(module->name, file->name, (int) filepos);
+    nx_config_cache_set_int(module->name, file->line_number_key_name, linenumber);
+}
+
+static void im_file_input_destroy(nx_im_file_input_t *file) {
+    if (file->ack != NULL) {
+        nx_ack_source_free(file->ack);
+        file->ack = NULL;
+    }
+    apr_pool_destroy(file->pool);
+}
+
 static void im_file_input_close(nx_module_t *module, nx_im_file_input_t *file) {
     nx_im_file_conf_t *imconf;
 
@@ -58,6 +104,7 @@ static void im_file_input_close(nx_module_t *module, nx_im_file_input_t *file) {
             }
             file->current_line_number = file->current_line_number + 1;
             nx_logdata_set_integer(logdata, "LineNumber", file->current_line_number);
+            im_file_ack_track(file, logdata);
             nx_module_add_logdata_input(module, file->input, logdata);
         }
     }
@@ -146,6 +193,7 @@ static void im_file_fill_buffer(nx_module_t *module, nx_im_file_input_t *file, b
     }
 
     input->buflen += (int) len;
+    file->readpos += (apr_off_t) len;
     ASSERT(input->buflen <= input->bufsize);
 }
 
@@ -297,6 +345,14 @@ static boolean im_file_input_open(nx_module_t *module,
 
                 (*file)->num_eof = 0;
 
+                if (opened == TRUE) {
+                    (*file)->readpos = (*file)->filepos;
+                    if (((*file)->ack == NULL) || ((*file)->filepos < (*file)->ack->committed)) {
+                        // first open, or the file was truncated/rotated in the meantime
+                        im_file_ack_reset(imconf, *file);
+                    }
+                }
+
                 if (opened == TRUE) {
                     if (imconf->num_open_files > imconf->active_files) {
                         log_debug("maximum number (>%d) of files open, closing current", imconf->active_files);
@@ -324,7 +380,7 @@ static boolean im_file_input_open(nx_module_t *module,
                     apr_hash_set(imconf->files, (*file)->name, APR_HASH_KEY_STRING, NULL);
                     nx_config_cache_remove(module->name, (*file)->name);
                     im_file_input_close(module, *file);
-                    apr_pool_destroy((*file)->pool);
+                    im_file_input_destroy(*file);
                     *file = NULL;
                 }
             } else {
@@ -476,7 +532,7 @@ static boolean im_file_check_file(nx_module_t *module,
                 nx_config_cache_remove(module->name, (*file)->name);
                 nx_config_cache_remove(module->name, (*file)->line_number_key_name);
                 im_file_input_close(module, *file);
-                apr_pool_destroy((*file)->pool);
+                im_file_input_destroy(*file);
                 *file = NULL;
             }
         } else {
@@ -653,7 +709,7 @@ static boolean im_file_add_file(nx_module_t *module,
                 file->filepos = dupe->filepos; // do not read the contents again
                 apr_hash_set(imconf->files, dupe->name, APR_HASH_KEY_STRING, NULL);
                 im_file_input_close(module, dupe);
-                apr_pool_destroy(dupe->pool);
+                im_file_input_destroy(dupe);
             }
         }
 
@@ -679,7 +735,7 @@ static boolean im_file_add_file(nx_module_t *module,
                 apr_hash_set(imconf->files, fname2, keylen, NULL);
                 if (file != NULL) {
                     im_file_input_close(module, file);
-                    apr_pool_destroy(file->pool);
+                    im_file_input_destroy(file);
                 }
             }
         }
@@ -913,6 +969,9 @@ static void im_file_read(nx_module_t *module) {
     boolean got_data;
     int evcnt = 0;
     nx_im_file_input_t *file;
+    apr_time_t started;
+    int next_check = IM_FILE_BUDGET_CHECK;
+    boolean budget_spent = FALSE;
 
     ASSERT(module != NULL);
     imconf = (nx_im_file_conf_t *) module->config;
@@ -935,10 +994,20 @@ static void im_file_read(nx_module_t *module) {
         }
     }
 
-    for (evcnt = 0; evcnt < IM_FILE_MAX_READ;) {
+    // yield after a time budget rather than a number of events so that
+    // large events or slow input readers don't hold the worker for long
+    started = apr_time_now();
+    for (evcnt = 0; ;) {
         if (nx_module_get_status(module) != NX_MODULE_STATUS_RUNNING) {
             break;
         }
+        if (evcnt >= next_check) {
+            if (apr_time_now() - started >= IM_FILE_READ_BUDGET) {
+                budget_spent = TRUE;
+                break;
+            }
+            next_check = evcnt + IM_FILE_BUDGET_CHECK;
+        }
 
         if (imconf->currsrc == NULL) {
             break;
@@ -950,16 +1019,20 @@ static void im_file_read(nx_module_t *module) {
                     imconf->currsrc->input, imconf->currsrc->input->inputfunc->data)) != NULL) {
             //log_info("read: [%s]", logdata->raw_event->buf);
             im_file_linenumber_recorder(imconf, logdata);
+            im_file_ack_track(imconf->currsrc, logdata);
             nx_module_add_logdata_input(module, imconf->currsrc->input, logdata);
             got_data = TRUE;
             evcnt++;
         } else { // buffer was empty (or couldn't read a full record)
             im_file_input_get_filepos(module, imconf->currsrc);
 
-            nx_config_cache_set_int(module->name, imconf->currsrc->name,
-                                    (int) imconf->currsrc->filepos);
-            nx_config_cache_set_int(module->name, imconf->currsrc->line_number_key_name,
-                                    imconf->currsrc->current_line_number);
+            if (imconf->savepos == TRUE) {
+                im_file_save_position(module, imconf->currsrc);
+            }
+            if (imconf->currsrc->ack != NULL) {
+                // events from the next buffer go into a new batch
+                nx_ack_source_seal(imconf->currsrc->ack);
+            }
             im_file_fill_buffer(module, imconf->currsrc, &got_eof);
             //log_info("set config cache filepos: %ld", imconf->currsrc->filepos);
             if (imconf->currsrc == NULL) {
@@ -969,6 +1042,7 @@ static void im_file_read(nx_module_t *module) {
                 (logdata = imconf->currsrc->input->inputfunc->func(
                         imconf->currsrc->input, imconf->currsrc->input->inputfunc->data)) != NULL) {
                 im_file_linenumber_recorder(imconf, logdata);
+                im_file_ack_track(imconf->currsrc, logdata);
                 nx_module_add_logdata_input(module, imconf->currsrc->input, logdata);
                 got_data = TRUE;
                 evcnt++;
@@ -997,6 +1071,7 @@ static void im_file_read(nx_module_t *module) {
                         if ((logdata = file->input->inputfunc->flush(file->input,
                                                                      file->input->inputfunc->data)) != NULL) {
                             im_file_linenumber_recorder(imconf, logdata);
+                            im_file_ack_track(file, logdata);
                             nx_module_add_logdata_input(module, file->input, logdata);
                             evcnt++;
                         }
@@ -1021,7 +1096,7 @@ static void im_file_read(nx_module_t *module) {
 
         //log_debug("evcnt: %d", evcnt);
 
-        if (evcnt < IM_FILE_MAX_READ) {
+        if (budget_spent == FALSE) {
             if (evcnt == 0) {
                 delayed = TRUE;
             }
@@ -1079,6 +1154,7 @@ static void im_file_config(nx_module_t *module) {
                 nx_conf_error(curr, "invalid expression in 'File', string type required");
             }
         } else if (strcasecmp(curr->directive, "savepos") == 0) {
+        } else if (strcasecmp(curr->directive, "SavePosOnAck") == 0) {
         } else if (strcasecmp(curr->directive, "recursive") == 0) {
         } else if (strcasecmp(curr->directive, "RenameCheck") == 0) {
         } else if (strcasecmp(curr->directive, "CloseWhenIdle") == 0) {
@@ -1120,6 +1196,12 @@ static void im_file_config(nx_module_t *module) {
     imconf->savepos = TRUE;
     nx_cfg_get_boolean(module->directives, "savepos", &(imconf->savepos));
 
+    imconf->saveposonack = FALSE;
+    nx_cfg_get_boolean(module->directives, "SavePosOnAck", &(imconf->saveposonack));
+    if (imconf->savepos != TRUE) {
+        imconf->saveposonack = FALSE;
+    }
+
     imconf->readfromlast = TRUE;
     nx_cfg_get_boolean(module->directives, "ReadFromLast", &(imconf->readfromlast));
 
@@ -1199,7 +1281,7 @@ static void im_file_stop(nx_module_t *module) {
         }
         apr_hash_set(imconf->files, fname, keylen, NULL);
         ASSERT(file->pool != NULL);
-        apr_pool_destroy(file->pool);
+        im_file_input_destroy(file);
     }
     apr_pool_destroy(pool);
 
@@ -11,6 +11,7 @@
 #include "../../../common/types.h"
 #include "../../../common/expr.h"
 #include "../../../common/module.h"
+#include "../../../common/ack.h"
 
 
 typedef struct nx_im_file_input_t
@@ -30,6 +31,8 @@ typedef struct nx_im_file_input_t
     int			blacklist_interval; ///< seconds to blacklist the file, increased on failure
     int64_t     current_line_number;///< current file linenumber
     char *line_number_key_name;
+    apr_off_t		readpos;///< File position of the end of the data in the input buffer
+    nx_ack_source_t	*ack;	///< Delivery tracking, NULL unless SavePosOnAck is enabled
 } nx_im_file_input_t;
 
 
@@ -42,6 +45,7 @@ typedef struct nx_im_file_conf_t
     boolean		filename_const;	///< Set to TRUE if the filename is not a dynamic string
     char		filename[APR_PATH_MAX];
     boolean 		savepos;
+    boolean		saveposonack;	///< save the position of delivered events only
     boolean		readfromlast;
     boolean		recursive;
     boolean		closewhenidle;
@@ -8,10 +8,13 @@
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
 
+#define IM_KAFKA_READ_BUDGET (APR_USEC_PER_SEC / 100) /* The max time to spend reading in a single iteration */
+#define IM_KAFKA_POLL_INTERVAL (APR_USEC_PER_SEC / 10) /* Delay of the next read when there was no message */
+
 static int run = 1;
 static int wait_eof = 0;
 
-static void im_kafka_add_poll_event(nx_module_t *module)
+static void im_kafka_add_poll_event(nx_module_t *module, boolean delayed)
 {
     nx_event_t *event;
     nx_im_kafka_conf_t *imconf;
@@ -21,7 +24,15 @@ static void im_kafka_add_poll_event(nx_module_t *module)
     imconf->event = event;
     event->module = module;
     event->type = NX_EVENT_READ;
-    event->delayed = FALSE;
+    if (delayed == TRUE)
+    {
+        event->delayed = TRUE;
+        event->time = apr_time_now() + IM_KAFKA_POLL_INTERVAL;
+    }
+    else
+    {
+        event->delayed = FALSE;
+    }
     event->priority = module->priority;
     nx_event_add(event);
 }
@@ -34,7 +45,7 @@ static void im_kafka_start(nx_module_t *module)
 
     ASSERT(imconf->event == NULL);
 
-    im_kafka_add_poll_event(module);
+    im_kafka_add_poll_event(module, FALSE);
 }
 
 static void im_kafka_stop(nx_module_t *module)
@@ -290,6 +301,8 @@ static void im_kafka_read(nx_module_t *module)
 {
     nx_im_kafka_conf_t *imconf;
     nx_logdata_t *logdata;
+    apr_time_t started;
+    boolean idle = FALSE;
 
     ASSERT(module != NULL);
     imconf = (nx_im_kafka_conf_t *)module->config;
@@ -301,12 +314,20 @@ static void im_kafka_read(nx_module_t *module)
         return;
     }
 
-    while (run)
+    // return the worker thread after the time budget, the read event is added again below
+    started = apr_time_now();
+    while (run && (apr_time_now() - started < IM_KAFKA_READ_BUDGET))
     {
         rd_kafka_message_t *rkmessage;
-        rkmessage = rd_kafka_consumer_poll(imconf->rk, 1000);
+        // do not block the worker thread, the read is retried with a delayed event
+        rkmessage = rd_kafka_consumer_poll(imconf->rk, 0);
 
-        if (rkmessage)
+        if (rkmessage == NULL)
+        {
+            idle = TRUE;
+            break;
+        }
+        else
         {
             if (rkmessage->err)
             {
@@ -331,6 +352,11 @@ static void im_kafka_read(nx_module_t *module)
             rd_kafka_message_destroy(rkmessage);
         }
     }
+
+    if (run && (nx_module_get_status(module) == NX_MODULE_STATUS_RUNNING))
+    {
+        im_kafka_add_poll_event(module, idle);
+    }
 }
 
 static void im_kafka_event(nx_module_t *module, nx_event_t *event)
@@ -380,7 +406,7 @@ static void im_kafka_resume(nx_module_t *module)
         nx_event_free(imconf->event);
         imconf->event = NULL;
     }
-    im_kafka_add_poll_event(module);
+    im_kafka_add_poll_event(module, FALSE);
 }
 
 NX_MODULE_DECLARATION nx_im_kafka_module =
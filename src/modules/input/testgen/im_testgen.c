@@ -14,15 +14,287 @@
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
 
-static void im_testgen_read(nx_module_t *module)
+#define IM_TESTGEN_DEFAULT_CARDINALITY 100
+#define IM_TESTGEN_DEFAULT_MAXSIZE 200
+#define IM_TESTGEN_DEFAULT_BATCHSIZE 10
+#define IM_TESTGEN_MAX_SIZE 65000
+#define IM_TESTGEN_MAX_BATCHSIZE 100000
+/* room for the header and the fields around the message */
+#define IM_TESTGEN_HEADER_SIZE 512
+/* templated events are timestamped from 2024-01-01 00:00:00 UTC, 1ms apart */
+#define IM_TESTGEN_BASE_TIME (APR_INT64_C(1704067200) * APR_USEC_PER_SEC)
+
+typedef struct im_testgen_template_t
+{
+    const char *app;
+    int facility;
+    const char *format; ///< printf format of the message taking the user, address and a number
+} im_testgen_template_t;
+
+static const im_testgen_template_t im_testgen_templates[] =
+    {
+        {"sshd", 4, "Accepted password for user%u from %s port %u ssh2"},
+        {"sshd", 4, "Failed password for invalid user user%u from %s port %u ssh2"},
+        {"CRON", 9, "(user%u) CMD (/usr/local/bin/job.sh --from %s --id %u)"},
+        {"nginx", 3, "user%u %s GET /api/v1/items/%u HTTP/1.1 200"},
+        {"postfix/smtpd", 2, "connect from user%u.example.com[%s] session %u"},
+        {"kernel", 0, "[UFW BLOCK] user%u SRC=%s DST=10.0.0.1 PROTO=TCP DPT=%u"},
+};
+
+#define IM_TESTGEN_NUM_TEMPLATES (sizeof(im_testgen_templates) / sizeof(im_testgen_template_t))
+
+static const char *im_testgen_words[] =
+    {
+        "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+        "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+};
+
+static const char *im_testgen_months[] =
+    {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+/**
+ * xorshift64*, the same seed gives the same events regardless of the
+ * batching and the rate.
+ */
+static uint64_t im_testgen_random(nx_im_testgen_conf_t *imconf)
+{
+    imconf->random ^= imconf->random >> 12;
+    imconf->random ^= imconf->random << 25;
+    imconf->random ^= imconf->random >> 27;
+
+    return (imconf->random * 2685821657736338717ULL);
+}
+
+static unsigned int im_testgen_pick(nx_im_testgen_conf_t *imconf, unsigned int range)
+{
+    return ((unsigned int)((im_testgen_random(imconf) >> 32) % range));
+}
+
+static void im_testgen_reset(nx_im_testgen_conf_t *imconf)
+{
+    // xorshift gets stuck at 0
+    imconf->random = imconf->seed ^ 0x9E3779B97F4A7C15ULL;
+    if (imconf->random == 0)
+    {
+        imconf->random = 1;
+    }
+    imconf->counter = 0;
+    imconf->started = apr_time_now();
+    imconf->started_counter = 0;
+}
+
+/**
+ * Write the message part to buf, padded with words to a length picked
+ * uniformly from MinSize..MaxSize. The template is never truncated, the
+ * message can be longer than MaxSize when it is small.
+ */
+static apr_size_t im_testgen_message(nx_im_testgen_conf_t *imconf,
+                                     const im_testgen_template_t *template,
+                                     unsigned int user,
+                                     const char *address,
+                                     char *buf,
+                                     apr_size_t bufsize)
+{
+    apr_size_t len;
+    apr_size_t size;
+    unsigned int num;
+    const char *word;
+    apr_size_t wordlen;
+
+    num = im_testgen_pick(imconf, 65536);
+    len = (apr_size_t)apr_snprintf(buf, bufsize, template->format, user, address, num);
+
+    size = imconf->minsize + im_testgen_pick(imconf, imconf->maxsize - imconf->minsize + 1);
+    if (size >= bufsize)
+    {
+        size = bufsize - 1;
+    }
+    while (len + 1 < size)
+    {
+        word = im_testgen_words[im_testgen_pick(imconf, sizeof(im_testgen_words) / sizeof(char *))];
+        wordlen = strlen(word);
+        if (len + 1 + wordlen > size)
+        {
+            wordlen = size - len - 1;
+        }
+        buf[len] = ' ';
+        memcpy(buf + len + 1, word, wordlen);
+        len += 1 + wordlen;
+    }
+    buf[len] = '\0';
+
+    return (len);
+}
+
+/**
+ * Generate the next templated event into imconf->buf. Returns the length.
+ */
+static apr_size_t im_testgen_generate(nx_im_testgen_conf_t *imconf)
+{
+    const im_testgen_template_t *template;
+    apr_time_exp_t exp;
+    unsigned int host, user, pid, addr;
+    int severity;
+    char address[20];
+    char *message;
+    char *buf;
+    apr_size_t bufsize;
+
+    buf = imconf->buf;
+    bufsize = imconf->bufsize;
+
+    CHECKERR(apr_time_exp_gmt(&exp, IM_TESTGEN_BASE_TIME + imconf->counter * 1000));
+    template = &(im_testgen_templates[im_testgen_pick(imconf, IM_TESTGEN_NUM_TEMPLATES)]);
+    host = im_testgen_pick(imconf, imconf->cardinality);
+    user = im_testgen_pick(imconf, imconf->cardinality);
+    pid = 1000 + im_testgen_pick(imconf, imconf->cardinality);
+    addr = im_testgen_pick(imconf, imconf->cardinality);
+    apr_snprintf(address, sizeof(address), "10.%u.%u.%u",
+                 (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff);
+    switch (im_testgen_pick(imconf, 16))
+    {
+    case 0:
+        severity = 3; // err
+        break;
+    case 1:
+    case 2:
+        severity = 4; // warning
+        break;
+    case 3:
+    case 4:
+        severity = 5; // notice
+        break;
+    default:
+        severity = 6; // info
+        break;
+    }
+    message = imconf->msgbuf;
+    im_testgen_message(imconf, template, user, address, message, imconf->msgbufsize);
+
+    switch (imconf->format)
+    {
+    case NX_IM_TESTGEN_FORMAT_SYSLOG_BSD:
+        return ((apr_size_t)apr_snprintf(buf, bufsize, "<%d>%s %2d %02d:%02d:%02d host%u %s[%u]: %s",
+                                         template->facility * 8 + severity, im_testgen_months[exp.tm_mon],
+                                         exp.tm_mday, exp.tm_hour, exp.tm_min, exp.tm_sec,
+                                         host, template->app, pid, message));
+    case NX_IM_TESTGEN_FORMAT_SYSLOG_IETF:
+        return ((apr_size_t)apr_snprintf(buf, bufsize, "<%d>1 %04d-%02d-%02dT%02d:%02d:%02d.%06dZ host%u %s %u"
+                                                       " - [meta sequenceId=\"%lld\"] %s",
+                                         template->facility * 8 + severity, exp.tm_year + 1900, exp.tm_mon + 1,
+                                         exp.tm_mday, exp.tm_hour, exp.tm_min, exp.tm_sec, exp.tm_usec,
+                                         host, template->app, pid, imconf->counter, message));
+    case NX_IM_TESTGEN_FORMAT_JSON:
+        return ((apr_size_t)apr_snprintf(buf, bufsize, "{\"EventTime\":\"%04d-%02d-%02d %02d:%02d:%02d\","
+                                                       "\"Hostname\":\"host%u\",\"SourceName\":\"%s\","
+                                                       "\"ProcessID\":%u,\"SeverityValue\":%d,"
+                                                       "\"AccountName\":\"user%u\",\"SourceIPAddress\":\"%s\","
+                                                       "\"Message\":\"%s\"}",
+                                         exp.tm_year + 1900, exp.tm_mon + 1, exp.tm_mday,
+                                         exp.tm_hour, exp.tm_min, exp.tm_sec,
+                                         host, template->app, pid, severity, user, address,
+                                         // the templates use no characters that need escaping
+                                         message));
+    case NX_IM_TESTGEN_FORMAT_CSV:
+        return ((apr_size_t)apr_snprintf(buf, bufsize, "%04d-%02d-%02d %02d:%02d:%02d,host%u,%s,%u,%d,user%u,%s,\"%s\"",
+                                         exp.tm_year + 1900, exp.tm_mon + 1, exp.tm_mday,
+                                         exp.tm_hour, exp.tm_min, exp.tm_sec,
+                                         host, template->app, pid, severity, user, address,
+                                         message));
+    case NX_IM_TESTGEN_FORMAT_KVP:
+        return ((apr_size_t)apr_snprintf(buf, bufsize, "EventTime=\"%04d-%02d-%02d %02d:%02d:%02d\", Hostname=host%u,"
+                                                       " SourceName=%s, ProcessID=%u, SeverityValue=%d,"
+                                                       " AccountName=user%u, SourceIPAddress=%s, Message=\"%s\"",
+                                         exp.tm_year + 1900, exp.tm_mon + 1, exp.tm_mday,
+                                         exp.tm_hour, exp.tm_min, exp.tm_sec,
+                                         host, template->app, pid, severity, user, address,
+                                         message));
+    default:
+        nx_panic("invalid format: %d", imconf->format);
+    }
+
+    return (0);
+}
+
+static void im_testgen_add_counter(nx_module_t *module, nx_im_testgen_conf_t *imconf)
 {
-    nx_im_testgen_conf_t *imconf;
     nx_logdata_t *logdata;
     char timebuf[40];
-    int i;
-    nx_event_t *event;
     char buf[250];
 
+    memset(timebuf, 0, sizeof(timebuf));
+    CHECKERR(apr_ctime(timebuf, apr_time_now()));
+    apr_snprintf(buf, sizeof(buf), "%ld@%s", (long int)imconf->counter, timebuf);
+    logdata = nx_logdata_new_logline(buf, (int)strlen(buf));
+    log_debug("generated line: [%s]", buf);
+    nx_logdata_set_integer(logdata, "SeverityValue", NX_LOGLEVEL_INFO);
+    nx_logdata_set_datetime(logdata, "EventTime", apr_time_now());
+    nx_logdata_set_string(logdata, "SourceName", PACKAGE);
+    nx_logdata_set_integer(logdata, "ProcessID", imconf->pid);
+    nx_module_add_logdata_input(module, NULL, logdata);
+}
+
+static void im_testgen_add_event(nx_module_t *module, boolean delayed, apr_time_t time)
+{
+    nx_im_testgen_conf_t *imconf;
+    nx_event_t *event;
+
+    imconf = (nx_im_testgen_conf_t *)module->config;
+
+    event = nx_event_new();
+    imconf->event = event;
+    event->module = module;
+    event->type = NX_EVENT_READ;
+    event->delayed = delayed;
+    event->time = time;
+    event->priority = module->priority;
+    nx_event_add(event);
+}
+
+/**
+ * Number of events that can be generated now without exceeding the rate.
+ * Returns 0 and sets due to the time when a batch is ready otherwise.
+ */
+static long long int im_testgen_throttle(nx_im_testgen_conf_t *imconf, apr_time_t *due)
+{
+    apr_time_t now;
+    long long int allowed;
+    long long int batch;
+
+    batch = (long long int)imconf->batchsize;
+    if (imconf->eps == 0)
+    {
+        return (batch);
+    }
+    // don't burst more than a second worth of events when the rate is low
+    if (batch > (long long int)imconf->eps)
+    {
+        batch = (long long int)imconf->eps;
+    }
+
+    now = apr_time_now();
+    allowed = (long long int)((now - imconf->started) * imconf->eps / APR_USEC_PER_SEC)
+              - (imconf->counter - imconf->started_counter);
+    if (allowed >= batch)
+    {
+        return (batch);
+    }
+    *due = imconf->started + (apr_time_t)((imconf->counter - imconf->started_counter + batch)
+                                          * APR_USEC_PER_SEC / imconf->eps);
+
+    return (0);
+}
+
+static void im_testgen_read(nx_module_t *module)
+{
+    nx_im_testgen_conf_t *imconf;
+    nx_logdata_t *logdata;
+    long long int i, batch;
+    apr_time_t due = 0;
+    apr_size_t len;
+
     ASSERT(module != NULL);
 
     imconf = (nx_im_testgen_conf_t *)module->config;
@@ -35,7 +307,14 @@ static void im_testgen_read(nx_module_t *module)
 
     log_debug("module %s looping while generating test input", module->name);
 
-    for (i = 0; i < 10; i++)
+    batch = im_testgen_throttle(imconf, &due);
+    if (batch == 0)
+    {
+        im_testgen_add_event(module, TRUE, due);
+        return;
+    }
+
+    for (i = 0; i < batch; i++)
     {
         if (imconf->maxcount != 0)
         {
@@ -45,31 +324,77 @@ static void im_testgen_read(nx_module_t *module)
                 return;
             }
         }
-        memset(timebuf, 0, sizeof(timebuf));
-        CHECKERR(apr_ctime(timebuf, apr_time_now()));
-        apr_snprintf(buf, (size_t)module->input.bufsize,
-                     "%ld@%s", (long int)imconf->counter, timebuf);
-        logdata = nx_logdata_new_logline(buf, (int)strlen(buf));
-        log_debug("generated line: [%s]", buf);
-        nx_logdata_set_integer(logdata, "SeverityValue", NX_LOGLEVEL_INFO);
-        nx_logdata_set_datetime(logdata, "EventTime", apr_time_now());
-        nx_logdata_set_string(logdata, "SourceName", PACKAGE);
-        nx_logdata_set_integer(logdata, "ProcessID", imconf->pid);
-        nx_module_add_logdata_input(module, NULL, logdata);
+        if (imconf->format == NX_IM_TESTGEN_FORMAT_COUNTER)
+        {
+            im_testgen_add_counter(module, imconf);
+        }
+        else
+        {
+            len = im_testgen_generate(imconf);
+            logdata = nx_logdata_new_logline(imconf->buf, (int)len);
+            nx_module_add_logdata_input(module, NULL, logdata);
+        }
 
         (imconf->counter)++;
+        if (nx_module_get_status(module) != NX_MODULE_STATUS_RUNNING)
+        { // paused by flow control
+            break;
+        }
     }
 
     if (nx_module_get_status(module) == NX_MODULE_STATUS_RUNNING)
     {
-        event = nx_event_new();
-        imconf->event = event;
-        event->module = module;
-        event->type = NX_EVENT_READ;
-        event->delayed = FALSE;
-        event->priority = module->priority;
-        nx_event_add(event);
+        im_testgen_add_event(module, FALSE, 0);
+    }
+}
+
+static void im_testgen_config_uint(const nx_directive_t *curr,
+                                   unsigned int *value,
+                                   unsigned int min,
+                                   unsigned int max)
+{
+    unsigned int parsed;
+
+    if (*value != 0)
+    {
+        nx_conf_error(curr, "%s is already defined", curr->directive);
     }
+    if ((sscanf(curr->args, "%u", &parsed) != 1) || (parsed < min) || (parsed > max))
+    {
+        nx_conf_error(curr, "invalid %s: %s, must be between %u and %u",
+                      curr->directive, curr->args, min, max);
+    }
+    *value = parsed;
+}
+
+static nx_im_testgen_format_t im_testgen_format_from_string(const char *str)
+{
+    if (strcasecmp(str, "counter") == 0)
+    {
+        return (NX_IM_TESTGEN_FORMAT_COUNTER);
+    }
+    if (strcasecmp(str, "syslog_bsd") == 0)
+    {
+        return (NX_IM_TESTGEN_FORMAT_SYSLOG_BSD);
+    }
+    if (strcasecmp(str, "syslog_ietf") == 0)
+    {
+        return (NX_IM_TESTGEN_FORMAT_SYSLOG_IETF);
+    }
+    if (strcasecmp(str, "json") == 0)
+    {
+        return (NX_IM_TESTGEN_FORMAT_JSON);
+    }
+    if (strcasecmp(str, "csv") == 0)
+    {
+        return (NX_IM_TESTGEN_FORMAT_CSV);
+    }
+    if (strcasecmp(str, "kvp") == 0)
+    {
+        return (NX_IM_TESTGEN_FORMAT_KVP);
+    }
+
+    return ((nx_im_testgen_format_t)-1);
 }
 
 static void im_testgen_config(nx_module_t *module)
@@ -77,6 +402,8 @@ static void im_testgen_config(nx_module_t *module)
     const nx_directive_t *curr;
     nx_im_testgen_conf_t *imconf;
     unsigned int maxcount;
+    boolean format_set = FALSE;
+    boolean maxsize_set = FALSE;
 
     ASSERT(module->directives != NULL);
     curr = module->directives;
@@ -101,6 +428,51 @@ static void im_testgen_config(nx_module_t *module)
             }
             imconf->maxcount = (long long int)maxcount;
         }
+        else if (strcasecmp(curr->directive, "Format") == 0)
+        {
+            if (format_set == TRUE)
+            {
+                nx_conf_error(curr, "Format is already defined");
+            }
+            imconf->format = im_testgen_format_from_string(curr->args);
+            if ((int)imconf->format == -1)
+            {
+                nx_conf_error(curr, "invalid Format: %s", curr->args);
+            }
+            format_set = TRUE;
+        }
+        else if (strcasecmp(curr->directive, "Seed") == 0)
+        {
+            if (imconf->seed != 0)
+            {
+                nx_conf_error(curr, "Seed is already defined");
+            }
+            if (sscanf(curr->args, "%" APR_UINT64_T_FMT, &(imconf->seed)) != 1)
+            {
+                nx_conf_error(curr, "invalid Seed: %s", curr->args);
+            }
+        }
+        else if (strcasecmp(curr->directive, "Cardinality") == 0)
+        {
+            im_testgen_config_uint(curr, &(imconf->cardinality), 1, 0xffffff);
+        }
+        else if (strcasecmp(curr->directive, "MinSize") == 0)
+        {
+            im_testgen_config_uint(curr, &(imconf->minsize), 0, IM_TESTGEN_MAX_SIZE);
+        }
+        else if (strcasecmp(curr->directive, "MaxSize") == 0)
+        {
+            im_testgen_config_uint(curr, &(imconf->maxsize), 0, IM_TESTGEN_MAX_SIZE);
+            maxsize_set = TRUE;
+        }
+        else if (strcasecmp(curr->directive, "EventsPerSecond") == 0)
+        {
+            im_testgen_config_uint(curr, &(imconf->eps), 0, 0x7fffffff);
+        }
+        else if (strcasecmp(curr->directive, "BatchSize") == 0)
+        {
+            im_testgen_config_uint(curr, &(imconf->batchsize), 1, IM_TESTGEN_MAX_BATCHSIZE);
+        }
         else
         {
             nx_conf_error(curr, "invalid keyword: %s", curr->directive);
@@ -108,24 +480,44 @@ static void im_testgen_config(nx_module_t *module)
         curr = curr->next;
     }
 
+    if (imconf->cardinality == 0)
+    {
+        imconf->cardinality = IM_TESTGEN_DEFAULT_CARDINALITY;
+    }
+    if (maxsize_set == FALSE)
+    {
+        imconf->maxsize = IM_TESTGEN_DEFAULT_MAXSIZE;
+    }
+    if (imconf->minsize > imconf->maxsize)
+    {
+        nx_conf_error(module->directives, "MinSize (%u) is larger than MaxSize (%u)",
+                      imconf->minsize, imconf->maxsize);
+    }
+    if (imconf->batchsize == 0)
+    {
+        imconf->batchsize = IM_TESTGEN_DEFAULT_BATCHSIZE;
+    }
+
+    if (imconf->format != NX_IM_TESTGEN_FORMAT_COUNTER)
+    {
+        imconf->msgbufsize = imconf->maxsize + IM_TESTGEN_HEADER_SIZE;
+        imconf->msgbuf = apr_palloc(module->pool, imconf->msgbufsize);
+        imconf->bufsize = imconf->msgbufsize + IM_TESTGEN_HEADER_SIZE;
+        imconf->buf = apr_palloc(module->pool, imconf->bufsize);
+    }
+
     imconf->pid = (int)getpid();
 }
 
 static void im_testgen_start(nx_module_t *module)
 {
     nx_im_testgen_conf_t *imconf;
-    nx_event_t *event;
 
     ASSERT(module->config != NULL);
     imconf = (nx_im_testgen_conf_t *)module->config;
 
-    event = nx_event_new();
-    imconf->event = event;
-    event->module = module;
-    event->type = NX_EVENT_READ;
-    event->delayed = FALSE;
-    event->priority = module->priority;
-    nx_event_add(event);
+    im_testgen_reset(imconf);
+    im_testgen_add_event(module, FALSE, 0);
 }
 
 static void im_testgen_pause(nx_module_t *module)
@@ -148,7 +540,6 @@ static void im_testgen_pause(nx_module_t *module)
 static void im_testgen_resume(nx_module_t *module)
 {
     nx_im_testgen_conf_t *imconf;
-    nx_event_t *event;
 
     ASSERT(module != NULL);
     ASSERT(module->config != NULL);
@@ -161,13 +552,10 @@ static void im_testgen_resume(nx_module_t *module)
         nx_event_free(imconf->event);
         imconf->event = NULL;
     }
-    event = nx_event_new();
-    imconf->event = event;
-    event->module = module;
-    event->delayed = FALSE;
-    event->type = NX_EVENT_READ;
-    event->priority = module->priority;
-    nx_event_add(event);
+    // don't try to catch up with the rate after being paused
+    imconf->started = apr_time_now();
+    imconf->started_counter = imconf->counter;
+    im_testgen_add_event(module, FALSE, 0);
 }
 
 static void im_testgen_event(nx_module_t *module, nx_event_t *event)
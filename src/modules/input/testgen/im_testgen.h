@@ -10,12 +10,36 @@
 
 #include "../../../common/types.h"
 
+typedef enum nx_im_testgen_format_t
+{
+    NX_IM_TESTGEN_FORMAT_COUNTER = 0,	///< the 'counter@ctime' lines verified by the test suite
+    NX_IM_TESTGEN_FORMAT_SYSLOG_BSD,
+    NX_IM_TESTGEN_FORMAT_SYSLOG_IETF,
+    NX_IM_TESTGEN_FORMAT_JSON,
+    NX_IM_TESTGEN_FORMAT_CSV,
+    NX_IM_TESTGEN_FORMAT_KVP,
+} nx_im_testgen_format_t;
+
 typedef struct nx_im_testgen_conf_t
 {
     long long int 	counter;
     long long int 	maxcount;
     int			pid;
     nx_event_t		*event;
+    nx_im_testgen_format_t format;
+    uint64_t		seed;
+    uint64_t		random;		///< state of the generator, reset from the seed on start
+    unsigned int	cardinality;	///< distinct hosts, users, addresses and process ids
+    unsigned int	minsize;	///< minimum length of the message part
+    unsigned int	maxsize;	///< maximum length of the message part
+    unsigned int	eps;		///< target events per second, 0 for unthrottled
+    unsigned int	batchsize;	///< events generated per read event
+    apr_time_t		started;	///< the rate is measured from here
+    long long int	started_counter; ///< value of counter at started
+    char		*buf;
+    apr_size_t		bufsize;
+    char		*msgbuf;	///< the message part is generated here first
+    apr_size_t		msgbufsize;
 } nx_im_testgen_conf_t;
 
 
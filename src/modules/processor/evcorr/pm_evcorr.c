@@ -46,78 +46,79 @@ static apr_time_t get_timeval(nx_pm_evcorr_conf_t *modconf,
 
 
 
-static void *get_context_hashval(nx_expr_eval_ctx_t *eval_ctx,
-				 apr_hash_t *context,
-				 nx_expr_t *context_expr,
-				 apr_size_t valsize,
-				 void **hkey,
-				 apr_ssize_t *hkeylen)
+typedef struct pm_evcorr_key_t
 {
-    nx_value_t contextkeyval;
-    const void *key = NULL;
-    void *keydupe = NULL;
-    apr_ssize_t keylen;
-    void *hashval = NULL;
-
-    nx_expr_evaluate(eval_ctx, &contextkeyval, context_expr);
-    if ( contextkeyval.defined == TRUE )
+    nx_value_t			value;	///< result of the Context expression
+    const void			*key;
+    size_t			keylen;
+    char			*keystr; ///< string representation of types not stored as is
+} pm_evcorr_key_t;
+
+
+
+/**
+ * Evaluate the Context expression, returns FALSE if it is undefined.
+ * The key must be released with free_context_key().
+ */
+static boolean get_context_key(nx_expr_eval_ctx_t *eval_ctx,
+			       nx_expr_t *context_expr,
+			       pm_evcorr_key_t *key)
+{
+    memset(key, 0, sizeof(pm_evcorr_key_t));
+
+    nx_expr_evaluate(eval_ctx, &(key->value), context_expr);
+    if ( key->value.defined != TRUE )
     {
-	if ( contextkeyval.type == NX_VALUE_TYPE_STRING )
-	{
-	    key = contextkeyval.string->buf;
-	    keylen = contextkeyval.string->len;
-	}
-	else if ( contextkeyval.type == NX_VALUE_TYPE_INTEGER )
-	{
-	    key = &(contextkeyval.integer);
-	    keylen = sizeof(int64_t);
-	}
-	else if ( contextkeyval.type == NX_VALUE_TYPE_DATETIME )
-	{
-	    key = &(contextkeyval.datetime);
-	    keylen = sizeof(apr_time_t);
-	}
-	else if ( contextkeyval.type == NX_VALUE_TYPE_BOOLEAN )
-	{
-	    key = &(contextkeyval.boolean);
-	    keylen = sizeof(boolean);
-	}
-	else if ( contextkeyval.type == NX_VALUE_TYPE_IP4ADDR )
-	{
-	    key = &(contextkeyval.ip4addr);
-	    keylen = 4;
-	}
-	else if ( contextkeyval.type == NX_VALUE_TYPE_IP6ADDR )
-	{
-	    key = &(contextkeyval.ip6addr);
-	    keylen = 16;
-	}
-	else 
-	{ 
-	    keydupe = nx_value_to_string(&contextkeyval);
-	    keylen = APR_HASH_KEY_STRING;
-	}
-	hashval = apr_hash_get(context, key, keylen);
-	if ( hashval == NULL )
-	{
-	    hashval = calloc(1, valsize);
-	    if ( keydupe == NULL )
-	    {
-		keydupe = malloc((size_t) keylen);
-		memcpy(keydupe, key, (size_t) keylen);
-	    }
-	    ASSERT(hashval != NULL);
-	    apr_hash_set(context, keydupe, keylen, hashval);
-	}
-	if ( hkey != NULL )
-	{
-	    *hkey = keydupe;
-	    *hkeylen = keylen;
-	}
+	nx_value_kill(&(key->value));
+	return ( FALSE );
+    }
+
+    switch ( key->value.type )
+    {
+	case NX_VALUE_TYPE_STRING:
+	    key->key = key->value.string->buf;
+	    key->keylen = key->value.string->len;
+	    break;
+	case NX_VALUE_TYPE_INTEGER:
+	    key->key = &(key->value.integer);
+	    key->keylen = sizeof(int64_t);
+	    break;
+	case NX_VALUE_TYPE_DATETIME:
+	    key->key = &(key->value.datetime);
+	    key->keylen = sizeof(apr_time_t);
+	    break;
+	case NX_VALUE_TYPE_BOOLEAN:
+	    key->key = &(key->value.boolean);
+	    key->keylen = sizeof(boolean);
+	    break;
+	case NX_VALUE_TYPE_IP4ADDR:
+	    key->key = &(key->value.ip4addr);
+	    key->keylen = 4;
+	    break;
+	case NX_VALUE_TYPE_IP6ADDR:
+	    key->key = &(key->value.ip6addr);
+	    key->keylen = 16;
+	    break;
+	default:
+	    key->keystr = nx_value_to_string(&(key->value));
+	    key->key = key->keystr;
+	    key->keylen = strlen(key->keystr);
+	    break;
     }
-    nx_value_kill(&contextkeyval);
 
-    return ( hashval );
+    return ( TRUE );
+}
+
+
+
+static void free_context_key(pm_evcorr_key_t *key)
+{
+    if ( key->keystr != NULL )
+    {
+	free(key->keystr);
+	key->keystr = NULL;
+    }
+    nx_value_kill(&(key->value));
 }
 
 
@@ -128,18 +129,22 @@ static void process_suppressed(nx_expr_eval_ctx_t *eval_ctx,
 {
     nx_value_t value;
     apr_time_t *matched = NULL;
+    pm_evcorr_key_t key;
 
     nx_expr_evaluate(eval_ctx, &value, rule->suppressed.cond);
     if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
 	 (value.defined == TRUE) &&
 	 (value.boolean == TRUE) )
     {
-	if ( rule->suppressed.context_expr != NULL )
+	if ( (rule->suppressed.context_expr != NULL) &&
+	     (get_context_key(eval_ctx, rule->suppressed.context_expr, &key) == TRUE) )
 	{
-	    matched = get_context_hashval(eval_ctx,
-					  rule->suppressed.context,
-					  rule->suppressed.context_expr,
-					  sizeof(apr_time_t), NULL, NULL);
+	    matched = nx_pm_evcorr_context_get(rule->suppressed.context, key.key, key.keylen);
+	    if ( matched == NULL )
+	    {
+		matched = nx_pm_evcorr_context_add(rule->suppressed.context, key.key, key.keylen);
+	    }
+	    free_context_key(&key);
 	}
 	if ( matched == NULL )
 	{
@@ -150,6 +155,11 @@ static void process_suppressed(nx_expr_eval_ctx_t *eval_ctx,
 	     (*matched + (rule->suppressed.interval * APR_USEC_PER_SEC) <= timeval) )
 	{
 	    *matched = timeval;
+	    if ( matched != &(rule->suppressed.matched) )
+	    {
+		nx_pm_evcorr_context_expire_at(rule->suppressed.context, matched,
+					       timeval + rule->suppressed.interval * APR_USEC_PER_SEC);
+	    }
 	    nx_expr_statement_list_execute(eval_ctx, rule->suppressed.exec);
 	}
     }
@@ -157,75 +167,145 @@ static void process_suppressed(nx_expr_eval_ctx_t *eval_ctx,
 
 
 
+/**
+ * Store, reschedule or remove the context entry after the Pair rule was processed.
+ */
+static void update_pair_context(nx_pm_evcorr_rule_t *rule,
+				pm_evcorr_key_t *key,
+				apr_time_t *matched,
+				boolean stored)
+{
+    apr_time_t *value;
+
+    if ( *matched == 0 )
+    {
+	if ( stored == TRUE )
+	{
+	    nx_pm_evcorr_context_remove(rule->pair.context, matched);
+	}
+	return;
+    }
+
+    if ( stored == FALSE )
+    { // TriggerCondition matched for the first time
+	value = nx_pm_evcorr_context_add(rule->pair.context, key->key, key->keylen);
+	*value = *matched;
+	matched = value;
+    }
+    if ( rule->pair.interval > 0 )
+    {
+	nx_pm_evcorr_context_expire_at(rule->pair.context, matched,
+				       *matched + rule->pair.interval * APR_USEC_PER_SEC);
+    }
+}
+
+
+
 static void process_pair(nx_expr_eval_ctx_t *eval_ctx,
 			 apr_time_t timeval,
 			 nx_pm_evcorr_rule_t *rule)
 {
     nx_value_t value;
     apr_time_t *matched = NULL;
-    void *hkey = NULL;
-    apr_ssize_t hkeylen;
-    
-    if ( rule->pair.context_expr != NULL )
+    apr_time_t newmatch = 0;
+    pm_evcorr_key_t key;
+    boolean haskey = FALSE;
+    nx_exception_t e;
+
+    if ( (rule->pair.context_expr != NULL) &&
+	 (get_context_key(eval_ctx, rule->pair.context_expr, &key) == TRUE) )
     {
-	matched = get_context_hashval(eval_ctx,
-				      rule->pair.context,
-				      rule->pair.context_expr,
-				      sizeof(apr_time_t),
-				      &hkey, &hkeylen);
+	haskey = TRUE;
+	matched = nx_pm_evcorr_context_get(rule->pair.context, key.key, key.keylen);
+	if ( matched == NULL )
+	{ // only stored if TriggerCondition matches
+	    matched = &newmatch;
+	}
     }
     if ( matched == NULL )
     {
 	matched = &(rule->pair.matched);
     }
 
-    if ( *matched > 0 )
-    { // TriggerCondtion was already matched
-	log_debug("triggercond was matched before");
-	nx_expr_evaluate(eval_ctx, &value, rule->pair.requiredcond);
-	if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
-	     (value.defined == TRUE) &&
-	     (value.boolean == TRUE) )
-	{ // RequiredCondition matches
-	    log_debug("requiredcond matches");
-	    if ( (rule->pair.interval == 0) ||
-		 (*matched + (rule->pair.interval * APR_USEC_PER_SEC) > timeval) )
-	    {
-		*matched = 0; // reset match
-		nx_expr_statement_list_execute(eval_ctx, rule->pair.exec);
-		if ( hkey != NULL )
-		{ // free hash entry
-		    apr_hash_set(rule->absence.context, hkey, hkeylen, NULL);
-		    free(hkey);
-		    free(matched);
+    try
+    {
+	if ( *matched > 0 )
+	{ // TriggerCondtion was already matched
+	    log_debug("triggercond was matched before");
+	    nx_expr_evaluate(eval_ctx, &value, rule->pair.requiredcond);
+	    if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
+		 (value.defined == TRUE) &&
+		 (value.boolean == TRUE) )
+	    { // RequiredCondition matches
+		log_debug("requiredcond matches");
+		if ( (rule->pair.interval == 0) ||
+		     (*matched + (rule->pair.interval * APR_USEC_PER_SEC) > timeval) )
+		{
+		    *matched = 0; // reset match
+		    nx_expr_statement_list_execute(eval_ctx, rule->pair.exec);
+		}
+	    }
+	    else
+	    {   // RequiredCondition didn't match, evaluate TriggerCondition again
+		// in case the timestamp can be updated
+		nx_expr_evaluate(eval_ctx, &value, rule->pair.triggercond);
+		if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
+		     (value.defined == TRUE) &&
+		     (value.boolean == TRUE) )
+		{ // TriggerCondition matches
+		    log_debug("requiredcond didn't match but triggercond matches");
+		    *matched = timeval;
 		}
 	    }
 	}
 	else
-	{   // RequiredCondition didn't match, evaluate TriggerCondition again
-	    // in case the timestamp can be updated
+	{ // TriggerCondition was never true, evaluate it
 	    nx_expr_evaluate(eval_ctx, &value, rule->pair.triggercond);
 	    if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
 		 (value.defined == TRUE) &&
 		 (value.boolean == TRUE) )
 	    { // TriggerCondition matches
-		log_debug("requiredcond didn't match but triggercond matches");
+		log_debug("first time match on triggercond");
 		*matched = timeval;
 	    }
 	}
+	nx_value_kill(&value);
     }
-    else
-    { // TriggerCondition was never true, evaluate it
-	nx_expr_evaluate(eval_ctx, &value, rule->pair.triggercond);
-	if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
-	     (value.defined == TRUE) &&
-	     (value.boolean == TRUE) )
-	{ // TriggerCondition matches
-	    log_debug("first time match on triggercond");
-	    *matched = timeval;
+    catch(e)
+    {
+	if ( haskey == TRUE )
+	{
+	    update_pair_context(rule, &key, matched, matched != &newmatch);
+	    free_context_key(&key);
 	}
+	rethrow(e);
+    }
+
+    if ( haskey == TRUE )
+    {
+	update_pair_context(rule, &key, matched, matched != &newmatch);
+	free_context_key(&key);
     }
-    nx_value_kill(&value);
+}
+
+
+
+static void remove_absence_event(nx_pm_evcorr_rule_absence_data_t *absence)
+{
+    if ( absence->event != NULL )
+    {
+	nx_event_remove(absence->event);
+	nx_event_free(absence->event);
+	absence->event = NULL;
+    }
+}
+
+
+
+static void free_absence_context(nx_pm_evcorr_context_t *context UNUSED,
+				 void *value)
+{
+    remove_absence_event((nx_pm_evcorr_rule_absence_data_t *) value);
 }
 
 
@@ -238,16 +318,21 @@ static void process_absence(nx_module_t *module,
     nx_value_t value;
     nx_event_t *event;
     nx_pm_evcorr_rule_absence_data_t *absence = NULL;
-    void *hkey = NULL;
-    apr_ssize_t hkeylen;
+    nx_pm_evcorr_rule_absence_data_t newabsence;
+    pm_evcorr_key_t key;
+    boolean haskey = FALSE;
+    nx_exception_t e;
 
-    if ( rule->absence.context_expr != NULL )
+    if ( (rule->absence.context_expr != NULL) &&
+	 (get_context_key(eval_ctx, rule->absence.context_expr, &key) == TRUE) )
     {
-	absence = get_context_hashval(eval_ctx,
-				      rule->absence.context,
-				      rule->absence.context_expr,
-				      sizeof(nx_pm_evcorr_rule_absence_data_t),
-				      &hkey, &hkeylen);
+	haskey = TRUE;
+	absence = nx_pm_evcorr_context_get(rule->absence.context, key.key, key.keylen);
+	if ( absence == NULL )
+	{ // only stored if TriggerCondition matches
+	    memset(&newabsence, 0, sizeof(nx_pm_evcorr_rule_absence_data_t));
+	    absence = &newabsence;
+	}
     }
     if ( absence == NULL )
     {
@@ -256,160 +341,219 @@ static void process_absence(nx_module_t *module,
     ASSERT((absence->rule == NULL) || (absence->rule == rule));
     absence->rule = rule;
 
-    if ( absence->matched > 0 )
-    { // trigger condition was already matched
-	log_debug("triggercond was matched before");
-
-	// check if we are over the time already
-	if ( timeval > absence->matched + rule->absence.interval * APR_USEC_PER_SEC )
-	{ // time window is over the limit
-	    absence->matched = 0; // reset match
-	    nx_expr_statement_list_execute(eval_ctx, rule->absence.exec);
-	    if ( absence->event != NULL )
-	    {
-		nx_event_remove(absence->event);
-		nx_event_free(absence->event);
-		absence->event = NULL;
+    try
+    {
+	if ( absence->matched > 0 )
+	{ // trigger condition was already matched
+	    log_debug("triggercond was matched before");
+
+	    // check if we are over the time already
+	    if ( timeval > absence->matched + rule->absence.interval * APR_USEC_PER_SEC )
+	    { // time window is over the limit
+		absence->matched = 0; // reset match
+		remove_absence_event(absence);
+		nx_expr_statement_list_execute(eval_ctx, rule->absence.exec);
 	    }
-	    if ( hkey != NULL )
-	    { // free hash entry
-		apr_hash_set(rule->absence.context, hkey, hkeylen, NULL);
-		free(hkey);
-		free(absence);
+	    else
+	    {
+		nx_expr_evaluate(eval_ctx, &value, rule->absence.requiredcond);
+		if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
+		     (value.defined == TRUE) &&
+		     (value.boolean == TRUE) )
+		{ // reqiredcondition matches
+		    log_debug("requiredcond matches");
+		    if ( absence->matched + (rule->absence.interval * APR_USEC_PER_SEC) > timeval )
+		    { // we are within the interval, remove the event
+			absence->matched = 0; // reset match
+			remove_absence_event(absence);
+		    }
+		    //else we are over the Interval time and the timer event should have fired
+		}
+		else
+		{   // requiredcondition didn't match
+		}
+		nx_value_kill(&value);
 	    }
 	}
 	else
-	{
-	    nx_expr_evaluate(eval_ctx, &value, rule->absence.requiredcond);
+	{ // triggercondition was never true, evaluate it
+	    nx_expr_evaluate(eval_ctx, &value, rule->absence.triggercond);
 	    if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
 		 (value.defined == TRUE) &&
 		 (value.boolean == TRUE) )
-	    { // reqiredcondition matches
-		log_debug("requiredcond matches");
-		if ( absence->matched + (rule->absence.interval * APR_USEC_PER_SEC) > timeval )
-		{ // we are within the interval, remove the event
-		    absence->matched = 0; // reset match
-		    if ( absence->event != NULL )
-		    {
-			nx_event_remove(absence->event);
-			nx_event_free(absence->event);
-			absence->event = NULL;
-		    }
-		    if ( hkey != NULL )
-		    { // free hash entry
-			apr_hash_set(rule->absence.context, hkey, hkeylen, NULL);
-			free(hkey);
-			free(absence);
-		    }
+	    { // triggercondition matches
+		log_debug("first time match on triggercond");
+		if ( absence == &newabsence )
+		{ // the event refers to the stored context
+		    absence = nx_pm_evcorr_context_add(rule->absence.context, key.key, key.keylen);
+		    absence->rule = rule;
 		}
-		//else we are over the Interval time and the timer event should have fired
+		absence->matched = timeval;
+		// add event
+		event = nx_event_new();
+		ASSERT(absence->event == NULL);
+		absence->event = event;
+		event->module = module;
+		event->type = NX_EVENT_MODULE_SPECIFIC;
+		event->delayed = TRUE;
+		event->time = apr_time_now() + APR_USEC_PER_SEC * rule->absence.interval;
+		event->data = (void *) absence;
+		event->priority = module->priority;
+		nx_event_add(event);
+	    }
+	    nx_value_kill(&value);
+	}
+    }
+    catch(e)
+    {
+	if ( haskey == TRUE )
+	{
+	    free_context_key(&key);
+	}
+	rethrow(e);
+    }
+
+    if ( haskey == TRUE )
+    {
+	if ( (absence != &newabsence) && (absence->matched == 0) )
+	{
+	    nx_pm_evcorr_context_remove(rule->absence.context, absence);
+	}
+	free_context_key(&key);
+    }
+}
+
+
+#define NX_PM_EVCORR_DEFAULT_THRESHOLDED_WINDOW_SIZE 16
+
+/**
+ * Add the match time to the sliding window. Matches older than the interval
+ * are dropped and only the last Threshold matches are kept.
+ */
+static void thresholded_add_match(nx_pm_evcorr_context_t *context,
+				  nx_pm_evcorr_rule_thresholded_data_t *thresholded,
+				  nx_pm_evcorr_rule_t *rule,
+				  apr_time_t timeval)
+{
+    apr_time_t *matchlist;
+    size_t size, i;
+
+    while ( (thresholded->num_match > 0) &&
+	    (timeval > thresholded->matchlist[thresholded->first] +
+	     rule->thresholded.interval * APR_USEC_PER_SEC) )
+    {
+	thresholded->first = (thresholded->first + 1) % thresholded->matchlist_size;
+	(thresholded->num_match)--;
+    }
+
+    if ( thresholded->num_match == thresholded->matchlist_size )
+    {
+	if ( thresholded->matchlist_size < rule->thresholded.threshold )
+	{
+	    if ( thresholded->matchlist_size == 0 )
+	    {
+		size = NX_PM_EVCORR_DEFAULT_THRESHOLDED_WINDOW_SIZE;
 	    }
 	    else
-	    {   // requiredcondition didn't match
+	    {
+		size = thresholded->matchlist_size * 2;
 	    }
-	    nx_value_kill(&value);
+	    if ( size > rule->thresholded.threshold )
+	    {
+		size = rule->thresholded.threshold;
+	    }
+	    matchlist = malloc(size * sizeof(apr_time_t));
+	    ASSERT(matchlist != NULL);
+	    for ( i = 0; i < thresholded->num_match; i++ )
+	    {
+		matchlist[i] = thresholded->matchlist[(thresholded->first + i) % thresholded->matchlist_size];
+	    }
+	    if ( thresholded->matchlist != NULL )
+	    {
+		free(thresholded->matchlist);
+	    }
+	    if ( context != NULL )
+	    {
+		context->memory += (size - thresholded->matchlist_size) * sizeof(apr_time_t);
+	    }
+	    thresholded->matchlist = matchlist;
+	    thresholded->matchlist_size = size;
+	    thresholded->first = 0;
+	}
+	else
+	{ // the window is full, drop the oldest match
+	    thresholded->first = (thresholded->first + 1) % thresholded->matchlist_size;
+	    (thresholded->num_match)--;
 	}
     }
-    else
-    { // triggercondition was never true, evaluate it
-	nx_expr_evaluate(eval_ctx, &value, rule->absence.triggercond);
-	if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
-	     (value.defined == TRUE) &&
-	     (value.boolean == TRUE) )
-	{ // triggercondition matches
-	    log_debug("first time match on triggercond");
-	    absence->matched = timeval;
-	    // add event
-	    event = nx_event_new();
-	    ASSERT(absence->event == NULL);
-	    absence->event = event;
-	    event->module = module;
-	    event->type = NX_EVENT_MODULE_SPECIFIC;
-	    event->delayed = TRUE;
-	    event->time = apr_time_now() + APR_USEC_PER_SEC * rule->absence.interval;
-	    event->data = (void *) absence;
-	    event->priority = module->priority;
-	    nx_event_add(event);
+
+    thresholded->matchlist[(thresholded->first + thresholded->num_match) %
+			   thresholded->matchlist_size] = timeval;
+    (thresholded->num_match)++;
+}
+
+
+
+static void free_thresholded_data(nx_pm_evcorr_context_t *context,
+				  nx_pm_evcorr_rule_thresholded_data_t *thresholded)
+{
+    if ( thresholded->matchlist != NULL )
+    {
+	free(thresholded->matchlist);
+	if ( context != NULL )
+	{
+	    context->memory -= thresholded->matchlist_size * sizeof(apr_time_t);
 	}
-	nx_value_kill(&value);
     }
+    memset(thresholded, 0, sizeof(nx_pm_evcorr_rule_thresholded_data_t));
+}
+
+
+
+static void free_thresholded_context(nx_pm_evcorr_context_t *context,
+				     void *value)
+{
+    free_thresholded_data(context, (nx_pm_evcorr_rule_thresholded_data_t *) value);
 }
 
 
-#define NX_PM_EVCORR_DEFAULT_THRESHOLDED_WINDOW_SIZE 100
 
 static void process_thresholded(nx_expr_eval_ctx_t *eval_ctx,
 				apr_time_t timeval,
 				nx_pm_evcorr_rule_t *rule)
 {
     nx_value_t value;
-    size_t i;
     nx_pm_evcorr_rule_thresholded_data_t *thresholded = NULL;
-    void *hkey = NULL;
-    apr_ssize_t hkeylen;
-
-    if ( rule->thresholded.context_expr != NULL )
-    {
-	thresholded = get_context_hashval(eval_ctx,
-					  rule->thresholded.context,
-					  rule->thresholded.context_expr,
-					  sizeof(nx_pm_evcorr_rule_thresholded_data_t),
-					  &hkey, &hkeylen);
-    }
-    if ( thresholded == NULL )
-    {
-	thresholded = &(rule->thresholded.data);
-    }
+    nx_pm_evcorr_context_t *context = NULL;
+    pm_evcorr_key_t key;
 
     nx_expr_evaluate(eval_ctx, &value, rule->thresholded.cond);
     if ( (value.type == NX_VALUE_TYPE_BOOLEAN) &&
 	 (value.defined == TRUE) &&
 	 (value.boolean == TRUE) )
     { // condition matches
-	if ( thresholded->matchlist == NULL )
+	if ( (rule->thresholded.context_expr != NULL) &&
+	     (get_context_key(eval_ctx, rule->thresholded.context_expr, &key) == TRUE) )
 	{
-	    thresholded->matchlist = malloc(sizeof(apr_time_t) * NX_PM_EVCORR_DEFAULT_THRESHOLDED_WINDOW_SIZE);
-	    ASSERT(thresholded->matchlist != NULL);
-	    thresholded->matchlist_size = NX_PM_EVCORR_DEFAULT_THRESHOLDED_WINDOW_SIZE;
-	    thresholded->num_match = 0;
-	}
-
-	if ( (thresholded->num_match + 1 >= rule->thresholded.threshold) ||
-	     (thresholded->num_match + 1 >= thresholded->matchlist_size) )
-	{
-	    for ( i = 0; i < thresholded->num_match; i++ )
+	    context = rule->thresholded.context;
+	    thresholded = nx_pm_evcorr_context_get(context, key.key, key.keylen);
+	    if ( thresholded == NULL )
 	    {
-		if ( timeval <= thresholded->matchlist[i] + rule->thresholded.interval * APR_USEC_PER_SEC )
-		{
-		    break;
-		}
-	    }
-	    if ( i > 0 )
-	    {
-		memmove(thresholded->matchlist, &(thresholded->matchlist[i]),
-			(thresholded->num_match - i) * sizeof(apr_time_t));
-		ASSERT(thresholded->num_match >= i);
-		thresholded->num_match -= i;
-		if ( (thresholded->num_match < thresholded->matchlist_size / 2) && 
-		     (thresholded->matchlist_size > NX_PM_EVCORR_DEFAULT_THRESHOLDED_WINDOW_SIZE) )
-		{
-		    thresholded->matchlist = realloc(thresholded->matchlist,
-						     (thresholded->matchlist_size / 2) *
-						     sizeof(apr_time_t));
-		    ASSERT(thresholded->matchlist != NULL);
-		}
+		thresholded = nx_pm_evcorr_context_add(context, key.key, key.keylen);
 	    }
+	    free_context_key(&key);
 	}
-
-	if ( thresholded->num_match + 1 >= thresholded->matchlist_size )
+	if ( thresholded == NULL )
 	{
-	    thresholded->matchlist_size = (thresholded->matchlist_size * 3) / 2;
-	    thresholded->matchlist = realloc(thresholded->matchlist,
-					     thresholded->matchlist_size * sizeof(apr_time_t));
-	    ASSERT(thresholded->matchlist != NULL);
+	    thresholded = &(rule->thresholded.data);
+	}
+
+	thresholded_add_match(context, thresholded, rule, timeval);
+	if ( context != NULL )
+	{ // the context is useless once the last match is out of the window
+	    nx_pm_evcorr_context_expire_at(context, thresholded,
+					   timeval + rule->thresholded.interval * APR_USEC_PER_SEC);
 	}
-	thresholded->matchlist[thresholded->num_match] = timeval;
-	(thresholded->num_match)++;
 
 	if ( thresholded->num_match >= rule->thresholded.threshold )
 	{
@@ -445,6 +589,71 @@ static boolean process_stop(nx_expr_eval_ctx_t *eval_ctx,
 
 
 
+static nx_pm_evcorr_context_t *pm_evcorr_rule_context(nx_pm_evcorr_rule_t *rule)
+{
+    switch ( rule->type )
+    {
+	case NX_PM_EVCORR_RULE_TYPE_SUPPRESSED:
+	    return ( rule->suppressed.context );
+	case NX_PM_EVCORR_RULE_TYPE_PAIR:
+	    return ( rule->pair.context );
+	case NX_PM_EVCORR_RULE_TYPE_ABSENCE:
+	    return ( rule->absence.context );
+	case NX_PM_EVCORR_RULE_TYPE_THRESHOLDED:
+	    return ( rule->thresholded.context );
+	default:
+	    break;
+    }
+
+    return ( NULL );
+}
+
+
+
+/**
+ * Remove the contexts which expired by timeval or all state if clearall is TRUE.
+ */
+static void pm_evcorr_clean_rules(nx_module_t *module,
+				  apr_time_t timeval,
+				  boolean clearall)
+{
+    nx_pm_evcorr_conf_t *modconf;
+    nx_pm_evcorr_rule_t *rule;
+    nx_pm_evcorr_context_t *context;
+
+    modconf = (nx_pm_evcorr_conf_t *) module->config;
+
+    for ( rule = NX_DLIST_FIRST(modconf->rules);
+	  rule != NULL;
+	  rule = NX_DLIST_NEXT(rule, link) )
+    {
+	context = pm_evcorr_rule_context(rule);
+	if ( clearall == FALSE )
+	{
+	    if ( context != NULL )
+	    {
+		nx_pm_evcorr_context_expire(context, timeval);
+	    }
+	    continue;
+	}
+
+	if ( context != NULL )
+	{
+	    nx_pm_evcorr_context_clear(context);
+	}
+	if ( rule->type == NX_PM_EVCORR_RULE_TYPE_ABSENCE )
+	{
+	    remove_absence_event(&(rule->absence.data));
+	}
+	else if ( rule->type == NX_PM_EVCORR_RULE_TYPE_THRESHOLDED )
+	{
+	    free_thresholded_data(NULL, &(rule->thresholded.data));
+	}
+    }
+}
+
+
+
 static nx_logdata_t *pm_evcorr_process(nx_module_t *module, nx_logdata_t *logdata)
 {
     nx_pm_evcorr_conf_t *modconf;
@@ -466,6 +675,7 @@ static nx_logdata_t *pm_evcorr_process(nx_module_t *module, nx_logdata_t *logdat
     // there might be a small delay caused by the exec blocks in rules down the list
     // but we assume it is negligable and don't calculate time before each rule
     timeval = get_timeval(modconf, logdata);
+    pm_evcorr_clean_rules(module, timeval, FALSE);
 
     for ( rule = NX_DLIST_FIRST(modconf->rules);
 	  (rule != NULL) && (stop == FALSE);
@@ -553,9 +763,13 @@ static void pm_evcorr_absence_event(nx_module_t *module,
     eval_ctx.logdata = NULL;
     ASSERT(absence->rule != NULL);
     rule = absence->rule;
-    nx_expr_statement_list_execute(&eval_ctx, rule->absence.exec);
     absence->matched = 0;
-    absence->event = NULL;
+    absence->event = NULL; // the event is freed by the caller
+    if ( absence != &(rule->absence.data) )
+    {
+	nx_pm_evcorr_context_remove(rule->absence.context, absence);
+    }
+    nx_expr_statement_list_execute(&eval_ctx, rule->absence.exec);
 }
 
 
@@ -712,7 +926,7 @@ static void pm_evcorr_config(nx_module_t *module)
 		    {
 			nx_conf_error(curr2, "using a constant value for 'Context' is useless");
 		    }
-		    rule->suppressed.context = apr_hash_make(module->pool);
+		    rule->suppressed.context = nx_pm_evcorr_context_new(module->pool, sizeof(apr_time_t), NULL);
 		    uses_context = TRUE;
 		}
 		else
@@ -776,7 +990,7 @@ static void pm_evcorr_config(nx_module_t *module)
 		    {
 			nx_conf_error(curr2, "using a constant value for 'Context' is useless");
 		    }
-		    rule->pair.context = apr_hash_make(module->pool);
+		    rule->pair.context = nx_pm_evcorr_context_new(module->pool, sizeof(apr_time_t), NULL);
 		    uses_context = TRUE;
 		}
 		else
@@ -848,7 +1062,9 @@ static void pm_evcorr_config(nx_module_t *module)
 		    {
 			nx_conf_error(curr2, "using a constant value for 'Context' is useless");
 		    }
-		    rule->absence.context = apr_hash_make(module->pool);
+		    rule->absence.context = nx_pm_evcorr_context_new(module->pool,
+								     sizeof(nx_pm_evcorr_rule_absence_data_t),
+								     &free_absence_context);
 		    uses_context = TRUE;
 		}
 		else
@@ -925,7 +1141,9 @@ static void pm_evcorr_config(nx_module_t *module)
 		    {
 			nx_conf_error(curr2, "using a constant value for 'Context' is useless");
 		    }
-		    rule->thresholded.context = apr_hash_make(module->pool);
+		    rule->thresholded.context = nx_pm_evcorr_context_new(module->pool,
+									 sizeof(nx_pm_evcorr_rule_thresholded_data_t),
+									 &free_thresholded_context);
 		    uses_context = TRUE;
 		}
 		else
@@ -1005,268 +1223,6 @@ static void pm_evcorr_config(nx_module_t *module)
 
 
 
-static void free_hash_item(apr_hash_t *hash,
-			   void *value,
-			   void *key,
-			   apr_ssize_t keylen)
-{
-
-    apr_hash_set(hash, key, keylen, NULL);
-    free(key);
-    free(value);
-}
-
-
-
-static void pm_evcorr_suppressed_clean(nx_module_t *module,
-				       nx_pm_evcorr_rule_t *rule,
-				       boolean clearall)
-{
-    apr_time_t matched;
-    nx_pm_evcorr_conf_t *modconf;
-    apr_hash_index_t *idx;
-    void *val;
-    void *key;
-    apr_ssize_t keylen;
-
-    if ( clearall == TRUE )
-    {
-	while ( (idx = apr_hash_first(NULL, rule->suppressed.context)) != NULL )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, &val);
-	    free_hash_item(rule->suppressed.context, val, key, keylen);
-	}
-    }
-    else
-    {
-	for ( idx = apr_hash_first(NULL, rule->suppressed.context); idx != NULL; )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, &val);
-	    idx = apr_hash_next(idx);
-	    matched = *((apr_time_t *) val);
-	    modconf = (nx_pm_evcorr_conf_t *) module->config;
-	    
-	    if ( matched + (rule->suppressed.interval * APR_USEC_PER_SEC) <= modconf->timeval )
-	    {
-		free_hash_item(rule->suppressed.context, val, key, keylen);
-	    }
-	}
-    }
-}
-
-
-
-static void pm_evcorr_pair_clean(nx_module_t *module,
-				 nx_pm_evcorr_rule_t *rule,
-				 boolean clearall)
-{
-    apr_time_t matched;
-    nx_pm_evcorr_conf_t *modconf;
-    apr_hash_index_t *idx;
-    void *val;
-    void *key;
-    apr_ssize_t keylen;
-
-    if ( clearall == TRUE )
-    {
-	while ( (idx = apr_hash_first(NULL, rule->pair.context)) != NULL )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, &val);
-	    free_hash_item(rule->pair.context, val, key, keylen);
-	}
-    }
-    else
-    {
-	for ( idx = apr_hash_first(NULL, rule->pair.context); idx != NULL; )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, &val);
-
-	    idx = apr_hash_next(idx);
-	    matched = *((apr_time_t *) val);
-	    modconf = (nx_pm_evcorr_conf_t *) module->config;
-	
-	    if ( (rule->pair.interval > 0 ) &&
-		 (matched + (rule->pair.interval * APR_USEC_PER_SEC) <= modconf->timeval) )
-	    {
-		free_hash_item(rule->pair.context, val, key, keylen);
-	    }
-	}
-    }
-}
-
-
-
-static void pm_evcorr_absence_clean(nx_module_t *module,
-				    nx_pm_evcorr_rule_t *rule,
-				    boolean clearall)
-{
-    nx_pm_evcorr_conf_t *modconf;
-    apr_hash_index_t *idx;
-    void *val;
-    void *key;
-    apr_ssize_t keylen;
-    nx_pm_evcorr_rule_absence_data_t *absence;
-
-    if ( clearall == TRUE )
-    {
-	while ( (idx = apr_hash_first(NULL, rule->absence.context)) != NULL )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, &val);
-	    absence = (nx_pm_evcorr_rule_absence_data_t *) val;
-
-	    if ( absence->event != NULL )
-	    {
-		nx_event_remove(absence->event);
-		nx_event_free(absence->event);
-		absence->event = NULL;
-	    }
-	    free_hash_item(rule->absence.context, val, key, keylen);
-	}
-    }
-    else
-    {
-	for ( idx = apr_hash_first(NULL, rule->absence.context); idx != NULL; )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, &val);
-	    idx = apr_hash_next(idx);
-	    absence = (nx_pm_evcorr_rule_absence_data_t *) val;
-
-	    modconf = (nx_pm_evcorr_conf_t *) module->config;
-	    if ( absence->matched + (rule->absence.interval * APR_USEC_PER_SEC) <= modconf->timeval )
-	    {
-		if ( absence->event != NULL )
-		{
-		    nx_event_remove(absence->event);
-		    nx_event_free(absence->event);
-		    absence->event = NULL;
-		}
-		free_hash_item(rule->absence.context, val, key, keylen);
-	    }
-	}
-    }
-}
-
-
-
-static void pm_evcorr_thresholded_clean(nx_module_t *module,
-					nx_pm_evcorr_rule_t *rule,
-					boolean clearall)
-{
-    nx_pm_evcorr_conf_t *modconf;
-    apr_hash_index_t *idx;
-    void *val;
-    void *key;
-    apr_ssize_t keylen;
-    nx_pm_evcorr_rule_thresholded_data_t *thresholded;
-
-    if ( clearall == TRUE )
-    {
-	while ( (idx = apr_hash_first(NULL, rule->thresholded.context)) != NULL )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, &val);
-	    thresholded = (nx_pm_evcorr_rule_thresholded_data_t *) val;
-
-	    if ( thresholded->matchlist != NULL )
-	    {
-		free(thresholded->matchlist);
-		thresholded->matchlist = NULL;
-	    }
-	    free_hash_item(rule->thresholded.context, val, key, keylen);
-	}
-    }
-    else
-    {
-	for ( idx = apr_hash_first(NULL, rule->thresholded.context); idx != NULL; )
-	{
-	    apr_hash_this(idx, (const void **) &key, &keylen, &val);
-	    thresholded = (nx_pm_evcorr_rule_thresholded_data_t *) val;
-	    idx = apr_hash_next(idx);
-	    modconf = (nx_pm_evcorr_conf_t *) module->config;
-
-	    ASSERT(thresholded != NULL);
-	    if ( (thresholded->matchlist != NULL) &&
-		 ((thresholded->matchlist[thresholded->num_match - 1] + 
-		   (rule->thresholded.interval * APR_USEC_PER_SEC)) <= modconf->timeval) )
-	    {
-		if ( thresholded->matchlist != NULL )
-		{
-		    free(thresholded->matchlist);
-		    thresholded->matchlist = NULL;
-		}
-		free_hash_item(rule->thresholded.context, val, key, keylen);
-	    }
-	}
-    }
-}
-
-
-
-static void pm_evcorr_clean_rules(nx_module_t *module, boolean clearall)
-{
-    nx_pm_evcorr_conf_t *modconf;
-    nx_pm_evcorr_rule_t *rule;
-
-    modconf = (nx_pm_evcorr_conf_t *) module->config;
-
-    for ( rule = NX_DLIST_FIRST(modconf->rules);
-	  rule != NULL;
-	  rule = NX_DLIST_NEXT(rule, link) )
-    {
-	switch ( rule->type )
-	{
-	    case NX_PM_EVCORR_RULE_TYPE_SIMPLE:
-		break;
-	    case NX_PM_EVCORR_RULE_TYPE_SUPPRESSED:
-		if ( rule->suppressed.context != NULL )
-		{
-		    pm_evcorr_suppressed_clean(module, rule, clearall);
-		}
-		break;
-	    case NX_PM_EVCORR_RULE_TYPE_PAIR:
-		if ( rule->pair.context != NULL )
-		{
-		    pm_evcorr_pair_clean(module, rule, clearall);
-		}
-		break;
-	    case NX_PM_EVCORR_RULE_TYPE_STOP:
-		break;
-	    case NX_PM_EVCORR_RULE_TYPE_ABSENCE:
-		if ( rule->absence.context != NULL )
-		{
-		    pm_evcorr_absence_clean(module, rule, clearall);
-		}
-		else
-		{
-		    if ( rule->absence.data.event != NULL )
-		    {
-			nx_event_remove(rule->absence.data.event);
-			nx_event_free(rule->absence.data.event);
-		    }
-		}
-		break;
-	    case NX_PM_EVCORR_RULE_TYPE_THRESHOLDED:
-		if ( rule->absence.context != NULL )
-		{
-		    pm_evcorr_thresholded_clean(module, rule, clearall);
-		}
-		else
-		{
-		    if ( rule->thresholded.data.matchlist != NULL )
-		    {
-			free(rule->thresholded.data.matchlist);
-			rule->thresholded.data.matchlist = NULL;
-			rule->thresholded.data.matchlist_size = 0;
-		    }
-		}
-		break;
-	    default:
-		nx_panic("invalid rule type %d", rule->type);
-	}
-    }
-}
-
-
-
 static void pm_evcorr_add_cleanup_event(nx_module_t *module)
 {
     nx_pm_evcorr_conf_t *modconf;
@@ -1315,7 +1271,7 @@ static void pm_evcorr_stop(nx_module_t *module)
 	modconf->cleanup_event = NULL;
     }
 
-    pm_evcorr_clean_rules(module, TRUE);
+    pm_evcorr_clean_rules(module, 0, TRUE);
 }
 
 
@@ -1334,7 +1290,11 @@ static void pm_evcorr_event(nx_module_t *module, nx_event_t *event)
 	    pm_evcorr_data_available(module);
 	    break;
 	case NX_EVENT_RECONNECT:
-	    pm_evcorr_clean_rules(module, FALSE);
+	    if ( modconf->timefield == NULL )
+	    { // expire contexts while no events are processed
+		modconf->timeval = apr_time_now();
+	    }
+	    pm_evcorr_clean_rules(module, modconf->timeval, FALSE);
 	    modconf->cleanup_event = NULL;
 	    pm_evcorr_add_cleanup_event(module);
 	    break;
@@ -1348,6 +1308,74 @@ static void pm_evcorr_event(nx_module_t *module, nx_event_t *event)
 
 
 
+static const char *pm_evcorr_rule_type_to_string(nx_pm_evcorr_rule_type_t type)
+{
+    switch ( type )
+    {
+	case NX_PM_EVCORR_RULE_TYPE_SIMPLE:
+	    return ( "Simple" );
+	case NX_PM_EVCORR_RULE_TYPE_SUPPRESSED:
+	    return ( "Suppressed" );
+	case NX_PM_EVCORR_RULE_TYPE_PAIR:
+	    return ( "Pair" );
+	case NX_PM_EVCORR_RULE_TYPE_ABSENCE:
+	    return ( "Absence" );
+	case NX_PM_EVCORR_RULE_TYPE_THRESHOLDED:
+	    return ( "Thresholded" );
+	case NX_PM_EVCORR_RULE_TYPE_STOP:
+	    return ( "Stop" );
+	default:
+	    break;
+    }
+
+    return ( "invalid" );
+}
+
+
+
+static char *pm_evcorr_info(nx_module_t *module)
+{
+    nx_pm_evcorr_conf_t *modconf;
+    nx_pm_evcorr_rule_t *rule;
+    nx_pm_evcorr_context_t *context;
+    nx_string_t *str;
+    char *retval;
+    int i = 0;
+
+    ASSERT(module != NULL);
+    ASSERT(module->config != NULL);
+
+    modconf = (nx_pm_evcorr_conf_t *) module->config;
+
+    str = nx_string_new();
+    for ( rule = NX_DLIST_FIRST(modconf->rules);
+	  rule != NULL;
+	  rule = NX_DLIST_NEXT(rule, link) )
+    {
+	i++;
+	context = pm_evcorr_rule_context(rule);
+	if ( context == NULL )
+	{
+	    continue;
+	}
+	nx_string_sprintf_append(str, "   rule %d (%s): %u contexts, %"APR_SIZE_T_FMT
+				 " bytes, %"APR_INT64_T_FMT" expired"NX_LINEFEED,
+				 i, pm_evcorr_rule_type_to_string(rule->type),
+				 context->num_entry, context->memory, context->expired);
+    }
+    if ( str->len == 0 )
+    {
+	nx_string_free(str);
+	return ( NULL );
+    }
+    retval = strdup(str->buf);
+    nx_string_free(str);
+
+    return ( retval );
+}
+
+
+
 NX_MODULE_DECLARATION nx_pm_evcorr_module =
 {
     NX_MODULE_API_VERSION,
@@ -1361,6 +1389,6 @@ NX_MODULE_DECLARATION nx_pm_evcorr_module =
     NULL,			// init
     NULL,			// shutdown
     pm_evcorr_event,		// event
-    NULL,			// info
+    pm_evcorr_info,		// info
     NULL,			// exports
 };
@@ -10,6 +10,7 @@
 
 #include "../../../common/types.h"
 #include "../../../common/dlist.h"
+#include "pm_evcorr_context.h"
 
 
 typedef enum nx_pm_evcorr_rule_type_t
@@ -39,8 +40,9 @@ typedef struct nx_pm_evcorr_rule_absence_data_t
 typedef struct nx_pm_evcorr_rule_thresholded_data_t
 {
     size_t			num_match; ///< current number of matches stored in matchlist
-    size_t			matchlist_size; //< size of matchlist
-    apr_time_t			*matchlist; ///< list of matched times
+    size_t			first;	///< index of the oldest match in matchlist
+    size_t			matchlist_size; //< size of matchlist, at most Threshold
+    apr_time_t			*matchlist; ///< ring buffer of matched times
 } nx_pm_evcorr_rule_thresholded_data_t;
 
 
@@ -62,7 +64,7 @@ struct nx_pm_evcorr_rule_t
 	{
 	    apr_time_t			matched; ///< last time when condition evaluated to true, without context
 	    nx_expr_t			*context_expr;
-	    apr_hash_t			*context; ///< hash to store context keys with values (matched)
+	    nx_pm_evcorr_context_t	*context; ///< context keys with values (matched)
 	    nx_expr_t			*cond;
 	    int64_t			interval;
 	    nx_expr_statement_list_t	*exec;	///< Statement blocks to execute
@@ -74,7 +76,7 @@ struct nx_pm_evcorr_rule_t
 	{
 	    apr_time_t			matched; ///< last time when TriggerCondition evaluated to true, without context
 	    nx_expr_t			*context_expr;
-	    apr_hash_t			*context; ///< hash to store context keys with values (matched)
+	    nx_pm_evcorr_context_t	*context; ///< context keys with values (matched)
 	    nx_expr_t			*triggercond;
 	    nx_expr_t			*requiredcond;
 	    int64_t			interval;
@@ -86,7 +88,7 @@ struct nx_pm_evcorr_rule_t
 	struct absence
 	{
 	    nx_expr_t			*context_expr;
-	    apr_hash_t			*context; ///< hash to store context keys with values (absence_data)
+	    nx_pm_evcorr_context_t	*context; ///< context keys with values (absence_data)
 	    nx_expr_t			*triggercond;
 	    nx_expr_t			*requiredcond;
 	    int64_t			interval;
@@ -99,7 +101,7 @@ struct nx_pm_evcorr_rule_t
 	{
 	    nx_expr_t			*cond;
 	    nx_expr_t			*context_expr;
-	    apr_hash_t			*context; ///< hash to store context keys with values (thresholded_data)
+	    nx_pm_evcorr_context_t	*context; ///< context keys with values (thresholded_data)
 	    size_t			threshold;
 	    int64_t			interval;
 	    nx_expr_statement_list_t	*exec;	///< Statement blocks to execute
@@ -127,7 +129,7 @@ typedef struct nx_pm_evcorr_conf_t
     const char			*timefield;
     apr_time_t			timeval; ///< either current time or value of the timefield updated by get_timeval()
     nx_pm_evcorr_rule_list_t	*rules;
-    int64_t			context_cleantime; ///< interval for context cleanup
+    int64_t			context_cleantime; ///< interval for expiring contexts when idle
     nx_event_t			*cleanup_event; ///< event for context cleanup
 } nx_pm_evcorr_conf_t;
 
@@ -0,0 +1,386 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include <stddef.h>
+
+#include "../../../common/error_debug.h"
+#include "pm_evcorr_context.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_MODULE
+
+#define NX_PM_EVCORR_CONTEXT_MIN_CAPACITY 64
+
+#define NX_PM_EVCORR_CONTEXT_ENTRY(value) \
+    ((nx_pm_evcorr_context_entry_t *) ((char *) (value) - offsetof(nx_pm_evcorr_context_entry_t, data)))
+
+#define NX_PM_EVCORR_CONTEXT_SLOT(tick) ((tick) & (NX_PM_EVCORR_CONTEXT_WHEEL_SIZE - 1))
+
+
+
+static uint32_t nx_pm_evcorr_context_hash(const void *key, size_t keylen)
+{
+    const unsigned char *ptr = (const unsigned char *) key;
+    uint32_t hash = 2166136261U;
+    size_t i;
+
+    for ( i = 0; i < keylen; i++ )
+    {
+	hash ^= ptr[i];
+	hash *= 16777619U;
+    }
+
+    return ( hash );
+}
+
+
+
+static size_t nx_pm_evcorr_context_valsize(const nx_pm_evcorr_context_t *context)
+{
+    return ( (context->valsize + sizeof(apr_time_t) - 1) & ~(sizeof(apr_time_t) - 1) );
+}
+
+
+
+nx_pm_evcorr_context_t *nx_pm_evcorr_context_new(apr_pool_t *pool,
+						 size_t valsize,
+						 nx_pm_evcorr_context_free_func_t *free_func)
+{
+    nx_pm_evcorr_context_t *context;
+
+    ASSERT(pool != NULL);
+
+    context = apr_pcalloc(pool, sizeof(nx_pm_evcorr_context_t));
+    context->valsize = valsize;
+    context->free_func = free_func;
+
+    return ( context );
+}
+
+
+
+static void nx_pm_evcorr_context_resize(nx_pm_evcorr_context_t *context, uint32_t capacity)
+{
+    nx_pm_evcorr_context_entry_t **table;
+    nx_pm_evcorr_context_entry_t *entry;
+    uint32_t i, j;
+
+    table = calloc(capacity, sizeof(nx_pm_evcorr_context_entry_t *));
+    ASSERT(table != NULL);
+
+    for ( i = 0; i < context->capacity; i++ )
+    {
+	entry = context->table[i];
+	if ( entry == NULL )
+	{
+	    continue;
+	}
+	for ( j = entry->hash & (capacity - 1); table[j] != NULL; j = (j + 1) & (capacity - 1) );
+	table[j] = entry;
+    }
+
+    if ( context->table != NULL )
+    {
+	free(context->table);
+    }
+    context->memory -= context->capacity * sizeof(nx_pm_evcorr_context_entry_t *);
+    context->memory += capacity * sizeof(nx_pm_evcorr_context_entry_t *);
+    context->table = table;
+    context->capacity = capacity;
+}
+
+
+
+/**
+ * Returns the table index of the entry or of the empty slot where it would be
+ */
+static uint32_t nx_pm_evcorr_context_find(const nx_pm_evcorr_context_t *context,
+					  const void *key,
+					  size_t keylen,
+					  uint32_t hash)
+{
+    nx_pm_evcorr_context_entry_t *entry;
+    uint32_t i;
+
+    for ( i = hash & (context->capacity - 1);
+	  (entry = context->table[i]) != NULL;
+	  i = (i + 1) & (context->capacity - 1) )
+    {
+	if ( (entry->hash == hash) && (entry->keylen == keylen) &&
+	     (memcmp(entry->key, key, keylen) == 0) )
+	{
+	    break;
+	}
+    }
+
+    return ( i );
+}
+
+
+
+void *nx_pm_evcorr_context_get(nx_pm_evcorr_context_t *context,
+			       const void *key,
+			       size_t keylen)
+{
+    nx_pm_evcorr_context_entry_t *entry;
+
+    ASSERT(context != NULL);
+
+    if ( context->num_entry == 0 )
+    {
+	return ( NULL );
+    }
+
+    entry = context->table[nx_pm_evcorr_context_find(context, key, keylen,
+						     nx_pm_evcorr_context_hash(key, keylen))];
+    if ( entry == NULL )
+    {
+	return ( NULL );
+    }
+
+    return ( entry->data );
+}
+
+
+
+/**
+ * Add a new zero filled entry, the key must not exist yet.
+ */
+void *nx_pm_evcorr_context_add(nx_pm_evcorr_context_t *context,
+			       const void *key,
+			       size_t keylen)
+{
+    nx_pm_evcorr_context_entry_t *entry;
+    size_t size;
+    uint32_t hash;
+    uint32_t i;
+
+    ASSERT(context != NULL);
+
+    if ( context->capacity == 0 )
+    {
+	nx_pm_evcorr_context_resize(context, NX_PM_EVCORR_CONTEXT_MIN_CAPACITY);
+    }
+    else if ( (context->num_entry + 1) * 4 > context->capacity * 3 )
+    {
+	nx_pm_evcorr_context_resize(context, context->capacity * 2);
+    }
+
+    hash = nx_pm_evcorr_context_hash(key, keylen);
+    i = nx_pm_evcorr_context_find(context, key, keylen, hash);
+    ASSERT(context->table[i] == NULL);
+
+    size = sizeof(nx_pm_evcorr_context_entry_t) + nx_pm_evcorr_context_valsize(context) + keylen;
+    entry = calloc(1, size);
+    ASSERT(entry != NULL);
+    entry->hash = hash;
+    entry->keylen = (uint32_t) keylen;
+    entry->key = (const char *) entry->data + nx_pm_evcorr_context_valsize(context);
+    memcpy((char *) entry->key, key, keylen);
+
+    context->table[i] = entry;
+    (context->num_entry)++;
+    context->memory += size;
+
+    return ( entry->data );
+}
+
+
+
+static void nx_pm_evcorr_context_unschedule(nx_pm_evcorr_context_t *context,
+					    nx_pm_evcorr_context_entry_t *entry)
+{
+    if ( entry->expires == 0 )
+    {
+	return;
+    }
+
+    if ( entry->wheel_prev != NULL )
+    {
+	entry->wheel_prev->wheel_next = entry->wheel_next;
+    }
+    else
+    {
+	context->wheel[NX_PM_EVCORR_CONTEXT_SLOT(entry->expires / NX_PM_EVCORR_CONTEXT_RESOLUTION)] = entry->wheel_next;
+    }
+    if ( entry->wheel_next != NULL )
+    {
+	entry->wheel_next->wheel_prev = entry->wheel_prev;
+    }
+    entry->wheel_next = NULL;
+    entry->wheel_prev = NULL;
+    entry->expires = 0;
+}
+
+
+
+static void nx_pm_evcorr_context_free_entry(nx_pm_evcorr_context_t *context,
+					    nx_pm_evcorr_context_entry_t *entry)
+{
+    if ( context->free_func != NULL )
+    {
+	context->free_func(context, entry->data);
+    }
+    context->memory -= sizeof(nx_pm_evcorr_context_entry_t) +
+	nx_pm_evcorr_context_valsize(context) + entry->keylen;
+    free(entry);
+}
+
+
+
+void nx_pm_evcorr_context_remove(nx_pm_evcorr_context_t *context, void *value)
+{
+    nx_pm_evcorr_context_entry_t *entry;
+    uint32_t i, j, k;
+    uint32_t mask;
+
+    ASSERT(context != NULL);
+    ASSERT(value != NULL);
+
+    entry = NX_PM_EVCORR_CONTEXT_ENTRY(value);
+    i = nx_pm_evcorr_context_find(context, entry->key, entry->keylen, entry->hash);
+    ASSERT(context->table[i] == entry);
+
+    // backward shift deletion, keeps the probe sequences intact without tombstones
+    mask = context->capacity - 1;
+    for ( j = (i + 1) & mask; context->table[j] != NULL; j = (j + 1) & mask )
+    {
+	k = context->table[j]->hash & mask;
+	if ( ((j > i) && ((k <= i) || (k > j))) ||
+	     ((j < i) && ((k <= i) && (k > j))) )
+	{
+	    context->table[i] = context->table[j];
+	    i = j;
+	}
+    }
+    context->table[i] = NULL;
+    (context->num_entry)--;
+
+    nx_pm_evcorr_context_unschedule(context, entry);
+    nx_pm_evcorr_context_free_entry(context, entry);
+
+    if ( (context->capacity > NX_PM_EVCORR_CONTEXT_MIN_CAPACITY) &&
+	 (context->num_entry * 8 < context->capacity) )
+    {
+	nx_pm_evcorr_context_resize(context, context->capacity / 2);
+    }
+}
+
+
+
+/**
+ * Schedule the entry to be removed when the time passed to
+ * nx_pm_evcorr_context_expire() reaches expires. 0 cancels the expiry.
+ */
+void nx_pm_evcorr_context_expire_at(nx_pm_evcorr_context_t *context,
+				    void *value,
+				    apr_time_t expires)
+{
+    nx_pm_evcorr_context_entry_t *entry;
+    apr_time_t tick;
+    int slot;
+
+    ASSERT(context != NULL);
+    ASSERT(value != NULL);
+
+    entry = NX_PM_EVCORR_CONTEXT_ENTRY(value);
+    nx_pm_evcorr_context_unschedule(context, entry);
+    if ( expires <= 0 )
+    {
+	return;
+    }
+
+    tick = expires / NX_PM_EVCORR_CONTEXT_RESOLUTION;
+    if ( context->tick == 0 )
+    {
+	context->tick = tick;
+    }
+    else if ( tick < context->tick )
+    { // already in the past, remove it with the next slot
+	expires = context->tick * NX_PM_EVCORR_CONTEXT_RESOLUTION;
+	tick = context->tick;
+    }
+    entry->expires = expires;
+
+    slot = (int) NX_PM_EVCORR_CONTEXT_SLOT(tick);
+    entry->wheel_prev = NULL;
+    entry->wheel_next = context->wheel[slot];
+    if ( entry->wheel_next != NULL )
+    {
+	entry->wheel_next->wheel_prev = entry;
+    }
+    context->wheel[slot] = entry;
+}
+
+
+
+/**
+ * Remove the entries which expired before the current slot. Entries are
+ * removed at most one slot later than they are scheduled.
+ */
+void nx_pm_evcorr_context_expire(nx_pm_evcorr_context_t *context, apr_time_t now)
+{
+    nx_pm_evcorr_context_entry_t *entry, *next;
+    apr_time_t tick;
+    int steps;
+
+    ASSERT(context != NULL);
+
+    tick = now / NX_PM_EVCORR_CONTEXT_RESOLUTION;
+    if ( context->tick == 0 )
+    {
+	context->tick = tick;
+	return;
+    }
+
+    for ( steps = 0;
+	  (context->tick < tick) && (steps < NX_PM_EVCORR_CONTEXT_WHEEL_SIZE);
+	  (context->tick)++, steps++ )
+    {
+	for ( entry = context->wheel[NX_PM_EVCORR_CONTEXT_SLOT(context->tick)];
+	      entry != NULL;
+	      entry = next )
+	{
+	    next = entry->wheel_next;
+	    if ( entry->expires < tick * NX_PM_EVCORR_CONTEXT_RESOLUTION )
+	    { // entries further in the future stay for the next round
+		nx_pm_evcorr_context_remove(context, entry->data);
+		(context->expired)++;
+	    }
+	}
+    }
+    if ( context->tick < tick )
+    { // every slot was processed
+	context->tick = tick;
+    }
+}
+
+
+
+void nx_pm_evcorr_context_clear(nx_pm_evcorr_context_t *context)
+{
+    uint32_t i;
+
+    ASSERT(context != NULL);
+
+    for ( i = 0; i < context->capacity; i++ )
+    {
+	if ( context->table[i] != NULL )
+	{
+	    nx_pm_evcorr_context_free_entry(context, context->table[i]);
+	}
+    }
+    if ( context->table != NULL )
+    {
+	free(context->table);
+    }
+    context->table = NULL;
+    context->capacity = 0;
+    context->num_entry = 0;
+    context->memory = 0;
+    context->tick = 0;
+    memset(context->wheel, 0, sizeof(context->wheel));
+}
@@ -0,0 +1,73 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_PM_EVCORR_CONTEXT_H
+#define __NX_PM_EVCORR_CONTEXT_H
+
+#include "../../../common/types.h"
+
+/*
+ * Context store of the correlation rules. Entries are kept in an open
+ * addressing hash table and are allocated with malloc() so that the memory
+ * is returned when they are removed. Entries can be scheduled to expire on
+ * a timer wheel which is advanced by the time of the processed events,
+ * this way expiry costs O(1) per entry instead of a periodic full sweep.
+ */
+
+#define NX_PM_EVCORR_CONTEXT_WHEEL_SIZE 512 ///< number of slots, must be a power of 2
+#define NX_PM_EVCORR_CONTEXT_RESOLUTION APR_USEC_PER_SEC ///< width of a slot
+
+typedef struct nx_pm_evcorr_context_t nx_pm_evcorr_context_t;
+typedef struct nx_pm_evcorr_context_entry_t nx_pm_evcorr_context_entry_t;
+
+/// called before an entry is freed, value points to the data of the entry
+typedef void (nx_pm_evcorr_context_free_func_t)(nx_pm_evcorr_context_t *context,
+						void *value);
+
+struct nx_pm_evcorr_context_entry_t
+{
+    nx_pm_evcorr_context_entry_t	*wheel_next; ///< next entry in the same timer wheel slot
+    nx_pm_evcorr_context_entry_t	*wheel_prev;
+    apr_time_t				expires; ///< 0 if not scheduled
+    uint32_t				hash;
+    uint32_t				keylen;
+    const char				*key;	///< stored after the value
+    apr_time_t				data[];	///< value of valsize bytes
+};
+
+
+
+struct nx_pm_evcorr_context_t
+{
+    nx_pm_evcorr_context_entry_t	**table; ///< open addressing with linear probing
+    uint32_t				capacity; ///< table size, a power of 2
+    uint32_t				num_entry;
+    size_t				valsize;
+    size_t				memory;	///< bytes allocated for the table and the entries
+    int64_t				expired; ///< number of entries removed by the timer wheel
+    nx_pm_evcorr_context_free_func_t	*free_func;
+    apr_time_t				tick;	///< next timer wheel slot to be processed
+    nx_pm_evcorr_context_entry_t	*wheel[NX_PM_EVCORR_CONTEXT_WHEEL_SIZE];
+};
+
+nx_pm_evcorr_context_t *nx_pm_evcorr_context_new(apr_pool_t *pool,
+						 size_t valsize,
+						 nx_pm_evcorr_context_free_func_t *free_func);
+void *nx_pm_evcorr_context_get(nx_pm_evcorr_context_t *context,
+			       const void *key,
+			       size_t keylen);
+void *nx_pm_evcorr_context_add(nx_pm_evcorr_context_t *context,
+			       const void *key,
+			       size_t keylen);
+void nx_pm_evcorr_context_remove(nx_pm_evcorr_context_t *context, void *value);
+void nx_pm_evcorr_context_expire_at(nx_pm_evcorr_context_t *context,
+				    void *value,
+				    apr_time_t expires);
+void nx_pm_evcorr_context_expire(nx_pm_evcorr_context_t *context, apr_time_t now);
+void nx_pm_evcorr_context_clear(nx_pm_evcorr_context_t *context);
+
+#endif	/* __NX_PM_EVCORR_CONTEXT_H */
@@ -79,6 +79,7 @@ static void pm_norepeat_add_event(nx_module_t *module)
     if ( modconf->event == NULL )
     {
 	event = nx_event_new();
+	modconf->event = event;
 	event->module = module;
 	event->delayed = TRUE;
 	event->type = NX_EVENT_WRITE;
@@ -96,32 +97,42 @@ static void pm_norepeat_add_event(nx_module_t *module)
 
 
 
-static void pm_norepeat_log_repeat(nx_module_t *module)
+/**
+ * Forward the duplicate if it was seen once, otherwise replace it with a
+ * "last message repeated n times" event. The duplicate is consumed.
+ * In window mode the CheckFields values other than Message are copied so
+ * that the summary can be told apart from those of the other keys.
+ */
+static void pm_norepeat_emit(nx_module_t *module,
+			     nx_logdata_t *duplicate,
+			     int repeatcnt)
 {
     nx_logdata_t *logdata;
     char msgbuf[256];
     int len;
     nx_pm_norepeat_conf_t *modconf;
     nx_value_t eventtime;
+    nx_value_t value;
+    const char *field;
+    int i;
 
     modconf = (nx_pm_norepeat_conf_t *) module->config;
 
-    if ( modconf->repeatcnt == 1 )
+    if ( repeatcnt == 1 )
     {
 	module->queue->needpop = FALSE;
-	nx_module_progress_logdata(module, modconf->logdata);
+	nx_module_progress_logdata(module, duplicate);
 	module->queue->needpop = TRUE;
-	modconf->logdata = NULL;
     }
-    else if ( modconf->repeatcnt > 1 )
+    else if ( repeatcnt > 1 )
     {
 	len = apr_snprintf(msgbuf, sizeof(msgbuf), "last message repeated %d times",
-			   modconf->repeatcnt);
+			   repeatcnt);
 	logdata = nx_logdata_new_logline(msgbuf, len);
 	nx_logdata_set_string(logdata, "Message", msgbuf);
 	nx_logdata_set_integer(logdata, "SeverityValue", NX_LOGLEVEL_INFO);
 	nx_logdata_set_string(logdata, "Severity", nx_loglevel_to_string(NX_LOGLEVEL_INFO));
-	if ( nx_logdata_get_field_value(modconf->logdata, "EventTime", &eventtime) == TRUE )
+	if ( nx_logdata_get_field_value(duplicate, "EventTime", &eventtime) == TRUE )
 	{
 	    ASSERT(eventtime.type == NX_VALUE_TYPE_DATETIME);
 	    nx_logdata_set_datetime(logdata, "EventTime", eventtime.datetime);
@@ -132,22 +143,402 @@ static void pm_norepeat_log_repeat(nx_module_t *module)
 	}
 	nx_logdata_set_string(logdata, "SourceName", PACKAGE);
 	nx_logdata_set_integer(logdata, "ProcessID", modconf->pid);
+	if ( (modconf->window > 0) && (modconf->fields != NULL) )
+	{
+	    for ( i = 0; i < modconf->fields->nelts; i++ )
+	    {
+		field = ((const char **)modconf->fields->elts)[i];
+		if ( (strcasecmp(field, "Message") == 0) ||
+		     (strcasecmp(field, "raw_event") == 0) )
+		{
+		    continue;
+		}
+		if ( nx_logdata_get_field_value(duplicate, field, &value) == TRUE )
+		{
+		    nx_logdata_set_field_value(logdata, field, nx_value_clone(NULL, &value));
+		}
+	    }
+	}
 	module->queue->needpop = FALSE;
 	nx_module_progress_logdata(module, logdata);
 	module->queue->needpop = TRUE;
-	nx_logdata_free(modconf->logdata);
-	modconf->logdata = NULL;
+	nx_logdata_free(duplicate);
     }
-    else // modconf->repeatcnt == 0
+    else if ( duplicate != NULL ) // repeatcnt == 0
     {
-	nx_logdata_free(modconf->logdata);
-	modconf->logdata = NULL;
-    }	
+	nx_logdata_free(duplicate);
+    }
+}
+
+
+
+static void pm_norepeat_log_repeat(nx_module_t *module)
+{
+    nx_pm_norepeat_conf_t *modconf;
+
+    modconf = (nx_pm_norepeat_conf_t *) module->config;
+
+    pm_norepeat_emit(module, modconf->logdata, modconf->repeatcnt);
+    modconf->logdata = NULL;
     modconf->repeatcnt = 0;
 }
 
 
 
+/**
+ * 64 bit FNV-1a over the values of the CheckFields. Fields which are
+ * missing hash differently from any value so that they only match
+ * when missing from both events, as in nx_logdata_eq().
+ */
+static uint64_t pm_norepeat_hash(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *ptr = (const unsigned char *) data;
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+    {
+	hash ^= ptr[i];
+	hash *= 1099511628211ULL;
+    }
+
+    return ( hash );
+}
+
+
+
+static uint64_t pm_norepeat_hash_value(uint64_t hash, const nx_value_t *value)
+{
+    uint32_t len;
+    uint8_t tag[2];
+
+    tag[0] = (uint8_t) value->type;
+    tag[1] = (uint8_t) value->defined;
+    hash = pm_norepeat_hash(hash, tag, sizeof(tag));
+    if ( value->defined != TRUE )
+    {
+	return ( hash );
+    }
+
+    switch ( value->type )
+    {
+	case NX_VALUE_TYPE_INTEGER:
+	    hash = pm_norepeat_hash(hash, &(value->integer), sizeof(value->integer));
+	    break;
+	case NX_VALUE_TYPE_STRING:
+	    // nx_value_eq() compares with strcmp()
+	    len = (uint32_t) strlen(value->string->buf);
+	    hash = pm_norepeat_hash(hash, &len, sizeof(len));
+	    hash = pm_norepeat_hash(hash, value->string->buf, len);
+	    break;
+	case NX_VALUE_TYPE_DATETIME:
+	    hash = pm_norepeat_hash(hash, &(value->datetime), sizeof(value->datetime));
+	    break;
+	case NX_VALUE_TYPE_REGEXP:
+	    hash = pm_norepeat_hash(hash, value->regexp.str, strlen(value->regexp.str) + 1);
+	    break;
+	case NX_VALUE_TYPE_BOOLEAN:
+	    tag[0] = (uint8_t) value->boolean;
+	    hash = pm_norepeat_hash(hash, tag, 1);
+	    break;
+	case NX_VALUE_TYPE_IP4ADDR:
+	    hash = pm_norepeat_hash(hash, value->ip4addr, sizeof(value->ip4addr));
+	    break;
+	case NX_VALUE_TYPE_IP6ADDR:
+	    hash = pm_norepeat_hash(hash, value->ip6addr, sizeof(value->ip6addr));
+	    break;
+	case NX_VALUE_TYPE_BINARY:
+	    hash = pm_norepeat_hash(hash, &(value->binary.len), sizeof(value->binary.len));
+	    hash = pm_norepeat_hash(hash, value->binary.value, (size_t) value->binary.len);
+	    break;
+	default:
+	    nx_panic("invalid type: %d", value->type);
+    }
+
+    return ( hash );
+}
+
+
+
+static uint64_t pm_norepeat_fingerprint(nx_pm_norepeat_conf_t *modconf,
+					nx_logdata_t *logdata)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    nx_value_t value;
+    const char *field;
+    uint8_t missing = 0xff;
+    int i;
+
+    if ( modconf->fields == NULL )
+    {
+	if ( nx_logdata_get_field_value(logdata, "Message", &value) == TRUE )
+	{
+	    hash = pm_norepeat_hash_value(hash, &value);
+	}
+	else
+	{
+	    hash = pm_norepeat_hash(hash, &missing, 1);
+	}
+    }
+    else
+    {
+	for ( i = 0; i < modconf->fields->nelts; i++ )
+	{
+	    field = ((const char **)modconf->fields->elts)[i];
+	    if ( nx_logdata_get_field_value(logdata, field, &value) == TRUE )
+	    {
+		hash = pm_norepeat_hash_value(hash, &value);
+	    }
+	    else
+	    {
+		hash = pm_norepeat_hash(hash, &missing, 1);
+	    }
+	}
+    }
+
+    return ( hash );
+}
+
+
+
+/**
+ * Returns the table index of the key or of the empty slot where it would be
+ */
+static uint32_t pm_norepeat_find(const nx_pm_norepeat_conf_t *modconf,
+				 uint64_t fingerprint)
+{
+    uint32_t i;
+
+    for ( i = (uint32_t) fingerprint & (modconf->capacity - 1);
+	  modconf->table[i].entry != 0;
+	  i = (i + 1) & (modconf->capacity - 1) )
+    {
+	if ( modconf->table[i].fingerprint == fingerprint )
+	{
+	    break;
+	}
+    }
+
+    return ( i );
+}
+
+
+
+static void pm_norepeat_unlink(nx_pm_norepeat_conf_t *modconf,
+			       nx_pm_norepeat_entry_t *entry)
+{
+    if ( entry->prev != 0 )
+    {
+	modconf->entries[entry->prev - 1].next = entry->next;
+    }
+    else
+    {
+	modconf->head = entry->next;
+    }
+    if ( entry->next != 0 )
+    {
+	modconf->entries[entry->next - 1].prev = entry->prev;
+    }
+    else
+    {
+	modconf->tail = entry->prev;
+    }
+    entry->prev = 0;
+    entry->next = 0;
+}
+
+
+
+static void pm_norepeat_link_head(nx_pm_norepeat_conf_t *modconf, uint32_t idx)
+{
+    nx_pm_norepeat_entry_t *entry;
+
+    entry = &(modconf->entries[idx - 1]);
+    entry->prev = 0;
+    entry->next = modconf->head;
+    if ( modconf->head != 0 )
+    {
+	modconf->entries[modconf->head - 1].prev = idx;
+    }
+    else
+    {
+	modconf->tail = idx;
+    }
+    modconf->head = idx;
+}
+
+
+
+/**
+ * Emit the pending summary of the entry and remove it from the window
+ */
+static void pm_norepeat_remove(nx_module_t *module, uint32_t idx)
+{
+    nx_pm_norepeat_conf_t *modconf;
+    nx_pm_norepeat_entry_t *entry;
+    uint32_t i, j, k;
+    uint32_t mask;
+
+    modconf = (nx_pm_norepeat_conf_t *) module->config;
+    entry = &(modconf->entries[idx - 1]);
+
+    i = pm_norepeat_find(modconf, entry->fingerprint);
+    ASSERT(modconf->table[i].entry == idx);
+
+    // backward shift deletion, keeps the probe sequences intact without tombstones
+    mask = modconf->capacity - 1;
+    for ( j = (i + 1) & mask; modconf->table[j].entry != 0; j = (j + 1) & mask )
+    {
+	k = (uint32_t) modconf->table[j].fingerprint & mask;
+	if ( ((j > i) && ((k <= i) || (k > j))) ||
+	     ((j < i) && ((k <= i) && (k > j))) )
+	{
+	    modconf->table[i] = modconf->table[j];
+	    i = j;
+	}
+    }
+    modconf->table[i].entry = 0;
+
+    pm_norepeat_unlink(modconf, entry);
+    pm_norepeat_emit(module, entry->logdata, entry->repeatcnt);
+    entry->logdata = NULL;
+    entry->repeatcnt = 0;
+    entry->next = modconf->free_list;
+    modconf->free_list = idx;
+    (modconf->num_entry)--;
+}
+
+
+
+/**
+ * Remove the keys which were not seen during the last window
+ */
+static void pm_norepeat_expire(nx_module_t *module, apr_time_t now)
+{
+    nx_pm_norepeat_conf_t *modconf;
+
+    modconf = (nx_pm_norepeat_conf_t *) module->config;
+
+    while ( (modconf->tail != 0) &&
+	    (modconf->entries[modconf->tail - 1].last + modconf->window <= now) )
+    {
+	pm_norepeat_remove(module, modconf->tail);
+    }
+}
+
+
+
+static void pm_norepeat_add_expiry_event(nx_module_t *module)
+{
+    nx_event_t *event;
+    nx_pm_norepeat_conf_t *modconf;
+
+    modconf = (nx_pm_norepeat_conf_t *) module->config;
+
+    // the tail is only ever seen later, so an earlier event is never too late
+    if ( (modconf->event != NULL) || (modconf->tail == 0) )
+    {
+	return;
+    }
+
+    event = nx_event_new();
+    modconf->event = event;
+    event->module = module;
+    event->delayed = TRUE;
+    event->type = NX_EVENT_WRITE;
+    event->time = modconf->entries[modconf->tail - 1].last + modconf->window;
+    event->priority = module->priority;
+    nx_event_add(event);
+}
+
+
+
+/**
+ * Window mode: the first event of a key within the window is forwarded, its
+ * duplicates are dropped and counted. The window of a key ends when it is
+ * not seen for Window seconds, when it has been open for Window seconds and
+ * the key is seen again, or when the least recently seen key is evicted to
+ * make room for a new one. The summary is emitted when the window ends.
+ */
+static nx_logdata_t *pm_norepeat_process_window(nx_module_t *module, nx_logdata_t *logdata)
+{
+    nx_pm_norepeat_conf_t *modconf;
+    nx_pm_norepeat_entry_t *entry;
+    uint64_t fingerprint;
+    apr_time_t now;
+    uint32_t i, idx;
+
+    modconf = (nx_pm_norepeat_conf_t *) module->config;
+
+    now = apr_time_now();
+    pm_norepeat_expire(module, now);
+
+    fingerprint = pm_norepeat_fingerprint(modconf, logdata);
+    i = pm_norepeat_find(modconf, fingerprint);
+    idx = modconf->table[i].entry;
+
+    if ( idx != 0 )
+    {
+	entry = &(modconf->entries[idx - 1]);
+	pm_norepeat_unlink(modconf, entry);
+	pm_norepeat_link_head(modconf, idx);
+	entry->last = now;
+	if ( entry->first + modconf->window > now )
+	{
+	    (entry->repeatcnt)++;
+	    nx_module_logqueue_pop(module, logdata);
+	    if ( entry->repeatcnt == 1 )
+	    { // kept in case there are no more duplicates
+		entry->logdata = logdata;
+	    }
+	    else
+	    {
+		nx_logdata_free(logdata);
+	    }
+	    pm_norepeat_add_expiry_event(module);
+	    return ( NULL );
+	}
+	// a continuous flood, report it and start a new window with this event
+	pm_norepeat_emit(module, entry->logdata, entry->repeatcnt);
+	entry->logdata = NULL;
+	entry->repeatcnt = 0;
+	entry->first = now;
+	return ( logdata );
+    }
+
+    if ( modconf->num_entry == modconf->window_size )
+    {
+	pm_norepeat_remove(module, modconf->tail);
+	i = pm_norepeat_find(modconf, fingerprint);
+    }
+
+    if ( modconf->free_list != 0 )
+    {
+	idx = modconf->free_list;
+	modconf->free_list = modconf->entries[idx - 1].next;
+    }
+    else
+    {
+	ASSERT(modconf->num_alloc < modconf->window_size);
+	(modconf->num_alloc)++;
+	idx = modconf->num_alloc;
+    }
+    entry = &(modconf->entries[idx - 1]);
+    entry->fingerprint = fingerprint;
+    entry->first = now;
+    entry->last = now;
+    entry->logdata = NULL;
+    entry->repeatcnt = 0;
+    modconf->table[i].fingerprint = fingerprint;
+    modconf->table[i].entry = idx;
+    pm_norepeat_link_head(modconf, idx);
+    (modconf->num_entry)++;
+    pm_norepeat_add_expiry_event(module);
+
+    return ( logdata );
+}
+
+
+
 static void pm_norepeat_write(nx_module_t *module)
 {
     nx_pm_norepeat_conf_t *modconf;
@@ -155,8 +546,14 @@ static void pm_norepeat_write(nx_module_t *module)
     ASSERT(module != NULL);
 
     modconf = (nx_pm_norepeat_conf_t *) module->config;
+    modconf->event = NULL;
 
-    if ( modconf->logdata != NULL )
+    if ( modconf->window > 0 )
+    {
+	pm_norepeat_expire(module, apr_time_now());
+	pm_norepeat_add_expiry_event(module);
+    }
+    else if ( modconf->logdata != NULL )
     {
 	pm_norepeat_log_repeat(module);
     }
@@ -176,6 +573,11 @@ static nx_logdata_t *pm_norepeat_process(nx_module_t *module, nx_logdata_t *logd
 
     //log_debug("processing: [%s]", logdata->data);
 
+    if ( modconf->window > 0 )
+    {
+	return ( pm_norepeat_process_window(module, logdata) );
+    }
+
     if ( modconf->logdata == NULL )
     {
 	modconf->logdata = nx_logdata_clone(logdata);
@@ -242,6 +644,7 @@ static void pm_norepeat_config(nx_module_t *module)
     const char *start, *ptr, *end;
     char *field = NULL;
     apr_size_t len;
+    unsigned int window = 0;
 
     modconf = apr_pcalloc(module->pool, sizeof(nx_pm_norepeat_conf_t));
     module->config = modconf;
@@ -280,6 +683,22 @@ static void pm_norepeat_config(nx_module_t *module)
 		for ( ; apr_isspace(*ptr) || (*ptr == ','); ptr++ );
 	    }
 	}
+	else if ( strcasecmp(curr->directive, "Window") == 0 )
+	{
+	    if ( (sscanf(curr->args, "%u", &window) != 1) || (window == 0) )
+	    {
+		nx_conf_error(curr, "invalid Window: %s", curr->args);
+	    }
+	    modconf->window = APR_USEC_PER_SEC * (apr_time_t) window;
+	}
+	else if ( strcasecmp(curr->directive, "WindowSize") == 0 )
+	{
+	    if ( (sscanf(curr->args, "%u", &(modconf->window_size)) != 1) ||
+		 (modconf->window_size == 0) || (modconf->window_size > (1U << 30)) )
+	    {
+		nx_conf_error(curr, "invalid WindowSize: %s", curr->args);
+	    }
+	}
 	else
 	{
 	    nx_conf_error(curr, "invalid pm_norepeat keyword: %s", curr->directive);
@@ -287,11 +706,73 @@ static void pm_norepeat_config(nx_module_t *module)
 	curr = curr->next;
     }
 
+    if ( modconf->window > 0 )
+    {
+	if ( modconf->window_size == 0 )
+	{
+	    modconf->window_size = NX_PM_NOREPEAT_DEFAULT_WINDOW_SIZE;
+	}
+	// at most half full
+	for ( modconf->capacity = 64;
+	      modconf->capacity < modconf->window_size * 2;
+	      modconf->capacity *= 2 );
+	modconf->entries = apr_pcalloc(module->pool, sizeof(nx_pm_norepeat_entry_t) * modconf->window_size);
+	modconf->table = apr_pcalloc(module->pool, sizeof(nx_pm_norepeat_slot_t) * modconf->capacity);
+    }
+    else if ( modconf->window_size > 0 )
+    {
+	nx_conf_error(module->directives, "WindowSize requires Window");
+    }
+
     modconf->pid = (int) getpid();
 }
 
 
 
+static void pm_norepeat_stop(nx_module_t *module)
+{
+    nx_pm_norepeat_conf_t *modconf;
+    uint32_t i;
+
+    ASSERT(module != NULL);
+
+    modconf = (nx_pm_norepeat_conf_t *) module->config;
+
+    if ( modconf->event != NULL )
+    {
+	nx_event_remove(modconf->event);
+	nx_event_free(modconf->event);
+	modconf->event = NULL;
+    }
+
+    if ( modconf->logdata != NULL )
+    {
+	nx_logdata_free(modconf->logdata);
+	modconf->logdata = NULL;
+    }
+    modconf->repeatcnt = 0;
+
+    if ( modconf->window > 0 )
+    {
+	for ( i = 0; i < modconf->num_alloc; i++ )
+	{
+	    if ( modconf->entries[i].logdata != NULL )
+	    {
+		nx_logdata_free(modconf->entries[i].logdata);
+	    }
+	}
+	memset(modconf->entries, 0, sizeof(nx_pm_norepeat_entry_t) * modconf->window_size);
+	memset(modconf->table, 0, sizeof(nx_pm_norepeat_slot_t) * modconf->capacity);
+	modconf->num_entry = 0;
+	modconf->num_alloc = 0;
+	modconf->free_list = 0;
+	modconf->head = 0;
+	modconf->tail = 0;
+    }
+}
+
+
+
 static void pm_norepeat_event(nx_module_t *module, nx_event_t *event)
 {
     ASSERT(event != NULL);
@@ -318,7 +799,7 @@ NX_MODULE_DECLARATION nx_pm_norepeat_module =
     NULL,			// capabilities
     pm_norepeat_config,		// config
     NULL,			// start
-    NULL,	 		// stop
+    pm_norepeat_stop,		// stop
     NULL,			// pause
     NULL,			// resume
     NULL,			// init
@@ -10,6 +10,37 @@
 
 #include "../../../common/types.h"
 
+#define NX_PM_NOREPEAT_DEFAULT_WINDOW_SIZE 10000
+
+/*
+ * In window mode every key (the fingerprint of the CheckFields) seen within
+ * the last Window seconds has an entry. Entries are preallocated, indexed by
+ * an open addressing hash table and kept on a list in least recently used
+ * order, so both time based expiry and eviction take the tail of the list.
+ * Indexes are stored as index + 1, 0 is the end of the list or an empty slot.
+ */
+
+typedef struct nx_pm_norepeat_entry_t
+{
+    uint64_t		fingerprint;
+    apr_time_t		first;		///< start of the current window
+    apr_time_t		last;		///< when the key was last seen
+    nx_logdata_t	*logdata;	///< first suppressed duplicate
+    int			repeatcnt;	///< number of suppressed duplicates
+    uint32_t		prev;		///< more recently used entry
+    uint32_t		next;		///< less recently used entry, or the next free one
+} nx_pm_norepeat_entry_t;
+
+
+
+typedef struct nx_pm_norepeat_slot_t
+{
+    uint64_t		fingerprint;
+    uint32_t		entry;
+} nx_pm_norepeat_slot_t;
+
+
+
 typedef struct nx_pm_norepeat_conf_t
 {
     nx_event_t		*event;
@@ -17,6 +48,17 @@ typedef struct nx_pm_norepeat_conf_t
     nx_logdata_t	*logdata;
     int			pid;
     apr_array_header_t	*fields;
+
+    apr_time_t		window;		///< 0 compares with the previous event only
+    uint32_t		window_size;	///< maximum number of keys
+    nx_pm_norepeat_entry_t *entries;	///< window_size entries
+    nx_pm_norepeat_slot_t *table;	///< linear probing
+    uint32_t		capacity;	///< table size, a power of 2
+    uint32_t		num_entry;
+    uint32_t		num_alloc;	///< entries handed out at least once
+    uint32_t		free_list;
+    uint32_t		head;		///< most recently used
+    uint32_t		tail;		///< least recently used
 } nx_pm_norepeat_conf_t;
 
 
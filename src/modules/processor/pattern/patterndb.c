@@ -5,15 +5,28 @@
  * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
  */
 
+#include <apr_lib.h>
+#include <apr_hash.h>
+
 #include "patterndb.h"
 #include "../../../common/exception.h"
 #include "../../../common/alloc.h"
 #include "../../../common/expr-parser.h"
+#include "../../../common/expr-vm.h"
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
 
 #define NX_PATTERNDB_MAX_CAPTURED_FIELDS 100
 
+#define NX_PATTERN_ANCHOR_MIN 3 ///< shortest literal used as a prefilter key
+#define NX_PATTERN_ANCHOR_BITS 12
+#define NX_PATTERN_ANCHOR_BUCKETS (1 << NX_PATTERN_ANCHOR_BITS)
+
+#define NX_PATTERN_COST_SAMPLE 16 ///< the cost of the patterns is measured on one in this many events
+
+#define NX_PATTERN_BITMAP_SET(map, i) ((map)[(i) >> 5] |= (1U << ((i) & 31)))
+#define NX_PATTERN_BITMAP_ISSET(map, i) ((map)[(i) >> 5] & (1U << ((i) & 31)))
+
 nx_patterndb_t *nx_patterndb_new(apr_pool_t *pool)
 {
     nx_patterndb_t *retval = NULL;
@@ -111,46 +124,15 @@ void nx_patterndb_add_group(nx_patterndb_t *patterndb, nx_patterngroup_t *group)
 static void nx_pattern_matchfield_compile(apr_pool_t *pool,
 					  nx_pattern_matchfield_t *matchfield)
 {
-    const char *error = NULL;
-    int erroroffs = 0;
-    size_t size;
-    pcre *tmppcre;
-    int rc;
-    int capturecount;
-
-    matchfield->regexp = pcre_compile(matchfield->value, 0, &error,  &erroroffs, NULL);
-    if ( matchfield->regexp == NULL )
-    {
-	throw_msg("failed to compile regular expression '%s', error at position %d: %s",
-		  matchfield->value, erroroffs, error);
-    }
-    rc = pcre_fullinfo(matchfield->regexp, NULL, PCRE_INFO_SIZE, &size); 
-    if ( rc < 0 )
-    {
-	pcre_free(matchfield->regexp);
-	throw_msg("failed to get compiled regexp size");
-    }
+    ASSERT(pool != NULL);
 
-    rc = pcre_fullinfo(matchfield->regexp, NULL, PCRE_INFO_CAPTURECOUNT, &capturecount); 
-    if ( rc < 0 )
+    // the compiled pattern is released together with the pool
+    matchfield->regexp = nx_regexp_compile(pool, matchfield->value, 0);
+    if ( matchfield->regexp->capturecount >= NX_PATTERNDB_MAX_CAPTURED_FIELDS )
     {
-	pcre_free(matchfield->regexp);
-	throw_msg("failed to get regexp captured count");
-    }
-    if ( capturecount >= NX_PATTERNDB_MAX_CAPTURED_FIELDS )
-    {
-	pcre_free(matchfield->regexp);
 	throw_msg("maximum number of captured substrings is limited to %d",
 		  NX_PATTERNDB_MAX_CAPTURED_FIELDS);
     }
-
-    ASSERT(size > 0);
-    ASSERT(pool != NULL);
-    tmppcre = apr_palloc(pool, (apr_size_t) size);
-    memcpy(tmppcre, matchfield->regexp, (apr_size_t) size);
-    pcre_free(matchfield->regexp);
-    matchfield->regexp = tmppcre;
-    //TODO: use pcre_study for further speed optimization
 }
 
 
@@ -218,7 +200,6 @@ void nx_pattern_add_matchfield(apr_pool_t *pool,
 			       nx_pattern_t *pattern,
 			       nx_pattern_matchfield_t *matchfield)
 {
-    int rc;
     int capturedcnt = 0, cnt;
     nx_pattern_capturedfield_t *capturedfield;
 
@@ -236,12 +217,7 @@ void nx_pattern_add_matchfield(apr_pool_t *pool,
 	{
 	    capturedcnt++;
 	}
-	rc = pcre_fullinfo(matchfield->regexp, NULL, PCRE_INFO_CAPTURECOUNT, &cnt); 
-	if ( rc < 0 )
-	{
-	    pcre_free(matchfield->regexp);
-	    throw_msg("failed to get captured count");
-	}
+	cnt = matchfield->regexp->capturecount;
 	if ( capturedcnt != cnt )
 	{
 	    throw_msg("number of captured fields (%d) does no match value (%d) reported by regexp engine for pattern %ld",
@@ -287,6 +263,7 @@ nx_pattern_match_type_t nx_pattern_match_type_from_string(const char *typestr)
 
 
 static boolean patterndb_regexp_match(const char *subject,
+				      int length,
 				      nx_pattern_matchfield_t *matchfield,
 				      nx_logdata_field_list_t *addfields,
 				      boolean isgroup,
@@ -300,8 +277,8 @@ static boolean patterndb_regexp_match(const char *subject,
     nx_logdata_field_t *setfield;
     nx_exception_t e;
 
-    result = pcre_exec(matchfield->regexp, NULL, subject, (int) strlen(subject), 0, 0,
-		       ovector, NX_PATTERNDB_MAX_CAPTURED_FIELDS * 3);
+    result = nx_regexp_exec(matchfield->regexp, subject, length, 0, 0,
+			    ovector, NX_PATTERNDB_MAX_CAPTURED_FIELDS * 3);
 
     if ( result < 0 )
     {
@@ -443,7 +420,8 @@ static boolean nx_patterndb_match_matchfields(nx_logdata_t *logdata,
 		    }
 		    break;
 		case NX_PATTERN_MATCH_TYPE_REGEXP:
-		    if ( patterndb_regexp_match(logfield->value->string->buf, matchfield,
+		    if ( patterndb_regexp_match(logfield->value->string->buf,
+						(int) logfield->value->string->len, matchfield,
 						addfields, isgroup, name) == FALSE )
 		    {
 			//log_debug("logdata field didn't match regexp");
@@ -474,7 +452,7 @@ static boolean nx_patterndb_match_matchfields(nx_logdata_t *logdata,
 		    strval = nx_value_to_string(logfield->value);
 		    try
 		    {
-			if ( patterndb_regexp_match(strval, matchfield,
+			if ( patterndb_regexp_match(strval, (int) strlen(strval), matchfield,
 						    addfields, isgroup, name) == TRUE )
 			{
 			    retval = TRUE;
@@ -531,7 +509,7 @@ static boolean nx_patterndb_match_matchfields(nx_logdata_t *logdata,
 			}
 			break;
 		    case NX_PATTERN_MATCH_TYPE_REGEXP:
-			if ( patterndb_regexp_match(strval, matchfield,
+			if ( patterndb_regexp_match(strval, (int) strlen(strval), matchfield,
 						    addfields, isgroup, name) == TRUE )
 			{
 			    retval = TRUE;
@@ -556,6 +534,519 @@ static boolean nx_patterndb_match_matchfields(nx_logdata_t *logdata,
 
 
 
+static uint32_t nx_pattern_anchor_hash(const char *str)
+{
+    uint32_t key;
+
+    key = ((uint32_t) (unsigned char) str[0] << 16) |
+	  ((uint32_t) (unsigned char) str[1] << 8) |
+	  (uint32_t) (unsigned char) str[2];
+
+    return ( (key * 2654435761U) >> (32 - NX_PATTERN_ANCHOR_BITS) );
+}
+
+
+
+static void nx_pattern_literal_end(char **run,
+				   char *out,
+				   const char **best,
+				   size_t *bestlen)
+{
+    if ( (size_t) (out - *run) > *bestlen )
+    {
+	*best = *run;
+	*bestlen = (size_t) (out - *run);
+    }
+    *run = out;
+}
+
+
+
+/**
+ * Skip the argument of an escape sequence such as \x41, \x{41}, \p{Lu},
+ * \cX, \012 or \k<name>. p points to the letter or digit after the
+ * backslash. Returns the last character of the sequence or NULL if it is
+ * not terminated.
+ */
+static const char *nx_pattern_regexp_skip_escape(const char *p)
+{
+    char close = '\0';
+    int i;
+
+    switch ( *p )
+    {
+	case 'x':
+	    if ( p[1] != '{' )
+	    {
+		for ( i = 0; (i < 2) && apr_isxdigit(p[1]); i++ )
+		{
+		    p++;
+		}
+		return ( p );
+	    }
+	    close = '}';
+	    break;
+	case 'p':
+	case 'P':
+	    if ( p[1] != '{' )
+	    { // single letter property
+		return ( (p[1] == '\0') ? NULL : p + 1 );
+	    }
+	    close = '}';
+	    break;
+	case 'c':
+	    return ( (p[1] == '\0') ? NULL : p + 1 );
+	case 'g':
+	case 'k':
+	    if ( p[1] == '<' )
+	    {
+		close = '>';
+	    }
+	    else if ( p[1] == '\'' )
+	    {
+		close = '\'';
+	    }
+	    else if ( p[1] == '{' )
+	    {
+		close = '}';
+	    }
+	    else
+	    { // \g1, \g-1
+		if ( (p[1] == '-') || (p[1] == '+') )
+		{
+		    p++;
+		}
+		while ( apr_isdigit(p[1]) )
+		{
+		    p++;
+		}
+		return ( p );
+	    }
+	    break;
+	case 'o':
+	case 'N':
+	    if ( p[1] != '{' )
+	    {
+		return ( p );
+	    }
+	    close = '}';
+	    break;
+	default:
+	    if ( apr_isdigit(*p) )
+	    { // backreference or octal character code
+		while ( apr_isdigit(p[1]) )
+		{
+		    p++;
+		}
+	    }
+	    return ( p );
+    }
+
+    p += 2;
+    while ( (*p != '\0') && (*p != close) )
+    {
+	p++;
+    }
+    if ( *p == '\0' )
+    {
+	return ( NULL );
+    }
+
+    return ( p );
+}
+
+
+
+/**
+ * Find the longest literal which must occur in the subject for the regular
+ * expression to match. Only the top level of the expression is inspected,
+ * groups and character classes end the literal. Returns 0 if the expression
+ * has no such literal (e.g. it contains a top level alternation or sets options).
+ */
+static size_t nx_pattern_regexp_literal(apr_pool_t *pool,
+					const char *regexp,
+					const char **literal)
+{
+    char *buf, *out, *run;
+    const char *best = NULL;
+    size_t bestlen = 0;
+    const char *p;
+    int depth = 0;
+    boolean inclass = FALSE;
+
+    buf = apr_palloc(pool, strlen(regexp) + 1);
+    out = buf;
+    run = buf;
+
+    for ( p = regexp; *p != '\0'; p++ )
+    {
+	if ( inclass == TRUE )
+	{
+	    if ( (p[0] == '\\') && (p[1] != '\0') )
+	    {
+		p++;
+	    }
+	    else if ( (p[0] == '[') && ((p[1] == ':') || (p[1] == '.') || (p[1] == '=')) )
+	    { // POSIX [:name:], [.x.] or [=x=], its ']' does not end the class
+		const char *end;
+
+		for ( end = p + 2; (*end != '\0') && (*end != ']'); end++ )
+		{
+		    if ( (end[0] == '\\') && ((end[1] == ']') || (end[1] == '\\')) )
+		    {
+			end++;
+		    }
+		    else if ( (end[0] == '[') && (end[1] == p[1]) )
+		    {
+			break;
+		    }
+		    else if ( (end[0] == p[1]) && (end[1] == ']') )
+		    {
+			p = end + 1;
+			break;
+		    }
+		}
+	    }
+	    else if ( p[0] == ']' )
+	    {
+		inclass = FALSE;
+	    }
+	    continue;
+	}
+
+	switch ( *p )
+	{
+	    case '\\':
+		if ( (p[1] == '\0') || (p[1] == 'Q') )
+		{
+		    return ( 0 );
+		}
+		p++;
+		if ( apr_isalnum(*p) )
+		{ // character type, character code, backreference or assertion
+		    nx_pattern_literal_end(&run, out, &best, &bestlen);
+		    if ( (p = nx_pattern_regexp_skip_escape(p)) == NULL )
+		    {
+			return ( 0 );
+		    }
+		}
+		else if ( depth == 0 )
+		{
+		    *out = *p;
+		    out++;
+		}
+		break;
+	    case '[':
+		nx_pattern_literal_end(&run, out, &best, &bestlen);
+		inclass = TRUE;
+		if ( p[1] == '^' )
+		{
+		    p++;
+		}
+		if ( p[1] == ']' )
+		{
+		    p++;
+		}
+		break;
+	    case '(':
+		nx_pattern_literal_end(&run, out, &best, &bestlen);
+		if ( (p[1] == '?') && ((apr_isalpha(p[2])) || (p[2] == '-')) )
+		{ // option setting, e.g. (?i)
+		    return ( 0 );
+		}
+		depth++;
+		break;
+	    case ')':
+		nx_pattern_literal_end(&run, out, &best, &bestlen);
+		depth--;
+		break;
+	    case '|':
+		if ( depth == 0 )
+		{
+		    return ( 0 );
+		}
+		break;
+	    case '{':
+		if ( apr_isdigit(p[1]) )
+		{ // quantifier, the previous character may be repeated zero times
+		    if ( (depth == 0) && (out > run) )
+		    {
+			out--;
+		    }
+		    nx_pattern_literal_end(&run, out, &best, &bestlen);
+		    while ( (*p != '\0') && (*p != '}') )
+		    {
+			p++;
+		    }
+		    if ( *p == '\0' )
+		    {
+			return ( 0 );
+		    }
+		}
+		else if ( depth == 0 )
+		{
+		    *out = *p;
+		    out++;
+		}
+		break;
+	    case '?':
+	    case '*':
+		if ( (depth == 0) && (out > run) )
+		{
+		    out--;
+		}
+		nx_pattern_literal_end(&run, out, &best, &bestlen);
+		break;
+	    case '+':
+	    case '.':
+	    case '^':
+	    case '$':
+		nx_pattern_literal_end(&run, out, &best, &bestlen);
+		break;
+	    default:
+		if ( depth == 0 )
+		{
+		    *out = *p;
+		    out++;
+		}
+		break;
+	}
+    }
+    nx_pattern_literal_end(&run, out, &best, &bestlen);
+
+    if ( best == NULL )
+    {
+	return ( 0 );
+    }
+    *literal = apr_pstrndup(pool, best, bestlen);
+
+    return ( bestlen );
+}
+
+
+
+static nx_pattern_fieldindex_t *nx_pattern_index_get_field(apr_pool_t *pool,
+							   nx_pattern_index_t *index,
+							   const char *name)
+{
+    nx_pattern_fieldindex_t *fieldindex;
+    int i;
+
+    for ( i = 0; i < index->fields->nelts; i++ )
+    {
+	fieldindex = &(((nx_pattern_fieldindex_t *) index->fields->elts)[i]);
+	if ( strcasecmp(fieldindex->name, name) == 0 )
+	{
+	    return ( fieldindex );
+	}
+    }
+
+    fieldindex = (nx_pattern_fieldindex_t *) apr_array_push(index->fields);
+    memset(fieldindex, 0, sizeof(nx_pattern_fieldindex_t));
+    fieldindex->name = name;
+    fieldindex->keyed = apr_pcalloc(pool, sizeof(uint32_t) * (size_t) index->num_word);
+
+    return ( fieldindex );
+}
+
+
+
+static void nx_patterngroup_build_index(apr_pool_t *pool, nx_patterngroup_t *group)
+{
+    nx_pattern_index_t *index;
+    nx_pattern_fieldindex_t *fieldindex;
+    nx_pattern_t *pattern;
+    nx_pattern_matchfield_t *matchfield, *keyfield;
+    nx_pattern_anchor_t *anchor;
+    const char *key, *literal;
+    size_t keylen, len;
+    int unindexed = 0;
+    uint32_t bucket;
+
+    index = apr_pcalloc(pool, sizeof(nx_pattern_index_t));
+    for ( pattern = NX_DLIST_FIRST(group->patterns);
+	  pattern != NULL;
+	  pattern = NX_DLIST_NEXT(pattern, link) )
+    {
+	pattern->idx = index->num_pattern;
+	(index->num_pattern)++;
+    }
+    index->num_word = (index->num_pattern + 31) / 32;
+    if ( index->num_word == 0 )
+    {
+	index->num_word = 1;
+    }
+    index->unindexed = apr_pcalloc(pool, sizeof(uint32_t) * (size_t) index->num_word);
+    index->fields = apr_array_make(pool, 4, sizeof(nx_pattern_fieldindex_t));
+
+    for ( pattern = NX_DLIST_FIRST(group->patterns);
+	  pattern != NULL;
+	  pattern = NX_DLIST_NEXT(pattern, link) )
+    {
+	key = NULL;
+	keylen = 0;
+	keyfield = NULL;
+
+	// all matchfields must match so one key is enough, EXACT matches are in front
+	for ( matchfield = NX_DLIST_FIRST(pattern->matchfields);
+	      matchfield != NULL;
+	      matchfield = NX_DLIST_NEXT(matchfield, link) )
+	{
+	    if ( matchfield->type == NX_PATTERN_MATCH_TYPE_EXACT )
+	    {
+		key = matchfield->value;
+		keylen = strlen(key);
+		keyfield = matchfield;
+		break;
+	    }
+	    if ( matchfield->type == NX_PATTERN_MATCH_TYPE_REGEXP )
+	    {
+		len = nx_pattern_regexp_literal(pool, matchfield->value, &literal);
+		if ( (len >= NX_PATTERN_ANCHOR_MIN) && (len > keylen) )
+		{
+		    key = literal;
+		    keylen = len;
+		    keyfield = matchfield;
+		}
+	    }
+	}
+
+	if ( keyfield == NULL )
+	{
+	    NX_PATTERN_BITMAP_SET(index->unindexed, pattern->idx);
+	    unindexed++;
+	    continue;
+	}
+
+	fieldindex = nx_pattern_index_get_field(pool, index, keyfield->name);
+	NX_PATTERN_BITMAP_SET(fieldindex->keyed, pattern->idx);
+
+	anchor = apr_pcalloc(pool, sizeof(nx_pattern_anchor_t));
+	anchor->str = key;
+	anchor->len = keylen;
+	anchor->idx = pattern->idx;
+
+	if ( keyfield->type == NX_PATTERN_MATCH_TYPE_EXACT )
+	{
+	    if ( fieldindex->exact == NULL )
+	    {
+		fieldindex->exact = apr_hash_make(pool);
+	    }
+	    anchor->next = apr_hash_get(fieldindex->exact, key, APR_HASH_KEY_STRING);
+	    apr_hash_set(fieldindex->exact, key, APR_HASH_KEY_STRING, anchor);
+	}
+	else
+	{
+	    if ( fieldindex->literals == NULL )
+	    {
+		fieldindex->literals = apr_pcalloc(pool, sizeof(nx_pattern_anchor_t *) * NX_PATTERN_ANCHOR_BUCKETS);
+	    }
+	    bucket = nx_pattern_anchor_hash(key);
+	    anchor->next = fieldindex->literals[bucket];
+	    fieldindex->literals[bucket] = anchor;
+	}
+    }
+
+    log_debug("pattern group '%s' has %d patterns, %d without prefilter key",
+	      group->name, index->num_pattern, unindexed);
+    group->index = index;
+}
+
+
+
+/**
+ * Build the prefilter index of each group, must be called after all
+ * patterns have been added.
+ */
+void nx_patterndb_build_index(nx_patterndb_t *patterndb)
+{
+    nx_patterngroup_t *group;
+
+    ASSERT(patterndb != NULL);
+
+    for ( group = NX_DLIST_FIRST(patterndb->groups);
+	  group != NULL;
+	  group = NX_DLIST_NEXT(group, link) )
+    {
+	nx_patterngroup_build_index(patterndb->pool, group);
+    }
+}
+
+
+
+/**
+ * Compute the set of patterns which can possibly match the event.
+ * The result may contain false positives but never leaves out a pattern
+ * that would match.
+ */
+static void nx_pattern_index_candidates(const nx_pattern_index_t *index,
+					nx_logdata_t *logdata,
+					uint32_t *candidates)
+{
+    const nx_pattern_fieldindex_t *fieldindex;
+    const nx_pattern_anchor_t *anchor;
+    nx_logdata_field_t *logfield;
+    const char *str;
+    size_t len, pos;
+    int i, j;
+
+    memcpy(candidates, index->unindexed, sizeof(uint32_t) * (size_t) index->num_word);
+
+    for ( i = 0; i < index->fields->nelts; i++ )
+    {
+	fieldindex = &(((const nx_pattern_fieldindex_t *) index->fields->elts)[i]);
+	logfield = nx_logdata_get_field(logdata, fieldindex->name);
+	if ( (logfield == NULL) || (logfield->value->defined == FALSE) )
+	{ // none of the patterns keyed on this field can match
+	    continue;
+	}
+	if ( logfield->value->type != NX_VALUE_TYPE_STRING )
+	{ // the value is converted during the match, let these be evaluated
+	    for ( j = 0; j < index->num_word; j++ )
+	    {
+		candidates[j] |= fieldindex->keyed[j];
+	    }
+	    continue;
+	}
+
+	str = logfield->value->string->buf;
+	len = logfield->value->string->len;
+
+	if ( fieldindex->exact != NULL )
+	{
+	    for ( anchor = apr_hash_get(fieldindex->exact, str, APR_HASH_KEY_STRING);
+		  anchor != NULL;
+		  anchor = anchor->next )
+	    {
+		NX_PATTERN_BITMAP_SET(candidates, anchor->idx);
+	    }
+	}
+
+	if ( (fieldindex->literals != NULL) && (len >= NX_PATTERN_ANCHOR_MIN) )
+	{
+	    for ( pos = 0; pos <= len - NX_PATTERN_ANCHOR_MIN; pos++ )
+	    {
+		for ( anchor = fieldindex->literals[nx_pattern_anchor_hash(str + pos)];
+		      anchor != NULL;
+		      anchor = anchor->next )
+		{
+		    if ( NX_PATTERN_BITMAP_ISSET(candidates, anchor->idx) )
+		    {
+			continue;
+		    }
+		    if ( (anchor->len <= len - pos) &&
+			 (memcmp(anchor->str, str + pos, anchor->len) == 0) )
+		    {
+			NX_PATTERN_BITMAP_SET(candidates, anchor->idx);
+		    }
+		}
+	    }
+	}
+    }
+}
+
+
+
 static nx_logdata_t *nx_patterndb_pattern_exec(nx_module_t *module,
 					       nx_logdata_t *logdata,
 					       nx_pattern_t *pattern)
@@ -585,6 +1076,24 @@ static nx_logdata_t *nx_patterndb_pattern_exec(nx_module_t *module,
 
 
 
+/**
+ * Add the prefilter counters of an event, these are read by
+ * nx_patterndb_stats() from another thread.
+ */
+static void nx_pattern_index_account(nx_pattern_index_t *index,
+				     int64_t checkcnt,
+				     int64_t skipcnt)
+{
+    if ( (index == NULL) || (checkcnt == 0) )
+    {
+	return;
+    }
+    nx_atomic_add64(&(index->checkcnt), checkcnt);
+    nx_atomic_add64(&(index->skipcnt), skipcnt);
+}
+
+
+
 nx_logdata_t *nx_patterndb_match_logdata(nx_module_t *module,
 					 nx_logdata_t *logdata,
 					 nx_patterndb_t *patterndb,
@@ -595,6 +1104,11 @@ nx_logdata_t *nx_patterndb_match_logdata(nx_module_t *module,
     nx_logdata_field_t *tmpfield;
     nx_logdata_field_list_t addfields;
     nx_logdata_field_t *setfield;
+    apr_time_t starttime = 0;
+    apr_time_t now;
+    int64_t checkcnt, skipcnt;
+    boolean matches;
+    boolean timed;
 
     ASSERT(module != NULL);
     ASSERT(logdata != NULL);
@@ -603,10 +1117,20 @@ nx_logdata_t *nx_patterndb_match_logdata(nx_module_t *module,
 
     NX_DLIST_INIT(&addfields, nx_logdata_field_t, link);
 
+    // reading the clock for each pattern would cost more than the cheap ones
+    (patterndb->costsample)++;
+    timed = (patterndb->costsample % NX_PATTERN_COST_SAMPLE) == 0;
+    if ( timed == TRUE )
+    {
+	starttime = apr_time_now();
+    }
+
     for ( group = NX_DLIST_FIRST(patterndb->groups);
 	  group != NULL;
 	  group = NX_DLIST_NEXT(group, link) )
     {
+	uint32_t candidates[(group->index != NULL) ? group->index->num_word : 1];
+
 	//log_debug("matching group '%s'", group->name);
 
 	if ( nx_patterndb_match_matchfields(logdata, group->matchfields, NULL, TRUE, group->name) != TRUE )
@@ -614,14 +1138,41 @@ nx_logdata_t *nx_patterndb_match_logdata(nx_module_t *module,
 	    continue;
 	}
 
+	if ( group->index != NULL )
+	{
+	    nx_pattern_index_candidates(group->index, logdata, candidates);
+	}
+	checkcnt = 0;
+	skipcnt = 0;
+
 	for ( pattern = NX_DLIST_FIRST(group->patterns);
 	      pattern != NULL;
 	      pattern = NX_DLIST_NEXT(pattern, link) )
 	{
 	    //log_debug("matching pattern '%ld'", pattern->id);
 
-	    if ( nx_patterndb_match_matchfields(logdata, pattern->matchfields, &addfields, FALSE, pattern->name) == TRUE )
+	    if ( group->index != NULL )
+	    {
+		checkcnt++;
+		if ( !NX_PATTERN_BITMAP_ISSET(candidates, pattern->idx) )
+		{
+		    skipcnt++;
+		    continue;
+		}
+	    }
+
+	    matches = nx_patterndb_match_matchfields(logdata, pattern->matchfields, &addfields, FALSE, pattern->name);
+	    if ( timed == TRUE )
+	    {
+		now = apr_time_now();
+		nx_atomic_add64(&(pattern->cost), (now - starttime) * NX_PATTERN_COST_SAMPLE);
+		starttime = now;
+	    }
+	    nx_atomic_add64(&(pattern->evalcnt), 1);
+
+	    if ( matches == TRUE )
 	    {   // if we get here all fields matched, i.e. the pattern matches
+		nx_pattern_index_account(group->index, checkcnt, skipcnt);
 		*matched = pattern;
 		while ( (tmpfield = NX_DLIST_FIRST(&addfields)) != NULL )
 		{ // now add captured fields
@@ -666,6 +1217,7 @@ nx_logdata_t *nx_patterndb_match_logdata(nx_module_t *module,
 		nx_logdata_field_free(tmpfield);
 	    }
 	}
+	nx_pattern_index_account(group->index, checkcnt, skipcnt);
     }
 
     return ( logdata );
@@ -673,6 +1225,112 @@ nx_logdata_t *nx_patterndb_match_logdata(nx_module_t *module,
 
 
 
+/// counters of a pattern copied for sorting while the patterns are being matched
+typedef struct nx_pattern_cost_t
+{
+    const nx_pattern_t	*pattern;
+    int64_t		evalcnt;
+    int64_t		cost;
+} nx_pattern_cost_t;
+
+
+
+static int nx_pattern_cost_cmp(const void *a, const void *b)
+{
+    const nx_pattern_cost_t *pa = (const nx_pattern_cost_t *) a;
+    const nx_pattern_cost_t *pb = (const nx_pattern_cost_t *) b;
+
+    if ( pa->cost > pb->cost )
+    {
+	return ( -1 );
+    }
+    if ( pa->cost < pb->cost )
+    {
+	return ( 1 );
+    }
+    return ( 0 );
+}
+
+
+
+/**
+ * Return the prefilter statistics of each group and the cost of the
+ * max_patterns most expensive patterns. The string must be freed by the caller.
+ */
+char *nx_patterndb_stats(nx_patterndb_t *patterndb, int max_patterns)
+{
+    nx_patterngroup_t *group;
+    nx_pattern_t *pattern;
+    nx_pattern_cost_t *patterns;
+    nx_string_t *str;
+    char *retval;
+    int num_pattern = 0;
+    int i;
+
+    ASSERT(patterndb != NULL);
+
+    str = nx_string_new();
+    for ( group = NX_DLIST_FIRST(patterndb->groups);
+	  group != NULL;
+	  group = NX_DLIST_NEXT(group, link) )
+    {
+	for ( pattern = NX_DLIST_FIRST(group->patterns);
+	      pattern != NULL;
+	      pattern = NX_DLIST_NEXT(pattern, link) )
+	{
+	    num_pattern++;
+	}
+	if ( group->index != NULL )
+	{
+	    nx_string_sprintf_append(str, "   pattern group '%s': %"APR_INT64_T_FMT
+				     " of %"APR_INT64_T_FMT" patterns skipped by the prefilter"
+				     NX_LINEFEED, group->name,
+				     (int64_t) nx_atomic_read64(&(group->index->skipcnt)),
+				     (int64_t) nx_atomic_read64(&(group->index->checkcnt)));
+	}
+    }
+
+    patterns = malloc(sizeof(nx_pattern_cost_t) * (size_t) (num_pattern + 1));
+    num_pattern = 0;
+    for ( group = NX_DLIST_FIRST(patterndb->groups);
+	  group != NULL;
+	  group = NX_DLIST_NEXT(group, link) )
+    {
+	for ( pattern = NX_DLIST_FIRST(group->patterns);
+	      pattern != NULL;
+	      pattern = NX_DLIST_NEXT(pattern, link) )
+	{
+	    patterns[num_pattern].pattern = pattern;
+	    patterns[num_pattern].evalcnt = (int64_t) nx_atomic_read64(&(pattern->evalcnt));
+	    patterns[num_pattern].cost = (int64_t) nx_atomic_read64(&(pattern->cost));
+	    num_pattern++;
+	}
+    }
+    qsort(patterns, (size_t) num_pattern, sizeof(nx_pattern_cost_t), nx_pattern_cost_cmp);
+
+    for ( i = 0; (i < num_pattern) && (i < max_patterns); i++ )
+    {
+	if ( patterns[i].evalcnt == 0 )
+	{
+	    continue;
+	}
+	nx_string_sprintf_append(str, "   pattern %"APR_INT64_T_FMT" (%s): evaluated %"
+				 APR_INT64_T_FMT", matched %"APR_INT64_T_FMT
+				 ", cost %"APR_INT64_T_FMT" usec"NX_LINEFEED,
+				 patterns[i].pattern->id, patterns[i].pattern->name,
+				 patterns[i].evalcnt, patterns[i].pattern->matchcnt,
+				 patterns[i].cost);
+    }
+    free(patterns);
+
+    retval = strdup(str->buf);
+    nx_string_free(str);
+
+    return ( retval );
+}
+
+
+
 void nx_patterndb_parse_exec_block(nx_module_t *module,
 				   nx_patterndb_t *patterndb,
 				   nx_pattern_t *pattern,
@@ -709,6 +1367,7 @@ void nx_patterndb_parse_exec_block(nx_module_t *module,
 	    NX_DLIST_REMOVE(statements, stmnt, link);
 	    NX_DLIST_INSERT_TAIL(pattern->exec, stmnt, link);
 	}
+	nx_expr_statement_list_compile(patterndb->pool, pattern->exec);
     }
 }
 
@@ -8,10 +8,10 @@
 #ifndef __NX_PATTERNDB_H
 #define __NX_PATTERNDB_H
 
-#include <pcre.h>
 #include "../../../common/types.h"
 #include "../../../common/dlist.h"
 #include "../../../common/value.h"
+#include "../../../common/regexp.h"
 #include "../../../common/logdata.h"
 #include "../../../common/expr.h"
 
@@ -40,6 +40,9 @@ typedef struct nx_pattern_t nx_pattern_t;
 typedef struct nx_patterngroup_t nx_patterngroup_t;
 typedef struct nx_patterndb_t nx_patterndb_t;
 typedef struct nx_pattern_field_t nx_pattern_field_t;
+typedef struct nx_pattern_anchor_t nx_pattern_anchor_t;
+typedef struct nx_pattern_fieldindex_t nx_pattern_fieldindex_t;
+typedef struct nx_pattern_index_t nx_pattern_index_t;
 
 
 struct nx_pattern_capturedfield_t
@@ -57,7 +60,7 @@ struct nx_pattern_matchfield_t
     const char 					*name;
     nx_pattern_match_type_t			type;
     const char					*value;
-    pcre 					*regexp; ///< if type is REGEXP
+    nx_regexp_t				*regexp; ///< if type is REGEXP
     int						capturedfield_cnt; // number for captured fields
     nx_pattern_capturedfields_t			*capturedfields;
 };
@@ -74,6 +77,9 @@ struct nx_pattern_t
     nx_patterngroup_t			*group; ///< pointer to the group this belongs to
     nx_logdata_field_list_t		*setfields;
     nx_expr_statement_list_t		*exec;	///< Statement blocks to execute
+    int32_t				idx;	///< position in the group index
+    int64_t				evalcnt; ///< number of times the matchfields were evaluated
+    apr_time_t				cost;	///< estimated time spent evaluating the matchfields, sampled
 };
 
 
@@ -86,6 +92,45 @@ struct nx_patterngroup_t
     nx_patterns_t			*patterns;
     nx_patterndb_t			*patterndb; ///< pointer to the patterndb this belongs to
     nx_pattern_matchfields_t		*matchfields;
+    nx_pattern_index_t			*index;	///< prefilter, NULL until nx_patterndb_build_index()
+};
+
+
+
+/*
+ * Each pattern in a group is keyed on one of its matchfields: either the value
+ * of an EXACT match or a literal string which must occur in the subject for
+ * the REGEXP to match. Only the patterns whose key is found in the event
+ * are evaluated, patterns without a usable key are always evaluated.
+ */
+struct nx_pattern_anchor_t
+{
+    nx_pattern_anchor_t			*next;	///< next anchor in the same bucket
+    const char				*str;
+    size_t				len;
+    int32_t				idx;	///< pattern index
+};
+
+
+
+struct nx_pattern_fieldindex_t
+{
+    const char				*name;	///< field name
+    apr_hash_t				*exact;	///< EXACT values, the value is a chain of anchors
+    nx_pattern_anchor_t			**literals; ///< NX_PATTERN_ANCHOR_BUCKETS buckets or NULL
+    uint32_t				*keyed;	///< bitmap of all patterns keyed on this field
+};
+
+
+
+struct nx_pattern_index_t
+{
+    int32_t				num_pattern;
+    int32_t				num_word; ///< bitmap size in 32 bit words
+    uint32_t				*unindexed; ///< bitmap of patterns without a key
+    apr_array_header_t			*fields; ///< array of nx_pattern_fieldindex_t
+    int64_t				checkcnt; ///< number of patterns considered
+    int64_t				skipcnt; ///< number of patterns skipped by the prefilter
 };
 
 
@@ -94,6 +139,7 @@ struct nx_patterndb_t
 {
     apr_pool_t		*pool;
     nx_patterngroups_t	*groups;
+    uint32_t		costsample; ///< events matched, for sampling the pattern cost
     // FIXME testcases
 };
 
@@ -134,6 +180,8 @@ nx_logdata_t *nx_patterndb_match_logdata(nx_module_t *module,
 					 nx_logdata_t *logdata,
 					 nx_patterndb_t *patterndb,
 					 const nx_pattern_t **matched);
+void nx_patterndb_build_index(nx_patterndb_t *patterndb);
+char *nx_patterndb_stats(nx_patterndb_t *patterndb, int max_patterns);
 void nx_patterndb_parse_exec_block(nx_module_t *module,
 				   nx_patterndb_t *patterndb,
 				   nx_pattern_t *pattern,
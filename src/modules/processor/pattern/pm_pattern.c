@@ -16,6 +16,8 @@
 
 #define NX_LOGMODULE NX_LOGMODULE_MODULE
 
+#define PM_PATTERN_STATS_MAX 10 ///< number of patterns listed in the module info
+
 static nx_logdata_t *pm_pattern_process(nx_module_t *module, nx_logdata_t *logdata)
 {
     nx_pm_pattern_conf_t *modconf;
@@ -140,6 +142,7 @@ static void pm_pattern_start(nx_module_t *module)
     {
 	log_warn("no pattern groups found");
     }
+    nx_patterndb_build_index(modconf->patterndb);
 }
 
 
@@ -161,6 +164,24 @@ static void pm_pattern_stop(nx_module_t *module)
 
 
 
+static char *pm_pattern_info(nx_module_t *module)
+{
+    nx_pm_pattern_conf_t *modconf;
+
+    ASSERT(module != NULL);
+    ASSERT(module->config != NULL);
+
+    modconf = (nx_pm_pattern_conf_t *) module->config;
+    if ( modconf->patterndb == NULL )
+    {
+	return ( NULL );
+    }
+
+    return ( nx_patterndb_stats(modconf->patterndb, PM_PATTERN_STATS_MAX) );
+}
+
+
+
 NX_MODULE_DECLARATION nx_pm_pattern_module =
 {
     NX_MODULE_API_VERSION,
@@ -174,6 +195,6 @@ NX_MODULE_DECLARATION nx_pm_pattern_module =
     NULL,			// init
     NULL,			// shutdown
     pm_pattern_event,		// event
-    NULL,			// info
+    pm_pattern_info,		// info
     NULL,			// exports
 };
@@ -38,12 +38,12 @@ static nx_logdata_t *pm_transformer_process(nx_module_t *module, nx_logdata_t *l
 	case NX_PM_TRANSFORMER_FORMAT_SYSLOG_BSD:
 	case NX_PM_TRANSFORMER_FORMAT_SYSLOG_RFC3164:
 	    nx_syslog_parse_rfc3164(logdata, logdata->raw_event->buf,
-				    logdata->raw_event->len);
+				    logdata->raw_event->len, &(module->date_format));
 	    break;
 	case NX_PM_TRANSFORMER_FORMAT_SYSLOG_IETF:
 	case NX_PM_TRANSFORMER_FORMAT_SYSLOG_RFC5424:
 	    nx_syslog_parse_rfc5424(logdata, logdata->raw_event->buf,
-				    logdata->raw_event->len);
+				    logdata->raw_event->len, &(module->date_format));
 	    break;
 	case NX_PM_TRANSFORMER_FORMAT_CSV:
 	    nx_csv_parse(logdata, &(modconf->csv_in_ctx), logdata->raw_event->buf,
@@ -0,0 +1,53 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include <stdlib.h>
+
+#include "alloc-count.h"
+
+static uint64_t _allocs = 0;
+
+#ifdef HAVE_LD_WRAP
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    __sync_fetch_and_add(&_allocs, 1);
+    return ( __real_malloc(size) );
+}
+
+
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    __sync_fetch_and_add(&_allocs, 1);
+    return ( __real_calloc(nmemb, size) );
+}
+
+
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    __sync_fetch_and_add(&_allocs, 1);
+    return ( __real_realloc(ptr, size) );
+}
+
+#endif
+
+
+
+uint64_t nx_alloc_count()
+{
+    return ( __sync_fetch_and_add(&_allocs, 0) );
+}
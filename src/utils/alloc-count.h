@@ -0,0 +1,23 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_ALLOC_COUNT_H
+#define __NX_ALLOC_COUNT_H
+
+#include "../common/types.h"
+
+/*
+ * Binaries linked with -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+ * and liballoccount.la count the allocations made by the statically linked
+ * core libraries. Modules are loaded as DSOs and APR allocates from pools,
+ * these are not counted.
+ */
+
+/** Number of allocations so far, always 0 without linker support for --wrap */
+uint64_t nx_alloc_count();
+
+#endif	/* __NX_ALLOC_COUNT_H */
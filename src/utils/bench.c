@@ -0,0 +1,599 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+/*
+ * Runs predefined pipelines in-process and reports the throughput, CPU
+ * time, allocations and latency of each as JSON so that the numbers can
+ * be compared between commits. Every scenario sends its events to an
+ * om_null instance called 'out', the run ends when it has received all
+ * of them. Latency is measured by tracing a sample of the events.
+ */
+
+#include <unistd.h>
+#ifndef WIN32
+# include <sys/resource.h>
+#endif
+#include <apr_getopt.h>
+
+#include "../common/error_debug.h"
+#include "../common/event.h"
+#include "../common/alloc.h"
+#include "../common/atomic.h"
+#include "../common/trace.h"
+#include "../core/nxlog.h"
+#include "../core/modules.h"
+#include "../core/router.h"
+#include "../core/ctx.h"
+#include "../core/core.h"
+#include "alloc-count.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_CORE
+
+#define NX_BENCH_DEFAULT_COUNT 200000
+#define NX_BENCH_DEFAULT_PORT 15140
+#define NX_BENCH_DEFAULT_TRACE_RATE 100
+#define NX_BENCH_TIMEOUT 30 /* sec without progress */
+#define NX_BENCH_INPUT_FILE "nxlog-bench-input.log"
+#define NX_BENCH_PATTERN_FILE "nxlog-bench-patterndb.xml"
+
+typedef struct nx_bench_t
+{
+    apr_pool_t		*pool;
+    const char		*moduledir;
+    const char		*workdir;
+    const char		*only;		///< run only this scenario, NULL for all
+    int			count;		///< events per scenario
+    int			port;		///< used by the tcp scenario
+    int			trace_rate;
+} nx_bench_t;
+
+typedef struct nx_bench_result_t
+{
+    uint64_t		events;
+    uint64_t		bytes;
+    apr_time_t		elapsed;
+    int64_t		cpu;		///< user and system time in usec
+    uint64_t		allocs;
+    nx_histogram_t	latency;
+    boolean		complete;	///< FALSE if the run stalled before all events arrived
+} nx_bench_result_t;
+
+typedef const char *(nx_bench_config_func_t)(nx_bench_t *bench);
+
+typedef struct nx_bench_scenario_t
+{
+    const char			*name;
+    const char			*route;	///< the route ending in 'out', latency is taken from this
+    nx_bench_config_func_t	*config;
+} nx_bench_scenario_t;
+
+
+
+static const char *bench_config_header(nx_bench_t *bench)
+{
+    return ( apr_psprintf(bench->pool,
+			  "ModuleDir %s\n"
+			  "CacheDir %s\n"
+			  "LogFile %s"NX_DIR_SEPARATOR"nxlog-bench.log\n"
+			  "LogLevel WARNING\n"
+			  "NoCache TRUE\n"
+			  "TraceSampleRate %d\n"
+			  "<Output out>\n"
+			  "    Module om_null\n"
+			  "</Output>\n",
+			  bench->moduledir, bench->workdir, bench->workdir,
+			  bench->trace_rate) );
+}
+
+
+
+static const char *bench_input_file(nx_bench_t *bench, const char *exec)
+{
+    return ( apr_psprintf(bench->pool,
+			  "<Input in>\n"
+			  "    Module im_file\n"
+			  "    File '%s"NX_DIR_SEPARATOR NX_BENCH_INPUT_FILE"'\n"
+			  "    SavePos FALSE\n"
+			  "    ReadFromLast FALSE\n"
+			  "%s%s%s"
+			  "</Input>\n",
+			  bench->workdir,
+			  exec == NULL ? "" : "    Exec ", exec == NULL ? "" : exec,
+			  exec == NULL ? "" : "\n") );
+}
+
+
+
+static const char *bench_file_null(nx_bench_t *bench)
+{
+    return ( apr_pstrcat(bench->pool, bench_config_header(bench),
+			 bench_input_file(bench, NULL),
+			 "<Route file_null>\n"
+			 "    Path in => out\n"
+			 "</Route>\n", NULL) );
+}
+
+
+
+static const char *bench_tcp_tcp(nx_bench_t *bench)
+{
+    return ( apr_pstrcat(bench->pool, bench_config_header(bench),
+			 apr_psprintf(bench->pool,
+				      "<Input gen>\n"
+				      "    Module im_testgen\n"
+				      "    MaxCount %d\n"
+				      "</Input>\n"
+				      "<Output tcpout>\n"
+				      "    Module om_tcp\n"
+				      "    Host 127.0.0.1\n"
+				      "    Port %d\n"
+				      "</Output>\n"
+				      "<Input tcpin>\n"
+				      "    Module im_tcp\n"
+				      "    Host 127.0.0.1\n"
+				      "    Port %d\n"
+				      "</Input>\n",
+				      bench->count, bench->port, bench->port),
+			 "<Route tcp_send>\n"
+			 "    Path gen => tcpout\n"
+			 "</Route>\n"
+			 "<Route tcp_tcp>\n"
+			 "    Path tcpin => out\n"
+			 "</Route>\n", NULL) );
+}
+
+
+
+static const char *bench_syslog_json(nx_bench_t *bench)
+{
+    return ( apr_pstrcat(bench->pool, bench_config_header(bench),
+			 "<Extension syslog>\n"
+			 "    Module xm_syslog\n"
+			 "</Extension>\n"
+			 "<Extension json>\n"
+			 "    Module xm_json\n"
+			 "</Extension>\n",
+			 bench_input_file(bench, "parse_syslog(); to_json();"),
+			 "<Route syslog_json>\n"
+			 "    Path in => out\n"
+			 "</Route>\n", NULL) );
+}
+
+
+
+static const char *bench_pattern(nx_bench_t *bench)
+{
+    return ( apr_pstrcat(bench->pool, bench_config_header(bench),
+			 "<Extension syslog>\n"
+			 "    Module xm_syslog\n"
+			 "</Extension>\n",
+			 bench_input_file(bench, "parse_syslog_bsd();"),
+			 apr_psprintf(bench->pool,
+				      "<Processor pattern>\n"
+				      "    Module pm_pattern\n"
+				      "    PatternFile '%s"NX_DIR_SEPARATOR NX_BENCH_PATTERN_FILE"'\n"
+				      "</Processor>\n", bench->workdir),
+			 "<Route pattern>\n"
+			 "    Path in => pattern => out\n"
+			 "</Route>\n", NULL) );
+}
+
+
+
+static const char *bench_buffer_disk(nx_bench_t *bench)
+{
+    return ( apr_pstrcat(bench->pool, bench_config_header(bench),
+			 apr_psprintf(bench->pool,
+				      "<Input gen>\n"
+				      "    Module im_testgen\n"
+				      "    MaxCount %d\n"
+				      "</Input>\n"
+				      "<Processor buffer>\n"
+				      "    Module pm_buffer\n"
+				      "    Type Disk\n"
+				      "    MaxSize 1048576\n"
+				      "    Directory %s\n"
+				      "</Processor>\n", bench->count, bench->workdir),
+			 "<Route buffer_disk>\n"
+			 "    Path gen => buffer => out\n"
+			 "</Route>\n", NULL) );
+}
+
+
+
+static const nx_bench_scenario_t _scenarios[] =
+{
+    { "file-null", "file_null", bench_file_null },
+    { "tcp-tcp", "tcp_tcp", bench_tcp_tcp },
+    { "syslog-json", "syslog_json", bench_syslog_json },
+    { "pattern", "pattern", bench_pattern },
+    { "buffer-disk", "buffer_disk", bench_buffer_disk },
+    { NULL, NULL, NULL },
+};
+
+
+
+static void bench_write_file(nx_bench_t *bench, const char *name, const char *data, apr_size_t len)
+{
+    apr_file_t *file;
+    const char *filename;
+
+    filename = apr_psprintf(bench->pool, "%s"NX_DIR_SEPARATOR"%s", bench->workdir, name);
+    CHECKERR_MSG(apr_file_open(&file, filename, APR_WRITE | APR_CREATE | APR_TRUNCATE | APR_BINARY,
+			       APR_OS_DEFAULT, bench->pool),
+		 "couldn't open '%s' for writing", filename);
+    CHECKERR_MSG(apr_file_write_full(file, data, len, NULL), "couldn't write '%s'", filename);
+    CHECKERR_MSG(apr_file_close(file), "couldn't close '%s'", filename);
+}
+
+
+
+/**
+ * Write the input of the file based scenarios, it does not depend on
+ * anything but the count so that runs are comparable.
+ */
+static void bench_prepare(nx_bench_t *bench)
+{
+    static const char *patterndb =
+	"<?xml version='1.0' encoding='UTF-8'?>\n"
+	"<patterndb>\n"
+	" <created>2010-01-01 01:02:03</created>\n"
+	" <version>1</version>\n"
+	" <group>\n"
+	"  <name>ssh</name>\n"
+	"  <id>1</id>\n"
+	"  <matchfield>\n"
+	"   <name>SourceName</name>\n"
+	"   <type>exact</type>\n"
+	"   <value>sshd</value>\n"
+	"  </matchfield>\n"
+	"  <pattern>\n"
+	"   <id>1</id>\n"
+	"   <name>ssh auth success</name>\n"
+	"   <matchfield>\n"
+	"    <name>Message</name>\n"
+	"    <type>regexp</type>\n"
+	"    <value>^Accepted (\\S+) for (\\S+) from (\\S+) port \\d+ ssh2</value>\n"
+	"    <capturedfield><name>AuthMethod</name><type>string</type></capturedfield>\n"
+	"    <capturedfield><name>AccountName</name><type>string</type></capturedfield>\n"
+	"    <capturedfield><name>SourceIP4Address</name><type>string</type></capturedfield>\n"
+	"   </matchfield>\n"
+	"  </pattern>\n"
+	" </group>\n"
+	"</patterndb>\n";
+    nx_string_t *str;
+    int i;
+
+    str = nx_string_new();
+    for ( i = 0; i < bench->count; i++ )
+    {
+	if ( i % 2 == 0 )
+	{
+	    nx_string_sprintf_append(str, "<38>Oct 19 12:%02d:%02d host%d sshd[%d]: Accepted password for user%d"
+				     " from 10.0.%d.%d port %d ssh2\n", (i / 60) % 60, i % 60, i % 10,
+				     1000 + i % 500, i % 1000, (i / 256) % 256, i % 256, 1024 + i % 60000);
+	}
+	else
+	{
+	    nx_string_sprintf_append(str, "<13>Oct 19 12:%02d:%02d host%d app[%d]: request %d served in %d ms"
+				     " status=%d\n", (i / 60) % 60, i % 60, i % 10, 2000 + i % 100, i,
+				     i % 997, (i % 7 == 0) ? 500 : 200);
+	}
+    }
+    bench_write_file(bench, NX_BENCH_INPUT_FILE, str->buf, str->len);
+    nx_string_free(str);
+
+    bench_write_file(bench, NX_BENCH_PATTERN_FILE, patterndb, strlen(patterndb));
+}
+
+
+
+static int64_t bench_cpu_time()
+{
+#ifndef WIN32
+    struct rusage usage;
+
+    if ( getrusage(RUSAGE_SELF, &usage) == 0 )
+    {
+	return ( ((int64_t) usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * APR_USEC_PER_SEC +
+		 usage.ru_utime.tv_usec + usage.ru_stime.tv_usec );
+    }
+#endif
+    return ( 0 );
+}
+
+
+
+static nx_module_t *bench_sink(nx_ctx_t *ctx)
+{
+    nx_module_t *module;
+
+    for ( module = NX_DLIST_FIRST(ctx->modules);
+	  module != NULL;
+	  module = NX_DLIST_NEXT(module, link) )
+    {
+	if ( strcmp(module->name, "out") == 0 )
+	{
+	    return ( module );
+	}
+    }
+    throw_msg("output 'out' is missing from the configuration");
+}
+
+
+
+/**
+ * Wait until the sink has received all events. Returns FALSE if no
+ * progress was made for NX_BENCH_TIMEOUT seconds.
+ */
+static boolean bench_wait(nx_bench_t *bench, nx_module_t *sink)
+{
+    uint64_t events, last = 0;
+    apr_time_t progress;
+
+    progress = apr_time_now();
+    for ( ; ; )
+    {
+	apr_sleep(APR_USEC_PER_SEC / 100);
+	events = nx_atomic_read64(&(sink->evt_fwd));
+	if ( events >= (uint64_t) bench->count )
+	{
+	    return ( TRUE );
+	}
+	if ( events != last )
+	{
+	    last = events;
+	    progress = apr_time_now();
+	}
+	else if ( apr_time_now() - progress > NX_BENCH_TIMEOUT * APR_USEC_PER_SEC )
+	{
+	    log_error("no progress in %d seconds, received %" APR_UINT64_T_FMT " of %d events",
+		      NX_BENCH_TIMEOUT, events, bench->count);
+	    return ( FALSE );
+	}
+    }
+}
+
+
+
+static void bench_run(nx_bench_t *bench,
+		      const nx_bench_scenario_t *scenario,
+		      nx_bench_result_t *result)
+{
+    nxlog_t nxlog;
+    nx_module_t *sink;
+    nx_metrics_shard_t total;
+    const char *config;
+    const char *cfgfile;
+    apr_time_t started;
+    int64_t cpu;
+    uint64_t allocs;
+
+    memset(result, 0, sizeof(nx_bench_result_t));
+
+    config = scenario->config(bench);
+    cfgfile = apr_psprintf(bench->pool, "nxlog-bench-%s.conf", scenario->name);
+    bench_write_file(bench, cfgfile, config, strlen(config));
+
+    nxlog_init(&nxlog);
+    nxlog.cfgfile = apr_psprintf(nxlog.pool, "%s"NX_DIR_SEPARATOR"%s", bench->workdir, cfgfile);
+
+    nx_ctx_parse_cfg(nxlog.ctx, nxlog.cfgfile);
+    nx_ctx_init_logging(nxlog.ctx);
+    nx_config_cache_read();
+    nx_ctx_config_modules(nxlog.ctx);
+    nx_ctx_init_modules(nxlog.ctx);
+    nx_ctx_init_routes(nxlog.ctx);
+    nx_ctx_init_jobs(nxlog.ctx);
+    sink = bench_sink(nxlog.ctx);
+
+    started = apr_time_now();
+    cpu = bench_cpu_time();
+    allocs = nx_alloc_count();
+
+    nxlog_create_threads(&nxlog);
+    nx_ctx_start_modules(nxlog.ctx);
+    result->complete = bench_wait(bench, sink);
+
+    result->elapsed = apr_time_now() - started;
+    result->cpu = bench_cpu_time() - cpu;
+    result->allocs = nx_alloc_count() - allocs;
+    result->events = nx_atomic_read64(&(sink->evt_fwd));
+    nx_metrics_get(sink->metrics, &total);
+    result->bytes = total.counters[NX_METRICS_BYTES_OUT];
+    nx_trace_get_route_latency(scenario->route, &(result->latency));
+
+    nxlog_shutdown(&nxlog);
+    nx_ctx_free(nxlog.ctx);
+    apr_pool_destroy(nxlog.pool);
+}
+
+
+
+static void bench_result_to_json(nx_string_t *str,
+				 const nx_bench_scenario_t *scenario,
+				 const nx_bench_result_t *result)
+{
+    double seconds;
+    double events;
+
+    seconds = (double) (result->elapsed > 0 ? result->elapsed : 1) / APR_USEC_PER_SEC;
+    events = (double) (result->events > 0 ? result->events : 1);
+
+    nx_string_sprintf_append(str, "{\"name\":\"%s\",\"complete\":%s,\"events\":%" APR_UINT64_T_FMT
+			     ",\"bytes\":%" APR_UINT64_T_FMT ",\"seconds\":%.3f,\"eps\":%.0f"
+			     ",\"bytes_per_sec\":%.0f,\"cpu_ns_per_event\":%.0f,\"allocs_per_event\":%.2f"
+			     ",\"latency_sampled\":%" APR_UINT64_T_FMT ",\"latency_p50_us\":%" APR_UINT64_T_FMT
+			     ",\"latency_p99_us\":%" APR_UINT64_T_FMT "}",
+			     scenario->name, result->complete == TRUE ? "true" : "false",
+			     result->events, result->bytes, seconds,
+			     (double) result->events / seconds, (double) result->bytes / seconds,
+			     (double) result->cpu * 1000.0 / events, (double) result->allocs / events,
+			     result->latency.count, nx_histogram_percentile(&(result->latency), 50),
+			     nx_histogram_percentile(&(result->latency), 99));
+}
+
+
+
+static void print_usage()
+{
+    int i;
+
+    printf(
+	   " nxlog-bench [-h/help] [-m/moduledir dir] [-d/workdir dir] [-n/count N]\n"
+	   "             [-s/scenario name] [-p/port port] [-t/trace N]\n"
+	   "   [-h] print help\n"
+	   "   [-m dir] directory of the modules, e.g. src/modules in the build tree\n"
+	   "   [-d dir] directory for the generated configs and input files (default: .)\n"
+	   "   [-n N] number of events per scenario (default: %d)\n"
+	   "   [-s name] run only this scenario\n"
+	   "   [-p port] local port used by the tcp scenario (default: %d)\n"
+	   "   [-t N] trace one in N events for the latency percentiles (default: %d)\n"
+	   " scenarios:", NX_BENCH_DEFAULT_COUNT, NX_BENCH_DEFAULT_PORT, NX_BENCH_DEFAULT_TRACE_RATE);
+    for ( i = 0; _scenarios[i].name != NULL; i++ )
+    {
+	printf(" %s", _scenarios[i].name);
+    }
+    printf("\n");
+}
+
+
+
+static int parse_int_arg(const char *arg)
+{
+    int value;
+
+    if ( (sscanf(arg, "%d", &value) != 1) || (value <= 0) )
+    {
+	print_usage();
+	exit(-1);
+    }
+
+    return ( value );
+}
+
+
+
+static void parse_cmd_line(nx_bench_t *bench, int argc, const char * const *argv)
+{
+    const char *opt_arg;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    int ch;
+
+    static const apr_getopt_option_t options[] = {
+	{ "help", 'h', 0, "print help" },
+	{ "moduledir", 'm', 1, "module directory" },
+	{ "workdir", 'd', 1, "work directory" },
+	{ "count", 'n', 1, "events per scenario" },
+	{ "scenario", 's', 1, "run only this scenario" },
+	{ "port", 'p', 1, "port of the tcp scenario" },
+	{ "trace", 't', 1, "trace sample rate" },
+	{ NULL, 0, 1, NULL },
+    };
+
+    apr_getopt_init(&opt, bench->pool, argc, argv);
+    while ( (rv = apr_getopt_long(opt, options, &ch, &opt_arg)) == APR_SUCCESS )
+    {
+	switch ( ch )
+	{
+	    case 'm':
+		bench->moduledir = apr_pstrdup(bench->pool, opt_arg);
+		break;
+	    case 'd':
+		bench->workdir = apr_pstrdup(bench->pool, opt_arg);
+		break;
+	    case 'n':
+		bench->count = parse_int_arg(opt_arg);
+		break;
+	    case 's':
+		bench->only = apr_pstrdup(bench->pool, opt_arg);
+		break;
+	    case 'p':
+		bench->port = parse_int_arg(opt_arg);
+		break;
+	    case 't':
+		bench->trace_rate = parse_int_arg(opt_arg);
+		break;
+	    case 'h':
+		print_usage();
+		exit(-1);
+	    default:
+		print_usage();
+		exit(-1);
+	}
+    }
+
+    if ( (rv != APR_SUCCESS) && (rv != APR_EOF) )
+    {
+        throw(rv, "Could not parse options");
+    }
+}
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    nx_bench_t bench;
+    nx_bench_result_t result;
+    nx_string_t *str;
+    nx_exception_t e;
+    int i, cnt = 0;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    memset(&bench, 0, sizeof(nx_bench_t));
+    bench.pool = nx_pool_create_core();
+    bench.moduledir = NX_MODULEDIR;
+    bench.workdir = ".";
+    bench.count = NX_BENCH_DEFAULT_COUNT;
+    bench.port = NX_BENCH_DEFAULT_PORT;
+    bench.trace_rate = NX_BENCH_DEFAULT_TRACE_RATE;
+
+    str = nx_string_new();
+    try
+    {
+	parse_cmd_line(&bench, argc, argv);
+	nx_string_sprintf_append(str, "{\"count\":%d,\"trace_rate\":%d,\"scenarios\":[",
+				 bench.count, bench.trace_rate);
+	bench_prepare(&bench);
+
+	for ( i = 0; _scenarios[i].name != NULL; i++ )
+	{
+	    if ( (bench.only != NULL) && (strcmp(bench.only, _scenarios[i].name) != 0) )
+	    {
+		continue;
+	    }
+	    bench_run(&bench, &(_scenarios[i]), &result);
+	    if ( cnt > 0 )
+	    {
+		nx_string_append(str, ",", 1);
+	    }
+	    bench_result_to_json(str, &(_scenarios[i]), &result);
+	    cnt++;
+	}
+    }
+    catch(e)
+    {
+	log_exception(e);
+	exit(1);
+    }
+
+    if ( cnt == 0 )
+    {
+	print_usage();
+	exit(-1);
+    }
+    nx_string_append(str, "]}\n", -1);
+    printf("%s", str->buf);
+    nx_string_free(str);
+
+    apr_pool_destroy(bench.pool);
+    apr_terminate();
+
+    return ( 0 );
+}
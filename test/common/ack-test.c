@@ -0,0 +1,90 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/ack.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+nxlog_t nxlog;
+
+#define WINDOW 4
+
+int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
+{
+    nx_ack_source_t *source;
+    nx_logdata_t *logdata[WINDOW * 2];
+    nx_logdata_t *clone;
+    int64_t offset, extra;
+    int i;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    source = nx_ack_source_new(WINDOW, 100, 1);
+    ASSERT(source->size == WINDOW);
+    ASSERT(nx_ack_source_committed(source, &offset, &extra) == FALSE);
+    ASSERT(offset == 100);
+    ASSERT(extra == 1);
+
+    // two batches of two events
+    for ( i = 0; i < 4; i++ )
+    {
+	logdata[i] = nx_logdata_new_logline("test", 4);
+	nx_ack_source_track(source, logdata[i], 110 + i * 10, 2 + i);
+	if ( i == 1 )
+	{
+	    nx_ack_source_seal(source);
+	}
+    }
+    nx_ack_source_seal(source);
+    ASSERT(source->refcnt == 5);
+
+    // out of order delivery must not move the committed position
+    nx_logdata_free(logdata[2]);
+    nx_logdata_free(logdata[0]);
+    ASSERT(nx_ack_source_committed(source, &offset, &extra) == FALSE);
+    ASSERT(offset == 100);
+
+    nx_logdata_free(logdata[1]);
+    ASSERT(nx_ack_source_committed(source, &offset, &extra) == TRUE);
+    ASSERT(offset == 120);
+    ASSERT(extra == 3);
+
+    // a clone must be acknowledged as well
+    clone = nx_logdata_clone(logdata[3]);
+    nx_logdata_free(logdata[3]);
+    ASSERT(nx_ack_source_committed(source, &offset, &extra) == FALSE);
+    nx_logdata_free(clone);
+    ASSERT(nx_ack_source_committed(source, &offset, &extra) == TRUE);
+    ASSERT(offset == 140);
+    ASSERT(extra == 5);
+    ASSERT(source->refcnt == 1);
+
+    // the window is full, the open slot keeps growing
+    for ( i = 0; i < WINDOW * 2; i++ )
+    {
+	logdata[i] = nx_logdata_new_logline("test", 4);
+	nx_ack_source_track(source, logdata[i], 200 + i, 0);
+	nx_ack_source_seal(source);
+    }
+    ASSERT(source->head - source->tail == WINDOW - 1);
+    for ( i = 0; i < WINDOW * 2 - 1; i++ )
+    {
+	nx_logdata_free(logdata[i]);
+    }
+    nx_ack_source_committed(source, &offset, &extra);
+    ASSERT(offset == 200 + WINDOW - 2);
+
+    // events in flight keep the source alive after the owner is gone
+    nx_ack_source_free(source);
+    nx_logdata_free(logdata[WINDOW * 2 - 1]);
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
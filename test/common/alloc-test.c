@@ -18,6 +18,108 @@ nxlog_t nxlog;
 
 #define LOOPCNT 1000
 
+
+
+static void check_scratch()
+{
+    nx_scratch_mark_t mark1, mark2;
+    nx_string_t *str1, *str2;
+    nx_value_t value;
+    char *ptr, *first;
+    char *value1, *value2;
+    apr_size_t size;
+    int i;
+
+    nx_scratch_mark(&mark1);
+    first = nx_scratch_alloc(10);
+    for ( i = 0; i < LOOPCNT; i++ )
+    { // spans several blocks, including ones larger than a block
+	size = (i % 7 == 0) ? NX_SCRATCH_BLOCK_SIZE * 2 : (apr_size_t) i;
+	ptr = nx_scratch_alloc(size);
+	ASSERT(((size_t) ptr % 8) == 0);
+	memset(ptr, 'x', size);
+    }
+    nx_scratch_release(&mark1);
+    ASSERT(nx_scratch_alloc(10) == first);
+
+    // strings are handed out again after release, nested marks are kept
+    nx_scratch_mark(&mark1);
+    str1 = nx_scratch_string();
+    nx_string_append(str1, "abc", 3);
+    nx_scratch_mark(&mark2);
+    str2 = nx_scratch_string();
+    ASSERT(str2 != str1);
+    nx_string_append(str2, "def", 3);
+    nx_scratch_release(&mark2);
+    ASSERT(strcmp(str1->buf, "abc") == 0);
+    ASSERT(nx_scratch_string() == str2);
+    ASSERT(str2->len == 0);
+    nx_scratch_release(&mark1);
+
+    ptr = nx_scratch_strdup("hello", -1);
+    ASSERT(strcmp(ptr, "hello") == 0);
+    ptr = nx_scratch_strdup("hello", 4);
+    ASSERT(strcmp(ptr, "hell") == 0);
+
+    nx_value_init_integer(&value, -42);
+    value1 = nx_value_to_string(&value);
+    value2 = nx_value_to_scratch_string(&value);
+    ASSERT(strcmp(value1, value2) == 0);
+    free(value1);
+    nx_value_init_datetime(&value, 1258531221650359LL);
+    value1 = nx_value_to_string(&value);
+    value2 = nx_value_to_scratch_string(&value);
+    ASSERT(strcmp(value1, value2) == 0);
+    free(value1);
+    value.defined = FALSE;
+    ASSERT(nx_value_to_scratch_string(&value) == NULL);
+
+    nx_scratch_reset();
+    str1 = nx_scratch_string();
+    nx_string_append(str1, "x", 1);
+    nx_scratch_reset();
+    ASSERT(nx_scratch_string() == str1);
+    ASSERT(str1->len == 0);
+    nx_scratch_reset();
+    nx_scratch_thread_cleanup();
+}
+
+
+
+static void* APR_THREAD_FUNC scratch_thread(apr_thread_t *thd, void *data)
+{
+    nx_scratch_alloc(NX_SCRATCH_BLOCK_SIZE * 2);
+    nx_scratch_string();
+
+    if ( data != NULL )
+    { // the per-thread resources must be freed on this path too
+	apr_thread_exit(thd, APR_SUCCESS);
+    }
+
+    return ( NULL );
+}
+
+
+
+static void check_thread_exit(apr_pool_t *pool)
+{
+    nx_scratch_stats_t before, after;
+    apr_thread_t *thread;
+    apr_status_t rv;
+    int i;
+
+    nx_scratch_get_stats(&before);
+    for ( i = 0; i < 10; i++ )
+    {
+	nx_thread_create(&thread, NULL, scratch_thread, i % 2 == 0 ? (void *) pool : NULL, pool);
+	CHECKERR(apr_thread_join(&rv, thread));
+    }
+    nx_scratch_get_stats(&after);
+    ASSERT(after.arenas == before.arenas);
+}
+
+
+
 int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
 {
     int i, j;
@@ -53,6 +155,9 @@ int main(int argc UNUSED, const char * const *argv, const char * const *env UNUS
 	apr_pool_destroy(pool);
     }
 
+    check_scratch();
+    check_thread_exit(mainpool);
+
     apr_terminate();
 
     printf("%s:	OK\n", argv[0]);
@@ -53,6 +53,30 @@ int main(int argc, const char * const *argv, const char * const *env)
     ASSERT(nx_config_cache_get_string("test", "skey2", &stringval) == TRUE);
     ASSERT(strcmp(stringval, "test2") == 0);
 
+    // updates are only kept in memory until a checkpoint
+    ASSERT(nxlog.ctx->cc_dirty == 4);
+    nx_config_cache_set_int("test", "ikey1", 4242);
+    ASSERT(nxlog.ctx->cc_dirty == 4);
+
+    nxlog.ctx->ccfilename = "configcache-test.dat";
+    nxlog.ctx->cc_flush_interval = 0;
+    nxlog.ctx->cc_flush_count = 5;
+    nx_config_cache_checkpoint();
+    ASSERT(nxlog.ctx->cc_dirty == 4);
+    nx_config_cache_set_int("test", "ikey1", 4343);
+    nx_config_cache_checkpoint();
+    ASSERT(nxlog.ctx->cc_dirty == 0);
+
+    // read back what was checkpointed
+    nx_config_cache_free();
+    ASSERT(nx_config_cache_get_int("test", "ikey1", &intval) == FALSE);
+    nx_config_cache_read();
+    ASSERT(nx_config_cache_get_int("test", "ikey1", &intval) == TRUE);
+    ASSERT(intval == 4343);
+    ASSERT(nx_config_cache_get_string("test", "skey2", &stringval) == TRUE);
+    ASSERT(strcmp(stringval, "test2") == 0);
+    apr_file_remove(nxlog.ctx->ccfilename, NULL);
+
     printf("%s:	OK\n", argv[0]);
     return ( 0 );
 }
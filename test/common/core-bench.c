@@ -0,0 +1,352 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/logdata.h"
+#include "../../src/common/date.h"
+#include "../../src/common/expr-parser.h"
+#include "../../src/common/alloc.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+#include "../../src/utils/alloc-count.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+nxlog_t nxlog;
+
+#define LOOPCNT 20000
+
+/*
+ * Timings of the core data structures as a baseline for changing them.
+ * The allocations/op are counted with liballoccount, see alloc-count.h.
+ */
+
+typedef struct bench_t
+{
+    const char		*name;
+    int			numfield;
+    apr_time_t		start;
+    uint64_t		allocs;
+} bench_t;
+
+
+
+static void bench_start(bench_t *bench, const char *name, int numfield)
+{
+    bench->name = name;
+    bench->numfield = numfield;
+    bench->allocs = nx_alloc_count();
+    bench->start = apr_time_now();
+}
+
+
+
+static void bench_end(bench_t *bench)
+{
+    apr_time_t elapsed;
+    uint64_t num_alloc;
+    char fields[20] = "";
+
+    elapsed = apr_time_now() - bench->start;
+    num_alloc = nx_alloc_count() - bench->allocs;
+
+    if ( bench->numfield >= 0 )
+    {
+	apr_snprintf(fields, sizeof(fields), "%d", bench->numfield);
+    }
+    printf("%-32s %6s %10.1f ns/op %8.2f allocs/op\n", bench->name, fields,
+	   (double) elapsed * 1000.0 / LOOPCNT, (double) num_alloc / LOOPCNT);
+}
+
+
+
+static nx_logdata_t *new_logdata(int numfield)
+{
+    nx_logdata_t *logdata;
+    const char *msg = "<38>Oct 19 12:00:00 host1 sshd[1234]: Accepted password for user1 from 10.0.0.1 port 22 ssh2";
+    char key[20];
+    int i;
+
+    logdata = nx_logdata_new_logline(msg, (int) strlen(msg));
+    for ( i = 0; i < numfield; i++ )
+    {
+	apr_snprintf(key, sizeof(key), "Field%d", i);
+	if ( i % 2 == 0 )
+	{
+	    nx_logdata_set_string(logdata, key, "some string value");
+	}
+	else
+	{
+	    nx_logdata_set_integer(logdata, key, i);
+	}
+    }
+
+    return ( logdata );
+}
+
+
+
+static void bench_logdata(int numfield)
+{
+    bench_t bench;
+    nx_logdata_t *logdata, *copy;
+    nx_logdata_field_t *field;
+    char key[20];
+    int i;
+
+    if ( numfield == 0 )
+    {
+	bench_start(&bench, "nx_logdata_new_logline+free", -1);
+	for ( i = 0; i < LOOPCNT; i++ )
+	{
+	    logdata = nx_logdata_new_logline("test message", 12);
+	    nx_logdata_free(logdata);
+	}
+	bench_end(&bench);
+    }
+
+    logdata = new_logdata(numfield);
+
+    bench_start(&bench, "nx_logdata_clone+free", numfield);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	copy = nx_logdata_clone(logdata);
+	nx_logdata_free(copy);
+    }
+    bench_end(&bench);
+
+    // the last field is the worst case for a list
+    apr_snprintf(key, sizeof(key), "Field%d", numfield > 0 ? numfield - 1 : 0);
+
+    bench_start(&bench, "nx_logdata_set_string existing", numfield);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	nx_logdata_set_string(logdata, key, "replaced value");
+    }
+    bench_end(&bench);
+
+    bench_start(&bench, "nx_logdata_set_integer new+delete", numfield);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	nx_logdata_set_integer(logdata, "NewField", i);
+	nx_logdata_delete_field(logdata, "NewField");
+    }
+    bench_end(&bench);
+
+    bench_start(&bench, "nx_logdata_get_field found", numfield);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	field = nx_logdata_get_field(logdata, key);
+    }
+    bench_end(&bench);
+    ASSERT((numfield == 0) || (field != NULL));
+
+    bench_start(&bench, "nx_logdata_get_field missing", numfield);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	field = nx_logdata_get_field(logdata, "MissingField");
+    }
+    bench_end(&bench);
+    ASSERT(field == NULL);
+
+    nx_logdata_free(logdata);
+}
+
+
+
+static void bench_serialize(int numfield)
+{
+    bench_t bench;
+    nx_logdata_t *logdata, *copy;
+    apr_size_t size, bytes;
+    char *buf;
+    int i;
+
+    logdata = new_logdata(numfield);
+    size = nx_logdata_serialized_size(logdata);
+    buf = malloc(size);
+
+    bench_start(&bench, "nx_logdata_to_membuf", numfield);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	ASSERT(nx_logdata_to_membuf(logdata, buf, nx_logdata_serialized_size(logdata)) == size);
+    }
+    bench_end(&bench);
+
+    bench_start(&bench, "nx_logdata_from_membuf+free", numfield);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	copy = nx_logdata_from_membuf(buf, size, &bytes);
+	nx_logdata_free(copy);
+    }
+    bench_end(&bench);
+    ASSERT(bytes == size);
+
+    free(buf);
+    nx_logdata_free(logdata);
+}
+
+
+
+static void bench_string()
+{
+    bench_t bench;
+    nx_string_t *str;
+    const char *chunk = "Accepted password for user1 ";
+    int len;
+    int i;
+
+    len = (int) strlen(chunk);
+    str = nx_string_new();
+    bench_start(&bench, "nx_string_append", -1);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	if ( i % 256 == 0 )
+	{ // keep the string short
+	    nx_string_set(str, "", 0);
+	}
+	nx_string_append(str, chunk, len);
+    }
+    bench_end(&bench);
+    nx_string_free(str);
+
+    bench_start(&bench, "nx_string_new+append+free", -1);
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	str = nx_string_new();
+	nx_string_append(str, chunk, len);
+	nx_string_free(str);
+    }
+    bench_end(&bench);
+}
+
+
+
+static void bench_date()
+{
+    static const char *dates[][2] =
+    {
+	{ "nx_date_parse rfc3164", "Oct 19 12:00:00 host1" },
+	{ "nx_date_parse iso", "2011-12-06T19:14:15.000003+01:00" },
+	{ "nx_date_parse apache", "24/Aug/2009:16:08:57 +0200" },
+	{ NULL, NULL },
+    };
+    bench_t bench;
+    apr_time_t t;
+    int i, j;
+
+    for ( j = 0; dates[j][0] != NULL; j++ )
+    {
+	bench_start(&bench, dates[j][0], -1);
+	for ( i = 0; i < LOOPCNT; i++ )
+	{
+	    ASSERT(nx_date_parse(&t, dates[j][1], NULL) == APR_SUCCESS);
+	}
+	bench_end(&bench);
+    }
+}
+
+
+
+static void bench_expr()
+{
+    static const char *exprs[][2] =
+    {
+	{ "evaluate comparison", "$SeverityValue > 3 and $Hostname == 'host1'" },
+	{ "evaluate regexp", "$raw_event =~ /accepted password/i" },
+	{ "evaluate function", "lc($Hostname) + '.example.com'" },
+	{ NULL, NULL },
+    };
+    static const char *statements[][2] =
+    {
+	{ "execute assignment", "$Hostname = lc($Hostname);" },
+	{ "execute regexp capture",
+	  "if $raw_event =~ /Accepted (\\S+) for (\\S+) from/ { $AuthMethod = $1; $AccountName = $2; }" },
+	{ "execute if/else", "if $SeverityValue >= 4 $Severity = 'ERROR'; else $Severity = 'INFO';" },
+	{ NULL, NULL },
+    };
+    bench_t bench;
+    apr_pool_t *pool;
+    nx_expr_t *expr;
+    nx_expr_statement_list_t *list;
+    nx_expr_eval_ctx_t eval_ctx;
+    nx_logdata_t *logdata;
+    nx_value_t result;
+    int i, j;
+
+    pool = nx_pool_create_child(NULL);
+    logdata = new_logdata(8);
+    nx_logdata_set_string(logdata, "Hostname", "HOST1");
+    nx_logdata_set_integer(logdata, "SeverityValue", 4);
+
+    for ( j = 0; exprs[j][0] != NULL; j++ )
+    {
+	expr = nx_expr_parse(NULL, exprs[j][1], pool, NULL, 1, 1);
+	nx_expr_eval_ctx_init(&eval_ctx, logdata, NULL, NULL);
+	bench_start(&bench, exprs[j][0], -1);
+	for ( i = 0; i < LOOPCNT; i++ )
+	{
+	    memset(&result, 0, sizeof(nx_value_t));
+	    nx_expr_evaluate(&eval_ctx, &result, expr);
+	    ASSERT(result.defined == TRUE);
+	    if ( result.type == NX_VALUE_TYPE_STRING )
+	    {
+		nx_value_kill(&result);
+	    }
+	}
+	bench_end(&bench);
+	nx_expr_eval_ctx_destroy(&eval_ctx);
+    }
+
+    for ( j = 0; statements[j][0] != NULL; j++ )
+    {
+	list = nx_expr_parse_statements(NULL, statements[j][1], pool, NULL, 1, 1);
+	bench_start(&bench, statements[j][0], -1);
+	for ( i = 0; i < LOOPCNT; i++ )
+	{
+	    nx_expr_eval_ctx_init(&eval_ctx, logdata, NULL, NULL);
+	    nx_expr_statement_list_execute(&eval_ctx, list);
+	    nx_expr_eval_ctx_destroy(&eval_ctx);
+	}
+	bench_end(&bench);
+    }
+    ASSERT(nx_logdata_get_field(logdata, "AccountName") != NULL);
+
+    nx_logdata_free(logdata);
+    apr_pool_destroy(pool);
+}
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    int fields[] = { 0, 8, 32, 128 };
+    unsigned int i;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    memset(&nxlog, 0, sizeof(nxlog_t));
+    nxlog_set(&nxlog);
+    nxlog.ctx = nx_ctx_new();
+    nxlog.ctx->loglevel = NX_LOGLEVEL_INFO;
+    nx_ctx_register_builtins(nxlog.ctx);
+
+    for ( i = 0; i < sizeof(fields) / sizeof(int); i++ )
+    {
+	bench_logdata(fields[i]);
+    }
+    for ( i = 0; i < sizeof(fields) / sizeof(int); i++ )
+    {
+	bench_serialize(fields[i]);
+    }
+    bench_string();
+    bench_date();
+    bench_expr();
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
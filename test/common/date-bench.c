@@ -0,0 +1,274 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/date.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+nxlog_t nxlog;
+
+#define LOOPCNT 20000
+
+typedef struct datesample
+{
+    const char *name;
+    const char *date;
+} datesample;
+
+
+static datesample samples[] =
+{
+    { "rfc3164", "Nov  2 10:45:18 host" },
+    { "rfc1123", "Sun, 06 Nov 1994 08:49:37 GMT" },
+    { "rfc1123", "Sun Nov  6 08:49:37 1994" },
+    { "rfc1123", "6 Nov 1994 08:49:37 GMT" },
+    { "iso", "2011-12-06T19:14:15.000003+01:00" },
+    { "iso", "2011-5-7 7:9:3" },
+    { "apache", "24/Aug/2009:16:08:57 +0200" },
+    { "cisco", "Nov 3 14:50:30.403" },
+    { "cisco", "Oct 12 2004 21:54:47" },
+    { "win", "20100426151354.537875-000" },
+    { "timestamp", "1258531221.650359" },
+    { "timestamp", "1258531221" },
+    { "invalid", "12 hello" },
+    { "invalid", "2011-12-06X" },
+    { "invalid", "" },
+    { NULL, NULL },
+};
+
+
+
+/* The cascade nx_date_parse() used before the format detection */
+static apr_status_t parse_cascade(apr_time_t *t, const char *date, const char **dateend)
+{
+    if ( nx_date_parse_rfc3164(t, date, dateend) == APR_SUCCESS )
+    {
+	return ( APR_SUCCESS );
+    }
+    if ( nx_date_parse_rfc1123(t, date, dateend) == APR_SUCCESS )
+    {
+	return ( APR_SUCCESS );
+    }
+    if ( nx_date_parse_iso(t, date, dateend) == APR_SUCCESS )
+    {
+	return ( APR_SUCCESS );
+    }
+    if ( nx_date_parse_apache(t, date, dateend) == APR_SUCCESS )
+    {
+	return ( APR_SUCCESS );
+    }
+    if ( nx_date_parse_cisco(t, date, dateend) == APR_SUCCESS )
+    {
+	return ( APR_SUCCESS );
+    }
+    if ( nx_date_parse_win(t, date, dateend) == APR_SUCCESS )
+    {
+	return ( APR_SUCCESS );
+    }
+    if ( nx_date_parse_timestamp(t, date, dateend) == APR_SUCCESS )
+    {
+	return ( APR_SUCCESS );
+    }
+
+    return ( APR_EBADDATE );
+}
+
+
+
+static void check_sample(const char *date)
+{
+    apr_time_t t1 = 0, t2 = 0, t3 = 0;
+    const char *end1 = NULL, *end2 = NULL, *end3 = NULL;
+    apr_status_t rv1, rv2, rv3;
+    nx_date_format_t format = NX_DATE_FORMAT_UNKNOWN;
+    int i;
+
+    rv1 = parse_cascade(&t1, date, &end1);
+    rv2 = nx_date_parse(&t2, date, &end2);
+    if ( (rv1 != rv2) || (t1 != t2) || (end1 != end2) )
+    {
+	nx_abort("nx_date_parse() differs from the cascade for '%s'", date);
+    }
+
+    // the remembered format of the other samples must not change the result
+    for ( i = NX_DATE_FORMAT_UNKNOWN; i < NX_DATE_FORMAT_NUM; i++ )
+    {
+	format = (nx_date_format_t) i;
+	t3 = 0;
+	end3 = NULL;
+	rv3 = nx_date_parse_format(&t3, date, &end3, &format);
+	if ( (rv1 != rv3) || (t1 != t3) || (end1 != end3) )
+	{
+	    nx_abort("nx_date_parse_format() with format %d differs from the cascade for '%s'",
+		     i, date);
+	}
+    }
+}
+
+
+
+static double bench(const char *date, int method)
+{
+    apr_time_t t;
+    apr_time_t start;
+    nx_date_format_t format = NX_DATE_FORMAT_UNKNOWN;
+    int i;
+
+    start = apr_time_now();
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	switch ( method )
+	{
+	    case 0:
+		parse_cascade(&t, date, NULL);
+		break;
+	    case 1:
+		nx_date_parse(&t, date, NULL);
+		break;
+	    default:
+		nx_date_parse_format(&t, date, NULL, &format);
+		break;
+	}
+    }
+
+    return ( (double) (apr_time_now() - start) * 1000.0 / LOOPCNT );
+}
+
+
+
+/* The formatting nx_date_to_rfc5424() did before caching the last second */
+static void format_rfc5424(char *dst, boolean gmt, apr_time_t t)
+{
+    apr_time_exp_t exp;
+
+    if ( gmt == TRUE )
+    {
+	ASSERT(apr_time_exp_gmt(&exp, t) == APR_SUCCESS);
+	apr_snprintf(dst, 30, "%d-%02d-%02dT%02d:%02d:%02d.%06dZ", exp.tm_year + 1900,
+		     exp.tm_mon + 1, exp.tm_mday, exp.tm_hour, exp.tm_min, exp.tm_sec,
+		     exp.tm_usec);
+    }
+    else
+    {
+	ASSERT(apr_time_exp_lt(&exp, t) == APR_SUCCESS);
+	apr_snprintf(dst, 33, "%d-%02d-%02dT%02d:%02d:%02d.%06d%+03d:%02d",
+		     exp.tm_year + 1900, exp.tm_mon + 1, exp.tm_mday, exp.tm_hour,
+		     exp.tm_min, exp.tm_sec, exp.tm_usec, exp.tm_gmtoff / 3600,
+		     (((exp.tm_gmtoff > 0) ? exp.tm_gmtoff : -exp.tm_gmtoff) / 60) % 60);
+    }
+}
+
+
+
+static void check_format(apr_time_t start)
+{
+    char expected[33];
+    char result[33];
+    apr_time_t t;
+    int i;
+
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	t = start + (apr_time_t) i * 123457;
+
+	format_rfc5424(expected, FALSE, t);
+	ASSERT(nx_date_to_rfc5424(result, sizeof(result), FALSE, t) == APR_SUCCESS);
+	if ( strcmp(expected, result) != 0 )
+	{
+	    nx_abort("%s != %s", expected, result);
+	}
+
+	format_rfc5424(expected, TRUE, t);
+	ASSERT(nx_date_to_rfc5424(result, sizeof(result), TRUE, t) == APR_SUCCESS);
+	if ( strcmp(expected, result) != 0 )
+	{
+	    nx_abort("%s != %s", expected, result);
+	}
+
+	ASSERT(nx_date_to_iso(result, sizeof(result), t) == APR_SUCCESS);
+	format_rfc5424(expected, FALSE, t);
+	expected[10] = ' ';
+	expected[19] = '\0';
+	if ( strcmp(expected, result) != 0 )
+	{
+	    nx_abort("%s != %s", expected, result);
+	}
+    }
+}
+
+
+
+static double bench_format(int method)
+{
+    char buf[33];
+    apr_time_t start;
+    apr_time_t t;
+    int i;
+
+    t = apr_time_now();
+    start = apr_time_now();
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	switch ( method )
+	{
+	    case 0:
+		format_rfc5424(buf, FALSE, t + i * 10);
+		break;
+	    case 1:
+		nx_date_to_rfc5424(buf, sizeof(buf), FALSE, t + i * 10);
+		break;
+	    case 2:
+		nx_date_to_rfc5424(buf, sizeof(buf), TRUE, t + i * 10);
+		break;
+	    case 3:
+		nx_date_to_iso(buf, sizeof(buf), t + i * 10);
+		break;
+	    default:
+		nx_date_to_rfc3164(buf, sizeof(buf), t + i * 10);
+		break;
+	}
+    }
+
+    return ( (double) (apr_time_now() - start) * 1000.0 / LOOPCNT );
+}
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    int i;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    for ( i = 0; samples[i].date != NULL; i++ )
+    {
+	check_sample(samples[i].date);
+    }
+
+    printf("%-10s %-34s %10s %10s %10s\n", "format", "date", "cascade", "sniff", "memo");
+    for ( i = 0; samples[i].date != NULL; i++ )
+    {
+	printf("%-10s %-34s %7.1f ns %7.1f ns %7.1f ns\n", samples[i].name, samples[i].date,
+	       bench(samples[i].date, 0), bench(samples[i].date, 1), bench(samples[i].date, 2));
+    }
+
+    // around the 2011 and 2012 DST changes in the EU
+    check_format(1301186400LL * APR_USEC_PER_SEC);
+    check_format(1351384800LL * APR_USEC_PER_SEC);
+
+    printf("\n%-32s %7.1f ns\n", "rfc5424 localtime without cache", bench_format(0));
+    printf("%-32s %7.1f ns\n", "nx_date_to_rfc5424() localtime", bench_format(1));
+    printf("%-32s %7.1f ns\n", "nx_date_to_rfc5424() GMT", bench_format(2));
+    printf("%-32s %7.1f ns\n", "nx_date_to_iso()", bench_format(3));
+    printf("%-32s %7.1f ns\n", "nx_date_to_rfc3164()", bench_format(4));
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
@@ -0,0 +1,396 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include <stddef.h>
+
+#include "../../src/common/error_debug.h"
+#include "../../src/modules/processor/evcorr/pm_evcorr_context.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+#define MIN_CAPACITY 64
+#define NUM_KEY 1000
+#define RES NX_PM_EVCORR_CONTEXT_RESOLUTION
+#define WHEEL NX_PM_EVCORR_CONTEXT_WHEEL_SIZE
+#define BASE (APR_INT64_C(1300000000) * RES)
+
+nxlog_t nxlog;
+
+static int freed = 0;
+
+
+
+static void free_value(nx_pm_evcorr_context_t *context UNUSED, void *value UNUSED)
+{
+    freed++;
+}
+
+
+
+static apr_time_t *add(nx_pm_evcorr_context_t *context, const char *key)
+{
+    apr_time_t *value;
+
+    ASSERT(nx_pm_evcorr_context_get(context, key, strlen(key)) == NULL);
+    value = nx_pm_evcorr_context_add(context, key, strlen(key));
+    ASSERT(value != NULL);
+    ASSERT(*value == 0);
+
+    return ( value );
+}
+
+
+
+static apr_time_t *get(nx_pm_evcorr_context_t *context, const char *key)
+{
+    return ( nx_pm_evcorr_context_get(context, key, strlen(key)) );
+}
+
+
+
+static nx_pm_evcorr_context_entry_t *entry_of(void *value)
+{
+    return ( (nx_pm_evcorr_context_entry_t *) ((char *) value - offsetof(nx_pm_evcorr_context_entry_t, data)) );
+}
+
+
+
+/**
+ * Table index of the entry holding value
+ */
+static uint32_t slot_of(nx_pm_evcorr_context_t *context, void *value)
+{
+    uint32_t i;
+
+    for ( i = 0; i < context->capacity; i++ )
+    {
+	if ( context->table[i] == entry_of(value) )
+	{
+	    return ( i );
+	}
+    }
+    nx_abort("entry is not in the table");
+
+    return ( 0 );
+}
+
+
+
+static void check_values(nx_pm_evcorr_context_t *context, int from, int to, int step)
+{
+    char key[32];
+    apr_time_t *value;
+    int i;
+
+    for ( i = from; i < to; i += step )
+    {
+	apr_snprintf(key, sizeof(key), "key%d", i);
+	value = get(context, key);
+	if ( (value == NULL) || (*value != i) )
+	{
+	    nx_abort("%s was not found after a resize", key);
+	}
+    }
+}
+
+
+
+static void check_resize(apr_pool_t *pool)
+{
+    nx_pm_evcorr_context_t *context;
+    char key[32];
+    apr_time_t *value;
+    uint32_t capacity;
+    int i;
+
+    freed = 0;
+    context = nx_pm_evcorr_context_new(pool, sizeof(apr_time_t), free_value);
+    ASSERT(get(context, "key0") == NULL);
+
+    for ( i = 0; i < NUM_KEY; i++ )
+    {
+	apr_snprintf(key, sizeof(key), "key%d", i);
+	value = add(context, key);
+	*value = i;
+    }
+    ASSERT(context->num_entry == NUM_KEY);
+    ASSERT(context->capacity >= NUM_KEY * 4 / 3);
+    check_values(context, 0, NUM_KEY, 1);
+    capacity = context->capacity;
+
+    // remove all but every 100th, the table shrinks on the way
+    for ( i = 0; i < NUM_KEY; i++ )
+    {
+	if ( i % 100 == 0 )
+	{
+	    continue;
+	}
+	apr_snprintf(key, sizeof(key), "key%d", i);
+	value = get(context, key);
+	ASSERT(value != NULL);
+	nx_pm_evcorr_context_remove(context, value);
+	ASSERT(get(context, key) == NULL);
+    }
+    ASSERT(freed == NUM_KEY - NUM_KEY / 100);
+    ASSERT(context->num_entry == NUM_KEY / 100);
+    ASSERT(context->capacity < capacity);
+    ASSERT(context->capacity == MIN_CAPACITY);
+    check_values(context, 0, NUM_KEY, 100);
+
+    // and grows again
+    for ( i = NUM_KEY; i < NUM_KEY * 2; i++ )
+    {
+	apr_snprintf(key, sizeof(key), "key%d", i);
+	value = add(context, key);
+	*value = i;
+    }
+    check_values(context, 0, NUM_KEY, 100);
+    check_values(context, NUM_KEY, NUM_KEY * 2, 1);
+
+    nx_pm_evcorr_context_clear(context);
+    ASSERT(freed == NUM_KEY * 2);
+    ASSERT(context->num_entry == 0);
+    ASSERT(context->memory == 0);
+    ASSERT(get(context, "key0") == NULL);
+}
+
+
+
+/**
+ * Find keys which hash to home and the slot after it in a table of
+ * MIN_CAPACITY, the hash is read from the entries of a scratch context.
+ */
+static void find_keys(apr_pool_t *pool, uint32_t home, char keys[][32], int num, char *next)
+{
+    nx_pm_evcorr_context_t *context;
+    apr_time_t *value;
+    uint32_t hash;
+    char key[32];
+    int i, found = 0;
+
+    context = nx_pm_evcorr_context_new(pool, sizeof(apr_time_t), NULL);
+    next[0] = '\0';
+    for ( i = 0; (found < num) || (next[0] == '\0'); i++ )
+    {
+	ASSERT(i < 100000);
+	apr_snprintf(key, sizeof(key), "probe%d", i);
+	value = add(context, key);
+	hash = entry_of(value)->hash & (MIN_CAPACITY - 1);
+	nx_pm_evcorr_context_remove(context, value);
+	if ( (hash == home) && (found < num) )
+	{
+	    strcpy(keys[found], key);
+	    found++;
+	}
+	else if ( (hash == ((home + 1) & (MIN_CAPACITY - 1))) && (next[0] == '\0') )
+	{
+	    strcpy(next, key);
+	}
+    }
+    nx_pm_evcorr_context_clear(context);
+}
+
+
+
+static void check_probe_chain(apr_pool_t *pool, uint32_t home)
+{
+    nx_pm_evcorr_context_t *context;
+    char keys[3][32];
+    char next[32];
+    apr_time_t *value;
+    int i;
+
+    find_keys(pool, home, keys, 3, next);
+
+    context = nx_pm_evcorr_context_new(pool, sizeof(apr_time_t), NULL);
+
+    // three entries with the same home, then one whose home is taken by the
+    // second, the table keeps the minimum capacity as it is never shrunk below it
+    for ( i = 0; i < 3; i++ )
+    {
+	*(add(context, keys[i])) = i + 1;
+    }
+    *(add(context, next)) = 4;
+    ASSERT(context->capacity == MIN_CAPACITY);
+    ASSERT(slot_of(context, get(context, keys[0])) == home);
+    ASSERT(slot_of(context, get(context, next)) == ((home + 3) & (MIN_CAPACITY - 1)));
+
+    // deleting from the middle shifts the rest of the chain back
+    nx_pm_evcorr_context_remove(context, get(context, keys[1]));
+    ASSERT(get(context, keys[1]) == NULL);
+    ASSERT(*(get(context, keys[0])) == 1);
+    ASSERT(*(get(context, keys[2])) == 3);
+    ASSERT(*(get(context, next)) == 4);
+    ASSERT(slot_of(context, get(context, keys[2])) == ((home + 1) & (MIN_CAPACITY - 1)));
+    ASSERT(slot_of(context, get(context, next)) == ((home + 2) & (MIN_CAPACITY - 1)));
+
+    // the head of the chain
+    nx_pm_evcorr_context_remove(context, get(context, keys[0]));
+    ASSERT(get(context, keys[0]) == NULL);
+    ASSERT(slot_of(context, get(context, keys[2])) == home);
+    ASSERT(slot_of(context, get(context, next)) == ((home + 1) & (MIN_CAPACITY - 1)));
+    ASSERT(*(get(context, keys[2])) == 3);
+    ASSERT(*(get(context, next)) == 4);
+
+    // an entry at its home stays there
+    nx_pm_evcorr_context_remove(context, get(context, keys[2]));
+    ASSERT(slot_of(context, get(context, next)) == ((home + 1) & (MIN_CAPACITY - 1)));
+    ASSERT(*(get(context, next)) == 4);
+
+    // the removed keys can be added again
+    value = add(context, keys[1]);
+    *value = 5;
+    ASSERT(*(get(context, keys[1])) == 5);
+
+    nx_pm_evcorr_context_clear(context);
+}
+
+
+
+static void check_far_expiry(apr_pool_t *pool)
+{
+    nx_pm_evcorr_context_t *context;
+    apr_time_t *value;
+    int i;
+
+    freed = 0;
+    context = nx_pm_evcorr_context_new(pool, sizeof(apr_time_t), free_value);
+    nx_pm_evcorr_context_expire(context, BASE);
+
+    value = add(context, "far");
+    nx_pm_evcorr_context_expire_at(context, value, BASE + (WHEEL + 100) * RES);
+
+    // the slot of the entry comes round once before it expires
+    for ( i = 1; i <= WHEEL + 100; i++ )
+    {
+	nx_pm_evcorr_context_expire(context, BASE + i * RES);
+	if ( get(context, "far") != value )
+	{
+	    nx_abort("entry expired %d ticks early", WHEEL + 100 - i + 1);
+	}
+    }
+    ASSERT(context->expired == 0);
+    nx_pm_evcorr_context_expire(context, BASE + (WHEEL + 101) * RES);
+    ASSERT(get(context, "far") == NULL);
+    ASSERT(context->expired == 1);
+    ASSERT(freed == 1);
+
+    nx_pm_evcorr_context_clear(context);
+}
+
+
+
+static void check_past_and_cancel(apr_pool_t *pool)
+{
+    nx_pm_evcorr_context_t *context;
+    apr_time_t *past, *cancelled, *moved;
+
+    context = nx_pm_evcorr_context_new(pool, sizeof(apr_time_t), NULL);
+    nx_pm_evcorr_context_expire(context, BASE);
+    nx_pm_evcorr_context_expire(context, BASE + 100 * RES);
+
+    // already expired, removed with the next tick
+    past = add(context, "past");
+    nx_pm_evcorr_context_expire_at(context, past, BASE + 10 * RES);
+    cancelled = add(context, "cancelled");
+    nx_pm_evcorr_context_expire_at(context, cancelled, BASE + 101 * RES);
+    nx_pm_evcorr_context_expire_at(context, cancelled, 0);
+    moved = add(context, "moved");
+    nx_pm_evcorr_context_expire_at(context, moved, BASE + 101 * RES);
+    nx_pm_evcorr_context_expire_at(context, moved, BASE + 300 * RES);
+
+    nx_pm_evcorr_context_expire(context, BASE + 100 * RES + RES / 2);
+    ASSERT(get(context, "past") == past);
+    nx_pm_evcorr_context_expire(context, BASE + 101 * RES);
+    ASSERT(get(context, "past") == NULL);
+    ASSERT(context->expired == 1);
+
+    nx_pm_evcorr_context_expire(context, BASE + 200 * RES);
+    ASSERT(get(context, "moved") == moved);
+    ASSERT(get(context, "cancelled") == cancelled);
+    ASSERT(context->expired == 1);
+
+    nx_pm_evcorr_context_expire(context, BASE + 301 * RES);
+    ASSERT(get(context, "moved") == NULL);
+    ASSERT(context->expired == 2);
+
+    // never scheduled again after the cancel
+    nx_pm_evcorr_context_expire(context, BASE + 10000 * RES);
+    ASSERT(get(context, "cancelled") == cancelled);
+    ASSERT(context->expired == 2);
+
+    nx_pm_evcorr_context_clear(context);
+}
+
+
+
+static void check_jump(apr_pool_t *pool)
+{
+    nx_pm_evcorr_context_t *context;
+    apr_time_t *value;
+    char key[32];
+    int i;
+
+    context = nx_pm_evcorr_context_new(pool, sizeof(apr_time_t), NULL);
+    nx_pm_evcorr_context_expire(context, BASE);
+
+    // spread over several rotations of the wheel
+    for ( i = 1; i <= 2000; i++ )
+    {
+	apr_snprintf(key, sizeof(key), "key%d", i);
+	value = add(context, key);
+	*value = i;
+	nx_pm_evcorr_context_expire_at(context, value, BASE + i * 3 * RES + RES / 2);
+    }
+    value = add(context, "later");
+    nx_pm_evcorr_context_expire_at(context, value, BASE + 10000 * RES);
+
+    // more than a full rotation at once
+    nx_pm_evcorr_context_expire(context, BASE + 5000 * RES);
+    for ( i = 1; i <= 2000; i++ )
+    {
+	apr_snprintf(key, sizeof(key), "key%d", i);
+	if ( (i * 3 < 5000) != (get(context, key) == NULL) )
+	{
+	    nx_abort("%s expiring at %d is wrong after the jump", key, i * 3);
+	}
+    }
+    ASSERT(context->expired == 1666);
+    ASSERT(get(context, "later") == value);
+
+    nx_pm_evcorr_context_expire(context, BASE + 20000 * RES);
+    ASSERT(context->num_entry == 0);
+    ASSERT(context->expired == 2001);
+
+    nx_pm_evcorr_context_clear(context);
+}
+
+
+
+int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
+{
+    apr_pool_t *pool;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    pool = nx_pool_create_core();
+
+    check_resize(pool);
+    check_probe_chain(pool, 17);
+    check_probe_chain(pool, MIN_CAPACITY - 2);
+    check_probe_chain(pool, MIN_CAPACITY - 1);
+    check_far_expiry(pool);
+    check_past_and_cancel(pool);
+    check_jump(pool);
+
+    apr_pool_destroy(pool);
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/statvar.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+#include "../../src/core/modules.h"
+#include "../../src/core/exporter.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+nxlog_t nxlog;
+
+
+
+static void check_line(const nx_string_t *str, const char *line)
+{
+    if ( strstr(str->buf, line) == NULL )
+    {
+	printf("%s\n", str->buf);
+	nx_abort("missing from exporter output: %s", line);
+    }
+}
+
+
+
+int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
+{
+    nx_module_t *module;
+    nx_module_stat_t *stat;
+    nx_string_t *str;
+    int i;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    memset(&nxlog, 0, sizeof(nxlog_t));
+    nxlog_set(&nxlog);
+    nxlog.ctx = nx_ctx_new();
+    nxlog.started = apr_time_now();
+
+    module = nx_module_new(NX_MODULE_TYPE_OUTPUT, "out", 1024);
+    NX_DLIST_INSERT_TAIL(nxlog.ctx->modules, module, link);
+    module->queue->limit = 100;
+    nx_logqueue_push(module->queue, nx_logdata_new_logline("test", 4));
+    module->evt_recvd = 3;
+    nx_metrics_add(module->metrics, NX_METRICS_DROPS, 2);
+    for ( i = 0; i < 10; i++ )
+    { // 9 below 1ms, 1 below 10ms
+	nx_metrics_record(module->metrics, NX_METRICS_PROCTIME, (i == 9) ? 5000 : 50);
+    }
+    stat = nx_module_stat_create(module, NX_MODULE_STAT_TYPE_COUNT, "a\"b", 3, 0, 0, 0);
+    nx_module_stat_add(stat, 5, apr_time_now());
+
+    str = nx_exporter_format(&nxlog);
+
+    check_line(str, "# TYPE nxlog_module_queue_size gauge\n");
+    check_line(str, "nxlog_module_status{module=\"out\",type=\"OUTPUT\",status=\"UNINITIALIZED\"} 1\n");
+    check_line(str, "nxlog_module_queue_size{module=\"out\"} 1\n");
+    check_line(str, "nxlog_module_queue_limit{module=\"out\"} 100\n");
+    check_line(str, "nxlog_module_queue_highwater{module=\"out\"} 1\n");
+    check_line(str, "nxlog_module_events_received_total{module=\"out\"} 3\n");
+    check_line(str, "nxlog_module_drops_total{module=\"out\"} 2\n");
+    check_line(str, "nxlog_module_processing_time_seconds_bucket{module=\"out\",le=\"0.0001\"} 9\n");
+    check_line(str, "nxlog_module_processing_time_seconds_bucket{module=\"out\",le=\"0.001\"} 9\n");
+    check_line(str, "nxlog_module_processing_time_seconds_bucket{module=\"out\",le=\"0.01\"} 10\n");
+    check_line(str, "nxlog_module_processing_time_seconds_bucket{module=\"out\",le=\"+Inf\"} 10\n");
+    check_line(str, "nxlog_module_processing_time_seconds_count{module=\"out\"} 10\n");
+    check_line(str, "nxlog_module_stat{module=\"out\",name=\"a\\\"b\",type=\"count\"} 5\n");
+    check_line(str, "# TYPE nxlog_scratch_arenas gauge\n");
+    nx_string_free(str);
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
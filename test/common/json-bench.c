@@ -0,0 +1,171 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/logdata.h"
+#include "../../src/modules/extension/json/json.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+#include "parser-bench.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+nxlog_t nxlog;
+
+/* Records parsed by nx_json_parse_fast(), the result must be the same as with yajl */
+static parser_bench_sample_t samples[] =
+{
+    { "empty", "{}", NULL },
+    { "flat",
+      "{\"EventTime\":\"2011-12-06 19:14:15\",\"Hostname\":\"host.example.com\","
+      "\"SeverityValue\":2,\"Severity\":\"INFO\",\"ProcessID\":1234,"
+      "\"SourceName\":\"sshd\",\"Message\":\"Accepted publickey for user from "
+      "192.168.1.1 port 53211 ssh2\"}", NULL },
+    { "types",
+      " {\n  \"int\" : -42 ,\n  \"big\": 123456789012345678901, \"float\": 1.5e3,\n"
+      "  \"t\": true, \"f\": false, \"n\": null, \"date\": \"2011-12-06T19:14:15.000003+01:00\",\n"
+      "  \"notdate\": \"2011-12-06 foo\", \"\": \"empty key\"\n } \n", NULL },
+    { "escapes",
+      "{\"Message\":\"line1\\nline2\\t\\\"quoted\\\" C:\\\\Windows\\\\System32 \\/ "
+      "\\u00e9\\u20ac\\u0041\",\"key\\u005fx\":\"\xc3\xa9t\xc3\xa9 \xe2\x82\xac\"}", NULL },
+    { "nested",
+      "{\"host\":\"h1\",\"http\":{\"method\":\"GET\",\"status\":200,\"ok\":true,"
+      "\"headers\":{\"User-Agent\":\"curl/7.29.0\",\"Accept\":\"*/*\"},\"x\":null},"
+      "\"tags\":[\"a\",\"b\",[1,2.5,[]],false],\"empty\":{}}", NULL },
+    { "duplicate",
+      "{\"a\":1,\"A\":\"two\",\"SourceModuleName\":\"in\",\"raw_event\":\"ignored\",\"a\":3}", NULL },
+    { "long",
+      "{\"Message\":\"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+      "tempor incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis "
+      "nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute "
+      "irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla "
+      "pariatur. Excepteur sint occaecat cupidatat non proident, sunt in culpa qui officia "
+      "deserunt mollit anim id est laborum.\",\"f1\":1,\"f2\":2,\"f3\":3,\"f4\":4,\"f5\":5,"
+      "\"f6\":6,\"f7\":7,\"f8\":8,\"f9\":9,\"f10\":\"ten\",\"f11\":\"eleven\"}", NULL },
+    { NULL, NULL, NULL },
+};
+
+
+/* Records left to yajl */
+static const char *fallback[] =
+{
+    "{\"a\":1 /* comment */}",
+    "{\"a\":\"\\ud83d\\ude00\"}",
+    "{\"a\":[{\"b\":1}]}",
+    "{\"a\":{\"b\":[1]}}",
+    "{\"raw_event\":1}",
+    "{\"Raw_Event\":\"x\"}",
+    "{\"a\":01}",
+    "{\"a\":1,}",
+    "{\"a\":tru}",
+    "{\"a\":\"\x01\"}",
+    "{\"a\":\"\xc3\"}",
+    "{\"a\":\"\\x\"}",
+    "{\"a\":\"unterminated}",
+    "{\"a\":1}}",
+    "[1,2]",
+    "\"a\"",
+    "",
+    NULL,
+};
+
+
+
+static nx_logdata_t *new_logdata(const char *input UNUSED)
+{
+    nx_logdata_t *logdata;
+
+    logdata = nx_logdata_new_logline("raw", 3);
+    nx_logdata_set_string(logdata, "SourceModuleName", "in");
+    nx_logdata_set_integer(logdata, "a", 0);
+
+    return ( logdata );
+}
+
+
+
+static void parse_yajl(nx_logdata_t *logdata, const char *json, size_t len)
+{
+    nx_json_parser_ctx_t ctx;
+
+    memset(&ctx, 0, sizeof(nx_json_parser_ctx_t));
+    ctx.logdata = logdata;
+    nx_json_parse_yajl(&ctx, json, len);
+}
+
+
+
+static void parse_fast(nx_logdata_t *logdata, const char *json, size_t len)
+{
+    nx_json_parser_ctx_t ctx;
+
+    memset(&ctx, 0, sizeof(nx_json_parser_ctx_t));
+    ctx.logdata = logdata;
+    if ( nx_json_parse_fast(&ctx, json, len) == FALSE )
+    {
+	nx_abort("nx_json_parse_fast() didn't accept '%s'", json);
+    }
+}
+
+
+
+static const parser_bench_parser_t parsers[] =
+{
+    { "yajl", new_logdata, parse_yajl },
+    { "fast", new_logdata, parse_fast },
+    { NULL, NULL, NULL },
+};
+
+static const parser_bench_t jsonbench = { parsers, samples, NULL, TRUE };
+
+
+
+static void check_fallback(const char *json)
+{
+    nx_json_parser_ctx_t ctx;
+    nx_logdata_t *logdata;
+    char *fields1, *fields2;
+
+    logdata = new_logdata(json);
+    fields1 = parser_bench_fields(&jsonbench, logdata);
+    memset(&ctx, 0, sizeof(nx_json_parser_ctx_t));
+    ctx.logdata = logdata;
+    if ( nx_json_parse_fast(&ctx, json, strlen(json)) == TRUE )
+    {
+	nx_abort("nx_json_parse_fast() should leave '%s' to yajl", json);
+    }
+
+    fields2 = parser_bench_fields(&jsonbench, logdata);
+    if ( strcmp(fields1, fields2) != 0 )
+    {
+	nx_abort("nx_json_parse_fast() modified the fields for '%s'", json);
+    }
+
+    free(fields1);
+    free(fields2);
+    nx_logdata_free(logdata);
+}
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    int i;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    parser_bench_check(&jsonbench);
+    for ( i = 0; fallback[i] != NULL; i++ )
+    {
+	check_fallback(fallback[i]);
+    }
+
+    parser_bench_print(&jsonbench);
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
@@ -0,0 +1,287 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/logdata.h"
+#include "../../src/modules/extension/json/json.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+nxlog_t nxlog;
+
+typedef struct jsonstr
+{
+    const char *str;
+    int len;
+} jsonstr;
+
+/* Strings which must be written the same as with yajl_gen_string() */
+static jsonstr strings[] =
+{
+    { "", 0 },
+    { "plain text", -1 },
+    { "\"quoted\" C:\\Windows\\ a/b", -1 },
+    { "\b\f\n\r\t", -1 },
+    { "nul \0 byte", 10 },
+    { "del \x7f", -1 },
+    { "\xc3\xa9t\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", -1 },
+    { "invalid \xff \xc3 \xc0\xaf \xed\xa0\x80 \xf8\x88\x80\x80\x80", -1 },
+    { "0123456789abcde\"0123456789abcdef\\0123456789abcdef\x01", -1 },
+    { "0123456789abcdef0123456789abcdef0123456789abcdef", -1 },
+    { NULL, 0 },
+};
+
+
+
+/**
+ * nx_logdata_to_json() as it was with yajl, the filters are applied here
+ */
+static nx_string_t *yajl_to_json(nx_logdata_t *logdata, apr_hash_t *include, apr_hash_t *exclude)
+{
+    const unsigned char *json;
+    size_t jsonlen;
+    yajl_gen gen;
+    nx_logdata_field_t *field;
+    nx_string_t *retval;
+    char *value;
+
+    gen = yajl_gen_alloc(NULL);
+    yajl_gen_map_open(gen);
+
+    for ( field = NX_DLIST_FIRST(&(logdata->fields));
+	  field != NULL;
+	  field = NX_DLIST_NEXT(field, link) )
+    {
+	if ( strcmp(field->key, "raw_event") == 0 )
+	{
+	    continue;
+	}
+	if ( include != NULL )
+	{
+	    if ( apr_hash_get(include, field->key, APR_HASH_KEY_STRING) == NULL )
+	    {
+		continue;
+	    }
+	}
+	else if ( (field->key[0] == '.') || (field->key[0] == '_') ||
+		  ((exclude != NULL) &&
+		   (apr_hash_get(exclude, field->key, APR_HASH_KEY_STRING) != NULL)) )
+	{
+	    continue;
+	}
+
+	ASSERT(yajl_gen_string(gen, (const unsigned char *) field->key,
+			       strlen(field->key)) == yajl_gen_status_ok);
+	if ( field->value->defined == FALSE )
+	{
+	    ASSERT(yajl_gen_null(gen) == yajl_gen_status_ok);
+	}
+	else
+	{
+	    switch ( field->value->type )
+	    {
+		case NX_VALUE_TYPE_BOOLEAN:
+		    ASSERT(yajl_gen_bool(gen, (int) field->value->boolean) == yajl_gen_status_ok);
+		    break;
+		case NX_VALUE_TYPE_INTEGER:
+		    ASSERT(yajl_gen_integer(gen, (long long) field->value->integer) == yajl_gen_status_ok);
+		    break;
+		case NX_VALUE_TYPE_STRING:
+		    ASSERT(yajl_gen_string(gen, (const unsigned char *) field->value->string->buf,
+					   field->value->string->len) == yajl_gen_status_ok);
+		    break;
+		default:
+		    value = nx_value_to_string(field->value);
+		    ASSERT(yajl_gen_string(gen, (const unsigned char *) value,
+					   strlen(value)) == yajl_gen_status_ok);
+		    free(value);
+		    break;
+	    }
+	}
+    }
+    yajl_gen_map_close(gen);
+    yajl_gen_get_buf(gen, &json, &jsonlen);
+
+    retval = nx_string_create((const char *) json, (int) jsonlen);
+    yajl_gen_free(gen);
+
+    return ( retval );
+}
+
+
+
+static void check_json(const char *name, nx_logdata_t *logdata,
+		       apr_hash_t *include, apr_hash_t *exclude)
+{
+    nx_json_parser_ctx_t ctx;
+    nx_string_t *json, *expected;
+
+    memset(&ctx, 0, sizeof(nx_json_parser_ctx_t));
+    ctx.logdata = logdata;
+    ctx.include_fields = include;
+    ctx.exclude_fields = exclude;
+
+    json = nx_logdata_to_json(&ctx);
+    expected = yajl_to_json(logdata, include, exclude);
+    if ( (json->len != expected->len) || (memcmp(json->buf, expected->buf, json->len) != 0) )
+    {
+	nx_abort("%s: got %s, expected %s", name, json->buf, expected->buf);
+    }
+    nx_string_free(json);
+    nx_string_free(expected);
+}
+
+
+
+static void set_bytes(nx_logdata_t *logdata, const char *key, const char *str, int len)
+{
+    nx_value_t *value;
+
+    value = nx_value_new(NX_VALUE_TYPE_STRING);
+    value->string = nx_string_create(str, len);
+    nx_logdata_set_field_value(logdata, key, value);
+}
+
+
+
+static void check_strings()
+{
+    nx_logdata_t *logdata;
+    char buf[64];
+    char key[32];
+    const char special[] = { '"', '\\', '/', '\x01', '\x1f', ' ', '\x7f', '\x80', '\xff' };
+    int i, j;
+
+    // every byte value, as a value and in a key
+    for ( i = 0; i < 256; i++ )
+    {
+	logdata = nx_logdata_new();
+	buf[0] = (char) i;
+	set_bytes(logdata, "value", buf, 1);
+	if ( i != 0 )
+	{
+	    apr_snprintf(key, sizeof(key), "key%c", (char) i);
+	    nx_logdata_set_integer(logdata, key, i);
+	}
+	check_json("byte", logdata, NULL, NULL);
+	nx_logdata_free(logdata);
+    }
+
+    for ( i = 0; strings[i].str != NULL; i++ )
+    {
+	logdata = nx_logdata_new();
+	set_bytes(logdata, "value", strings[i].str, strings[i].len);
+	check_json(strings[i].str, logdata, NULL, NULL);
+	nx_logdata_free(logdata);
+    }
+
+    // a byte which may need escaping at each offset of the 16 byte blocks
+    for ( i = 0; i < (int) sizeof(special); i++ )
+    {
+	for ( j = 0; j < 48; j++ )
+	{
+	    memset(buf, 'a', 48);
+	    buf[j] = special[i];
+	    logdata = nx_logdata_new();
+	    set_bytes(logdata, "value", buf, 48);
+	    check_json("offset", logdata, NULL, NULL);
+	    nx_logdata_free(logdata);
+	}
+    }
+}
+
+
+
+static nx_logdata_t *new_record()
+{
+    nx_logdata_t *logdata;
+    nx_value_t *value;
+    const char *line = "raw \"line\"";
+
+    logdata = nx_logdata_new_logline(line, (int) strlen(line));
+    nx_logdata_set_string(logdata, "Hostname", "host.example.com");
+    nx_logdata_set_integer(logdata, "SeverityValue", 2);
+    nx_logdata_set_integer(logdata, "Min", INT64_MIN);
+    nx_logdata_set_integer(logdata, "Max", INT64_MAX);
+    nx_logdata_set_boolean(logdata, "True", TRUE);
+    nx_logdata_set_boolean(logdata, "False", FALSE);
+    nx_logdata_set_datetime(logdata, "EventTime", APR_INT64_C(1323195255000003));
+    nx_logdata_set_datetime(logdata, "Epoch", 0);
+    nx_logdata_set_binary(logdata, "Binary", "\x01\xff", 2);
+    value = nx_value_new(NX_VALUE_TYPE_INTEGER);
+    value->defined = FALSE;
+    nx_logdata_set_field_value(logdata, "Undef", value);
+    nx_logdata_set_string(logdata, ".hidden", "dot");
+    nx_logdata_set_string(logdata, "_private", "underscore");
+    nx_logdata_set_string(logdata, "Message", "a message");
+
+    return ( logdata );
+}
+
+
+
+static apr_hash_t *field_hash(apr_pool_t *pool, const char * const *fields)
+{
+    apr_hash_t *retval;
+    int i;
+
+    retval = apr_hash_make(pool);
+    for ( i = 0; fields[i] != NULL; i++ )
+    {
+	apr_hash_set(retval, fields[i], APR_HASH_KEY_STRING, "");
+    }
+
+    return ( retval );
+}
+
+
+
+static void check_filters(apr_pool_t *pool)
+{
+    nx_logdata_t *logdata;
+    const char *include[] = { "Message", "EventTime", ".hidden", "raw_event", "missing", NULL };
+    const char *exclude[] = { "Hostname", "Min", "_private", "raw_event", "missing", NULL };
+    const char *none[] = { NULL };
+    apr_hash_t *includes, *excludes, *empty;
+
+    includes = field_hash(pool, include);
+    excludes = field_hash(pool, exclude);
+    empty = field_hash(pool, none);
+
+    logdata = new_record();
+    check_json("types", logdata, NULL, NULL);
+    check_json("include", logdata, includes, NULL);
+    check_json("exclude", logdata, NULL, excludes);
+    check_json("include none", logdata, empty, NULL);
+    check_json("exclude none", logdata, NULL, empty);
+
+    // a replaced raw_event is still skipped
+    nx_logdata_set_string(logdata, "raw_event", "replaced");
+    check_json("raw_event", logdata, NULL, NULL);
+    nx_logdata_free(logdata);
+}
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    apr_pool_t *pool;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    pool = nx_pool_create_core();
+
+    check_strings();
+    check_filters(pool);
+
+    apr_pool_destroy(pool);
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
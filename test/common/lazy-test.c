@@ -0,0 +1,362 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/logdata.h"
+#include "../../src/common/date.h"
+#include "../../src/modules/extension/syslog/syslog.h"
+#include "../../src/modules/extension/json/json.h"
+#include "../../src/modules/extension/kvp/kvp.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+// a missing timestamp is the time of the parse call, which differs a bit
+#define TIME_TOLERANCE APR_USEC_PER_SEC
+
+nxlog_t nxlog;
+
+typedef enum lazy_parser_t
+{
+    PARSER_BSD,
+    PARSER_IETF,
+    PARSER_JSON,
+    PARSER_KVP,
+} lazy_parser_t;
+
+typedef enum lazy_op_t
+{
+    OP_LOOKUP = 0,
+    OP_SET,
+    OP_SET_NEW,
+    OP_DELETE,
+    OP_RENAME,
+    OP_CLONE,
+    OP_SERIALIZE,
+    OP_NUM,
+} lazy_op_t;
+
+typedef struct lazysample
+{
+    lazy_parser_t parser;
+    const char *input;
+} lazysample;
+
+static lazysample samples[] =
+{
+    { PARSER_BSD, "<30>Oct 12 12:49:06 host app[12345]: message text" },
+    { PARSER_BSD, "<13>2011-12-06T19:14:15.000003+01:00 host.example.com sshd[42]: Accepted" },
+    { PARSER_BSD, "Oct  2 02:09:03 host app: no priority" },
+    { PARSER_BSD, "<14>no timestamp at all" },
+    { PARSER_BSD, "<189>Mar  1 00:00:00.123: %SYS-5-CONFIG_I: Configured" },
+    { PARSER_BSD, "<999>Oct 12 12:49:06 host app: bad priority" },
+    { PARSER_BSD, "" },
+    { PARSER_IETF, "<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog - ID47 "
+      "[exampleSDID@32473 iut=\"3\" eventSource=\"Application\" eventID=\"1011\"]"
+      "[examplePriority@32473 class=\"high\"] An application event log entry" },
+    { PARSER_IETF, "<34>1 2003-10-11T22:14:15.003Z mymachine.example.com su - ID47 - 'su root' failed" },
+    { PARSER_IETF, "<34>1 2003-10-11T22:14:15.003Z host app - - [x@1 p=\"a\\\"b\\]c\\\\d\"] escapes" },
+    { PARSER_IETF, "<34>1 2003-10-11T22:14:15.003Z host app - - [a@1 k=\"1\"][b@1 K=\"2\"] duplicate" },
+    { PARSER_IETF, "<34>1 2003-10-11T22:14:15.003Z host app - - [a@1 Hostname=\"sd\"] header name" },
+    { PARSER_IETF, "<34>1 - - - - - - nil values" },
+    { PARSER_IETF, "<34>1 notadate host app" },
+    { PARSER_IETF, "<34>Oct 11 22:14:15 mymachine su: BSD fallback" },
+    { PARSER_JSON, "{\"EventTime\":\"2011-12-06 19:14:15\",\"Hostname\":\"host.example.com\","
+      "\"SeverityValue\":2,\"Message\":\"Accepted publickey\"}" },
+    { PARSER_JSON, "{\"int\":-42,\"float\":1.5e3,\"t\":true,\"f\":false,\"n\":null,"
+      "\"date\":\"2011-12-06T19:14:15.000003+01:00\",\"\":\"empty key\"}" },
+    { PARSER_JSON, "{\"Message\":\"line1\\nline2 \\\"quoted\\\" \\u00e9\","
+      "\"http\":{\"method\":\"GET\",\"status\":200},\"tags\":[\"a\",\"b\"]}" },
+    { PARSER_JSON, "{\"a\":1,\"A\":\"two\",\"a\":3}" },
+    { PARSER_KVP, "a=1 b=2 c=\"quoted value\"" },
+    { PARSER_KVP, "k1='x y';k2=3;Message=text" },
+    { PARSER_KVP, "Key=Val, Other=x, key=again" },
+    { PARSER_KVP, "a=\"x\\\"y\" b=" },
+    { PARSER_BSD, NULL },
+};
+
+static const char *lookups[] =
+{
+    "Hostname", "EventTime", "SourceName", "ProcessID", "MessageID", "Message",
+    "SyslogSeverity", "SeverityValue", "iut", "eventID", "class", "p", "k",
+    "int", "n", "a", "http.method", "Key", "k2", "NoSuchField", "raw_event", NULL,
+};
+
+static const char *opnames[] =
+{
+    "lookup", "set", "set new", "delete", "rename", "clone", "serialize",
+};
+
+
+
+static nx_logdata_t *parse(const lazysample *sample, boolean lazy,
+			   nx_date_format_t *dateformat, nx_kvp_ctx_t *kvpctx)
+{
+    nx_logdata_t *logdata;
+    nx_json_parser_ctx_t ctx;
+    size_t len;
+
+    len = strlen(sample->input);
+    logdata = nx_logdata_new_logline(sample->input, (int) len);
+    switch ( sample->parser )
+    {
+	case PARSER_BSD:
+	case PARSER_IETF:
+	    if ( lazy == TRUE )
+	    {
+		nx_syslog_parse_lazy(logdata, sample->input, len, dateformat,
+				     (sample->parser == PARSER_IETF) ? TRUE : FALSE);
+	    }
+	    else if ( sample->parser == PARSER_IETF )
+	    {
+		nx_syslog_parse_rfc5424(logdata, sample->input, len, dateformat);
+	    }
+	    else
+	    {
+		nx_syslog_parse_rfc3164(logdata, sample->input, len, dateformat);
+	    }
+	    break;
+	case PARSER_JSON:
+	    memset(&ctx, 0, sizeof(nx_json_parser_ctx_t));
+	    ctx.logdata = logdata;
+	    if ( lazy == TRUE )
+	    {
+		nx_json_parse_lazy(&ctx, sample->input, len);
+	    }
+	    else
+	    {
+		nx_json_parse(&ctx, sample->input, len);
+	    }
+	    break;
+	case PARSER_KVP:
+	    if ( lazy == TRUE )
+	    {
+		nx_kvp_parse_lazy(logdata, kvpctx, sample->input, len);
+	    }
+	    else
+	    {
+		nx_kvp_parse(logdata, kvpctx, sample->input, len);
+	    }
+	    break;
+	default:
+	    nx_panic("invalid parser %d", sample->parser);
+    }
+
+    return ( logdata );
+}
+
+
+
+static boolean value_equal(const nx_value_t *v1, const nx_value_t *v2)
+{
+    char *s1, *s2;
+    boolean retval;
+
+    if ( (v1->type != v2->type) || (v1->defined != v2->defined) )
+    {
+	return ( FALSE );
+    }
+    if ( v1->defined == FALSE )
+    {
+	return ( TRUE );
+    }
+    switch ( v1->type )
+    {
+	case NX_VALUE_TYPE_STRING:
+	    return ( (v1->string->len == v2->string->len) &&
+		     (memcmp(v1->string->buf, v2->string->buf, v1->string->len) == 0) );
+	case NX_VALUE_TYPE_INTEGER:
+	    return ( v1->integer == v2->integer );
+	case NX_VALUE_TYPE_BOOLEAN:
+	    return ( v1->boolean == v2->boolean );
+	case NX_VALUE_TYPE_DATETIME:
+	    return ( (v1->datetime - v2->datetime < TIME_TOLERANCE) &&
+		     (v2->datetime - v1->datetime < TIME_TOLERANCE) );
+	default:
+	    break;
+    }
+    s1 = nx_value_to_string((nx_value_t *) v1);
+    s2 = nx_value_to_string((nx_value_t *) v2);
+    retval = (strcmp(s1, s2) == 0) ? TRUE : FALSE;
+    free(s1);
+    free(s2);
+
+    return ( retval );
+}
+
+
+
+/**
+ * The fields must be the same in the same order with the same name
+ */
+static void check_fields(const char *name, lazy_op_t op,
+			 nx_logdata_t *eager, nx_logdata_t *lazy)
+{
+    nx_logdata_field_t *f1, *f2;
+
+    nx_logdata_materialize(lazy);
+    ASSERT(lazy->lazy == NULL);
+
+    for ( f1 = NX_DLIST_FIRST(&(eager->fields)), f2 = NX_DLIST_FIRST(&(lazy->fields));
+	  (f1 != NULL) && (f2 != NULL);
+	  f1 = NX_DLIST_NEXT(f1, link), f2 = NX_DLIST_NEXT(f2, link) )
+    {
+	if ( strcmp(f1->key, f2->key) != 0 )
+	{
+	    nx_abort("%s '%s': field %s is %s with the deferred parse",
+		     opnames[op], name, f1->key, f2->key);
+	}
+	if ( value_equal(f1->value, f2->value) != TRUE )
+	{
+	    nx_abort("%s '%s': field %s differs with the deferred parse",
+		     opnames[op], name, f1->key);
+	}
+    }
+    if ( (f1 != NULL) || (f2 != NULL) )
+    {
+	nx_abort("%s '%s': field %s is missing with the %s parse", opnames[op], name,
+		 (f1 != NULL) ? f1->key : f2->key, (f1 != NULL) ? "deferred" : "eager");
+    }
+}
+
+
+
+static void check_lookups(const char *name, nx_logdata_t *eager, nx_logdata_t *lazy)
+{
+    nx_value_t v1, v2;
+    boolean found1, found2;
+    int i, j;
+
+    // twice, the second time from the extracted fields
+    for ( j = 0; j < 2; j++ )
+    {
+	for ( i = 0; lookups[i] != NULL; i++ )
+	{
+	    found1 = nx_logdata_get_field_value(eager, lookups[i], &v1);
+	    found2 = nx_logdata_get_field_value(lazy, lookups[i], &v2);
+	    if ( found1 != found2 )
+	    {
+		nx_abort("lookup '%s': %s is %s with the deferred parse", name, lookups[i],
+			 (found2 == TRUE) ? "present" : "absent");
+	    }
+	    if ( (found1 == TRUE) && (value_equal(&v1, &v2) != TRUE) )
+	    {
+		nx_abort("lookup '%s': %s differs with the deferred parse", name, lookups[i]);
+	    }
+	}
+    }
+}
+
+
+
+static void check_op(const lazysample *sample, lazy_op_t op,
+		     nx_date_format_t *format1, nx_date_format_t *format2)
+{
+    nx_logdata_t *eager, *lazy, *tmp;
+    nx_kvp_ctx_t kvpctx1, kvpctx2;
+    apr_size_t size;
+    char *buf;
+    boolean extractable;
+
+    nx_kvp_ctx_init(&kvpctx1);
+    nx_kvp_ctx_init(&kvpctx2);
+    eager = parse(sample, FALSE, format1, &kvpctx1);
+    lazy = parse(sample, TRUE, format2, &kvpctx2);
+
+    // the state kept by the callers must be updated the same way
+    ASSERT(*format1 == *format2);
+    ASSERT(memcmp(&kvpctx1, &kvpctx2, sizeof(nx_kvp_ctx_t)) == 0);
+
+    if ( lazy->lazy == NULL )
+    { // parsed eagerly, e.g. invalid input
+	check_fields(sample->input, op, eager, lazy);
+	nx_logdata_free(eager);
+	nx_logdata_free(lazy);
+	return;
+    }
+    extractable = (lazy->lazy->get != NULL) ? TRUE : FALSE;
+
+    switch ( op )
+    {
+	case OP_LOOKUP:
+	    check_lookups(sample->input, eager, lazy);
+	    if ( extractable == TRUE )
+	    { // present and absent fields were extracted one by one
+		ASSERT(lazy->lazy != NULL);
+	    }
+	    break;
+	case OP_SET:
+	    nx_logdata_get_field(lazy, "Hostname");
+	    nx_logdata_set_string(eager, "Hostname", "changed");
+	    nx_logdata_set_string(lazy, "Hostname", "changed");
+	    ASSERT(lazy->lazy == NULL);
+	    break;
+	case OP_SET_NEW:
+	    nx_logdata_get_field(lazy, "NoSuchField");
+	    nx_logdata_set_integer(eager, "NoSuchField", 1);
+	    nx_logdata_set_integer(lazy, "NoSuchField", 1);
+	    ASSERT(lazy->lazy == NULL);
+	    break;
+	case OP_DELETE:
+	    ASSERT(nx_logdata_delete_field(eager, "Message") ==
+		   nx_logdata_delete_field(lazy, "Message"));
+	    ASSERT(lazy->lazy == NULL);
+	    break;
+	case OP_RENAME:
+	    nx_logdata_rename_field(eager, "EventTime", "Renamed");
+	    nx_logdata_rename_field(lazy, "EventTime", "Renamed");
+	    ASSERT(lazy->lazy == NULL);
+	    break;
+	case OP_CLONE:
+	    tmp = nx_logdata_clone(lazy);
+	    ASSERT(lazy->lazy == NULL);
+	    nx_logdata_free(lazy);
+	    lazy = tmp;
+	    break;
+	case OP_SERIALIZE:
+	    size = nx_logdata_serialized_size(lazy);
+	    ASSERT(lazy->lazy == NULL);
+	    buf = malloc(size);
+	    ASSERT(buf != NULL);
+	    ASSERT(nx_logdata_to_membuf(lazy, buf, size) == size);
+	    nx_logdata_free(lazy);
+	    lazy = nx_logdata_from_membuf(buf, size, NULL);
+	    ASSERT(lazy != NULL);
+	    free(buf);
+	    break;
+	default:
+	    nx_panic("invalid operation %d", op);
+    }
+
+    check_fields(sample->input, op, eager, lazy);
+    nx_logdata_free(eager);
+    nx_logdata_free(lazy);
+}
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    nx_date_format_t format1 = NX_DATE_FORMAT_UNKNOWN;
+    nx_date_format_t format2 = NX_DATE_FORMAT_UNKNOWN;
+    int i, op;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    // the date format remembered from the previous samples is used in both
+    for ( op = 0; op < OP_NUM; op++ )
+    {
+	for ( i = 0; samples[i].input != NULL; i++ )
+	{
+	    check_op(&(samples[i]), (lazy_op_t) op, &format1, &format2);
+	}
+    }
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
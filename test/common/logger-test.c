@@ -0,0 +1,256 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+#define LOGFILE "logger-test.log"
+#define NUM_THREADS 4
+#define MSGCNT (NX_LOGGER_RING_SIZE / NUM_THREADS / 2)
+#define OVERFLOW 100
+
+nxlog_t nxlog;
+
+static apr_thread_mutex_t *logger_mutex;
+
+
+
+static void open_logfile(apr_pool_t *pool)
+{
+    apr_file_remove(LOGFILE, NULL);
+    CHECKERR(apr_file_open(&(nxlog.ctx->logfile), LOGFILE,
+			   APR_WRITE | APR_CREATE | APR_TRUNCATE,
+			   APR_OS_DEFAULT, pool));
+}
+
+
+
+static void close_logfile()
+{
+    apr_file_close(nxlog.ctx->logfile);
+    nxlog.ctx->logfile = NULL;
+}
+
+
+
+static void* APR_THREAD_FUNC producer(apr_thread_t *thd, void *data)
+{
+    int id = (int) (apr_size_t) data;
+    int i;
+
+    for ( i = 0; i < MSGCNT; i++ )
+    {
+	log_info("producer %d message %d", id, i);
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return ( NULL );
+}
+
+
+
+static void check_producers(apr_pool_t *pool)
+{
+    apr_thread_t *threads[NUM_THREADS];
+    int seen[NUM_THREADS][MSGCNT];
+    apr_status_t rv;
+    uint64_t drops;
+    char line[NX_LOGBUF_SIZE];
+    FILE *file;
+    int i, j;
+
+    memset(seen, 0, sizeof(seen));
+    nxlog.ctx->norepeat = FALSE;
+    open_logfile(pool);
+    drops = nx_logger_get_drops();
+
+    nx_logger_start();
+    for ( i = 0; i < NUM_THREADS; i++ )
+    {
+	nx_thread_create(&(threads[i]), NULL, producer, (void *) (apr_size_t) i, pool);
+    }
+    for ( i = 0; i < NUM_THREADS; i++ )
+    {
+	apr_thread_join(&rv, threads[i]);
+    }
+    nx_logger_stop();
+    close_logfile();
+
+    // below the ring capacity nothing is dropped
+    ASSERT(nx_logger_get_drops() == drops);
+
+    file = fopen(LOGFILE, "r");
+    ASSERT(file != NULL);
+    while ( fgets(line, sizeof(line), file) != NULL )
+    {
+	if ( sscanf(line, "producer %d message %d", &i, &j) != 2 )
+	{
+	    nx_abort("unexpected line in %s: %s", LOGFILE, line);
+	}
+	ASSERT((i >= 0) && (i < NUM_THREADS) && (j >= 0) && (j < MSGCNT));
+	(seen[i][j])++;
+    }
+    fclose(file);
+
+    for ( i = 0; i < NUM_THREADS; i++ )
+    {
+	for ( j = 0; j < MSGCNT; j++ )
+	{
+	    if ( seen[i][j] != 1 )
+	    {
+		nx_abort("message %d of producer %d was written %d times", j, i, seen[i][j]);
+	    }
+	}
+    }
+}
+
+
+
+static void check_drops(apr_pool_t *pool)
+{
+    uint64_t drops;
+    char line[NX_LOGBUF_SIZE];
+    char dropmsg[100];
+    FILE *file;
+    int i, written = 0;
+    boolean reported = FALSE;
+
+    nxlog.ctx->norepeat = FALSE;
+    open_logfile(pool);
+    drops = nx_logger_get_drops();
+
+    nx_logger_start();
+    // the logger thread cannot write while the logger mutex is held
+    CHECKERR(apr_thread_mutex_lock(logger_mutex));
+    for ( i = 0; i < NX_LOGGER_RING_SIZE + OVERFLOW; i++ )
+    {
+	log_info("stalled message %d", i);
+    }
+    ASSERT(nx_logger_get_drops() - drops == OVERFLOW);
+    CHECKERR(apr_thread_mutex_unlock(logger_mutex));
+    nx_logger_stop();
+    close_logfile();
+
+    apr_snprintf(dropmsg, sizeof(dropmsg), "%d internal log messages were dropped", OVERFLOW);
+    file = fopen(LOGFILE, "r");
+    ASSERT(file != NULL);
+    while ( fgets(line, sizeof(line), file) != NULL )
+    {
+	if ( sscanf(line, "stalled message %d", &i) == 1 )
+	{ // the oldest ones are kept
+	    ASSERT(i == written);
+	    written++;
+	}
+	else if ( strstr(line, dropmsg) != NULL )
+	{
+	    reported = TRUE;
+	}
+	else
+	{
+	    nx_abort("unexpected line in %s: %s", LOGFILE, line);
+	}
+    }
+    fclose(file);
+
+    ASSERT(written == NX_LOGGER_RING_SIZE);
+    ASSERT(reported == TRUE);
+}
+
+
+
+static int read_lines(char lines[][NX_LOGBUF_SIZE], int max)
+{
+    FILE *file;
+    int num = 0;
+
+    file = fopen(LOGFILE, "r");
+    ASSERT(file != NULL);
+    while ( (num < max) && (fgets(lines[num], NX_LOGBUF_SIZE, file) != NULL) )
+    {
+	num++;
+    }
+    fclose(file);
+
+    return ( num );
+}
+
+
+
+static void check_norepeat(apr_pool_t *pool)
+{
+    char lines[5][NX_LOGBUF_SIZE];
+    apr_time_t start;
+    int i, num;
+
+    nxlog.ctx->norepeat = TRUE;
+    open_logfile(pool);
+
+    nx_logger_start();
+    for ( i = 0; i < 5; i++ )
+    {
+	log_info("repeated message");
+    }
+
+    // flushed by the logger thread when no other message follows
+    start = apr_time_now();
+    do
+    {
+	apr_sleep(APR_USEC_PER_SEC / 10);
+	num = read_lines(lines, 5);
+    } while ( (num < 2) && (apr_time_now() - start < NX_LOGGER_NOREPEAT_INTERVAL * 3) );
+    ASSERT(apr_time_now() - start >= NX_LOGGER_NOREPEAT_INTERVAL - APR_USEC_PER_SEC / 10);
+    ASSERT(num == 2);
+    ASSERT(strcmp(lines[0], "repeated message\n") == 0);
+    ASSERT(strcmp(lines[1], "last message repeated 4 times\n") == 0);
+
+    // a critical message is written by the caller after the pending repeats
+    for ( i = 0; i < 3; i++ )
+    {
+	log_info("repeated message");
+    }
+    nx_log(APR_SUCCESS, NX_LOGLEVEL_CRITICAL, NX_LOGMODULE, "critical message");
+    num = read_lines(lines, 5);
+    ASSERT(num == 4);
+    ASSERT(strcmp(lines[2], "last message repeated 3 times\n") == 0);
+    ASSERT(strcmp(lines[3], "critical message\n") == 0);
+
+    nx_logger_stop();
+    close_logfile();
+}
+
+
+
+int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
+{
+    apr_pool_t *pool;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    memset(&nxlog, 0, sizeof(nxlog_t));
+    nxlog_set(&nxlog);
+    nxlog.ctx = nx_ctx_new();
+    nxlog.ctx->loglevel = NX_LOGLEVEL_INFO;
+    nxlog.ctx->formatlog = FALSE;
+    nx_logger_disable_foreground();
+
+    pool = nx_pool_create_core();
+    CHECKERR(apr_thread_mutex_create(&logger_mutex, APR_THREAD_MUTEX_UNNESTED, pool));
+    nx_logger_mutex_set(logger_mutex);
+
+    check_producers(pool);
+    check_drops(pool);
+    check_norepeat(pool);
+
+    apr_file_remove(LOGFILE, NULL);
+    apr_pool_destroy(pool);
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
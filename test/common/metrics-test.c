@@ -0,0 +1,179 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/metrics.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+#define NUM_THREADS 4
+#define LOOPCNT 100000
+#define CPUTIME_SPIN (APR_USEC_PER_SEC / 50)
+
+nxlog_t nxlog;
+
+
+
+static void check_buckets()
+{
+    uint64_t value;
+    int bucket, last = 0;
+
+    for ( value = 0; value < 100000; value++ )
+    { // buckets are contiguous and the value is below the limit
+	bucket = nx_histogram_bucket(value);
+	ASSERT((bucket == last) || (bucket == last + 1));
+	ASSERT(value < nx_histogram_bucket_limit(bucket));
+	if ( bucket > 0 )
+	{
+	    ASSERT(value >= nx_histogram_bucket_limit(bucket - 1));
+	}
+	last = bucket;
+    }
+    for ( bucket = NX_HISTOGRAM_SUB_BUCKETS; bucket < NX_HISTOGRAM_BUCKETS; bucket++ )
+    { // relative error stays within one sub-bucket
+	value = nx_histogram_bucket_limit(bucket - 1);
+	ASSERT(nx_histogram_bucket(value) == bucket);
+	ASSERT((nx_histogram_bucket_limit(bucket) - value) * NX_HISTOGRAM_SUB_BUCKETS <= value);
+    }
+    ASSERT(nx_histogram_bucket(0xFFFFFFFFFFFFULL) == NX_HISTOGRAM_BUCKETS - 1);
+}
+
+
+
+static void check_percentile(apr_pool_t *pool)
+{
+    nx_metrics_t *metrics;
+    nx_metrics_shard_t total;
+    nx_histogram_t *hist;
+    uint64_t p;
+    int i;
+
+    metrics = nx_metrics_new(pool);
+    for ( i = 1; i <= 1000; i++ )
+    {
+	nx_metrics_record(metrics, NX_METRICS_PROCTIME, i);
+    }
+    nx_metrics_record(metrics, NX_METRICS_QUEUETIME, -5);
+    nx_metrics_get(metrics, &total);
+
+    hist = &(total.histograms[NX_METRICS_PROCTIME]);
+    ASSERT(hist->count == 1000);
+    ASSERT(hist->sum == 500500);
+    ASSERT(hist->max == 1000);
+    ASSERT(nx_histogram_percentile(hist, 100) == 1000);
+    p = nx_histogram_percentile(hist, 50);
+    ASSERT((p >= 500) && (p <= 500 + 500 / NX_HISTOGRAM_SUB_BUCKETS));
+    p = nx_histogram_percentile(hist, 99);
+    ASSERT((p >= 990) && (p <= 1000));
+
+    hist = &(total.histograms[NX_METRICS_QUEUETIME]);
+    ASSERT(hist->count == 1);
+    ASSERT(hist->max == 0);
+    ASSERT(nx_histogram_percentile(hist, 99) == 0);
+
+    nx_metrics_add(NULL, NX_METRICS_DROPS, 1);
+    nx_metrics_record(NULL, NX_METRICS_PROCTIME, 1);
+}
+
+
+
+static void* APR_THREAD_FUNC update_thread(apr_thread_t *thd, void *data)
+{
+    nx_metrics_t *metrics = (nx_metrics_t *) data;
+    int i;
+
+    for ( i = 0; i < LOOPCNT; i++ )
+    {
+	nx_metrics_add(metrics, NX_METRICS_BYTES_IN, 3);
+	nx_metrics_record(metrics, NX_METRICS_QUEUETIME, i % 100);
+    }
+    apr_thread_exit(thd, APR_SUCCESS);
+
+    return ( NULL );
+}
+
+
+
+static void check_threads(apr_pool_t *pool)
+{
+    nx_metrics_t *metrics;
+    nx_metrics_shard_t total;
+    apr_thread_t *threads[NUM_THREADS];
+    apr_status_t rv;
+    int i;
+
+    metrics = nx_metrics_new(pool);
+    for ( i = 0; i < NUM_THREADS; i++ )
+    {
+	nx_thread_create(&(threads[i]), NULL, update_thread, metrics, pool);
+    }
+    for ( i = 0; i < NUM_THREADS; i++ )
+    {
+	CHECKERR(apr_thread_join(&rv, threads[i]));
+    }
+
+    nx_metrics_get(metrics, &total);
+    ASSERT(total.counters[NX_METRICS_BYTES_IN] == (uint64_t) NUM_THREADS * LOOPCNT * 3);
+    ASSERT(total.histograms[NX_METRICS_QUEUETIME].count == (uint64_t) NUM_THREADS * LOOPCNT);
+    ASSERT(total.histograms[NX_METRICS_QUEUETIME].max == 99);
+}
+
+
+
+static void check_cputime()
+{
+    apr_time_t start, used, wallstart;
+    volatile uint64_t sum = 0;
+    uint64_t i;
+
+    start = nx_metrics_thread_cputime();
+    // 0 if the platform has no per thread CPU clock
+    if ( start != 0 )
+    { // spin until the CPU clock advances, bounded by wall clock time
+	wallstart = apr_time_now();
+	do
+	{
+	    for ( i = 0; i < 10000; i++ )
+	    {
+		sum += i;
+	    }
+	    used = nx_metrics_thread_cputime() - start;
+	} while ( (used < CPUTIME_SPIN) && (apr_time_now() - wallstart < APR_USEC_PER_SEC * 5) );
+	ASSERT(used >= CPUTIME_SPIN);
+    }
+
+    // sleeping does not use CPU time
+    start = nx_metrics_thread_cputime();
+    apr_sleep(APR_USEC_PER_SEC / 5);
+    used = nx_metrics_thread_cputime() - start;
+    ASSERT(used < APR_USEC_PER_SEC / 10);
+}
+
+
+
+int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
+{
+    apr_pool_t *pool;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    pool = nx_pool_create_core();
+
+    check_buckets();
+    check_percentile(pool);
+    check_threads(pool);
+    check_cputime();
+
+    apr_pool_destroy(pool);
+    apr_terminate();
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
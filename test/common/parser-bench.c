@@ -0,0 +1,184 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "parser-bench.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+
+
+static boolean skipped(const parser_bench_t *bench, const char *key)
+{
+    int i;
+
+    if ( bench->skip == NULL )
+    {
+	return ( FALSE );
+    }
+    for ( i = 0; bench->skip[i] != NULL; i++ )
+    {
+	if ( strcmp(bench->skip[i], key) == 0 )
+	{
+	    return ( TRUE );
+	}
+    }
+
+    return ( FALSE );
+}
+
+
+
+/**
+ * Returns the fields as key=value| pairs, must be freed with free()
+ */
+char *parser_bench_fields(const parser_bench_t *bench, nx_logdata_t *logdata)
+{
+    nx_logdata_field_t *field;
+    nx_string_t *str;
+    char *value;
+    char *retval;
+
+    str = nx_string_new();
+    for ( field = NX_DLIST_FIRST(&(logdata->fields));
+	  field != NULL;
+	  field = NX_DLIST_NEXT(field, link) )
+    {
+	if ( skipped(bench, field->key) == TRUE )
+	{
+	    continue;
+	}
+	nx_string_append(str, field->key, -1);
+	if ( bench->types == TRUE )
+	{
+	    nx_string_sprintf_append(str, "=%s/%d:", nx_value_type_to_string(field->value->type),
+				     field->value->defined);
+	}
+	else
+	{
+	    nx_string_append(str, "=", 1);
+	}
+	if ( field->value->defined == TRUE )
+	{
+	    value = nx_value_to_string(field->value);
+	    nx_string_append(str, value, -1);
+	    free(value);
+	}
+	nx_string_append(str, "|", 1);
+    }
+    retval = strdup(str->buf);
+    nx_string_free(str);
+
+    return ( retval );
+}
+
+
+
+static char *parse_fields(const parser_bench_t *bench,
+			  const parser_bench_parser_t *parser,
+			  const char *input)
+{
+    nx_logdata_t *logdata;
+    char *retval;
+
+    logdata = parser->new(input);
+    parser->parse(logdata, input, strlen(input));
+    retval = parser_bench_fields(bench, logdata);
+    nx_logdata_free(logdata);
+
+    return ( retval );
+}
+
+
+
+/**
+ * Aborts if a parser sets different fields than expected for a sample
+ */
+void parser_bench_check(const parser_bench_t *bench)
+{
+    const parser_bench_sample_t *sample;
+    const parser_bench_parser_t *parser;
+    char *expected, *fields;
+
+    for ( sample = bench->samples; sample->input != NULL; sample++ )
+    {
+	if ( sample->fields != NULL )
+	{
+	    expected = strdup(sample->fields);
+	    parser = bench->parsers;
+	}
+	else
+	{
+	    expected = parse_fields(bench, bench->parsers, sample->input);
+	    parser = bench->parsers + 1;
+	}
+	for ( ; parser->name != NULL; parser++ )
+	{
+	    fields = parse_fields(bench, parser, sample->input);
+	    if ( strcmp(fields, expected) != 0 )
+	    {
+		nx_abort("unexpected fields from %s for '%s':\n%s\n%s", parser->name,
+			 sample->input, fields, expected);
+	    }
+	    free(fields);
+	}
+	free(expected);
+    }
+}
+
+
+
+static double bench_parser(const parser_bench_parser_t *parser, const char *input)
+{
+    nx_logdata_t *logdata;
+    apr_time_t start;
+    apr_time_t elapsed = 0;
+    size_t len;
+    int i;
+
+    len = strlen(input);
+    for ( i = 0; i < PARSER_BENCH_LOOPCNT; i++ )
+    {
+	logdata = parser->new(input);
+
+	start = apr_time_now();
+	parser->parse(logdata, input, len);
+	elapsed += apr_time_now() - start;
+
+	nx_logdata_free(logdata);
+    }
+
+    return ( (double) elapsed * 1000.0 / PARSER_BENCH_LOOPCNT );
+}
+
+
+
+/**
+ * Prints the time of a parse for each sample and parser
+ */
+void parser_bench_print(const parser_bench_t *bench)
+{
+    const parser_bench_sample_t *sample;
+    const parser_bench_parser_t *parser;
+
+    printf("%-12s %6s", "record", "bytes");
+    for ( parser = bench->parsers; parser->name != NULL; parser++ )
+    {
+	printf(" %10s", parser->name);
+    }
+    printf("\n");
+
+    for ( sample = bench->samples; sample->input != NULL; sample++ )
+    {
+	printf("%-12s %6d", sample->name, (int) strlen(sample->input));
+	for ( parser = bench->parsers; parser->name != NULL; parser++ )
+	{
+	    printf(" %7.1f ns", bench_parser(parser, sample->input));
+	}
+	printf("\n");
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#ifndef __NX_PARSER_BENCH_H
+#define __NX_PARSER_BENCH_H
+
+#include "../../src/common/logdata.h"
+
+/*
+ * Shared by the parser benchmarks: the fields set by each parser are
+ * checked for every sample, then the parse time is printed per sample.
+ */
+
+#define PARSER_BENCH_LOOPCNT 20000
+
+/// creates the logdata which is passed to the parser, this is not timed
+typedef nx_logdata_t *(parser_bench_new_func_t)(const char *input);
+/// sets the fields parsed from input in logdata
+typedef void (parser_bench_parse_func_t)(nx_logdata_t *logdata, const char *input, size_t len);
+
+typedef struct parser_bench_parser_t
+{
+    const char			*name;	///< column of the timings, NULL terminates the list
+    parser_bench_new_func_t	*new;
+    parser_bench_parse_func_t	*parse;
+} parser_bench_parser_t;
+
+typedef struct parser_bench_sample_t
+{
+    const char	*name;
+    const char	*input;		///< NULL terminates the list
+    const char	*fields;	///< expected fields, NULL to compare with the first parser
+} parser_bench_sample_t;
+
+typedef struct parser_bench_t
+{
+    const parser_bench_parser_t	*parsers;
+    const parser_bench_sample_t	*samples;
+    const char * const		*skip;	///< fields left out of the comparison, NULL terminated
+    boolean			types;	///< compare the value types too
+} parser_bench_t;
+
+char *parser_bench_fields(const parser_bench_t *bench, nx_logdata_t *logdata);
+void parser_bench_check(const parser_bench_t *bench);
+void parser_bench_print(const parser_bench_t *bench);
+
+#endif	/* __NX_PARSER_BENCH_H */
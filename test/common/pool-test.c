@@ -0,0 +1,181 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+#include "../../src/core/ctx.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+#define INTERVAL APR_USEC_PER_SEC
+
+nxlog_t nxlog;
+
+
+
+static apr_array_header_t *parse_cpu_list(apr_pool_t *pool, const char *list)
+{
+    nx_directive_t directive;
+    apr_array_header_t * volatile cpus = NULL;
+    nx_exception_t e;
+
+    memset(&directive, 0, sizeof(nx_directive_t));
+    directive.directive = "CPUAffinity";
+    directive.args = apr_pstrdup(pool, list);
+    directive.filename = "pool-test.conf";
+    directive.line_num = 1;
+
+    try
+    {
+	cpus = nx_ctx_parse_cpu_list(pool, &directive);
+    }
+    catch(e)
+    {
+	cpus = NULL;
+    }
+
+    return ( cpus );
+}
+
+
+
+static void check_cpu_list(apr_pool_t *pool, const char *list, int num, const int *expected)
+{
+    apr_array_header_t *cpus;
+    int i;
+
+    cpus = parse_cpu_list(pool, list);
+    if ( cpus == NULL )
+    {
+	nx_abort("failed to parse CPU list '%s'", list);
+    }
+    if ( cpus->nelts != num )
+    {
+	nx_abort("CPU list '%s' has %d entries, expected %d", list, cpus->nelts, num);
+    }
+    for ( i = 0; i < num; i++ )
+    {
+	if ( ((int *) cpus->elts)[i] != expected[i] )
+	{
+	    nx_abort("CPU %d of list '%s' is %d, expected %d", i, list,
+		     ((int *) cpus->elts)[i], expected[i]);
+	}
+    }
+}
+
+
+
+static void check_cpu_lists(apr_pool_t *pool)
+{
+    const int range[] = { 0, 1, 2, 3, 8 };
+    const int single[] = { 5 };
+    const int spaced[] = { 1, 4, 5 };
+    const int last[] = { NX_THREAD_MAX_CPU - 1 };
+    const char *invalids[] =
+    {
+	"",
+	"x",
+	"3-1",
+	"-1",
+	"1-",
+	"1-x",
+	"0,",
+	"0-3, ",
+	",1",
+	"1,,2",
+	"1;2",
+	"1 2",
+	"0-1024",
+	"99999999999999999999",
+	NULL
+    };
+    char tmpstr[32];
+    int i;
+
+    check_cpu_list(pool, "0-3,8", 5, range);
+    check_cpu_list(pool, "5", 1, single);
+    check_cpu_list(pool, "1, 4-5", 3, spaced);
+    apr_snprintf(tmpstr, sizeof(tmpstr), "%d", NX_THREAD_MAX_CPU - 1);
+    check_cpu_list(pool, tmpstr, 1, last);
+
+    apr_snprintf(tmpstr, sizeof(tmpstr), "%d", NX_THREAD_MAX_CPU);
+    if ( parse_cpu_list(pool, tmpstr) != NULL )
+    {
+	nx_abort("CPU %s should be rejected", tmpstr);
+    }
+    for ( i = 0; invalids[i] != NULL; i++ )
+    {
+	if ( parse_cpu_list(pool, invalids[i]) != NULL )
+	{
+	    nx_abort("invalid CPU list '%s' was accepted", invalids[i]);
+	}
+    }
+}
+
+
+
+static void check_pool_decide()
+{
+    unsigned int idle = 0;
+    unsigned int i;
+
+    // busy with a backlog: grow up to max
+    ASSERT(nxlog_pool_decide(INTERVAL * 2, INTERVAL, 10, 10, 2, 1, 4, &idle) == NXLOG_POOL_GROW);
+    ASSERT(nxlog_pool_decide(INTERVAL * 4, INTERVAL, 10, 10, 4, 1, 4, &idle) == NXLOG_POOL_KEEP);
+    // busy without enough jobs waiting
+    ASSERT(nxlog_pool_decide(INTERVAL * 2, INTERVAL, 10, 4, 2, 1, 4, &idle) == NXLOG_POOL_KEEP);
+    // jobs waiting while the workers are mostly idle
+    ASSERT(nxlog_pool_decide(INTERVAL, INTERVAL, 10, 10, 2, 1, 4, &idle) == NXLOG_POOL_KEEP);
+    // no samples taken
+    ASSERT(nxlog_pool_decide(INTERVAL * 2, INTERVAL, 0, 0, 2, 1, 4, &idle) == NXLOG_POOL_KEEP);
+    ASSERT(nxlog_pool_decide(INTERVAL * 2, 0, 10, 10, 2, 1, 4, &idle) == NXLOG_POOL_KEEP);
+
+    // shrink only after NXLOG_POOL_SHRINK_INTERVALS idle intervals in a row
+    idle = 0;
+    for ( i = 1; i < NXLOG_POOL_SHRINK_INTERVALS; i++ )
+    {
+	ASSERT(nxlog_pool_decide(0, INTERVAL, 10, 0, 3, 1, 4, &idle) == NXLOG_POOL_KEEP);
+	ASSERT(idle == i);
+    }
+    ASSERT(nxlog_pool_decide(0, INTERVAL, 10, 0, 3, 1, 4, &idle) == NXLOG_POOL_SHRINK);
+    ASSERT(idle == 0);
+
+    // a busy interval resets the idle count
+    for ( i = 1; i < NXLOG_POOL_SHRINK_INTERVALS; i++ )
+    {
+	ASSERT(nxlog_pool_decide(0, INTERVAL, 10, 0, 3, 1, 4, &idle) == NXLOG_POOL_KEEP);
+    }
+    ASSERT(nxlog_pool_decide(INTERVAL * 3 / 2, INTERVAL, 10, 0, 3, 1, 4, &idle) == NXLOG_POOL_KEEP);
+    ASSERT(idle == 0);
+    ASSERT(nxlog_pool_decide(0, INTERVAL, 10, 0, 3, 1, 4, &idle) == NXLOG_POOL_KEEP);
+    ASSERT(idle == 1);
+
+    // never below min
+    idle = NXLOG_POOL_SHRINK_INTERVALS;
+    ASSERT(nxlog_pool_decide(0, INTERVAL, 10, 0, 2, 2, 4, &idle) == NXLOG_POOL_KEEP);
+}
+
+
+
+int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
+{
+    apr_pool_t *pool;
+
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    pool = nx_pool_create_core();
+
+    check_cpu_lists(pool);
+    check_pool_decide();
+
+    apr_pool_destroy(pool);
+    apr_terminate();
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
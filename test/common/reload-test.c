@@ -0,0 +1,421 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+#include "../../src/core/reload.h"
+#include "../../src/core/modules.h"
+#include "../../src/core/job.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+#define CONFIGFILE "reload-test.conf"
+#define OUTFILE1 "reload-test-out1.log"
+#define OUTFILE2 "reload-test-out2.log"
+#define FIFOFILE "reload-test.fifo"
+#define MESSAGE "queued before the reload"
+
+nxlog_t nxlog;
+
+static const char *baseconf =
+    "LogLevel INFO\n"
+    "<Extension json>\n"
+    "    Module	xm_json\n"
+    "</Extension>\n"
+    "<Input in1>\n"
+    "    Module	im_file\n"
+    "    File	'/tmp/in1.log'\n"
+    "</Input>\n"
+    "<Input in2>\n"
+    "    Module	im_tcp\n"
+    "    Port	1514\n"
+    "</Input>\n"
+    "<Input in3>\n"
+    "    Module	im_udp\n"
+    "    Port	1516\n"
+    "</Input>\n"
+    "<Output out1>\n"
+    "    Module	om_file\n"
+    "    File	'/tmp/out1.log'\n"
+    "</Output>\n"
+    "<Output out2>\n"
+    "    Module	om_file\n"
+    "    File	'/tmp/out2.log'\n"
+    "</Output>\n"
+    "<Output out3>\n"
+    "    Module	om_null\n"
+    "</Output>\n"
+    "<Route r1>\n"
+    "    Path	in1 => out1\n"
+    "</Route>\n"
+    "<Route r2>\n"
+    "    Path	in2 => out2\n"
+    "</Route>\n"
+    "<Route r3>\n"
+    "    Path	in3 => out3\n"
+    "</Route>\n";
+
+// out3 blocks its worker in om_file_start() until the fifo is opened for reading
+static const char *runconf =
+    "ModuleDir	../../src/modules\n"
+    "CacheDir	.\n"
+    "NoCache	TRUE\n"
+    "Threads	4\n"
+    "LogLevel	INFO\n"
+    "<Input in1>\n"
+    "    Module	im_null\n"
+    "</Input>\n"
+    "<Input in2>\n"
+    "    Module	im_null\n"
+    "</Input>\n"
+    "<Input in3>\n"
+    "    Module	im_null\n"
+    "</Input>\n"
+    "<Output out1>\n"
+    "    Module	om_null\n"
+    "</Output>\n"
+    "<Output out2>\n"
+    "    Module	om_file\n"
+    "    File	'" OUTFILE1 "'\n"
+    "</Output>\n"
+    "<Output out3>\n"
+    "    Module	om_file\n"
+    "    File	'" FIFOFILE "'\n"
+    "</Output>\n"
+    "<Route r1>\n"
+    "    Path	in1 => out1\n"
+    "</Route>\n"
+    "<Route r2>\n"
+    "    Path	in2 => out2\n"
+    "</Route>\n"
+    "<Route r3>\n"
+    "    Path	in3 => out3\n"
+    "</Route>\n";
+
+
+
+static nx_directive_t *parse_conf(apr_pool_t *pool, const char *conf)
+{
+    FILE *file;
+
+    file = fopen(CONFIGFILE, "w");
+    ASSERT(file != NULL);
+    ASSERT(fputs(conf, file) >= 0);
+    fclose(file);
+
+    return ( nx_ctx_parse_cfgtree(pool, CONFIGFILE) );
+}
+
+
+
+static const char *edit_conf(apr_pool_t *pool, const char *conf,
+			     const char *search, const char *replace)
+{
+    const char *pos;
+
+    pos = strstr(conf, search);
+    ASSERT(pos != NULL);
+
+    return ( apr_psprintf(pool, "%.*s%s%s", (int) (pos - conf), conf,
+			  replace, pos + strlen(search)) );
+}
+
+
+
+static nx_reload_plan_t *plan_for(apr_pool_t *pool, const char *oldconf, const char *newconf)
+{
+    return ( nx_reload_plan(pool, parse_conf(pool, oldconf), parse_conf(pool, newconf)) );
+}
+
+
+
+static nx_module_t *get_module(const char *name)
+{
+    nx_module_t *module;
+
+    for ( module = NX_DLIST_FIRST(nxlog.ctx->modules);
+	  module != NULL;
+	  module = NX_DLIST_NEXT(module, link) )
+    {
+	if ( strcmp(module->name, name) == 0 )
+	{
+	    return ( module );
+	}
+    }
+
+    return ( NULL );
+}
+
+
+
+static boolean has_route(const char *name)
+{
+    nx_route_t *route;
+
+    for ( route = NX_DLIST_FIRST(nxlog.ctx->routes);
+	  route != NULL;
+	  route = NX_DLIST_NEXT(route, link) )
+    {
+	if ( strcmp(route->name, name) == 0 )
+	{
+	    return ( TRUE );
+	}
+    }
+
+    return ( FALSE );
+}
+
+
+
+static boolean file_contains(const char *filename, const char *str)
+{
+    char line[NX_LOGBUF_SIZE];
+    boolean found = FALSE;
+    FILE *file;
+
+    file = fopen(filename, "r");
+    if ( file == NULL )
+    {
+	return ( FALSE );
+    }
+    while ( (found == FALSE) && (fgets(line, sizeof(line), file) != NULL) )
+    {
+	found = (strstr(line, str) != NULL) ? TRUE : FALSE;
+    }
+    fclose(file);
+
+    return ( found );
+}
+
+
+
+static void write_conf(const char *conf)
+{
+    FILE *file;
+
+    file = fopen(CONFIGFILE, "w");
+    ASSERT(file != NULL);
+    ASSERT(fputs(conf, file) >= 0);
+    fclose(file);
+}
+
+
+
+static void remove_files()
+{
+    apr_file_remove(CONFIGFILE, NULL);
+    apr_file_remove(OUTFILE1, NULL);
+    apr_file_remove(OUTFILE2, NULL);
+    apr_file_remove(FIFOFILE, NULL);
+    apr_file_remove("out2.q", NULL);
+}
+
+
+
+static void start_nxlog(apr_pool_t *pool)
+{
+    remove_files();
+    CHECKERR(apr_file_namedpipe_create(FIFOFILE, APR_OS_DEFAULT, pool));
+    write_conf(runconf);
+
+    nxlog_init(&nxlog);
+    nxlog.cfgfile = CONFIGFILE;
+    nx_ctx_parse_cfg(nxlog.ctx, nxlog.cfgfile);
+    nx_ctx_init_logging(nxlog.ctx);
+    nx_ctx_config_modules(nxlog.ctx);
+    nx_ctx_init_modules(nxlog.ctx);
+    nx_ctx_init_routes(nxlog.ctx);
+    nx_ctx_init_jobs(nxlog.ctx);
+    nx_ctx_restore_queues(nxlog.ctx);
+    nxlog_create_threads(&nxlog);
+    nx_ctx_start_modules(nxlog.ctx);
+}
+
+
+
+/**
+ * An event in the queue of the replaced module must be saved and
+ * processed by its replacement, the other modules are kept.
+ */
+static void check_requeue(apr_pool_t *pool)
+{
+    nx_module_t *in1, *out1, *out2;
+    nx_logdata_t *logdata;
+    apr_time_t start;
+
+    in1 = get_module("in1");
+    out1 = get_module("out1");
+    out2 = get_module("out2");
+    ASSERT((in1 != NULL) && (out1 != NULL) && (out2 != NULL));
+
+    // om_file processes the saved queue on start
+    start = apr_time_now();
+    while ( (nx_module_get_status(out2) != NX_MODULE_STATUS_RUNNING) &&
+	    (apr_time_now() - start < APR_USEC_PER_SEC * 5) )
+    {
+	apr_sleep(APR_USEC_PER_SEC / 10);
+    }
+    ASSERT(nx_module_get_status(out2) == NX_MODULE_STATUS_RUNNING);
+
+    // no event is sent, it stays in the queue until out2 is stopped
+    logdata = nx_logdata_new_logline(MESSAGE, (int) strlen(MESSAGE));
+    nx_logqueue_push(out2->queue, logdata);
+
+    write_conf(edit_conf(pool, runconf, "'" OUTFILE1 "'", "'" OUTFILE2 "'"));
+    ASSERT(nxlog_reload_modules(&nxlog) == TRUE);
+
+    ASSERT(get_module("in1") == in1);
+    ASSERT(get_module("out1") == out1);
+    ASSERT(get_module("out2") != NULL);
+    ASSERT(get_module("out2") != out2);
+    ASSERT(has_route("r2") == TRUE);
+
+    start = apr_time_now();
+    while ( (file_contains(OUTFILE2, MESSAGE) != TRUE) &&
+	    (apr_time_now() - start < APR_USEC_PER_SEC * 5) )
+    {
+	apr_sleep(APR_USEC_PER_SEC / 10);
+    }
+    ASSERT(file_contains(OUTFILE2, MESSAGE) == TRUE);
+    ASSERT(file_contains(OUTFILE1, MESSAGE) == FALSE);
+}
+
+
+
+/**
+ * A module which does not leave its worker thread is put back, the
+ * caller must fall back to a full reload.
+ */
+static void check_busy(apr_pool_t *pool)
+{
+    nx_module_t *out3;
+    apr_file_t *fifo;
+    int i;
+
+    out3 = get_module("out3");
+    ASSERT(out3 != NULL);
+    for ( i = 0; (i < 50) && (nx_atomic_read32(&(out3->job->busy)) != TRUE); i++ )
+    {
+	apr_sleep(APR_USEC_PER_SEC / 10);
+    }
+    ASSERT(nx_atomic_read32(&(out3->job->busy)) == TRUE);
+
+    write_conf(edit_conf(pool, edit_conf(pool, runconf, "'" OUTFILE1 "'", "'" OUTFILE2 "'"),
+			 "'" FIFOFILE "'", "'" FIFOFILE "'\n    Sync	TRUE"));
+    ASSERT(nxlog_reload_modules(&nxlog) == FALSE);
+
+    ASSERT(get_module("out3") == out3);
+    ASSERT(get_module("in3") != NULL);
+    ASSERT(has_route("r3") == TRUE);
+
+    // let om_file_start() return
+    CHECKERR(apr_file_open(&fifo, FIFOFILE, APR_READ, APR_OS_DEFAULT, pool));
+    for ( i = 0; (i < 50) && (nx_atomic_read32(&(out3->job->busy)) == TRUE); i++ )
+    {
+	apr_sleep(APR_USEC_PER_SEC / 10);
+    }
+    ASSERT(nx_atomic_read32(&(out3->job->busy)) == FALSE);
+    apr_file_close(fifo);
+}
+
+
+
+/**
+ * Trees replaced by partial reloads are freed once no module uses them.
+ */
+static void check_cfgtrees(apr_pool_t *pool)
+{
+    nx_module_t *out2;
+
+    out2 = get_module("out2");
+    ASSERT(out2 != NULL);
+
+    write_conf(runconf);
+    ASSERT(nxlog_reload_modules(&nxlog) == TRUE);
+    ASSERT(get_module("out2") != out2);
+    ASSERT(nxlog.ctx->cfgtree_pool != NULL);
+    ASSERT((nxlog.ctx->old_cfgtrees == NULL) || (nxlog.ctx->old_cfgtrees->nelts == 0));
+}
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    apr_pool_t *pool;
+    nx_reload_plan_t *plan;
+    const char *conf;
+
+    nx_init(&argc, &argv, &env);
+
+    memset(&nxlog, 0, sizeof(nxlog_t));
+    nxlog_set(&nxlog);
+    nxlog.ctx = nx_ctx_new();
+    nxlog.ctx->loglevel = NX_LOGLEVEL_INFO;
+
+    pool = nx_pool_create_core();
+
+    // nothing changed, external files may have, restart everything
+    plan = plan_for(pool, baseconf, baseconf);
+    ASSERT(plan->full == TRUE);
+
+    // only the route of the changed module is restarted
+    plan = plan_for(pool, baseconf, edit_conf(pool, baseconf, "1514", "1515"));
+    ASSERT(plan->full == FALSE);
+    ASSERT(plan->modules->nelts == 2);
+    ASSERT(nx_reload_plan_has_module(plan, "in2") == TRUE);
+    ASSERT(nx_reload_plan_has_module(plan, "out2") == TRUE);
+    ASSERT(nx_reload_plan_has_module(plan, "in1") == FALSE);
+    ASSERT(plan->routes->nelts == 1);
+    ASSERT(nx_reload_plan_has_route(plan, "r2") == TRUE);
+
+    // a new route with a new module
+    plan = plan_for(pool, baseconf,
+		    edit_conf(pool, baseconf, "<Route r1>",
+			      "<Output out4>\n    Module	om_null\n</Output>\n"
+			      "<Route r4>\n    Path	in9 => out4\n</Route>\n<Route r1>"));
+    ASSERT(plan->full == FALSE);
+    ASSERT(plan->modules->nelts == 1);
+    ASSERT(nx_reload_plan_has_module(plan, "out4") == TRUE);
+    ASSERT(plan->routes->nelts == 1);
+    ASSERT(nx_reload_plan_has_route(plan, "r4") == TRUE);
+
+    // in1 joins r2, so r1 and r2 are restarted together
+    plan = plan_for(pool, baseconf, edit_conf(pool, baseconf, "in2 => out2", "in2, in1 => out2"));
+    ASSERT(plan->full == FALSE);
+    ASSERT(plan->modules->nelts == 4);
+    ASSERT(plan->routes->nelts == 2);
+
+    // in1 calls a function of out2 which is replaced
+    conf = edit_conf(pool, baseconf, "'/tmp/in1.log'\n",
+		     "'/tmp/in1.log'\n    Exec	out2->rotate_to('/tmp/x');\n");
+    plan = plan_for(pool, conf, edit_conf(pool, conf, "1514", "1515"));
+    ASSERT(plan->full == FALSE);
+    ASSERT(nx_reload_plan_has_module(plan, "in1") == TRUE);
+    ASSERT(nx_reload_plan_has_route(plan, "r1") == TRUE);
+    ASSERT(nx_reload_plan_has_route(plan, "r3") == FALSE);
+
+    // global directives, extensions and reroute() need a full reload
+    plan = plan_for(pool, baseconf, edit_conf(pool, baseconf, "LogLevel INFO", "LogLevel DEBUG"));
+    ASSERT(plan->full == TRUE);
+    plan = plan_for(pool, baseconf, edit_conf(pool, baseconf, "xm_json\n", "xm_json\n    Foo	bar\n"));
+    ASSERT(plan->full == TRUE);
+    plan = plan_for(pool, baseconf, edit_conf(pool, baseconf, "1514\n", "1515\n    Exec	reroute('r1');\n"));
+    ASSERT(plan->full == TRUE);
+
+    start_nxlog(pool);
+    check_requeue(pool);
+    check_busy(pool);
+    check_cfgtrees(pool);
+    nxlog_shutdown(&nxlog);
+
+    remove_files();
+    apr_pool_destroy(pool);
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
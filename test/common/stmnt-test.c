@@ -7,6 +7,7 @@
 
 #include "../../src/common/error_debug.h"
 #include "../../src/common/expr-parser.h"
+#include "../../src/common/expr-vm.h"
 #include "../../src/common/alloc.h"
 #include "../../src/core/nxlog.h"
 #include "../../src/core/core.h"
@@ -68,19 +69,91 @@ static void fail(const char *errormsg)
 
 
 
-int main(int argc, const char * const *argv, const char * const *env)
+static void execute(nx_module_t *module,
+		    const nx_expr_statement_list_t *statements,
+		    const char *message)
 {
-    apr_pool_t *pool = NULL;
     nx_expr_eval_ctx_t eval_ctx;
     nx_logdata_t *logdata;
     nx_value_t result;
+
+    logdata = nx_logdata_new_logline(message, (int) strlen(message));
+    nx_expr_eval_ctx_init(&eval_ctx, logdata, module, NULL);
+
+    nx_expr_statement_list_execute(&eval_ctx, statements);
+    memset(&result, 0, sizeof(nx_value_t));
+    if ( nx_logdata_get_field_value(logdata, "success", &result) != TRUE )
+    {
+	fail("test didn't return 'success' field");
+    }
+    if ( result.type != NX_VALUE_TYPE_BOOLEAN )
+    {
+	fail("boolean type required for 'success' field");
+    }
+    if ( result.defined != TRUE )
+    {
+	fail("test failed: returned 'success' is undef");
+    }
+    if ( result.boolean != TRUE )
+    {
+	fail("test failed: returned 'success' is FALSE");
+    }
+
+    nx_logdata_free(logdata);
+    nx_expr_eval_ctx_destroy(&eval_ctx);
+}
+
+
+
+/**
+ * Run the statements with BENCH=<count> in the environment
+ * to compare the tree walker with the compiled program.
+ */
+static void benchmark(nx_module_t *module,
+		      nx_expr_statement_list_t *statements,
+		      const char *message,
+		      int count)
+{
+    nx_expr_program_t *program;
+    apr_time_t start, tree, compiled;
+    int i;
+
+    program = statements->program;
+
+    statements->program = NULL;
+    start = apr_time_now();
+    for ( i = 0; i < count; i++ )
+    {
+	execute(module, statements, message);
+    }
+    tree = apr_time_now() - start;
+
+    statements->program = program;
+    start = apr_time_now();
+    for ( i = 0; i < count; i++ )
+    {
+	execute(module, statements, message);
+    }
+    compiled = apr_time_now() - start;
+
+    printf("%d runs: tree %ld usec, compiled %ld usec\n", count,
+	   (long int) tree, (long int) compiled);
+}
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    apr_pool_t *pool = NULL;
     const char *message = "<6> Oct 12 12:49:06 host app[12345]: kernel message";
     //nx_value_t *value;
     apr_file_t *input;
     char inputstr[10000];
     apr_size_t inputlen;
     nx_expr_statement_list_t *statements;
+    nx_expr_program_t *program;
     int i;
+    int bench = 0;
     nx_module_t *module = NULL;
     nx_exception_t e;
 
@@ -98,7 +171,10 @@ int main(int argc, const char * const *argv, const char * const *env)
 	if (strncmp(env[i], "DEBUG=", 6) == 0)
 	{
 	    nxlog.ctx->loglevel = NX_LOGLEVEL_DEBUG;
-	    break;
+	}
+	if (strncmp(env[i], "BENCH=", 6) == 0)
+	{
+	    bench = atoi(env[i] + 6);
 	}
     }
     nxlog.ctx->norepeat = FALSE;
@@ -123,32 +199,18 @@ int main(int argc, const char * const *argv, const char * const *env)
 	statements = nx_expr_parse_statements(NULL, inputstr, pool, NULL, 1, 0);
 	ASSERT(statements != NULL);
 
-	for ( i = 0; i < 1; i++ )
+	program = statements->program;
+	ASSERT(program != NULL);
+
+	// the tree walker and the compiled program must both pass
+	statements->program = NULL;
+	execute(module, statements, message);
+	statements->program = program;
+	execute(module, statements, message);
+
+	if ( bench > 0 )
 	{
-	    logdata = nx_logdata_new_logline(message, (int) strlen(message));
-	    nx_expr_eval_ctx_init(&eval_ctx, logdata, module, NULL);
-
-	    nx_expr_statement_list_execute(&eval_ctx, statements);
-	    memset(&result, 0, sizeof(nx_value_t));
-	    if ( nx_logdata_get_field_value(logdata, "success", &result) != TRUE )
-	    {
-		fail("test didn't return 'success' field");
-	    }
-	    if ( result.type != NX_VALUE_TYPE_BOOLEAN )
-	    {
-		fail("boolean type required for 'success' field");
-	    }
-	    if ( result.defined != TRUE )
-	    {
-		fail("test failed: returned 'success' is undef");
-	    }
-	    if ( result.boolean != TRUE )
-	    {
-		fail("test failed: returned 'success' is FALSE");
-	    }
-
-	    nx_logdata_free(logdata);
-	    nx_expr_eval_ctx_destroy(&eval_ctx);
+	    benchmark(module, statements, message, bench);
 	}
     }
     catch(e)
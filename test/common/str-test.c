@@ -136,6 +136,46 @@ static void test_utf()
 
 
 
+static void test_scan()
+{
+    nx_string_scan_t scan;
+    char buf[100];
+    size_t i, j;
+
+    nx_string_scan_init(&scan);
+    ASSERT(nx_string_scan(&scan, "abc", 3) == 3);
+
+    nx_string_scan_add(&scan, ',');
+    nx_string_scan_add(&scan, '"');
+    nx_string_scan_add(&scan, ',');
+    ASSERT(scan.num == 2);
+    ASSERT(nx_string_scan(&scan, "", 0) == 0);
+    ASSERT(nx_string_scan(&scan, "abc", 3) == 3);
+    ASSERT(nx_string_scan(&scan, "ab,c", 4) == 2);
+    ASSERT(nx_string_scan(&scan, "\"abc", 4) == 0);
+    // the length is respected, the NUL is not special
+    ASSERT(nx_string_scan(&scan, "ab\0c,", 4) == 4);
+
+    nx_string_scan_add(&scan, '\0');
+    nx_string_scan_add(&scan, '\xe9');
+    ASSERT(nx_string_scan(&scan, "ab\0c,", 5) == 2);
+
+    // every offset in and after the vectorized blocks
+    for ( i = 0; i < sizeof(buf); i++ )
+    {
+	for ( j = 0; j < sizeof(buf); j++ )
+	{
+	    buf[j] = (char) ('a' + j % 26);
+	}
+	buf[i] = '\xe9';
+	ASSERT(nx_string_scan(&scan, buf, sizeof(buf)) == i);
+	ASSERT(nx_string_scan(&scan, buf + 1, sizeof(buf) - 1) == ((i == 0) ? sizeof(buf) - 1 : i - 1));
+	ASSERT(nx_string_scan(&scan, buf, i) == i);
+    }
+}
+
+
+
 int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
 {
     nx_string_t *str, *str2;
@@ -224,6 +264,7 @@ int main(int argc UNUSED, const char * const *argv, const char * const *env UNUS
     test_ascii();
     test_utf();
     test_strip_crlf();
+    test_scan();
 
     printf("%s:	OK\n", argv[0]);
     return ( 0 );
@@ -0,0 +1,117 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/logdata.h"
+#include "../../src/modules/extension/syslog/syslog.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+#include "parser-bench.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+nxlog_t nxlog;
+
+/* The expected fields are without raw_event, EventTime and MessageSourceAddress */
+static parser_bench_sample_t samples[] =
+{
+    { "bsd",
+      "<30>Nov 21 11:40:27 host sshd[123]: Accepted password for user from 192.168.1.1 port 53211 ssh2",
+      "SyslogFacilityValue=3|SyslogFacility=DAEMON|SyslogSeverityValue=6|SyslogSeverity=INFO|"
+      "SeverityValue=2|Severity=INFO|Hostname=host|SourceName=sshd|ProcessID=123|"
+      "Message=Accepted password for user from 192.168.1.1 port 53211 ssh2|" },
+    { "bsd",
+      "<13>Oct 11 22:14:15 mymachine su: 'su root' failed for lonvick on /dev/pts/8",
+      "SyslogFacilityValue=1|SyslogFacility=USER|SyslogSeverityValue=5|SyslogSeverity=NOTICE|"
+      "SeverityValue=2|Severity=INFO|Hostname=mymachine|SourceName=su|"
+      "Message='su root' failed for lonvick on /dev/pts/8|" },
+    { "bsd-nohost",
+      "<14>Nov  2 10:45:18 host.example.com: message without tag\n",
+      "SyslogFacilityValue=1|SyslogFacility=USER|SyslogSeverityValue=6|SyslogSeverity=INFO|"
+      "SeverityValue=2|Severity=INFO|Hostname=10.0.0.1|SourceName=host.example.com|"
+      "Message=message without tag|" },
+    { "ietf",
+      "<34>1 2003-10-11T22:14:15.003Z mymachine.example.com su - ID47 - 'su root' failed for lonvick",
+      "SyslogFacilityValue=4|SyslogFacility=AUTH|SyslogSeverityValue=2|SyslogSeverity=CRIT|"
+      "SeverityValue=5|Severity=CRITICAL|Hostname=mymachine.example.com|SourceName=su|"
+      "MessageID=ID47|Message='su root' failed for lonvick|" },
+    { "ietf-sd",
+      "<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog - ID47 "
+      "[exampleSDID@32473 iut=\"3\" eventSource=\"Application\" eventID=\"1011\"]"
+      "[examplePriority@32473 class=\"high\"] An application event log entry",
+      "SyslogFacilityValue=20|SyslogFacility=LOCAL4|SyslogSeverityValue=5|SyslogSeverity=NOTICE|"
+      "SeverityValue=2|Severity=INFO|Hostname=mymachine.example.com|SourceName=evntslog|"
+      "MessageID=ID47|exampleSDID.iut=3|exampleSDID.eventSource=Application|"
+      "exampleSDID.eventID=1011|examplePriority.class=high|Message=An application event log entry|" },
+    { "ietf-nxlog",
+      "<165>1 2003-08-24T05:14:15.000003-07:00 192.0.2.1 myproc 8710 - "
+      "[NXLOG@14506 EventID=\"1\" Escaped=\"a\\\"b\\]c\\\\d\"] message",
+      "SyslogFacilityValue=20|SyslogFacility=LOCAL4|SyslogSeverityValue=5|SyslogSeverity=NOTICE|"
+      "SeverityValue=2|Severity=INFO|Hostname=192.0.2.1|SourceName=myproc|ProcessID=8710|"
+      "EventID=1|Escaped=a\"b]c\\d|Message=message|" },
+    { NULL, NULL, NULL },
+};
+
+
+
+static const char *skip[] = { "raw_event", "EventTime", "MessageSourceAddress", NULL };
+
+
+
+static nx_logdata_t *new_logdata(const char *msg)
+{
+    nx_logdata_t *logdata;
+
+    logdata = nx_logdata_new_logline(msg, (int) strlen(msg));
+    nx_logdata_set_string(logdata, "MessageSourceAddress", "10.0.0.1");
+
+    return ( logdata );
+}
+
+
+
+static void parse(nx_logdata_t *logdata, const char *msg UNUSED, size_t len UNUSED)
+{
+    nx_date_format_t dateformat = NX_DATE_FORMAT_UNKNOWN;
+    const char *ptr;
+
+    // the IETF header has a version after the priority
+    ptr = strchr(logdata->raw_event->buf, '>');
+    if ( (ptr != NULL) && (strncmp(ptr + 1, "1 ", 2) == 0) )
+    {
+	nx_syslog_parse_rfc5424(logdata, logdata->raw_event->buf,
+				logdata->raw_event->len, &dateformat);
+    }
+    else
+    {
+	nx_syslog_parse_rfc3164(logdata, logdata->raw_event->buf,
+				logdata->raw_event->len, &dateformat);
+    }
+}
+
+
+
+static const parser_bench_parser_t parsers[] =
+{
+    { "parse", new_logdata, parse },
+    { NULL, NULL, NULL },
+};
+
+static const parser_bench_t syslogbench = { parsers, samples, skip, FALSE };
+
+
+
+int main(int argc, const char * const *argv, const char * const *env)
+{
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    parser_bench_check(&syslogbench);
+    parser_bench_print(&syslogbench);
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
@@ -0,0 +1,122 @@
+/*
+ * This file is part of the nxlog log collector tool.
+ * See the file LICENSE in the source root for licensing terms.
+ * Website: http://nxlog.org
+ * Author: Botond Botyanszki <botond.botyanszki@nxlog.org>
+ */
+
+#include "../../src/common/error_debug.h"
+#include "../../src/common/trace.h"
+#include "../../src/core/nxlog.h"
+#include "../../src/core/core.h"
+
+#define NX_LOGMODULE NX_LOGMODULE_TEST
+
+#define TRACEFILE "trace-test.json"
+
+nxlog_t nxlog;
+
+
+
+static void check_sampling()
+{
+    int countdown = 0;
+    int i, sampled = 0;
+
+    for ( i = 0; i < 10; i++ )
+    { // disabled
+	ASSERT(NX_TRACE_SAMPLE(countdown) == FALSE);
+    }
+    countdown = 3;
+    for ( i = 0; i < 9; i++ )
+    {
+	if ( NX_TRACE_SAMPLE(countdown) )
+	{
+	    countdown = 3;
+	    sampled++;
+	}
+    }
+    ASSERT(sampled == 3);
+}
+
+
+
+static void check_trace()
+{
+    nx_logdata_t *logdata, *copy;
+    nx_string_t *str;
+    FILE *file;
+    char line[2048];
+    int lines = 0, delivered = 0;
+
+    nx_trace_start(1, TRACEFILE);
+    ASSERT(nx_trace_rate() == 1);
+
+    logdata = nx_logdata_new_logline("test", 4);
+    nx_trace_begin(logdata, "in");
+    ASSERT(logdata->trace != NULL);
+    nx_trace_set_route(logdata->trace, "r1");
+    nx_trace_stamp(logdata->trace, NX_TRACE_PUSH, "proc");
+    nx_trace_stamp(logdata->trace, NX_TRACE_PEEK, "proc");
+    nx_trace_stamp(logdata->trace, NX_TRACE_POP, "proc");
+    nx_trace_stamp(logdata->trace, NX_TRACE_PUSH, "out");
+    copy = nx_logdata_clone(logdata);
+    ASSERT(copy->trace != NULL);
+    ASSERT(copy->trace->id == logdata->trace->id);
+
+    nx_trace_stamp(logdata->trace, NX_TRACE_PEEK, "out");
+    nx_trace_stamp(logdata->trace, NX_TRACE_PEEK, "out"); // blocked output peeks again
+    nx_trace_stamp(logdata->trace, NX_TRACE_OUTPUT, "out");
+    ASSERT(logdata->trace->num_stamp == 7);
+    nx_logdata_free(logdata);
+    // not popped by an output, only written to the file
+    nx_logdata_free(copy);
+
+    str = nx_string_new();
+    nx_trace_summary_append(str);
+    if ( (strstr(str->buf, "[trace route r1] 1 events") == NULL) ||
+	 (strstr(str->buf, " - queued proc: ") == NULL) ||
+	 (strstr(str->buf, " - output out: ") == NULL) )
+    {
+	nx_abort("unexpected trace summary: %s", str->buf);
+    }
+    nx_string_free(str);
+
+    nx_trace_stop();
+    ASSERT(nx_trace_rate() == 0);
+
+    file = fopen(TRACEFILE, "r");
+    ASSERT(file != NULL);
+    while ( fgets(line, sizeof(line), file) != NULL )
+    {
+	lines++;
+	if ( strstr(line, "\"route\":\"r1\",\"delivered\":true") != NULL )
+	{
+	    delivered++;
+	    ASSERT(strstr(line, "{\"name\":\"process\",\"module\":\"out\"") == NULL);
+	    ASSERT(strstr(line, "{\"name\":\"output\",\"module\":\"out\"") != NULL);
+	}
+    }
+    fclose(file);
+    ASSERT(lines == 2);
+    ASSERT(delivered == 1);
+    apr_file_remove(TRACEFILE, NULL);
+}
+
+
+
+int main(int argc UNUSED, const char * const *argv, const char * const *env UNUSED)
+{
+    ASSERT(nx_init(&argc, &argv, &env) == TRUE);
+
+    memset(&nxlog, 0, sizeof(nxlog_t));
+    nxlog_set(&nxlog);
+    nxlog.ctx = nx_ctx_new();
+
+    apr_file_remove(TRACEFILE, NULL);
+    check_sampling();
+    check_trace();
+
+    printf("%s:	OK\n", argv[0]);
+    return ( 0 );
+}
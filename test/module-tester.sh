@@ -14,6 +14,7 @@ fi
 ./tester.pl modules/input/tcp/im_tcp.txt || FAILED="$FAILED im_tcp"
 ./tester.pl modules/input/uds/im_uds.txt || FAILED="$FAILED im_uds"
 ./tester.pl modules/input/file/im_file.txt || FAILED="$FAILED im_file"
+./tester.pl modules/input/testgen/im_testgen.txt || FAILED="$FAILED im_testgen"
 ./tester.pl modules/output/file/om_file.txt || FAILED="$FAILED om_file"
 ./tester.pl modules/output/ssl/om_ssl.txt || FAILED="$FAILED om_ssl"
 ./tester.pl modules/output/tcp/om_tcp.txt || FAILED="$FAILED om_tcp"